@@ -109,6 +109,27 @@ typedef int16  s16;
 typedef int32  s32;
 typedef int64  s64;
 
+// with MULTI_INSTANCE each thread runs its own emulator: the core's state is declared
+// EMU_STATE, which makes it thread-local, and tables that need dynamic initialization
+// (addresses of such state) are declared EMU_STATE_DYNAMIC
+#ifdef MULTI_INSTANCE
+# if defined(USE_GBA_CORE_V7) || defined(USE_GB_CORE_V7)
+#  error "MULTI_INSTANCE requires the V8 cores"
+# endif
+# ifndef C_CORE
+#  error "MULTI_INSTANCE requires C_CORE, the assembler cores address the CPU state as plain globals"
+# endif
+# ifdef _MSC_VER
+#  define EMU_STATE __declspec(thread)
+# else
+#  define EMU_STATE __thread
+# endif
+# define EMU_STATE_DYNAMIC thread_local
+#else
+# define EMU_STATE
+# define EMU_STATE_DYNAMIC
+#endif
+
 // for consistency
 static inline u8 swap8(u8 v)
 {
@@ -406,6 +406,8 @@ long Blip_Buffer::read_samples( blip_sample_t* out_, long max_samples, int stere
 		}
 		else
 		{
+			// interleaved samples are twice as far apart, so start from out_ + count * 2
+			out += count;
 			do
 			{
 				blip_long s = BLIP_READER_READ( reader );
@@ -0,0 +1,302 @@
+#include <cstdlib>
+#include <cstring>
+
+#ifdef WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#endif
+
+#include "../Port.h"
+#include "../NLS.h"
+#include "System.h"
+#include "Util.h"
+#include "AsyncSave.h"
+
+// Slots are handed between the emulation thread and the worker without locking:
+// the emulation thread owns FREE and DONE slots, the worker owns PENDING ones.
+// Each slot keeps its buffer between saves so steady-state saving does not allocate.
+#define ASYNC_SAVE_SLOTS 4
+
+enum
+{
+	SLOT_FREE,
+	SLOT_PENDING,
+	SLOT_DONE
+};
+
+struct AsyncSaveSlot
+{
+	volatile long	  state;
+	u32				  sequence;
+	char			  fileName[2048];
+	RawMemStream	  stream;
+	bool			  success;
+	AsyncSaveCallback callback;
+	void *			  userData;
+};
+
+static AsyncSaveSlot slots[ASYNC_SAVE_SLOTS];
+static u32			 nextSequence  = 0;  // emulation thread only
+static u32			 nextDelivery  = 0;  // emulation thread only
+static volatile long workerExit	   = 0;
+static bool			 workerRunning = false;
+static bool			 workerFailed  = false;
+
+#ifdef WIN32
+static HANDLE workerThread	  = NULL;
+static HANDLE workerSemaphore = NULL;
+
+static inline long slotGetState(AsyncSaveSlot &slot)
+{
+	return InterlockedCompareExchange(&slot.state, 0, 0);
+}
+
+static inline void slotSetState(AsyncSaveSlot &slot, long state)
+{
+	InterlockedExchange(&slot.state, state);
+}
+
+static void asyncSaveSleep()
+{
+	Sleep(1);
+}
+#else
+static pthread_t workerThread;
+static sem_t	 workerSemaphore;
+
+static inline long slotGetState(AsyncSaveSlot &slot)
+{
+	return __sync_fetch_and_add(&slot.state, 0);
+}
+
+static inline void slotSetState(AsyncSaveSlot &slot, long state)
+{
+	__sync_synchronize();
+	slot.state = state;
+	__sync_synchronize();
+}
+
+static void asyncSaveSleep()
+{
+	usleep(1000);
+}
+#endif
+
+static void asyncSaveCompress(AsyncSaveSlot &slot)
+{
+	slot.success = false;
+
+	gzFile gzFile = gzopen(slot.fileName, "wb");
+	if (gzFile == NULL)
+		return;
+
+	slot.success = (gzwrite(gzFile, slot.stream.data, slot.stream.size) == (int)slot.stream.size);
+
+	if (gzclose(gzFile) != Z_OK)
+		slot.success = false;
+}
+
+// jobs are queued in sequence order, so the worker only ever has to look for the next one
+static void asyncSaveWorker()
+{
+	u32 sequence = 0;
+	for (;;)
+	{
+#ifdef WIN32
+		WaitForSingleObject(workerSemaphore, INFINITE);
+#else
+		while (sem_wait(&workerSemaphore) != 0)
+			;
+#endif
+		if (workerExit)
+			break;
+
+		for (int i = 0; i < ASYNC_SAVE_SLOTS; ++i)
+		{
+			AsyncSaveSlot &slot = slots[i];
+			if (slotGetState(slot) == SLOT_PENDING && slot.sequence == sequence)
+			{
+				asyncSaveCompress(slot);
+				slotSetState(slot, SLOT_DONE);
+				++sequence;
+				break;
+			}
+		}
+	}
+}
+
+#ifdef WIN32
+static unsigned __stdcall asyncSaveThreadProc(void *)
+{
+	asyncSaveWorker();
+	return 0;
+}
+#else
+static void *asyncSaveThreadProc(void *)
+{
+	asyncSaveWorker();
+	return NULL;
+}
+#endif
+
+static bool asyncSaveStart()
+{
+	if (workerRunning)
+		return true;
+	if (workerFailed)
+		return false;
+
+	workerExit = 0;
+#ifdef WIN32
+	workerSemaphore = CreateSemaphore(NULL, 0, ASYNC_SAVE_SLOTS, NULL);
+	if (workerSemaphore != NULL)
+	{
+		workerThread = (HANDLE)_beginthreadex(NULL, 0, asyncSaveThreadProc, NULL, 0, NULL);
+		if (workerThread == NULL)
+		{
+			CloseHandle(workerSemaphore);
+			workerSemaphore = NULL;
+		}
+	}
+	workerRunning = (workerThread != NULL);
+#else
+	if (sem_init(&workerSemaphore, 0, 0) == 0)
+	{
+		if (pthread_create(&workerThread, NULL, asyncSaveThreadProc, NULL) == 0)
+			workerRunning = true;
+		else
+			sem_destroy(&workerSemaphore);
+	}
+#endif
+
+	// without a worker, jobs are compressed right away on the emulation thread
+	workerFailed = !workerRunning;
+	return workerRunning;
+}
+
+static void asyncSaveWake()
+{
+#ifdef WIN32
+	ReleaseSemaphore(workerSemaphore, 1, NULL);
+#else
+	sem_post(&workerSemaphore);
+#endif
+}
+
+static AsyncSaveSlot *asyncSaveGetFreeSlot()
+{
+	for (;;)
+	{
+		for (int i = 0; i < ASYNC_SAVE_SLOTS; ++i)
+		{
+			if (slotGetState(slots[i]) == SLOT_FREE)
+				return &slots[i];
+		}
+
+		// every slot is in flight; wait for the oldest one to finish
+		asyncSaveSleep();
+		asyncSavePoll();
+	}
+}
+
+bool asyncSaveState(const char *fileName, bool (*writeToStream)(gzFile),
+                    AsyncSaveCallback callback, void *userData)
+{
+	if (strlen(fileName) >= sizeof(slots[0].fileName))
+		return false;
+
+	AsyncSaveSlot *slot = asyncSaveGetFreeSlot();
+
+	gzFile gzFile = utilRawMemOpen(&slot->stream, "w");
+	bool   res	  = writeToStream(gzFile);
+	utilGzClose(gzFile);
+
+	if (!res)
+		return false;
+
+	strcpy(slot->fileName, fileName);
+	slot->sequence = nextSequence++;
+	slot->callback = callback;
+	slot->userData = userData;
+
+	if (asyncSaveStart())
+	{
+		slotSetState(*slot, SLOT_PENDING);
+		asyncSaveWake();
+	}
+	else
+	{
+		asyncSaveCompress(*slot);
+		slotSetState(*slot, SLOT_DONE);
+	}
+
+	return true;
+}
+
+void asyncSavePoll()
+{
+	bool delivered;
+	do
+	{
+		delivered = false;
+		for (int i = 0; i < ASYNC_SAVE_SLOTS; ++i)
+		{
+			AsyncSaveSlot &slot = slots[i];
+			if (slotGetState(slot) == SLOT_DONE && slot.sequence == nextDelivery)
+			{
+				if (slot.callback)
+					slot.callback(slot.fileName, slot.success, slot.userData);
+				else if (!slot.success)
+					systemMessage(MSG_ERROR_CREATING_FILE, N_("Error creating file %s"), slot.fileName);
+
+				slotSetState(slot, SLOT_FREE);
+				++nextDelivery;
+				delivered = true;
+			}
+		}
+	}
+	while (delivered);
+}
+
+// waits until every queued save has been written and its callback delivered
+void asyncSaveFlush()
+{
+	asyncSavePoll();
+	while (nextDelivery != nextSequence)
+	{
+		asyncSaveSleep();
+		asyncSavePoll();
+	}
+}
+
+void asyncSaveShutdown()
+{
+	asyncSaveFlush();
+
+	if (workerRunning)
+	{
+		workerExit = 1;
+		asyncSaveWake();
+#ifdef WIN32
+		WaitForSingleObject(workerThread, INFINITE);
+		CloseHandle(workerThread);
+		CloseHandle(workerSemaphore);
+		workerThread	= NULL;
+		workerSemaphore = NULL;
+#else
+		pthread_join(workerThread, NULL);
+		sem_destroy(&workerSemaphore);
+#endif
+		workerRunning = false;
+	}
+
+	for (int i = 0; i < ASYNC_SAVE_SLOTS; ++i)
+	{
+		free(slots[i].stream.data);
+		memset(&slots[i].stream, 0, sizeof(slots[i].stream));
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef VBA_ASYNC_SAVE_H
+#define VBA_ASYNC_SAVE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "zlib.h"
+
+// Savestates are serialized uncompressed into a preallocated buffer on the emulation thread,
+// then gzipped and written to disk by a background worker. Completion callbacks are delivered
+// on the emulation thread from asyncSavePoll().
+
+typedef void (*AsyncSaveCallback)(const char *fileName, bool success, void *userData);
+
+extern bool asyncSaveState(const char *fileName, bool (*writeToStream)(gzFile),
+                           AsyncSaveCallback callback = NULL, void *userData = NULL);
+extern void asyncSavePoll();
+extern void asyncSaveFlush();
+extern void asyncSaveShutdown();
+
+#endif // VBA_ASYNC_SAVE_H
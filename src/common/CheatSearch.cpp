@@ -3,6 +3,11 @@
 
 #include "CheatSearch.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CHEAT_SEARCH_SIMD
+#include <emmintrin.h>
+#endif
+
 CheatSearchBlock cheatSearchBlocks[4];
 
 CheatSearchData cheatSearchData = {
@@ -177,163 +182,247 @@ u32 cheatSearchRead(u8 *data, int off, int size)
 	return res;
 }
 
-void cheatSearch(const CheatSearchData *cs, int compare, int size,
-                 bool isSigned)
+// Each byte of a block's bits covers eight bytes of data. The search works on whole bits bytes:
+// it builds a mask of the values that fail the compare, spreads each failure over the bits its
+// value clears, and skips bits bytes with no candidates left.
+static inline u32 cheatSearchClearMask(u32 fail, int size)
+{
+	switch (size)
+	{
+	case BITS_16:
+		fail &= 0x5555;
+		return fail | (fail << 1);
+	case BITS_32:
+		// only the first, third and fourth bits are cleared for 32-bit values
+		fail &= 0x1111;
+		return fail | (fail << 2) | (fail << 3);
+	}
+	return fail;
+}
+
+// other is the saved data for a search against the previous values, NULL for a search against value
+static void cheatSearchBlockScalar(CheatSearchBlock *block, int start, int compare, int size,
+                                   bool isSigned, const u8 *other, u32 value)
 {
-	if (compare < 0 || compare > SEARCH_GE)
-		return;
 	int inc = 1;
 	if (size == BITS_16)
 		inc = 2;
 	else if (size == BITS_32)
 		inc = 4;
 
-	if (isSigned)
+	bool (*func)(u32, u32)		 = cheatSearchFunc[compare];
+	bool (*signedFunc)(s32, s32) = cheatSearchSignedFunc[compare];
+
+	int count = block->size >> 3;
+	u8 *bits  = block->bits;
+	u8 *data  = block->data;
+
+	for (int i = start; i < count; i++)
 	{
-		bool (*func)(s32, s32) = cheatSearchSignedFunc[compare];
+		u32 candidates = bits[i];
+		if (!candidates)
+			continue;
 
-		for (int i = 0; i < cs->count; i++)
+		u32 fail = 0;
+		for (int k = 0; k < 8; k += inc)
 		{
-			CheatSearchBlock *block = &cs->blocks[i];
-			int size2 = block->size;
-			u8 *bits  = block->bits;
-			u8 *data  = block->data;
-			u8 *saved = block->saved;
+			if (!(candidates & (1 << k)))
+				continue;
 
-			for (int j = 0; j < size2; j += inc)
+			int j = (i << 3) + k;
+			if (isSigned)
+			{
+				s32 a = cheatSearchSignedRead(data, j, size);
+				s32 b = other ? cheatSearchSignedRead((u8 *)other, j, size) : (s32)value;
+				if (!signedFunc(a, b))
+					fail |= 1 << k;
+			}
+			else
 			{
-				if (IS_BIT_SET(bits, j))
-				{
-					s32 a = cheatSearchSignedRead(data, j, size);
-					s32 b = cheatSearchSignedRead(saved, j, size);
-
-					if (!func(a, b))
-					{
-						CLEAR_BIT(bits, j);
-						if (size == BITS_16)
-							CLEAR_BIT(bits, j+1);
-						if (size == BITS_32)
-						{
-							CLEAR_BIT(bits, j+2);
-							CLEAR_BIT(bits, j+3);
-						}
-					}
-				}
+				u32 a = cheatSearchRead(data, j, size);
+				u32 b = other ? cheatSearchRead((u8 *)other, j, size) : value;
+				if (!func(a, b))
+					fail |= 1 << k;
 			}
 		}
+
+		bits[i] &= ~cheatSearchClearMask(fail, size);
 	}
-	else
+}
+
+#ifdef CHEAT_SEARCH_SIMD
+// Sixteen bytes of data, two bytes of bits, per step. Values are little-endian in the blocks,
+// so each vector lane lines up with the value cheatSearchRead() would return. Unsigned
+// compares are done as signed ones with the sign bits flipped.
+template <int size>
+static inline __m128i cheatSearchGreater(__m128i a, __m128i b)
+{
+	switch (size)
 	{
-		bool (*func)(u32, u32) = cheatSearchFunc[compare];
+	case BITS_8:
+		return _mm_cmpgt_epi8(a, b);
+	case BITS_16:
+		return _mm_cmpgt_epi16(a, b);
+	default:
+		return _mm_cmpgt_epi32(a, b);
+	}
+}
 
-		for (int i = 0; i < cs->count; i++)
-		{
-			CheatSearchBlock *block = &cs->blocks[i];
-			int size2 = block->size;
-			u8 *bits  = block->bits;
-			u8 *data  = block->data;
-			u8 *saved = block->saved;
+template <int size>
+static inline __m128i cheatSearchEqual(__m128i a, __m128i b)
+{
+	switch (size)
+	{
+	case BITS_8:
+		return _mm_cmpeq_epi8(a, b);
+	case BITS_16:
+		return _mm_cmpeq_epi16(a, b);
+	default:
+		return _mm_cmpeq_epi32(a, b);
+	}
+}
 
-			for (int j = 0; j < size2; j += inc)
-			{
-				if (IS_BIT_SET(bits, j))
-				{
-					u32 a = cheatSearchRead(data, j, size);
-					u32 b = cheatSearchRead(saved, j, size);
-
-					if (!func(a, b))
-					{
-						CLEAR_BIT(bits, j);
-						if (size == BITS_16)
-							CLEAR_BIT(bits, j+1);
-						if (size == BITS_32)
-						{
-							CLEAR_BIT(bits, j+2);
-							CLEAR_BIT(bits, j+3);
-						}
-					}
-				}
-			}
-		}
+// returns one bit per data byte, set where the value starting at that lane fails the compare
+template <int size>
+static inline u32 cheatSearchFailMask(__m128i a, __m128i b, int compare)
+{
+	switch (compare)
+	{
+	case SEARCH_EQ:
+		return ~_mm_movemask_epi8(cheatSearchEqual<size>(a, b)) & 0xffff;
+	case SEARCH_NE:
+		return _mm_movemask_epi8(cheatSearchEqual<size>(a, b));
+	case SEARCH_LT:
+		return ~_mm_movemask_epi8(cheatSearchGreater<size>(b, a)) & 0xffff;
+	case SEARCH_LE:
+		return _mm_movemask_epi8(cheatSearchGreater<size>(a, b));
+	case SEARCH_GT:
+		return ~_mm_movemask_epi8(cheatSearchGreater<size>(a, b)) & 0xffff;
+	default:
+		return _mm_movemask_epi8(cheatSearchGreater<size>(b, a));
 	}
 }
 
-void cheatSearchValue(const CheatSearchData *cs, int compare, int size,
-                      bool isSigned, u32 value)
+template <int size>
+static int cheatSearchBlockSIMD(CheatSearchBlock *block, int compare, bool isSigned,
+                                const u8 *other, u32 value)
 {
-	if (compare < 0 || compare > SEARCH_GE)
-		return;
-	int inc = 1;
-	if (size == BITS_16)
-		inc = 2;
-	else if (size == BITS_32)
-		inc = 4;
+	__m128i bias = _mm_setzero_si128();
+	if (!isSigned)
+	{
+		switch (size)
+		{
+		case BITS_8:
+			bias = _mm_set1_epi8((char)0x80);
+			break;
+		case BITS_16:
+			bias = _mm_set1_epi16((short)0x8000);
+			break;
+		default:
+			bias = _mm_set1_epi32((int)0x80000000);
+			break;
+		}
+	}
 
-	if (isSigned)
+	__m128i b;
+	switch (size)
 	{
-		bool (*func)(s32, s32) = cheatSearchSignedFunc[compare];
+	case BITS_8:
+		b = _mm_set1_epi8((char)value);
+		break;
+	case BITS_16:
+		b = _mm_set1_epi16((short)value);
+		break;
+	default:
+		b = _mm_set1_epi32((int)value);
+		break;
+	}
+	b = _mm_xor_si128(b, bias);
 
-		for (int i = 0; i < cs->count; i++)
-		{
-			CheatSearchBlock *block = &cs->blocks[i];
-			int size2 = block->size;
-			u8 *bits  = block->bits;
-			u8 *data  = block->data;
+	int count = (block->size >> 4) << 1;
+	u8 *bits  = block->bits;
+	u8 *data  = block->data;
 
-			for (int j = 0; j < size2; j += inc)
-			{
-				if (IS_BIT_SET(bits, j))
-				{
-					s32 a = cheatSearchSignedRead(data, j, size);
-					s32 b = (s32)value;
-
-					if (!func(a, b))
-					{
-						CLEAR_BIT(bits, j);
-						if (size == BITS_16)
-							CLEAR_BIT(bits, j+1);
-						if (size == BITS_32)
-						{
-							CLEAR_BIT(bits, j+2);
-							CLEAR_BIT(bits, j+3);
-						}
-					}
-				}
-			}
-		}
+	for (int i = 0; i < count; i += 2)
+	{
+		u32 candidates = bits[i] | (bits[i + 1] << 8);
+		if (!candidates)
+			continue;
+
+		__m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(data + (i << 3))), bias);
+		if (other)
+			b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(other + (i << 3))), bias);
+
+		u32 clear = cheatSearchClearMask(cheatSearchFailMask<size>(a, b, compare) & candidates, size);
+		bits[i]		&= ~clear;
+		bits[i + 1] &= ~(clear >> 8);
 	}
-	else
+
+	// the caller finishes any bits left over
+	return count;
+}
+
+// against a fixed value, lanes can only hold values of the search size
+static bool cheatSearchValueFits(int size, bool isSigned, u32 value)
+{
+	switch (size)
 	{
-		bool (*func)(u32, u32) = cheatSearchFunc[compare];
+	case BITS_8:
+		return isSigned ? ((s32)value >= -0x80 && (s32)value < 0x80) : value < 0x100;
+	case BITS_16:
+		return isSigned ? ((s32)value >= -0x8000 && (s32)value < 0x8000) : value < 0x10000;
+	}
+	return true;
+}
+#endif
 
-		for (int i = 0; i < cs->count; i++)
-		{
-			CheatSearchBlock *block = &cs->blocks[i];
-			int size2 = block->size;
-			u8 *bits  = block->bits;
-			u8 *data  = block->data;
+static void cheatSearchBlock(CheatSearchBlock *block, int compare, int size,
+                             bool isSigned, const u8 *other, u32 value)
+{
+	int start = 0;
 
-			for (int j = 0; j < size2; j += inc)
-			{
-				if (IS_BIT_SET(bits, j))
-				{
-					u32 a = cheatSearchRead(data, j, size);
-
-					if (!func(a, value))
-					{
-						CLEAR_BIT(bits, j);
-						if (size == BITS_16)
-							CLEAR_BIT(bits, j+1);
-						if (size == BITS_32)
-						{
-							CLEAR_BIT(bits, j+2);
-							CLEAR_BIT(bits, j+3);
-						}
-					}
-				}
-			}
+#ifdef CHEAT_SEARCH_SIMD
+	if (other || cheatSearchValueFits(size, isSigned, value))
+	{
+		switch (size)
+		{
+		case BITS_8:
+			start = cheatSearchBlockSIMD<BITS_8>(block, compare, isSigned, other, value);
+			break;
+		case BITS_16:
+			start = cheatSearchBlockSIMD<BITS_16>(block, compare, isSigned, other, value);
+			break;
+		case BITS_32:
+			start = cheatSearchBlockSIMD<BITS_32>(block, compare, isSigned, other, value);
+			break;
 		}
 	}
+#endif
+
+	cheatSearchBlockScalar(block, start, compare, size, isSigned, other, value);
+}
+
+void cheatSearch(const CheatSearchData *cs, int compare, int size,
+                 bool isSigned)
+{
+	if (compare < 0 || compare > SEARCH_GE)
+		return;
+
+	for (int i = 0; i < cs->count; i++)
+	{
+		CheatSearchBlock *block = &cs->blocks[i];
+		cheatSearchBlock(block, compare, size, isSigned, block->saved, 0);
+	}
+}
+
+void cheatSearchValue(const CheatSearchData *cs, int compare, int size,
+                      bool isSigned, u32 value)
+{
+	if (compare < 0 || compare > SEARCH_GE)
+		return;
+
+	for (int i = 0; i < cs->count; i++)
+		cheatSearchBlock(&cs->blocks[i], compare, size, isSigned, NULL, value);
 }
 
 int cheatSearchGetCount(const CheatSearchData *cs, int size)
@@ -0,0 +1,330 @@
+#include <cstdio>
+#include <cstring>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "../Port.h"
+#include "Util.h"
+#include "MappedImage.h"
+
+static EMU_STATE u8 *mappedImage		 = NULL;
+static EMU_STATE int mappedImageRegion	 = 0;
+static EMU_STATE int mappedImageFileSize = 0;  // mapped bytes of the file
+static EMU_STATE int mappedImageFillSize = 0;
+
+// writes the fill block over [from, to) as the fill mapping would have
+static void mappedImageCopyFill(u8 *image, int from, int to, const u8 *fill, int fillSize)
+{
+	while (from < to)
+	{
+		int offset = from % fillSize;
+		int len	   = fillSize - offset;
+		if (len > to - from)
+			len = to - from;
+		memcpy(image + from, fill + offset, len);
+		from += len;
+	}
+}
+
+#ifdef WIN32
+
+// Views can only start on allocation granularity boundaries, so the region is laid out as
+// one view of the file followed by views of a pagefile section holding the fill block.
+static void mappedImageRelease(u8 *image, int mapped)
+{
+	if (mapped > 0)
+		UnmapViewOfFile(image);
+	if (mappedImageFillSize == 0)
+	{
+		if (mapped > mappedImageFileSize)
+			VirtualFree(image + mappedImageFileSize, 0, MEM_RELEASE);
+		return;
+	}
+	for (int i = mappedImageFileSize; i < mapped; i += mappedImageFillSize - i % mappedImageFillSize)
+		UnmapViewOfFile(image + i);
+}
+
+static int mappedImageViews(u8 *image, HANDLE section, HANDLE fillSection)
+{
+	if (MapViewOfFileEx(section, FILE_MAP_COPY, 0, 0, mappedImageFileSize, image) != image)
+		return 0;
+
+	int i = mappedImageFileSize;
+	if (i < mappedImageRegion && fillSection == NULL)
+	{
+		if (VirtualAlloc(image + i, mappedImageRegion - i, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE) != image + i)
+			return i;
+		return mappedImageRegion;
+	}
+	while (i < mappedImageRegion)
+	{
+		int offset = i % mappedImageFillSize;
+		int len	   = mappedImageFillSize - offset;
+		if (len > mappedImageRegion - i)
+			len = mappedImageRegion - i;
+		if (MapViewOfFileEx(fillSection, FILE_MAP_COPY, 0, offset, len, image + i) != image + i)
+			return i;
+		i += len;
+	}
+	return i;
+}
+
+static u8 *mappedImageMap(const char *file, int regionSize, int &size, const u8 *fill, int fillSize)
+{
+	HANDLE handle = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart <= 0 || fileSize.QuadPart > 0x7fffffff)
+	{
+		CloseHandle(handle);
+		return NULL;
+	}
+
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int granularity = info.dwAllocationGranularity;
+
+	int mapSize = fileSize.QuadPart < regionSize ? (int)fileSize.QuadPart : regionSize;
+	if ((mapSize < regionSize && mapSize % granularity) || (fill != NULL && fillSize % granularity))
+	{
+		CloseHandle(handle);
+		return NULL;
+	}
+
+	HANDLE section = CreateFileMapping(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(handle);
+	if (section == NULL)
+		return NULL;
+
+	HANDLE fillSection = NULL;
+	if (fill != NULL && mapSize < regionSize)
+	{
+		fillSection = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, fillSize, NULL);
+		u8 *view = fillSection ? (u8 *)MapViewOfFile(fillSection, FILE_MAP_WRITE, 0, 0, fillSize) : NULL;
+		if (view == NULL)
+		{
+			if (fillSection)
+				CloseHandle(fillSection);
+			CloseHandle(section);
+			return NULL;
+		}
+		memcpy(view, fill, fillSize);
+		UnmapViewOfFile(view);
+	}
+
+	mappedImageRegion	= regionSize;
+	mappedImageFileSize = mapSize;
+	mappedImageFillSize = fillSection ? fillSize : 0;
+
+	// find a free block for the whole region; another thread may take it before the views are in
+	u8 *image = NULL;
+	for (int tries = 0; tries < 4 && image == NULL; ++tries)
+	{
+		image = (u8 *)VirtualAlloc(NULL, regionSize, MEM_RESERVE, PAGE_NOACCESS);
+		if (image == NULL)
+			break;
+		VirtualFree(image, 0, MEM_RELEASE);
+
+		int mapped = mappedImageViews(image, section, fillSection);
+		if (mapped < regionSize)
+		{
+			mappedImageRelease(image, mapped);
+			image = NULL;
+		}
+	}
+
+	if (fillSection)
+		CloseHandle(fillSection);
+	CloseHandle(section);
+
+	if (image != NULL)
+		size = (int)fileSize.QuadPart;
+	return image;
+}
+
+static u8 *mappedFileMap(const char *file, int &size)
+{
+	HANDLE handle = CreateFileA(file, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart <= 0 || fileSize.QuadPart > 0x7fffffff)
+	{
+		CloseHandle(handle);
+		return NULL;
+	}
+
+	HANDLE section = CreateFileMapping(handle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	CloseHandle(handle);
+	if (section == NULL)
+		return NULL;
+
+	u8 *data = (u8 *)MapViewOfFile(section, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(section);
+
+	if (data != NULL)
+		size = (int)fileSize.QuadPart;
+	return data;
+}
+
+void mappedFileFree(u8 *data, int size)
+{
+	if (data != NULL)
+		UnmapViewOfFile(data);
+}
+
+#else
+
+// The file is laid over a demand-zero block, and the fill block comes from a small temporary
+// file mapped over and over, so all of it is shared until written.
+static void mappedImageRelease(u8 *image, int mapped)
+{
+	munmap(image, mappedImageRegion);
+}
+
+static void mappedImageMapFill(u8 *image, int from, const u8 *fill, int fillSize)
+{
+	FILE *f = tmpfile();
+	if (f != NULL && fwrite(fill, 1, fillSize, f) == (size_t)fillSize && fflush(f) == 0)
+	{
+		while (from < mappedImageRegion)
+		{
+			int offset = from % fillSize;
+			int len	   = fillSize - offset;
+			if (len > mappedImageRegion - from)
+				len = mappedImageRegion - from;
+			if (mmap(image + from, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fileno(f), offset) == MAP_FAILED)
+				break;
+			from += len;
+		}
+	}
+	if (f != NULL)
+		fclose(f);
+
+	// what could not be mapped is still demand-zero memory
+	mappedImageCopyFill(image, from, mappedImageRegion, fill, fillSize);
+}
+
+static u8 *mappedImageMap(const char *file, int regionSize, int &size, const u8 *fill, int fillSize)
+{
+	int fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > 0x7fffffff)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	int mapSize = st.st_size < regionSize ? (int)st.st_size : regionSize;
+	int page	= (int)sysconf(_SC_PAGESIZE);
+
+	u8 *image = (u8 *)mmap(NULL, regionSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (image == (u8 *)MAP_FAILED)
+	{
+		close(fd);
+		return NULL;
+	}
+	if (mmap(image, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+	{
+		munmap(image, regionSize);
+		close(fd);
+		return NULL;
+	}
+	close(fd);
+
+	mappedImageRegion	= regionSize;
+	mappedImageFileSize = mapSize;
+	mappedImageFillSize = fill ? fillSize : 0;
+
+	if (fill != NULL && mapSize < regionSize)
+	{
+		// the rest of the last file page is private anyway
+		int start = (mapSize + page - 1) / page * page;
+		if (start > regionSize)
+			start = regionSize;
+		mappedImageCopyFill(image, mapSize, start, fill, fillSize);
+		if (fillSize % page == 0)
+			mappedImageMapFill(image, start, fill, fillSize);
+		else
+			mappedImageCopyFill(image, start, regionSize, fill, fillSize);
+	}
+
+	size = (int)st.st_size;
+	return image;
+}
+
+static u8 *mappedFileMap(const char *file, int &size)
+{
+	int fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > 0x7fffffff)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	u8 *data = (u8 *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == (u8 *)MAP_FAILED)
+		return NULL;
+
+	size = (int)st.st_size;
+	return data;
+}
+
+void mappedFileFree(u8 *data, int size)
+{
+	if (data != NULL)
+		munmap(data, size);
+}
+
+#endif
+
+u8 *mappedImageLoad(const char *file, int regionSize, int &size, const u8 *fill, int fillSize)
+{
+	if (mappedImage != NULL || file == NULL || (fill != NULL && fillSize <= 0))
+		return NULL;
+	if (utilIsZipFile(file) || utilIsGzipFile(file) || utilIsRarFile(file))
+		return NULL;
+
+	mappedImage = mappedImageMap(file, regionSize, size, fill, fillSize);
+	return mappedImage;
+}
+
+bool mappedImageOwns(const u8 *image)
+{
+	return image != NULL && image == mappedImage;
+}
+
+bool mappedImageFree(u8 *image)
+{
+	if (!mappedImageOwns(image))
+		return false;
+
+	mappedImageRelease(image, mappedImageRegion);
+	mappedImage = NULL;
+	return true;
+}
+
+u8 *mappedFileLoad(const char *file, int &size)
+{
+	if (file == NULL)
+		return NULL;
+	return mappedFileMap(file, size);
+}
@@ -0,0 +1,28 @@
+#ifndef VBA_MAPPED_IMAGE_H
+#define VBA_MAPPED_IMAGE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include "../Port.h"
+
+// Uncompressed images are mapped copy-on-write instead of being read: every instance and process
+// that loads the same file shares its pages until one of them writes a byte, and nothing is read
+// from disk before it is touched. Archives, and anything the system refuses to map, return NULL so
+// the caller falls back to utilLoad().
+
+// Maps the file at the start of a regionSize-byte block. The rest is filled with the fillSize-byte
+// fill block repeated from the start of the region, or zeroes without one. size is set to the file
+// size as utilLoad() does. Only one image is mapped per emulator instance.
+extern u8 *mappedImageLoad(const char *file, int regionSize, int &size, const u8 *fill = NULL, int fillSize = 0);
+extern bool mappedImageOwns(const u8 *image);
+// returns false if image was not mapped, so the caller can free() it instead
+extern bool mappedImageFree(u8 *image);
+
+// Maps a whole file copy-on-write for a loader that only parses it. Any number of files can be
+// mapped this way; each is released with mappedFileFree() and the size that was returned.
+extern u8 *mappedFileLoad(const char *file, int &size);
+extern void mappedFileFree(u8 *data, int size);
+
+#endif // VBA_MAPPED_IMAGE_H
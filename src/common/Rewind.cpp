@@ -0,0 +1,369 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "../Port.h"
+#include "System.h"
+#include "SystemGlobals.h"
+#include "Util.h"
+#include "Rewind.h"
+
+// Encoded point layout: a sequence of (unchanged byte count, changed byte count, changed bytes XOR base),
+// counts stored as 7-bit varints. Bytes past the end of the base compare against zero, so a keyframe
+// is simply a point encoded against an empty base.
+
+struct RewindPoint
+{
+	u32 offset;		// position of the encoded data in the ring
+	u32 length;		// encoded length
+	u32 stateSize;	// raw state length
+	u32 serial;
+	u32 keyframe;	// serial of the keyframe this point was encoded against
+	u32 groupIndex; // 0 for keyframes
+};
+
+static RewindPoint *points		  = NULL;
+static int			pointCapacity = 0;
+static int			pointFirst	  = 0;
+static int			pointCount	  = 0;
+static u32			nextSerial	  = 0;
+static int			keyInterval	  = 1;
+
+static u8 *ring		= NULL;
+static u32 ringSize = 0;
+static u32 ringHead = 0;
+
+static RawMemStream current	 = { NULL, 0, 0, 0 };
+static RawMemStream keyState = { NULL, 0, 0, 0 };
+static bool			keyValid = false;
+static u32			keySerial = 0;
+
+static u8 *scratch	   = NULL;
+static u32 scratchSize = 0;
+
+static inline RewindPoint &rewindPointAt(int index)
+{
+	return points[(pointFirst + index) % pointCapacity];
+}
+
+static bool rewindReserve(RawMemStream &stream, u32 size)
+{
+	if (size <= stream.capacity)
+		return true;
+
+	u8 *data = (u8 *)realloc(stream.data, size);
+	if (data == NULL)
+		return false;
+
+	stream.data		= data;
+	stream.capacity = size;
+	return true;
+}
+
+static inline u8 *rewindPutCount(u8 *p, u32 value)
+{
+	while (value >= 0x80)
+	{
+		*p++	= (u8)(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = (u8)value;
+	return p;
+}
+
+static inline const u8 *rewindGetCount(const u8 *p, const u8 *end, u32 &value)
+{
+	value = 0;
+	for (int shift = 0; p < end && shift < 32; shift += 7)
+	{
+		u8 b = *p++;
+		value |= (u32)(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return p;
+	}
+	return NULL;
+}
+
+static inline bool rewindSame(const u8 *state, const u8 *base, u32 baseSize, u32 i)
+{
+	return state[i] == (i < baseSize ? base[i] : 0);
+}
+
+// the output must hold at least 3 * size + 32 bytes
+static u32 rewindEncode(const u8 *state, u32 size, const u8 *base, u32 baseSize, u8 *out)
+{
+	u8 *p	   = out;
+	u32 common = size < baseSize ? size : baseSize;
+	u32 i	   = 0;
+
+	while (i < size)
+	{
+		u32 start = i;
+		while (i + 8 <= common && !memcmp(state + i, base + i, 8))
+			i += 8;
+		while (i < size && rewindSame(state, base, baseSize, i))
+			++i;
+		u32 unchanged = i - start;
+
+		// a changed run ends at the next stretch of 4 unchanged bytes
+		start = i;
+		u32 same = 0;
+		while (i < size && same < 4)
+		{
+			same = rewindSame(state, base, baseSize, i) ? same + 1 : 0;
+			++i;
+		}
+		if (same == 4)
+			i -= 4;
+		u32 changed = i - start;
+
+		p = rewindPutCount(p, unchanged);
+		p = rewindPutCount(p, changed);
+		for (u32 j = start; j < i; ++j)
+			*p++ = state[j] ^ (j < baseSize ? base[j] : 0);
+	}
+
+	return p - out;
+}
+
+static bool rewindDecode(const u8 *data, u32 length, const u8 *base, u32 baseSize, u8 *out, u32 size)
+{
+	u32 common = size < baseSize ? size : baseSize;
+	if (common)
+		memcpy(out, base, common);
+	memset(out + common, 0, size - common);
+
+	const u8 *end = data + length;
+	u32		  pos = 0;
+	while (data < end)
+	{
+		u32 unchanged, changed;
+		data = rewindGetCount(data, end, unchanged);
+		if (data == NULL)
+			return false;
+		data = rewindGetCount(data, end, changed);
+		if (data == NULL)
+			return false;
+
+		pos += unchanged;
+		if (pos > size || changed > size - pos || changed > (u32)(end - data))
+			return false;
+
+		for (u32 j = 0; j < changed; ++j)
+			out[pos + j] ^= data[j];
+		pos	 += changed;
+		data += changed;
+	}
+
+	return pos == size;
+}
+
+static void rewindDropOldest()
+{
+	pointFirst = (pointFirst + 1) % pointCapacity;
+	--pointCount;
+
+	// points of the evicted keyframe's group cannot be decoded any more
+	while (pointCount > 0 && rewindPointAt(0).groupIndex != 0)
+	{
+		pointFirst = (pointFirst + 1) % pointCapacity;
+		--pointCount;
+	}
+}
+
+// evicts whatever occupies the next length bytes of the ring and returns their offset
+static bool rewindAllocate(u32 length, u32 &offset)
+{
+	if (length > ringSize)
+		return false;
+
+	if (pointCount == pointCapacity)
+		rewindDropOldest();
+
+	if (ringHead + length > ringSize)
+	{
+		// points behind the head are the oldest ones; drop them before wrapping around
+		while (pointCount > 0 && rewindPointAt(0).offset >= ringHead)
+			rewindDropOldest();
+		ringHead = 0;
+	}
+
+	while (pointCount > 0 && rewindPointAt(0).offset >= ringHead && rewindPointAt(0).offset < ringHead + length)
+		rewindDropOldest();
+
+	if (pointCount == 0)
+		ringHead = 0;
+
+	offset	  = ringHead;
+	ringHead += length;
+	return true;
+}
+
+bool rewindInit(int maxPoints, int keyframeInterval, int bufferSize)
+{
+	rewindCleanup();
+
+	if (maxPoints <= 0 || bufferSize <= 0)
+		return false;
+
+	points = (RewindPoint *)malloc(maxPoints * sizeof(RewindPoint));
+	ring   = (u8 *)malloc(bufferSize);
+	if (points == NULL || ring == NULL)
+	{
+		rewindCleanup();
+		return false;
+	}
+
+	pointCapacity = maxPoints;
+	ringSize	  = bufferSize;
+	keyInterval	  = keyframeInterval > 0 ? keyframeInterval : 1;
+	rewindReset();
+	return true;
+}
+
+void rewindReset()
+{
+	pointFirst = 0;
+	pointCount = 0;
+	ringHead   = 0;
+	keyValid   = false;
+}
+
+void rewindCleanup()
+{
+	free(points);
+	free(ring);
+	free(current.data);
+	free(keyState.data);
+	free(scratch);
+
+	points	 = NULL;
+	ring	 = NULL;
+	scratch	 = NULL;
+	memset(&current, 0, sizeof(current));
+	memset(&keyState, 0, sizeof(keyState));
+	pointCapacity = 0;
+	ringSize	  = 0;
+	scratchSize	  = 0;
+	rewindReset();
+}
+
+int rewindPointCount()
+{
+	return pointCount;
+}
+
+bool rewindSavePoint()
+{
+	if (ring == NULL || !theEmulator.emuWriteStateToStream)
+		return false;
+
+	gzFile gzFile = utilRawMemOpen(&current, "w");
+	bool   res	  = theEmulator.emuWriteStateToStream(gzFile);
+	utilGzClose(gzFile);
+	if (!res)
+		return false;
+
+	u32 groupIndex = 0;
+	if (pointCount > 0 && keyValid)
+	{
+		RewindPoint &newest = rewindPointAt(pointCount - 1);
+		if (newest.keyframe == keySerial && newest.groupIndex + 1 < (u32)keyInterval)
+			groupIndex = newest.groupIndex + 1;
+	}
+
+	u32 needed = 3 * current.size + 32;
+	if (needed > scratchSize)
+	{
+		u8 *data = (u8 *)realloc(scratch, needed);
+		if (data == NULL)
+			return false;
+		scratch		= data;
+		scratchSize = needed;
+	}
+
+	u32 length, offset;
+	for (;;)
+	{
+		if (groupIndex == 0)
+			length = rewindEncode(current.data, current.size, NULL, 0, scratch);
+		else
+			length = rewindEncode(current.data, current.size, keyState.data, keyState.size, scratch);
+
+		if (!rewindAllocate(length, offset))
+			return false;
+
+		if (groupIndex == 0 || (pointCount > 0 && rewindPointAt(0).serial <= keySerial))
+			break;
+
+		// making room evicted our own keyframe, so this point has to become one
+		ringHead   = offset;
+		groupIndex = 0;
+	}
+
+	memcpy(ring + offset, scratch, length);
+
+	RewindPoint &point = rewindPointAt(pointCount++);
+	point.offset	 = offset;
+	point.length	 = length;
+	point.stateSize	 = current.size;
+	point.serial	 = nextSerial++;
+	point.keyframe	 = groupIndex == 0 ? point.serial : keySerial;
+	point.groupIndex = groupIndex;
+
+	if (groupIndex == 0)
+	{
+		keyValid = false;
+		if (rewindReserve(keyState, current.size))
+		{
+			memcpy(keyState.data, current.data, current.size);
+			keyState.size = current.size;
+			keySerial	  = point.serial;
+			keyValid	  = true;
+		}
+	}
+
+	return true;
+}
+
+// restores the newest point and removes it
+bool rewindLoadPoint()
+{
+	if (pointCount == 0 || !theEmulator.emuReadStateFromStream)
+		return false;
+
+	RewindPoint &point = rewindPointAt(pointCount - 1);
+
+	if (!keyValid || keySerial != point.keyframe)
+	{
+		keyValid = false;
+
+		RewindPoint &key = rewindPointAt(pointCount - 1 - point.groupIndex);
+		if (!rewindReserve(keyState, key.stateSize) ||
+		    !rewindDecode(ring + key.offset, key.length, NULL, 0, keyState.data, key.stateSize))
+			return false;
+
+		keyState.size = key.stateSize;
+		keySerial	  = key.serial;
+		keyValid	  = true;
+	}
+
+	if (!rewindReserve(current, point.stateSize))
+		return false;
+
+	if (point.groupIndex == 0)
+		memcpy(current.data, keyState.data, point.stateSize);
+	else if (!rewindDecode(ring + point.offset, point.length, keyState.data, keyState.size, current.data, point.stateSize))
+		return false;
+	current.size = point.stateSize;
+
+	ringHead = point.offset;
+	--pointCount;
+
+	gzFile gzFile = utilRawMemOpen(&current, "r");
+	tempSaveSafe = false;
+	bool res = theEmulator.emuReadStateFromStream(gzFile);
+	tempSaveSafe = true;
+	utilGzClose(gzFile);
+
+	return res;
+}
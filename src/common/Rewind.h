@@ -0,0 +1,18 @@
+#ifndef VBA_REWIND_H
+#define VBA_REWIND_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+// Rewind points are kept as XOR deltas against a keyframe, run-length encoded into one ring buffer.
+// Restoring a point decodes at most its keyframe and the point itself.
+
+extern bool rewindInit(int maxPoints, int keyframeInterval, int bufferSize);
+extern void rewindReset();
+extern void rewindCleanup();
+extern bool rewindSavePoint();
+extern bool rewindLoadPoint();
+extern int	rewindPointCount();
+
+#endif // VBA_REWIND_H
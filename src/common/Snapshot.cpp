@@ -0,0 +1,78 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "../Port.h"
+#include "System.h"
+#include "SystemGlobals.h"
+#include "Util.h"
+#include "Snapshot.h"
+
+struct EmuSnapshot
+{
+	RawMemStream stream;
+	u32			 serial;	// 0 while empty
+};
+
+// serial of the snapshot the emulator memory is in sync with, 0 if none
+static EMU_STATE u32 syncedSerial = 0;
+static EMU_STATE u32 nextSerial	  = 1;
+
+EmuSnapshot *snapshotCreate()
+{
+	return (EmuSnapshot *)calloc(1, sizeof(EmuSnapshot));
+}
+
+void snapshotDelete(EmuSnapshot *snapshot)
+{
+	if (snapshot == NULL)
+		return;
+
+	free(snapshot->stream.data);
+	free(snapshot);
+}
+
+bool snapshotSave(EmuSnapshot *snapshot)
+{
+	if (!theEmulator.emuWriteStateToStream)
+		return false;
+
+	snapshot->serial = 0;
+
+	gzFile gzFile = utilRawMemOpen(&snapshot->stream, "w");
+	bool   res;
+	if (theEmulator.emuWriteSnapshot)
+		res = theEmulator.emuWriteSnapshot(gzFile);
+	else
+		res = theEmulator.emuWriteStateToStream(gzFile);
+	utilGzClose(gzFile);
+	if (!res)
+		return false;
+
+	snapshot->serial = nextSerial++;
+	if (theEmulator.emuWriteSnapshot)
+		syncedSerial = snapshot->serial;
+	return true;
+}
+
+bool snapshotLoad(EmuSnapshot *snapshot)
+{
+	if (snapshot->serial == 0 || !theEmulator.emuReadStateFromStream)
+		return false;
+
+	gzFile gzFile = utilRawMemOpen(&snapshot->stream, "r");
+	bool   res;
+	if (theEmulator.emuReadSnapshot)
+	{
+		res = theEmulator.emuReadSnapshot(gzFile, snapshot->serial == syncedSerial);
+		syncedSerial = res ? snapshot->serial : 0;
+	}
+	else
+	{
+		tempSaveSafe = false;
+		res = theEmulator.emuReadStateFromStream(gzFile);
+		tempSaveSafe = true;
+	}
+	utilGzClose(gzFile);
+
+	return res;
+}
@@ -0,0 +1,18 @@
+#ifndef VBA_SNAPSHOT_H
+#define VBA_SNAPSHOT_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+// Uncompressed in-memory savestates for branching searches. The emulator memory stays in sync with
+// the snapshot last saved or loaded, so loading that one again only copies back what was written since.
+
+struct EmuSnapshot;
+
+extern EmuSnapshot *snapshotCreate();
+extern void snapshotDelete(EmuSnapshot *snapshot);
+extern bool snapshotSave(EmuSnapshot *snapshot);
+extern bool snapshotLoad(EmuSnapshot *snapshot);
+
+#endif // VBA_SNAPSHOT_H
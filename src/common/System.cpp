@@ -1,3 +1,11 @@
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <time.h>
+#endif
+#include <cstring>
+
 #include "System.h"
 #include "SystemGlobals.h"
 #include "inputGlobal.h"
@@ -6,6 +14,8 @@
 #include "../gba/GBA.h"
 #include "../common/movie.h"
 #include "../common/vbalua.h"
+#include "../common/AsyncSave.h"
+#include "../apu/Blip_Buffer.h"
 
 // systemABC stuff are core-related
 
@@ -15,14 +25,27 @@
 #endif
 
 // evil static variables
-static u32	 lastFrameTime	= 0;
-static int32 frameSkipCount	= 0;
-static int32 frameCount		= 0;
-
-static s16	 soundFilter[4000];
-static s16	 soundRight[5]  = { 0, 0, 0, 0, 0 };
-static s16	 soundLeft[5]   = { 0, 0, 0, 0, 0 };
-static int32 soundEchoIndex = 0;
+static EMU_STATE u32	 lastFrameTime	= 0;
+static EMU_STATE int32 frameSkipCount	= 0;
+static EMU_STATE int32 frameCount		= 0;
+
+static EMU_STATE s16	 soundFilter[4000];
+static EMU_STATE s16	 soundRight[5]  = { 0, 0, 0, 0, 0 };
+static EMU_STATE s16	 soundLeft[5]   = { 0, 0, 0, 0, 0 };
+static EMU_STATE int32 soundEchoIndex = 0;
+
+// band-limited synthesis: one output sample per sound tick, so a buffer clocked at the
+// output rate maps a cpu cycle inside the tick to a fraction of the sample
+#define SOUND_SYNTH_CHANNELS 6
+static EMU_STATE_DYNAMIC Blip_Buffer soundBlipLeft;
+static EMU_STATE_DYNAMIC Blip_Buffer soundBlipRight;
+static EMU_STATE_DYNAMIC Blip_Synth<blip_good_quality, 0x10000> soundBlipSynth;
+static EMU_STATE int32 soundSynthRate = 0;
+static EMU_STATE int32 soundSynthLeft[SOUND_SYNTH_CHANNELS];
+static EMU_STATE int32 soundSynthRight[SOUND_SYNTH_CHANNELS];
+
+EMU_STATE bool systemProfiling = false;
+EMU_STATE u64	 systemProfileTime[PROFILE_COUNT];
 
 // motion sensor
 void systemSetSensorX(int32 x)
@@ -160,7 +183,9 @@ void systemUpdateJoypads(bool sensor)
 	systemUpdateMovieJoypads(sensor);
 
 	// this allows the lua engine to read and write the input before the game does
+	u64 luaStart = systemProfileBegin();
 	CallRegisteredLuaFunctions(LUACALL_BEFOREEMULATION);
+	systemProfileEnd(PROFILE_LUA, luaStart);
 
 	// in case the Lua script engine might load a save state during a movie,
 	// re-load the movie input that could be different now
@@ -327,7 +352,7 @@ void systemReset()
 
 bool systemFrameDrawingRequired()
 {
-	return frameSkipCount >= systemFramesToSkip();
+	return !turboMode && frameSkipCount >= systemFramesToSkip();
 }
 
 void systemFrameBoundaryWork()
@@ -336,6 +361,8 @@ void systemFrameBoundaryWork()
 
 	systemFrame();
 
+	asyncSavePoll();
+
 	++frameCount;
 	u32 currentTime = systemGetClock();
 	if (currentTime - lastFrameTime >= 1000)
@@ -382,7 +409,9 @@ void systemFrameBoundaryWork()
 
 	VBAMovieAfterEmulation();
 
+	u64 luaStart = systemProfileBegin();
 	CallRegisteredLuaFunctions(LUACALL_AFTEREMULATION);
+	systemProfileEnd(PROFILE_LUA, luaStart);
 
 	VBAMovieUpdateState();
 
@@ -393,7 +422,9 @@ void systemFrameBoundaryWork()
 
 	if (VBALuaRunning())
 	{
+		luaStart = systemProfileBegin();
 		VBALuaFrameBoundary();
+		systemProfileEnd(PROFILE_LUA, luaStart);
 	}
 }
 
@@ -534,6 +565,8 @@ void systemSoundSetQuality(int quality)
 	soundTickStep	  = USE_TICKS_AS * soundQuality;
 	soundIndex		  = 0;
 	soundBufferIndex  = 0;
+
+	systemSoundSynthReset();
 }
 
 void systemSoundMixReset()
@@ -542,19 +575,147 @@ void systemSoundMixReset()
 	memset(soundFinalWave, 0, soundBufferLen);
 	memset(soundFilter, 0, sizeof(soundFilter));
 	soundEchoIndex = 0;
+
+	systemSoundSynthReset();
+}
+
+static bool systemSoundSynthInit()
+{
+	int32 rate = 44100 / (soundQuality > 0 ? soundQuality : 1);
+	if (soundSynthRate == rate)
+		return true;
+
+	if (soundBlipLeft.set_sample_rate(rate) || soundBlipRight.set_sample_rate(rate))
+	{
+		soundSynthRate = 0;
+		return false;
+	}
+
+	// one time unit per output sample, the tick fraction is added in resampled time
+	soundBlipLeft.clock_rate(rate);
+	soundBlipRight.clock_rate(rate);
+	soundBlipSynth.volume(1.0);
+	soundSynthRate = rate;
+
+	memset(soundSynthLeft, 0, sizeof(soundSynthLeft));
+	memset(soundSynthRight, 0, sizeof(soundSynthRight));
+	return true;
+}
+
+void systemSoundSynthReset()
+{
+	if (soundSynthRate)
+	{
+		soundBlipLeft.clear();
+		soundBlipRight.clear();
+	}
+	memset(soundSynthLeft, 0, sizeof(soundSynthLeft));
+	memset(soundSynthRight, 0, sizeof(soundSynthRight));
 }
 
-void systemSoundMixSilence()
+// time is in cpu cycles since the start of the first sound tick that has not been mixed yet
+void systemSoundSynth(int channel, int time, int left, int right)
 {
-	soundFinalWave[soundBufferIndex++] = 0;
-	soundFinalWave[soundBufferIndex++] = 0;
-	if ((soundFrameSoundWritten + 1) < countof(soundFrameSound))
+	if (channel < 0 || channel >= SOUND_SYNTH_CHANNELS || soundTickStep <= 0 || !systemSoundSynthInit())
+		return;
+
+	if (time < 0)
+		time = 0;
+
+	blip_resampled_time_t when = ((blip_resampled_time_t)(time / soundTickStep) << BLIP_BUFFER_ACCURACY) +
+	                             ((blip_resampled_time_t)(time % soundTickStep) << BLIP_BUFFER_ACCURACY) / soundTickStep;
+
+	if (left != soundSynthLeft[channel])
+	{
+		soundBlipSynth.offset_resampled(soundBlipLeft.offset_ + when, left - soundSynthLeft[channel], &soundBlipLeft);
+		soundSynthLeft[channel] = left;
+	}
+
+	if (right != soundSynthRight[channel])
 	{
-		soundFrameSound[soundFrameSoundWritten++] = 0;
-		soundFrameSound[soundFrameSoundWritten++] = 0;
+		soundBlipSynth.offset_resampled(soundBlipRight.offset_ + when, right - soundSynthRight[channel], &soundBlipRight);
+		soundSynthRight[channel] = right;
 	}
 }
 
+// true when systemSoundMix would pass clamped samples through unchanged
+static bool systemSoundMixIsPlain()
+{
+	if (soundEcho || soundLowPass)
+		return false;
+
+	return !systemSoundAppliesDSP() || (!soundReverse && (soundVolume == 0 || soundVolume > 5));
+}
+
+// copies count stereo samples to the per-frame log, as far as it has room
+static void systemSoundFrameSound(const u16 *samples, int count)
+{
+	int room = ((int)countof(soundFrameSound) - (int)soundFrameSoundWritten) / 2;
+	if (count > room)
+		count = room;
+	if (count <= 0)
+		return;
+
+	memcpy(&soundFrameSound[soundFrameSoundWritten], samples, count * 2 * sizeof(u16));
+	soundFrameSoundWritten += count * 2;
+}
+
+// ends count sound ticks and mixes their band-limited samples in one pass; the samples are
+// read unclamped when DSP options apply so that they see the same range as with systemSoundMix
+void systemSoundSynthMix(int count)
+{
+	if (count <= 0)
+		return;
+
+	if (!systemSoundSynthInit())
+	{
+		systemSoundMixSilence(count);
+		return;
+	}
+
+	soundBlipLeft.end_frame(count);
+	soundBlipRight.end_frame(count);
+
+	if (systemSoundMixIsPlain())
+	{
+		blip_sample_t *out = (blip_sample_t *)&soundFinalWave[soundBufferIndex];
+		soundBlipLeft.read_samples(out, count, 1);
+		soundBlipRight.read_samples(out + 1, count, 1);
+
+		systemSoundFrameSound((u16 *)out, count);
+		soundBufferIndex += count * 2;
+		return;
+	}
+
+	int bassL = BLIP_READER_BASS(soundBlipLeft);
+	int bassR = BLIP_READER_BASS(soundBlipRight);
+	BLIP_READER_BEGIN(left, soundBlipLeft);
+	BLIP_READER_BEGIN(right, soundBlipRight);
+	for (int i = 0; i < count; i++)
+	{
+		int resL = BLIP_READER_READ_RAW(left) >> (blip_sample_bits - 16);
+		int resR = BLIP_READER_READ_RAW(right) >> (blip_sample_bits - 16);
+		BLIP_READER_NEXT(left, bassL);
+		BLIP_READER_NEXT(right, bassR);
+		systemSoundMix(resL, resR);
+	}
+	BLIP_READER_END(left, soundBlipLeft);
+	BLIP_READER_END(right, soundBlipRight);
+
+	soundBlipLeft.remove_samples(count);
+	soundBlipRight.remove_samples(count);
+}
+
+void systemSoundMixSilence(int count)
+{
+	if (count <= 0)
+		return;
+
+	memset(&soundFinalWave[soundBufferIndex], 0, count * 2 * sizeof(u16));
+	systemSoundFrameSound(&soundFinalWave[soundBufferIndex], count);
+	soundBufferIndex += count * 2;
+}
+
 void systemSoundMix(int resL, int resR)
 {
 	bool usesDSP = systemSoundAppliesDSP();
@@ -641,13 +802,32 @@ void systemSoundMix(int resL, int resR)
 	}
 }
 
-void systemSoundNext()
+// number of ticks, at most count, that can be mixed as one run before systemSoundNext hands the buffer over
+int systemSoundRunLength(int count)
 {
-	soundIndex++;
+	int left = ((int)soundBufferLen - 2 * (int)soundBufferIndex + 3) / 4;
+	if (left > (int)countof(soundBuffer[0]) - (int)soundIndex)
+		left = (int)countof(soundBuffer[0]) - (int)soundIndex;
+	if (left < 1)
+		left = 1;
+
+	return count < left ? count : left;
+}
+
+// in turbo mode the channels keep their state but no samples are mixed or output
+bool systemSoundMixingRequired()
+{
+	return !turboMode;
+}
+
+// advances past count mixed ticks, handing the buffer over once it is full
+void systemSoundNext(int count)
+{
+	soundIndex += count;
 
 	if (2 * soundBufferIndex >= soundBufferLen)
 	{
-		if (systemSoundOn)
+		if (systemSoundOn && !turboMode)
 		{
 			if (soundPaused && !systemIsPaused())	// this checking is for the old frame timing
 			{
@@ -660,3 +840,34 @@ void systemSoundNext()
 		soundBufferIndex = 0;
 	}
 }
+
+// profiling
+
+// nanoseconds from an arbitrary origin
+u64 systemGetPreciseTime()
+{
+#ifdef WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (u64)(counter.QuadPart / frequency.QuadPart) * 1000000000 +
+	       (u64)(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (u64)tv.tv_sec * 1000000000 + (u64)tv.tv_usec * 1000;
+#endif
+}
+
+void systemResetProfile()
+{
+	for (int i = 0; i < PROFILE_COUNT; ++i)
+		systemProfileTime[i] = 0;
+}
@@ -59,9 +59,14 @@ extern int systemSoundGetEnabledChannels();
 extern void systemSoundSetQuality(int quality);
 extern bool systemSoundAppliesDSP();
 extern void systemSoundMixReset();
-extern void systemSoundMixSilence();
+extern void systemSoundMixSilence(int count = 1);
 extern void systemSoundMix(int resL, int resR);
-extern void systemSoundNext();
+extern void systemSoundSynthReset();
+extern void systemSoundSynth(int channel, int time, int left, int right);
+extern void systemSoundSynthMix(int count = 1);
+extern void systemSoundNext(int count = 1);
+extern bool systemSoundMixingRequired();
+extern int systemSoundRunLength(int count);
 // speed-related stuff
 extern u32 systemGetFrameRateDividend();
 extern u32 systemGetFrameRateDivisor();
@@ -87,8 +92,11 @@ extern bool systemIsPaused();
 extern void systemSetPause(bool pause);
 extern bool systemPausesNextFrame();
 extern bool systemLoadBIOS(const char *biosFileName, bool useBiosFile);
+// subsystem timing, only gathered while systemProfiling is set
+extern u64  systemGetPreciseTime();
+extern void systemResetProfile();
 
-extern int	systemCartridgeType;
+extern EMU_STATE int	systemCartridgeType;
 extern int  systemSpeed;
 extern bool systemSoundOn;
 extern u16  systemColorMap16[0x10000];
@@ -101,13 +109,34 @@ extern int  systemColorDepth;
 extern int  systemDebug;
 extern int  systemVerbose;
 extern int  systemFrameSkip;
-extern int  systemSaveUpdateCounter;
+extern EMU_STATE int  systemSaveUpdateCounter;
+extern EMU_STATE bool systemProfiling;
+extern EMU_STATE u64  systemProfileTime[];
 
 // constances
 #define SYSTEM_SAVE_UPDATED 30
 #define SYSTEM_SAVE_NOT_UPDATED 0
 #define SYSTEM_SENSOR_INIT_VALUE 2047
 
+enum SystemProfileSection
+{
+	PROFILE_RENDER = 0,
+	PROFILE_SOUND,
+	PROFILE_LUA,
+	PROFILE_COUNT
+};
+
+static inline u64 systemProfileBegin()
+{
+	return systemProfiling ? systemGetPreciseTime() : 0;
+}
+
+static inline void systemProfileEnd(int section, u64 start)
+{
+	if (systemProfiling)
+		systemProfileTime[section] += systemGetPreciseTime() - start;
+}
+
 enum NativeDisplayResolutions
 {
 	UNKNOWN_NDR = -1,
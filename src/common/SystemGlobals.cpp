@@ -1,9 +1,9 @@
 #include "SystemGlobals.h"
 
 // FIXME: it must be admitted that the naming schema is a whole mess
-EmulatedSystem theEmulator;
+EMU_STATE EmulatedSystem theEmulator;
 
-EmulatedSystemCounters systemCounters =
+EMU_STATE EmulatedSystemCounters systemCounters =
 {
 	// frameCount
 	0,
@@ -19,7 +19,7 @@ EmulatedSystemCounters systemCounters =
 
 int emulating = 0;
 
-u8 *bios = NULL;
+EMU_STATE u8 *bios = NULL;
 
 struct Pix
 {
@@ -30,84 +30,91 @@ struct Pix
 	int height;
 };
 
-u8 *pix	 = NULL;
+EMU_STATE u8 *pix	 = NULL;
 
-u16	  joypadButtons[4] = { 0, 0, 0, 0 };
-u16	  movieButtons[4] = { 0, 0, 0, 0 };
-u16	  currentButtons[4] = { 0, 0, 0, 0 };
-u16	  lastButtons[4] = { 0, 0, 0, 0 };
-u16	  nextButtons[4] = { 0, 0, 0, 0 };
+EMU_STATE u16	  joypadButtons[4] = { 0, 0, 0, 0 };
+EMU_STATE u16	  movieButtons[4] = { 0, 0, 0, 0 };
+EMU_STATE u16	  currentButtons[4] = { 0, 0, 0, 0 };
+EMU_STATE u16	  lastButtons[4] = { 0, 0, 0, 0 };
+EMU_STATE u16	  nextButtons[4] = { 0, 0, 0, 0 };
 
-int32 sensorX  = 0;
-int32 sensorY  = 0;
+EMU_STATE int32 sensorX  = 0;
+EMU_STATE int32 sensorY  = 0;
 
-bool  newFrame		  = true;
+EMU_STATE bool  newFrame		  = true;
 bool8 speedup		  = false;
-u32	  extButtons	  = 0;
-bool8 capturePrevious = false;
-int32 captureNumber	  = 0;
+EMU_STATE u32	  extButtons	  = 0;
+EMU_STATE bool8 capturePrevious = false;
+EMU_STATE int32 captureNumber	  = 0;
 
-soundtick_t USE_TICKS_AS  = 0;
-soundtick_t soundTickStep = soundQuality * USE_TICKS_AS;
-soundtick_t soundTicks	  = 0;
+EMU_STATE soundtick_t USE_TICKS_AS  = 0;
+EMU_STATE soundtick_t soundTickStep = 0;
+EMU_STATE soundtick_t soundTicks	  = 0;
+EMU_STATE int32 soundTicksPending = 0;
 
-u32	  soundIndex		= 0;
-int32 soundPaused		= 1;
-int32 soundPlay			= 0;
-u32	  soundNextPosition = 0;
+EMU_STATE u32	  soundIndex		= 0;
+EMU_STATE int32 soundPaused		= 1;
+EMU_STATE int32 soundPlay			= 0;
+EMU_STATE u32	  soundNextPosition = 0;
 
-u8	soundBuffer[6][735];
-u32 soundBufferLen		= 1470;
-u32 soundBufferTotalLen = 14700;
-u32 soundBufferIndex	= 0;
+EMU_STATE u8	soundBuffer[6][735];
+EMU_STATE u32 soundBufferLen		= 1470;
+EMU_STATE u32 soundBufferTotalLen = 14700;
+EMU_STATE u32 soundBufferIndex	= 0;
 
-u16	  soundFinalWave[1470];
-u16	  soundFrameSound[735 * 30 * 2]; // for avi logging
-int32 soundFrameSoundWritten = 0;
+EMU_STATE u16	  soundFinalWave[1470];
+EMU_STATE u16	  soundFrameSound[735 * 30 * 2]; // for avi logging
+EMU_STATE int32 soundFrameSoundWritten = 0;
 
-bool tempSaveSafe	  = true;
-int	 tempSaveID		  = 0;
-int	 tempSaveAttempts = 0;
+EMU_STATE bool tempSaveSafe	  = true;
+EMU_STATE int	 tempSaveID		  = 0;
+EMU_STATE int	 tempSaveAttempts = 0;
 
 // settings
-bool  synchronize = true;
-int32 gbFrameSkip = 0;
-int32 frameSkip	  = 0;
+EMU_STATE bool  synchronize = true;
+EMU_STATE int32 gbFrameSkip = 0;
+EMU_STATE int32 frameSkip	  = 0;
+EMU_STATE bool8 turboMode   = false;
 
-bool  cpuDisableSfx = false;
-int32 layerSettings = 0xff00;
+EMU_STATE bool  cpuDisableSfx = false;
+EMU_STATE bool8 cpuBlockCacheEnabled = false;
+EMU_STATE bool8 biosDirectAccess = true;
+EMU_STATE int32 layerSettings = 0xff00;
 
 #ifdef USE_GB_CORE_V7
-bool gbNullInputHackEnabled		= false;
-bool gbNullInputHackTempEnabled = false;
+EMU_STATE bool gbNullInputHackEnabled		= false;
+EMU_STATE bool gbNullInputHackTempEnabled = false;
 #else
-bool gbV20GBFrameTimingHack		= false;
-bool gbV20GBFrameTimingHackTemp = false;
+EMU_STATE bool gbV20GBFrameTimingHack		= false;
+EMU_STATE bool gbV20GBFrameTimingHackTemp = false;
 #endif
 
 #ifdef USE_GBA_CORE_V7
-bool memLagEnabled	   = false;
-bool memLagTempEnabled = false;
+EMU_STATE bool memLagEnabled	   = false;
+EMU_STATE bool memLagTempEnabled = false;
 #endif
 
-bool8 useOldFrameTiming	  = false;
-bool8 useBios			  = false;
-bool8 skipBios			  = false;
-bool8 skipSaveGameBattery = false;
-bool8 skipSaveGameCheats  = false;
-bool8 cheatsEnabled		  = true;
-bool8 mirroringEnable	  = false;
-
-bool8 cpuEnhancedDetection = true;
-int32 cpuSaveType		   = 0;
-
-int32 soundVolume	  = 0;
-int32 soundQuality	  = 2;
-bool8 soundEcho		  = false;
-bool8 soundLowPass	  = false;
-bool8 soundReverse	  = false;
-int32 soundEnableFlag = 0x3ff;
-bool8 soundOffFlag	  = false;
+EMU_STATE bool8 useOldFrameTiming	  = false;
+EMU_STATE bool8 useBios			  = false;
+EMU_STATE bool8 skipBios			  = false;
+EMU_STATE bool8 skipSaveGameBattery = false;
+EMU_STATE bool8 skipSaveGameCheats  = false;
+EMU_STATE bool8 asyncSaveStates	  = false;
+EMU_STATE bool8 cheatsEnabled		  = true;
+EMU_STATE bool8 mirroringEnable	  = false;
+EMU_STATE bool8 skipIdleLoops		  = false;
+EMU_STATE bool8 skipIdleLoopsTemp	  = false;
+
+EMU_STATE bool8 cpuEnhancedDetection = true;
+EMU_STATE int32 cpuSaveType		   = 0;
+
+EMU_STATE int32 soundVolume	  = 0;
+EMU_STATE int32 soundQuality	  = 2;
+EMU_STATE bool8 soundEcho		  = false;
+EMU_STATE bool8 soundLowPass	  = false;
+EMU_STATE bool8 soundReverse	  = false;
+EMU_STATE int32 soundEnableFlag = 0x3ff;
+EMU_STATE bool8 soundOffFlag	  = false;
 
 // I am just too lazy...
 u8 osd[4 * 257 * 226];
@@ -34,6 +34,10 @@ struct EmulatedSystem
 	bool (*emuReadMemState)(char *, int);
 	// write memory state (rewind)
 	bool (*emuWriteMemState)(char *, int);
+	// save snapshot (uncompressed state whose memory is tracked for writes from then on)
+	bool (*emuWriteSnapshot)(gzFile);
+	// load snapshot, only copying back the memory written since it was last saved or loaded if asked to
+	bool (*emuReadSnapshot)(gzFile, bool);
 	// write PNG file
 	bool (*emuWritePNG)(const char *);
 	// write BMP file
@@ -56,92 +60,99 @@ struct EmulatedSystemCounters
 	bool8 laggedLast;
 };
 
-extern struct EmulatedSystem theEmulator;
-extern struct EmulatedSystemCounters systemCounters;
+extern EMU_STATE struct EmulatedSystem theEmulator;
+extern EMU_STATE struct EmulatedSystemCounters systemCounters;
 
 extern int emulating;
 
-extern u8 *bios;
-extern u8 *pix;
+extern EMU_STATE u8 *bios;
+extern EMU_STATE u8 *pix;
 extern u8 osd[];
 
-extern u16 joypadButtons[4];
-extern u16 movieButtons[4];
-extern u16 currentButtons[4];
-extern u16 lastButtons[4];
-extern u16 nextButtons[4];
+extern EMU_STATE u16 joypadButtons[4];
+extern EMU_STATE u16 movieButtons[4];
+extern EMU_STATE u16 currentButtons[4];
+extern EMU_STATE u16 lastButtons[4];
+extern EMU_STATE u16 nextButtons[4];
 
-extern int32 sensorX, sensorY;
+extern EMU_STATE int32 sensorX, sensorY;
 
-extern bool	 newFrame;
+extern EMU_STATE bool	 newFrame;
 extern bool8 speedup;
-extern u32	 extButtons;
-extern bool8 capturePrevious;
-extern int32 captureNumber;
+extern EMU_STATE u32	 extButtons;
+extern EMU_STATE bool8 capturePrevious;
+extern EMU_STATE int32 captureNumber;
 
 typedef int32 soundtick_t;
 
-extern soundtick_t USE_TICKS_AS;
-extern soundtick_t soundTickStep;
-extern soundtick_t soundTicks;
+extern EMU_STATE soundtick_t USE_TICKS_AS;
+extern EMU_STATE soundtick_t soundTickStep;
+extern EMU_STATE soundtick_t soundTicks;
+extern EMU_STATE int32 soundTicksPending;
 
-extern u32	 soundIndex;
-extern int32 soundPaused;
-extern int32 soundPlay;
-extern u32	 soundNextPosition;
+extern EMU_STATE u32	 soundIndex;
+extern EMU_STATE int32 soundPaused;
+extern EMU_STATE int32 soundPlay;
+extern EMU_STATE u32	 soundNextPosition;
 
-extern u8  soundBuffer[6][735];
-extern u32 soundBufferLen;
-extern u32 soundBufferTotalLen;
-extern u32 soundBufferIndex;
+extern EMU_STATE u8  soundBuffer[6][735];
+extern EMU_STATE u32 soundBufferLen;
+extern EMU_STATE u32 soundBufferTotalLen;
+extern EMU_STATE u32 soundBufferIndex;
 
-extern u16	 soundFinalWave[1470];
-extern u16	 soundFrameSound[735 * 30 * 2];
-extern int32 soundFrameSoundWritten;
+extern EMU_STATE u16	 soundFinalWave[1470];
+extern EMU_STATE u16	 soundFrameSound[735 * 30 * 2];
+extern EMU_STATE int32 soundFrameSoundWritten;
 
-extern bool tempSaveSafe;
-extern int	tempSaveID;
-extern int	tempSaveAttempts;
+extern EMU_STATE bool tempSaveSafe;
+extern EMU_STATE int	tempSaveID;
+extern EMU_STATE int	tempSaveAttempts;
 
 // settings that should have no effect on timing
-extern bool	 synchronize;   // ... except this one?
-extern int32 gbFrameSkip;
-extern int32 frameSkip;
+extern EMU_STATE bool	 synchronize;   // ... except this one?
+extern EMU_STATE int32 gbFrameSkip;
+extern EMU_STATE int32 frameSkip;
+extern EMU_STATE bool8 turboMode;   // no rendering or sound synthesis at all, change it between frames only
 
-extern bool	 cpuDisableSfx;
-extern int32 layerSettings;
+extern EMU_STATE bool	 cpuDisableSfx;
+extern EMU_STATE bool8 cpuBlockCacheEnabled;   // GBA code runs from blocks of decoded instructions, see GBA-arm.cpp
+extern EMU_STATE bool8 biosDirectAccess;   // HLE BIOS routines reach plain memory through host pointers
+extern EMU_STATE int32 layerSettings;
 
 // other settings
 #ifdef USE_GB_CORE_V7
-extern bool gbNullInputHackEnabled;
-extern bool gbNullInputHackTempEnabled;
+extern EMU_STATE bool gbNullInputHackEnabled;
+extern EMU_STATE bool gbNullInputHackTempEnabled;
 #else
-extern bool gbV20GBFrameTimingHack;
-extern bool gbV20GBFrameTimingHackTemp;
+extern EMU_STATE bool gbV20GBFrameTimingHack;
+extern EMU_STATE bool gbV20GBFrameTimingHackTemp;
 #endif
 
 #ifdef USE_GBA_CORE_V7
-extern bool memLagEnabled;
-extern bool memLagTempEnabled;
+extern EMU_STATE bool memLagEnabled;
+extern EMU_STATE bool memLagTempEnabled;
 #endif
 
-extern bool8 useOldFrameTiming;
-extern bool8 useBios;
-extern bool8 skipBios;
-extern bool8 skipSaveGameBattery; // skip battery data when reading save states
-extern bool8 skipSaveGameCheats; // skip cheat list data when reading save states
-extern bool8 cheatsEnabled;
-extern bool8 mirroringEnable;
-
-extern bool8 cpuEnhancedDetection;
-extern int32 cpuSaveType;
-
-extern int32 soundVolume;
-extern int32 soundQuality;
-extern bool8 soundEcho;
-extern bool8 soundLowPass;
-extern bool8 soundReverse;
-extern int32 soundEnableFlag;
-extern bool8 soundOffFlag;
+extern EMU_STATE bool8 useOldFrameTiming;
+extern EMU_STATE bool8 useBios;
+extern EMU_STATE bool8 skipBios;
+extern EMU_STATE bool8 skipSaveGameBattery; // skip battery data when reading save states
+extern EMU_STATE bool8 skipSaveGameCheats; // skip cheat list data when reading save states
+extern EMU_STATE bool8 asyncSaveStates; // compress and write save states on a background thread
+extern EMU_STATE bool8 cheatsEnabled;
+extern EMU_STATE bool8 mirroringEnable;
+extern EMU_STATE bool8 skipIdleLoops; // fast-forward loops that provably only wait for the next event
+extern EMU_STATE bool8 skipIdleLoopsTemp; // the above for the loaded ROM, after its vba-over.ini entry
+
+extern EMU_STATE bool8 cpuEnhancedDetection;
+extern EMU_STATE int32 cpuSaveType;
+
+extern EMU_STATE int32 soundVolume;
+extern EMU_STATE int32 soundQuality;
+extern EMU_STATE bool8 soundEcho;
+extern EMU_STATE bool8 soundLowPass;
+extern EMU_STATE bool8 soundReverse;
+extern EMU_STATE int32 soundEnableFlag;
+extern EMU_STATE bool8 soundOffFlag;
 
 #endif
@@ -16,18 +16,35 @@ extern "C" {
 #include "../NLS.h"
 #include "System.h"
 #include "Util.h"
+#include "MappedImage.h"
 #include "../gba/Flash.h"
 #include "../gba/RTC.h"
 
 extern "C" {
 #include "memgzio.h"
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define UTIL_COLOR_MAP_SSE2
+#include <emmintrin.h>
+#if defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define UTIL_COLOR_MAP_AVX2
+#include <immintrin.h>
+#endif
+#ifdef __GNUC__
+#define UTIL_TARGET_SSE2 __attribute__((target("sse2")))
+#define UTIL_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define UTIL_TARGET_SSE2
+#include <intrin.h>
+#endif
+#endif
 }
 
 #ifndef _MSC_VER
 #define _stricmp strcasecmp
 #endif // ! _MSC_VER
 
-extern int32 cpuSaveType;
+extern EMU_STATE int32 cpuSaveType;
 
 extern int systemColorDepth;
 extern int systemRedShift;
@@ -37,11 +54,11 @@ extern int systemBlueShift;
 extern u16 systemColorMap16[0x10000];
 extern u32 systemColorMap32[0x10000];
 
-static int	   (ZEXPORT *utilGzWriteFunc)(gzFile, voidp, unsigned int) = NULL;
-static int	   (ZEXPORT *utilGzReadFunc)(gzFile, voidp, unsigned int)  = NULL;
-static int	   (ZEXPORT *utilGzCloseFunc)(gzFile) = NULL;
-static z_off_t (ZEXPORT *utilGzSeekFunc)(gzFile, z_off_t, int) = NULL;
-static z_off_t (ZEXPORT *utilGzTellFunc)(gzFile) = NULL;
+static EMU_STATE int	   (ZEXPORT *utilGzWriteFunc)(gzFile, voidp, unsigned int) = NULL;
+static EMU_STATE int	   (ZEXPORT *utilGzReadFunc)(gzFile, voidp, unsigned int)  = NULL;
+static EMU_STATE int	   (ZEXPORT *utilGzCloseFunc)(gzFile) = NULL;
+static EMU_STATE z_off_t (ZEXPORT *utilGzSeekFunc)(gzFile, z_off_t, int) = NULL;
+static EMU_STATE z_off_t (ZEXPORT *utilGzTellFunc)(gzFile) = NULL;
 
 //Kludge to get it to compile in Linux, GCC cannot convert
 //gzwrite function pointer to the type of utilGzWriteFunc
@@ -495,6 +512,9 @@ void utilApplyIPS(const char *ips, u8 * *r, int *s)
 			// check if we need to reallocate our ROM
 			if ((offset + len) >= size)
 			{
+				// a mapped image cannot grow
+				if (mappedImageOwns(rom))
+					break;
 				size *= 2;
 				void *tmp = realloc(rom, size);
 				if (!tmp) free(rom);	// crash is better than a security hole
@@ -522,7 +542,7 @@ void utilApplyIPS(const char *ips, u8 * *r, int *s)
 	fclose(f);
 }
 
-extern bool8 cpuIsMultiBoot;
+extern EMU_STATE bool8 cpuIsMultiBoot;
 
 bool utilIsGBAImage(const char *file)
 {
@@ -1195,6 +1215,81 @@ gzFile utilMemGzOpen(char *memory, int available, char *mode)
 	return memgzopen(memory, available, mode);
 }
 
+static int ZEXPORT rawMemWrite(gzFile file, voidp buffer, unsigned int len)
+{
+	RawMemStream *stream = (RawMemStream *)file;
+	if (stream->size + len > stream->capacity)
+	{
+		u32 capacity = stream->capacity ? stream->capacity : 0x10000;
+		while (stream->size + len > capacity)
+			capacity <<= 1;
+
+		u8 *data = (u8 *)realloc(stream->data, capacity);
+		if (data == NULL)
+			return 0;
+
+		stream->data	 = data;
+		stream->capacity = capacity;
+	}
+
+	memcpy(stream->data + stream->size, buffer, len);
+	stream->size += len;
+	return len;
+}
+
+static int ZEXPORT rawMemRead(gzFile file, voidp buffer, unsigned int len)
+{
+	RawMemStream *stream = (RawMemStream *)file;
+	if (len > stream->size - stream->pos)
+		len = stream->size - stream->pos;
+
+	memcpy(buffer, stream->data + stream->pos, len);
+	stream->pos += len;
+	return len;
+}
+
+static int ZEXPORT rawMemClose(gzFile file)
+{
+	return 0;
+}
+
+static z_off_t ZEXPORT rawMemSeek(gzFile file, z_off_t offset, int whence)
+{
+	RawMemStream *stream = (RawMemStream *)file;
+	if (whence == SEEK_CUR)
+		offset += stream->pos;
+	else if (whence == SEEK_END)
+		offset += stream->size;
+
+	if (offset < 0 || (u32)offset > stream->size)
+		return -1;
+
+	stream->pos = offset;
+	return offset;
+}
+
+static z_off_t ZEXPORT rawMemTell(gzFile file)
+{
+	RawMemStream *stream = (RawMemStream *)file;
+	return stream->pos < stream->size ? stream->pos : stream->size;
+}
+
+// uncompressed stream over a growable buffer; the buffer is kept by the caller and reused across opens
+gzFile utilRawMemOpen(RawMemStream *stream, const char *mode)
+{
+	utilGzWriteFunc = rawMemWrite;
+	utilGzReadFunc	= rawMemRead;
+	utilGzCloseFunc = rawMemClose;
+	utilGzSeekFunc	= rawMemSeek;
+	utilGzTellFunc	= rawMemTell;
+
+	if (strchr(mode, 'w'))
+		stream->size = 0;
+	stream->pos = 0;
+
+	return (gzFile)stream;
+}
+
 int utilGzWrite(gzFile file, voidp buffer, unsigned int len)
 {
 	return utilGzWriteFunc(file, buffer, len);
@@ -1284,6 +1379,42 @@ void utilGBAFindSave(const u8 *data, const int size)
 	flashSetSize(flashSize);
 }
 
+// Whole-line conversion from BGR555 to the system color format. While the color maps hold the
+// plain channel shifts built by utilUpdateSystemColorMaps(), lines are converted arithmetically
+// with SIMD instead of going through the 64K-entry tables.
+enum
+{
+	COLOR_MAP_TABLE,
+	COLOR_MAP_SSE2,
+	COLOR_MAP_AVX2
+};
+
+static int colorMapKernel	  = COLOR_MAP_TABLE;
+static int colorMapDepth	  = 0;
+static int colorMapRedShift	  = 0;
+static int colorMapGreenShift = 0;
+static int colorMapBlueShift  = 0;
+
+static int utilDetectColorMapKernel()
+{
+#ifdef UTIL_COLOR_MAP_SSE2
+#ifdef __GNUC__
+	__builtin_cpu_init();
+#ifdef UTIL_COLOR_MAP_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return COLOR_MAP_AVX2;
+#endif
+	return __builtin_cpu_supports("sse2") ? COLOR_MAP_SSE2 : COLOR_MAP_TABLE;
+#else
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) ? COLOR_MAP_SSE2 : COLOR_MAP_TABLE;
+#endif
+#else
+	return COLOR_MAP_TABLE;
+#endif
+}
+
 void utilUpdateSystemColorMaps()
 {
 	switch (systemColorDepth)
@@ -1310,6 +1441,215 @@ void utilUpdateSystemColorMaps()
 		break;
 	}
 	}
+
+	static int detectedKernel = -1;
+	if (detectedKernel < 0)
+		detectedKernel = utilDetectColorMapKernel();
+
+	colorMapKernel	   = detectedKernel;
+	colorMapDepth	   = systemColorDepth;
+	colorMapRedShift   = systemRedShift;
+	colorMapGreenShift = systemGreenShift;
+	colorMapBlueShift  = systemBlueShift;
+}
+
+static inline int utilColorMapKernel()
+{
+	if (colorMapDepth != systemColorDepth || colorMapRedShift != systemRedShift ||
+	    colorMapGreenShift != systemGreenShift || colorMapBlueShift != systemBlueShift)
+		return COLOR_MAP_TABLE;
+	return colorMapKernel;
+}
+
+#ifdef UTIL_COLOR_MAP_SSE2
+UTIL_TARGET_SSE2 static inline __m128i colorMapLoad16(const u32 *src)
+{
+	// the top bit is not part of the color, and dropping it keeps the signed pack exact
+	const __m128i color = _mm_set1_epi32(0x7fff);
+	__m128i		  lo	= _mm_and_si128(_mm_loadu_si128((const __m128i *)src), color);
+	__m128i		  hi	= _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + 4)), color);
+	return _mm_packs_epi32(lo, hi);
+}
+
+UTIL_TARGET_SSE2 static inline __m128i colorMapLoad16(const u16 *src)
+{
+	return _mm_loadu_si128((const __m128i *)src);
+}
+
+UTIL_TARGET_SSE2 static inline __m128i colorMapLoad32(const u32 *src)
+{
+	return _mm_loadu_si128((const __m128i *)src);
+}
+
+UTIL_TARGET_SSE2 static inline __m128i colorMapLoad32(const u16 *src)
+{
+	return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)src), _mm_setzero_si128());
+}
+
+template <typename T>
+UTIL_TARGET_SSE2 static void colorMapLine16SSE2(u16 *dest, const T *src, int count)
+{
+	const __m128i mask	= _mm_set1_epi16(0x1f);
+	const __m128i red	= _mm_cvtsi32_si128(colorMapRedShift);
+	const __m128i green = _mm_cvtsi32_si128(colorMapGreenShift);
+	const __m128i blue	= _mm_cvtsi32_si128(colorMapBlueShift);
+
+	for (int x = 0; x < count; x += 8)
+	{
+		__m128i v = colorMapLoad16(src + x);
+		__m128i r = _mm_sll_epi16(_mm_and_si128(v, mask), red);
+		__m128i g = _mm_sll_epi16(_mm_and_si128(_mm_srli_epi16(v, 5), mask), green);
+		__m128i b = _mm_sll_epi16(_mm_and_si128(_mm_srli_epi16(v, 10), mask), blue);
+		_mm_storeu_si128((__m128i *)(dest + x), _mm_or_si128(_mm_or_si128(r, g), b));
+	}
+}
+
+template <typename T>
+UTIL_TARGET_SSE2 static void colorMapLine32SSE2(u32 *dest, const T *src, int count)
+{
+	const __m128i mask	= _mm_set1_epi32(0x1f);
+	const __m128i red	= _mm_cvtsi32_si128(colorMapRedShift);
+	const __m128i green = _mm_cvtsi32_si128(colorMapGreenShift);
+	const __m128i blue	= _mm_cvtsi32_si128(colorMapBlueShift);
+
+	for (int x = 0; x < count; x += 4)
+	{
+		__m128i v = colorMapLoad32(src + x);
+		__m128i r = _mm_sll_epi32(_mm_and_si128(v, mask), red);
+		__m128i g = _mm_sll_epi32(_mm_and_si128(_mm_srli_epi32(v, 5), mask), green);
+		__m128i b = _mm_sll_epi32(_mm_and_si128(_mm_srli_epi32(v, 10), mask), blue);
+		_mm_storeu_si128((__m128i *)(dest + x), _mm_or_si128(_mm_or_si128(r, g), b));
+	}
+}
+#endif
+
+#ifdef UTIL_COLOR_MAP_AVX2
+UTIL_TARGET_AVX2 static inline __m256i colorMapLoad16AVX2(const u32 *src)
+{
+	const __m256i color = _mm256_set1_epi32(0x7fff);
+	__m256i		  lo	= _mm256_and_si256(_mm256_loadu_si256((const __m256i *)src), color);
+	__m256i		  hi	= _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(src + 8)), color);
+	// the pack works per 128-bit lane, so put the quarters back in order
+	return _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8);
+}
+
+UTIL_TARGET_AVX2 static inline __m256i colorMapLoad16AVX2(const u16 *src)
+{
+	return _mm256_loadu_si256((const __m256i *)src);
+}
+
+UTIL_TARGET_AVX2 static inline __m256i colorMapLoad32AVX2(const u32 *src)
+{
+	return _mm256_loadu_si256((const __m256i *)src);
+}
+
+UTIL_TARGET_AVX2 static inline __m256i colorMapLoad32AVX2(const u16 *src)
+{
+	return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)src));
+}
+
+template <typename T>
+UTIL_TARGET_AVX2 static void colorMapLine16AVX2(u16 *dest, const T *src, int count)
+{
+	const __m256i mask	= _mm256_set1_epi16(0x1f);
+	const __m128i red	= _mm_cvtsi32_si128(colorMapRedShift);
+	const __m128i green = _mm_cvtsi32_si128(colorMapGreenShift);
+	const __m128i blue	= _mm_cvtsi32_si128(colorMapBlueShift);
+
+	for (int x = 0; x < count; x += 16)
+	{
+		__m256i v = colorMapLoad16AVX2(src + x);
+		__m256i r = _mm256_sll_epi16(_mm256_and_si256(v, mask), red);
+		__m256i g = _mm256_sll_epi16(_mm256_and_si256(_mm256_srli_epi16(v, 5), mask), green);
+		__m256i b = _mm256_sll_epi16(_mm256_and_si256(_mm256_srli_epi16(v, 10), mask), blue);
+		_mm256_storeu_si256((__m256i *)(dest + x), _mm256_or_si256(_mm256_or_si256(r, g), b));
+	}
+}
+
+template <typename T>
+UTIL_TARGET_AVX2 static void colorMapLine32AVX2(u32 *dest, const T *src, int count)
+{
+	const __m256i mask	= _mm256_set1_epi32(0x1f);
+	const __m128i red	= _mm_cvtsi32_si128(colorMapRedShift);
+	const __m128i green = _mm_cvtsi32_si128(colorMapGreenShift);
+	const __m128i blue	= _mm_cvtsi32_si128(colorMapBlueShift);
+
+	for (int x = 0; x < count; x += 8)
+	{
+		__m256i v = colorMapLoad32AVX2(src + x);
+		__m256i r = _mm256_sll_epi32(_mm256_and_si256(v, mask), red);
+		__m256i g = _mm256_sll_epi32(_mm256_and_si256(_mm256_srli_epi32(v, 5), mask), green);
+		__m256i b = _mm256_sll_epi32(_mm256_and_si256(_mm256_srli_epi32(v, 10), mask), blue);
+		_mm256_storeu_si256((__m256i *)(dest + x), _mm256_or_si256(_mm256_or_si256(r, g), b));
+	}
+}
+#endif
+
+// the SIMD kernels work on 16 pixels at a time; other widths use the tables
+template <typename T>
+static inline void utilColorMapLine16(u16 *dest, const T *src, int count)
+{
+	int kernel = (count & 15) ? COLOR_MAP_TABLE : utilColorMapKernel();
+	switch (kernel)
+	{
+#ifdef UTIL_COLOR_MAP_AVX2
+	case COLOR_MAP_AVX2:
+		colorMapLine16AVX2(dest, src, count);
+		break;
+#endif
+#ifdef UTIL_COLOR_MAP_SSE2
+	case COLOR_MAP_SSE2:
+		colorMapLine16SSE2(dest, src, count);
+		break;
+#endif
+	default:
+		for (int x = 0; x < count; x++)
+			dest[x] = systemColorMap16[src[x] & 0xFFFF];
+		break;
+	}
+}
+
+template <typename T>
+static inline void utilColorMapLine32(u32 *dest, const T *src, int count)
+{
+	int kernel = (count & 15) ? COLOR_MAP_TABLE : utilColorMapKernel();
+	switch (kernel)
+	{
+#ifdef UTIL_COLOR_MAP_AVX2
+	case COLOR_MAP_AVX2:
+		colorMapLine32AVX2(dest, src, count);
+		break;
+#endif
+#ifdef UTIL_COLOR_MAP_SSE2
+	case COLOR_MAP_SSE2:
+		colorMapLine32SSE2(dest, src, count);
+		break;
+#endif
+	default:
+		for (int x = 0; x < count; x++)
+			dest[x] = systemColorMap32[src[x] & 0xFFFF];
+		break;
+	}
+}
+
+void utilColorMapLine(u16 *dest, const u32 *src, int count)
+{
+	utilColorMapLine16(dest, src, count);
+}
+
+void utilColorMapLine(u16 *dest, const u16 *src, int count)
+{
+	utilColorMapLine16(dest, src, count);
+}
+
+void utilColorMapLine(u32 *dest, const u32 *src, int count)
+{
+	utilColorMapLine32(dest, src, count);
+}
+
+void utilColorMapLine(u32 *dest, const u16 *src, int count)
+{
+	utilColorMapLine32(dest, src, count);
 }
 
 //// BIOS stuff
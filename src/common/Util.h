@@ -23,6 +23,14 @@ typedef struct
 	int	  size;
 } variable_desc;
 
+typedef struct
+{
+	u8 *data;
+	u32 size;
+	u32 capacity;
+	u32 pos;
+} RawMemStream;
+
 extern void utilWriteBMP(u8 *out, int w, int h, int dstDepth, const u8 *in);
 extern bool utilWriteBMPFile(const char *, int, int, const u8 *);
 extern bool utilWritePNGFile(const char *, int, int, const u8 *);
@@ -48,6 +56,7 @@ extern void	 utilWriteInt(gzFile, int32);
 extern gzFile utilGzOpen(const char *file, const char *mode);
 extern gzFile utilGzReopen(int id, const char *mode);
 extern gzFile utilMemGzOpen(char *memory, int available, char *mode);
+extern gzFile utilRawMemOpen(RawMemStream *stream, const char *mode);
 extern int utilGzWrite(gzFile file, voidp buffer, unsigned int len);
 extern int utilGzRead(gzFile file, voidp buffer, unsigned int len);
 extern int utilGzClose(gzFile file);
@@ -55,6 +64,10 @@ extern z_off_t utilGzSeek(gzFile file, z_off_t offset, int whence);
 extern z_off_t utilGzTell(gzFile file);
 extern void utilGBAFindSave(const u8 *, const int);
 extern void utilUpdateSystemColorMaps();
+extern void utilColorMapLine(u16 *dest, const u32 *src, int count);
+extern void utilColorMapLine(u16 *dest, const u16 *src, int count);
+extern void utilColorMapLine(u32 *dest, const u32 *src, int count);
+extern void utilColorMapLine(u32 *dest, const u16 *src, int count);
 extern bool utilLoadBIOS(u8 *bios, const char *biosFileName, int systemType);
 extern bool utilCheckBIOS(const char *biosFileName, int systemType);
 extern u16 utilCalcBIOSChecksum(const u8 *bios, int systemType);
@@ -37,6 +37,7 @@ using namespace std;
 #include "../Port.h"
 #include "System.h"
 #include "movie.h"
+#include "Snapshot.h"
 #include "../common/SystemGlobals.h"
 #include "../gba/GBA.h"
 #include "../gba/GBAinline.h"
@@ -171,20 +172,6 @@ static const char *luaCallIDStrings[] =
 //make sure we have the right number of strings
 CTASSERT(sizeof(luaCallIDStrings) / sizeof(*luaCallIDStrings) == LUACALL_COUNT)
 
-static const char *luaMemHookTypeStrings [] =
-{
-	"MEMHOOK_WRITE",
-	"MEMHOOK_READ",
-	"MEMHOOK_EXEC",
-
-	"MEMHOOK_WRITE_SUB",
-	"MEMHOOK_READ_SUB",
-	"MEMHOOK_EXEC_SUB",
-};
-
-//make sure we have the right number of strings
-CTASSERT(sizeof(luaMemHookTypeStrings) / sizeof(*luaMemHookTypeStrings) ==  LUAMEMHOOK_COUNT)
-
 static const char* luaJoypadTypeStrings[] =
 {
 	"JOYPAD_USER",
@@ -913,13 +900,13 @@ struct registerPointerMap
 	int dataSize;
 };
 
-extern gbRegister AF;
-extern gbRegister BC;
-extern gbRegister DE;
-extern gbRegister HL;
-extern gbRegister SP;
-extern gbRegister PC;
-extern u16 IFF;
+extern EMU_STATE gbRegister AF;
+extern EMU_STATE gbRegister BC;
+extern EMU_STATE gbRegister DE;
+extern EMU_STATE gbRegister HL;
+extern EMU_STATE gbRegister SP;
+extern EMU_STATE gbRegister PC;
+extern EMU_STATE u16 IFF;
 
 #define RPM_ENTRY(name, var) \
 	{ name, (unsigned int *)&var, sizeof(var) },
@@ -1100,120 +1087,313 @@ void CallRegisteredLuaFunctions(LuaCallID calltype)
 // with a bias toward fast rejection because the majority of addresses will not be hooked.
 // (it must not use any part of Lua or perform any per-script operations,
 //  otherwise it would definitely be too slow.)
-// calculating the regions when a hook is added/removed may be slow,
-// but this is an intentional tradeoff to obtain a high speed of checking during later execution
-struct TieredRegion
+// every hooked byte is one bit in a bitmap of its 64 KB page, and the callback of every hooked byte
+// is kept natively as a registry reference next to that bit (the page is allocated only once
+// something in it is hooked), so a match is one bit test and one load, with nothing looked up
+// in Lua tables.
+struct MemHookIndex
 {
-	template<unsigned int maxGap>
-	struct Region
+	enum
 	{
-		struct Island
-		{
-			unsigned int	   start;
-			unsigned int	   end;
-			__forceinline bool Contains(unsigned int address, int size) const { return address < end && address + size > start; }
-		};
-		std::vector<Island> islands;
+		PAGE_SHIFT = 16,
+		PAGE_SIZE  = 1 << PAGE_SHIFT,
+		PAGE_COUNT = 1 << (32 - PAGE_SHIFT)
+	};
 
-		void Calculate(const std::vector<unsigned int> &bytes)
+	struct Page
+	{
+		u8	bits[PAGE_SIZE / 8];
+		int refs[PAGE_SIZE];	// registry reference of the callback of each hooked byte
+		int used;				// hooked bytes in the page
+	};
+
+	Page **pages;
+	int	   count;
+	std::map<int, int> refCounts; // registry reference -> number of bytes using it
+
+	MemHookIndex() : pages(NULL), count(0) {}
+
+	__forceinline int NotEmpty()
+	{
+		return count;
+	}
+
+	// note: it is illegal to call this if NotEmpty() returns 0
+	__forceinline bool Contains(unsigned int address, int size) const
+	{
+		for (unsigned int i = address; i != address + size; i++)
 		{
-			islands.clear();
+			const Page *page = pages[i >> PAGE_SHIFT];
+			if (page && (page->bits[(i & (PAGE_SIZE - 1)) >> 3] & (1 << (i & 7))))
+				return true;
+		}
+		return false;
+	}
 
-			unsigned int lastEnd = ~0;
+	// returns the reference of the callback hooking this byte, or LUA_NOREF
+	__forceinline int Find(unsigned int address) const
+	{
+		if (!pages)
+			return LUA_NOREF;
+		const Page *page = pages[address >> PAGE_SHIFT];
+		unsigned int offset = address & (PAGE_SIZE - 1);
+		if (page && (page->bits[offset >> 3] & (1 << (offset & 7))))
+			return page->refs[offset];
+		return LUA_NOREF;
+	}
+
+	bool HasRef(int ref) const
+	{
+		return refCounts.find(ref) != refCounts.end();
+	}
+
+	// hooks a byte with an already counted reference, or unhooks it if ref is LUA_NOREF;
+	// returns true if the byte was hooked before
+	bool Set(lua_State *L, unsigned int address, int ref)
+	{
+		int oldRef = Find(address);
+		if (oldRef != LUA_NOREF)
+			Release(L, oldRef);
+
+		if (ref != LUA_NOREF && !pages)
+			pages = (Page **)calloc(PAGE_COUNT, sizeof(Page *));
+		if (!pages)
+			return false;
 
-			std::vector<unsigned int>::const_iterator iter = bytes.begin();
-			std::vector<unsigned int>::const_iterator end  = bytes.end();
-			for (; iter != end; ++iter)
+		Page *&page = pages[address >> PAGE_SHIFT];
+		unsigned int offset = address & (PAGE_SIZE - 1);
+		if (ref != LUA_NOREF)
+		{
+			if (!page)
+				page = (Page *)calloc(1, sizeof(Page));
+			if (oldRef == LUA_NOREF)
 			{
-				unsigned int addr = *iter;
-				if (addr < lastEnd || addr > lastEnd + (long long)maxGap)
-				{
-					islands.push_back(Island());
-					islands.back().start = addr;
-				}
-				islands.back(). end = addr + 1;
-				lastEnd = addr + 1;
+				page->bits[offset >> 3] |= 1 << (offset & 7);
+				page->used++;
+				count++;
 			}
+			page->refs[offset] = ref;
+			refCounts[ref]++;
 		}
-
-		bool Contains(unsigned int address, int size) const
+		else if (oldRef != LUA_NOREF)
 		{
-			//for (size_t i = 0, j = islands.size(); i != j; ++i)
-			for (size_t i = islands.size(); i--; )
+			page->bits[offset >> 3] &= ~(1 << (offset & 7));
+			count--;
+			if (--page->used == 0)
 			{
-				if (islands[i].Contains(address, size))
-					return true;
+				free(page);
+				page = NULL;
 			}
-			return false;
 		}
-	};
-
-	Region<0xFFFFFFFF> broad;
-	Region<0x1000>	   mid;
-	Region<0>		   narrow;
-
-	void Calculate(std::vector<unsigned int> &bytes)
-	{
-		std:: sort(bytes.begin(), bytes.end());
-
-		broad.Calculate(bytes);
-		mid.Calculate(bytes);
-		narrow.Calculate(bytes);
+		return oldRef != LUA_NOREF;
 	}
 
-	TieredRegion()
+	// drops every hook; the references are released too if the state is still alive
+	void Clear(lua_State *L)
 	{
-		std::vector <unsigned int> temp;
-		Calculate(temp);
+		if (L)
+		{
+			for (std::map<int, int>::iterator iter = refCounts.begin(); iter != refCounts.end(); ++iter)
+				luaL_unref(L, LUA_REGISTRYINDEX, iter->first);
+		}
+		if (pages)
+		{
+			for (int i = 0; i < PAGE_COUNT; i++)
+				free(pages[i]);
+			free(pages);
+			pages = NULL;
+		}
+		refCounts.clear();
+		count = 0;
 	}
 
-	__forceinline int NotEmpty()
+private:
+	void Release(lua_State *L, int ref)
 	{
-		return broad.islands.size();
+		if (--refCounts[ref] == 0)
+		{
+			refCounts.erase(ref);
+			luaL_unref(L, LUA_REGISTRYINDEX, ref);
+		}
 	}
+};
 
-	// note: it is illegal to call this if NotEmpty() returns 0
-	__forceinline bool Contains(unsigned int address, int size)
+MemHookIndex hookedRegions[LUAMEMHOOK_COUNT];
+
+// hooks registered with the *_batched functions only log accesses to memHookQueue,
+// and the logged records are handed to their callbacks once per frame
+MemHookIndex batchedRegions[LUAMEMHOOK_COUNT];
+
+struct MemHookRecord
+{
+	int			 ref;
+	unsigned int serial;	// registration that owned ref when the access was logged
+	unsigned int address;
+	unsigned int value;
+	unsigned int pc;
+	unsigned int cycle;
+	unsigned int size;
+};
+
+// ring buffer; when it's full the oldest records are dropped
+#define MEMHOOK_QUEUE_SIZE 0x10000
+static MemHookRecord memHookQueue[MEMHOOK_QUEUE_SIZE];
+static unsigned int	 memHookQueueStart	 = 0;
+static unsigned int	 memHookQueueLength	 = 0;
+static unsigned int	 memHookQueueDropped = 0;
+
+// luaL_ref hands out released references again right away, so each batched registration
+// gets a serial, and records logged for an earlier owner of the reference are not delivered
+static std::map<int, unsigned int> batchedHookSerials; // registry reference -> serial
+static unsigned int batchedHookSerial = 0;
+
+extern EMU_STATE int32 lcdTicks;
+extern EMU_STATE int32 cpuTotalTicks;
+extern EMU_STATE int32 gbLcdLYIncrementTicks;
+extern EMU_STATE int32 GBLY_INCREMENT_CLOCK_TICKS;
+#ifndef USE_GBA_CORE_V7
+extern void CPUMemoryBlockWritten(u32 address, u32 size);
+#endif
+
+// address of the instruction being executed
+static unsigned int GetCurrentPC()
+{
+	if (systemIsRunningGBA())
+		return armState ? armNextPC - 4 : armNextPC - 2;
+	return PC.W;
+}
+
+// approximate emulated cycle since the start of the frame (GB cycles are in LY increment units)
+static unsigned int GetCurrentFrameCycle()
+{
+	if (systemIsRunningGBA())
+		return VCOUNT * 1232 + ((DISPSTAT & 2) ? 1232 : 960) - lcdTicks + cpuTotalTicks;
+	return register_LY * GBLY_INCREMENT_CLOCK_TICKS + GBLY_INCREMENT_CLOCK_TICKS - gbLcdLYIncrementTicks;
+}
+
+static void QueueBatchedMemHook(unsigned int address, int size, unsigned int value, LuaMemHookType hookType)
+{
+	for (unsigned int i = address; i != address + size; i++)
 	{
-		return broad.islands[0].Contains(address, size) &&
-				mid.Contains(address, size) &&
-				narrow.Contains(address, size);
+		int ref = batchedRegions[hookType].Find(i);
+		if (ref != LUA_NOREF)
+		{
+			MemHookRecord *record;
+			if (memHookQueueLength < MEMHOOK_QUEUE_SIZE)
+			{
+				record = &memHookQueue[(memHookQueueStart + memHookQueueLength++) % MEMHOOK_QUEUE_SIZE];
+			}
+			else
+			{
+				record			  = &memHookQueue[memHookQueueStart];
+				memHookQueueStart = (memHookQueueStart + 1) % MEMHOOK_QUEUE_SIZE;
+				memHookQueueDropped++;
+			}
+			record->ref		= ref;
+			record->serial	= batchedHookSerials[ref];
+			record->address = address;
+			record->value	= value;
+			record->pc		= GetCurrentPC();
+			record->cycle	= GetCurrentFrameCycle();
+			record->size	= size;
+			break;
+		}
 	}
-};
+}
 
-TieredRegion hookedRegions[LUAMEMHOOK_COUNT];
+static void ClearBatchedMemHookQueue()
+{
+	memHookQueueStart	= 0;
+	memHookQueueLength	= 0;
+	memHookQueueDropped = 0;
+}
 
-static void CalculateMemHookRegions(LuaMemHookType hookType)
+// calls every batched hook callback with a table of the accesses it logged since the last frame:
+// { n = count, dropped = records lost to overflow, address = {...}, size = {...}, value = {...},
+//   pc = {...}, cycle = {...} }
+static void DeliverBatchedMemHooks(lua_State *L)
 {
-	std::vector<unsigned int> hookedBytes;
-//	std::map<int, LuaContextInfo*>::iterator iter = luaContextInfo.begin();
-//	std::map<int, LuaContextInfo*>::iterator end = luaContextInfo.end();
-//	while(iter != end)
-//	{
-//		LuaContextInfo& info = *iter->second;
-		if (/*info.*/ numMemHooks)
+	static const char *fields[] = { "address", "size", "value", "pc", "cycle" };
+
+	if (!memHookQueueLength)
+		return;
+
+	// the queue must be emptied first, since the callbacks may run into hooks themselves
+	std::vector<MemHookRecord> records(memHookQueueLength);
+	for (unsigned int i = 0; i < memHookQueueLength; i++)
+		records[i] = memHookQueue[(memHookQueueStart + i) % MEMHOOK_QUEUE_SIZE];
+	unsigned int dropped = memHookQueueDropped;
+	ClearBatchedMemHookQueue();
+
+	// build one batch table per callback on the stack
+	lua_settop(L, 0);
+	struct Batch
+	{
+		int			 index; // stack index of the batch table
+		int			 n;
+		unsigned int serial;
+	};
+	std::map<int, Batch> batches; // registry reference -> its batch
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		const MemHookRecord &record = records[i];
+		if (record.serial != batchedHookSerials[record.ref])
+			continue;
+
+		std::map<int, Batch>::iterator iter = batches.find(record.ref);
+		if (iter == batches.end())
 		{
-			lua_State *L = LUA /*info.L*/;
-			if (L)
+			lua_checkstack(L, 3);
+			lua_newtable(L);
+			Batch batch = { lua_gettop(L), 0, record.serial };
+			for (int f = 0; f < (int)countof(fields); f++)
 			{
-				lua_settop(L, 0);
-				lua_getfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[hookType]);
-				lua_pushnil(L);
-				while (lua_next(L, -2))
-				{
-					if (lua_isfunction(L, -1))
-					{
-						unsigned int addr = lua_tointeger(L, -2);
-						hookedBytes.push_back(addr);
-					}
-					lua_pop(L, 1);
-				}
-				lua_settop(L, 0);
+				lua_newtable(L);
+				lua_setfield(L, batch.index, fields[f]);
 			}
+			lua_pushinteger(L, dropped);
+			lua_setfield(L, batch.index, "dropped");
+			iter = batches.insert(std::make_pair(record.ref, batch)).first;
 		}
-//		++iter;
-//	}
-	hookedRegions[hookType].Calculate(hookedBytes);
+
+		Batch &batch = iter->second;
+		batch.n++;
+		const unsigned int values[] = { record.address, record.size, record.value, record.pc, record.cycle };
+		for (int f = 0; f < (int)countof(fields); f++)
+		{
+			lua_getfield(L, batch.index, fields[f]);
+			lua_pushinteger(L, values[f]);
+			lua_rawseti(L, -2, batch.n);
+			lua_pop(L, 1);
+		}
+	}
+
+	for (std::map<int, Batch>::iterator iter = batches.begin(); iter != batches.end(); ++iter)
+	{
+		lua_pushinteger(L, iter->second.n);
+		lua_setfield(L, iter->second.index, "n");
+
+		// skip callbacks that were unregistered in the meantime, or whose reference
+		// an earlier callback of this frame has released and registered again
+		bool registered = false;
+		for (int i = 0; i < LUAMEMHOOK_COUNT; i++)
+			registered |= batchedRegions[i].HasRef(iter->first);
+		if (!registered || batchedHookSerials[iter->first] != iter->second.serial)
+			continue;
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, iter->first);
+		lua_pushvalue(L, iter->second.index);
+		bool wasRunning = (luaRunning != 0);
+		luaRunning = true;
+		int errorcode = lua_pcall(L, 1, 0, 0);
+		luaRunning = wasRunning;
+		if (errorcode)
+		{
+			HandleCallbackError(L);
+			return; // the script may have been stopped
+		}
+	}
+	lua_settop(L, 0);
 }
 
 static void CallRegisteredLuaMemHook_LuaMatch(unsigned int address, int size, unsigned int value, LuaMemHookType hookType)
@@ -1232,13 +1412,13 @@ static void CallRegisteredLuaMemHook_LuaMatch(unsigned int address, int size, un
 			infoStack.insert(infoStack.begin(), &info);
 			struct Scope { ~Scope(){ infoStack.erase(infoStack.begin()); } } scope;
 #endif
-			lua_settop(L, 0);
-			lua_getfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[hookType]);
-			for (int i = address; i != address + size; i++)
+			for (unsigned int i = address; i != address + size; i++)
 			{
-				lua_rawgeti(L, -1, i);
-				if (lua_isfunction(L, -1))
+				int ref = hookedRegions[hookType].Find(i);
+				if (ref != LUA_NOREF)
 				{
+					lua_settop(L, 0);
+					lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
 					bool wasRunning = (luaRunning != 0) /*info.running*/;
 					luaRunning /*info.running*/ = true;
 					//RefreshScriptSpeedStatus();
@@ -1255,10 +1435,6 @@ static void CallRegisteredLuaMemHook_LuaMatch(unsigned int address, int size, un
 					}
 					break;
 				}
-				else
-				{
-					lua_pop(L, 1);
-				}
 			}
 			lua_settop(L, 0);
 		}
@@ -1283,9 +1459,32 @@ void CallRegisteredLuaMemHook(unsigned int address, int size, unsigned int value
 			CallRegisteredLuaMemHook_LuaMatch(address, size, value, hookType);  // something has hooked this
 																				// specific address
 	}
+	if (batchedRegions[hookType].NotEmpty())
+	{
+		if (batchedRegions[hookType].Contains(address, size))
+			QueueBatchedMemHook(address, size, value, hookType);
+	}
+}
+
+// lets the CPU cores pick a hook-free execution loop
+bool VBALuaHasMemHook(LuaMemHookType hookType)
+{
+	return hookedRegions[hookType].NotEmpty() || batchedRegions[hookType].NotEmpty();
+}
+
+static void ClearMemHooks(lua_State *L)
+{
+	for (int i = 0; i < LUAMEMHOOK_COUNT; i++)
+	{
+		hookedRegions[i].Clear(L);
+		batchedRegions[i].Clear(L);
+	}
+	/*info.*/ numMemHooks = 0;
+	ClearBatchedMemHookQueue();
+	batchedHookSerials.clear();
 }
 
-static int memory_registerHook(lua_State *L, LuaMemHookType hookType, int defaultSize)
+static int memory_registerHook(lua_State *L, LuaMemHookType hookType, int defaultSize, bool batched = false)
 {
 	// get first argument: address
 	unsigned int addr = luaL_checkinteger(L, 1);
@@ -1312,33 +1511,30 @@ static int memory_registerHook(lua_State *L, LuaMemHookType hookType, int defaul
 		luaL_checktype(L, funcIdx, LUA_TFUNCTION);
 	lua_settop(L, funcIdx);
 
-	// get the address-to-callback table for this hook type of the current script
-	lua_getfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[hookType]);
+	// one registry reference is shared by all the bytes this call hooks
+	int ref = LUA_NOREF;
+	if (!clearing && size > 0)
+	{
+		ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		if (batched)
+			batchedHookSerials[ref] = ++batchedHookSerial;
+	}
 
-	// count how many callback functions we'll be displacing
+	// put the callback function in the address slots,
+	// counting how many callback functions we'll be displacing
+	MemHookIndex &regions = batched ? batchedRegions[hookType] : hookedRegions[hookType];
 	int numFuncsAfter  = clearing ? 0 : size;
 	int numFuncsBefore = 0;
 	for (unsigned int i = addr; i != addr + size; i++)
 	{
-		lua_rawgeti(L, -1, i);
-		if (lua_isfunction(L, -1))
+		if (regions.Set(L, i, ref))
 			numFuncsBefore++;
-		lua_pop(L, 1);
-	}
-
-	// put the callback function in the address slots
-	for (unsigned int i = addr; i != addr + size; i++)
-	{
-		lua_pushvalue(L, -2);
-		lua_rawseti(L, -2, i);
 	}
 
 	// adjust the count of active hooks
 	//LuaContextInfo& info = GetCurrentInfo();
-	/*info.*/ numMemHooks += numFuncsAfter - numFuncsBefore;
-
-	// re-cache regions of hooked memory across all scripts
-	CalculateMemHookRegions(hookType);
+	if (!batched)
+		/*info.*/ numMemHooks += numFuncsAfter - numFuncsBefore;
 
 	//StopScriptIfFinished(luaStateToUIDMap[L]);
 	return 0;
@@ -1396,6 +1592,21 @@ static int memory_registerexec(lua_State *L)
 	return memory_registerHook(L, MatchHookTypeToCPU(L, LUAMEMHOOK_EXEC), 1);
 }
 
+static int memory_registerwrite_batched(lua_State *L)
+{
+	return memory_registerHook(L, MatchHookTypeToCPU(L, LUAMEMHOOK_WRITE), 1, true);
+}
+
+static int memory_registerread_batched(lua_State *L)
+{
+	return memory_registerHook(L, MatchHookTypeToCPU(L, LUAMEMHOOK_READ), 1, true);
+}
+
+static int memory_registerexec_batched(lua_State *L)
+{
+	return memory_registerHook(L, MatchHookTypeToCPU(L, LUAMEMHOOK_EXEC), 1, true);
+}
+
 //int vba.lagcount
 //
 
@@ -1602,6 +1813,155 @@ static int memory_readbyterange(lua_State *L)
 	return 1;
 }
 
+// Copies length bytes from or to the emulated address space, one contiguous run of the memory map
+// at a time, the way the quick accessors above see it.
+static void memory_copyblock(u32 address, u8 *data, int length, bool write)
+{
+	while (length > 0)
+	{
+		int run;
+		if (systemIsRunningGBA())
+		{
+			MemoryMap &map	  = memoryMap[address >> 24];
+			u32		   offset = address & map.mask;
+			run = map.mask + 1 - offset;
+			if (run <= 0 || run > 0x1000000 - (int)(address & 0xFFFFFF))
+				run = 0x1000000 - (address & 0xFFFFFF);
+			if (run > length)
+				run = length;
+
+			if (write)
+			{
+				memcpy(&map.address[offset], data, run);
+#ifdef USE_GBA_CORE_V7
+				CPUMarkDirtyRun(address, run);
+#else
+				CPUMemoryBlockWritten(address, run);
+#endif
+			}
+			else
+				memcpy(data, &map.address[offset], run);
+		}
+		else
+		{
+			u16 addr = (u16)address;
+			run = 0x1000 - (addr & 0xfff);
+			if (addr < 0xfe00 && addr + run > 0xfe00)
+				run = 0xfe00 - addr;	// echo RAM ends inside the page
+			if (run > length)
+				run = length;
+
+			u16 mapped = gbMemoryQuickAddress(addr);
+			u8 *page   = gbMemoryMap[mapped >> 12];
+			if (page == NULL)
+			{
+				if (!write)
+					memset(data, 0, run);
+			}
+			else if (write)
+				memcpy(&page[mapped & 0xfff], data, run);
+			else
+				memcpy(data, &page[mapped & 0xfff], run);
+		}
+
+		address += run;
+		data	+= run;
+		length	-= run;
+	}
+}
+
+// the block functions share one buffer rather than allocating per call; a block is at most
+// as large as the biggest region of the address space, a ROM mirror
+#define MEMORY_BLOCK_MAX 0x1000000
+
+static std::vector<u8> memoryBlockBuffer;
+
+static u8 *memory_readblockbuffer(u32 address, int length)
+{
+	if ((int)memoryBlockBuffer.size() < length)
+		memoryBlockBuffer.resize(length);
+	u8 *data = memoryBlockBuffer.empty() ? NULL : &memoryBlockBuffer[0];
+	memory_copyblock(address, data, length, false);
+	return data;
+}
+
+// memory.readblock(address, length) returns the bytes as a string
+static int memory_readblock(lua_State *L)
+{
+	uint32 address = luaL_checkinteger(L, 1);
+	int	   length  = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, length >= -MEMORY_BLOCK_MAX && length <= MEMORY_BLOCK_MAX, 2, "block too large");
+
+	if (length < 0)
+	{
+		address += length;
+		length	 = -length;
+	}
+
+	u8 *data = memory_readblockbuffer(address, length);
+	lua_pushlstring(L, (const char *)data, length);
+	return 1;
+}
+
+// memory.readwordrange(address, count) and readdwordrange return a (1-based) array of count values
+static int memory_readvaluerange(lua_State *L, int valueSize)
+{
+	uint32 address = luaL_checkinteger(L, 1);
+	int	   count   = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, count <= MEMORY_BLOCK_MAX / valueSize, 2, "range too large");
+
+	if (count < 0)
+		count = 0;
+
+	u8 *data = memory_readblockbuffer(address, count * valueSize);
+
+	lua_createtable(L, count, 0);
+	for (int n = 1; n <= count; n++, data += valueSize)
+	{
+		if (valueSize == 2)
+			lua_pushinteger(L, READ16LE(data));
+		else
+		{
+			u32 value = READ32LE(data);
+			// lua_pushinteger doesn't work properly for 32bit system, does it?
+			if (value >= 0x80000000 && sizeof(int) <= 4)
+				lua_pushnumber(L, value);
+			else
+				lua_pushinteger(L, value);
+		}
+		lua_rawseti(L, -2, n);
+	}
+
+	return 1;
+}
+
+static int memory_readwordrange(lua_State *L)
+{
+	return memory_readvaluerange(L, 2);
+}
+
+static int memory_readdwordrange(lua_State *L)
+{
+	return memory_readvaluerange(L, 4);
+}
+
+// memory.writeblock(address, string) writes the bytes of the string
+static int memory_writeblock(lua_State *L)
+{
+	uint32		address = luaL_checkinteger(L, 1);
+	size_t		length;
+	const char *data = luaL_checklstring(L, 2, &length);
+	luaL_argcheck(L, length <= MEMORY_BLOCK_MAX, 2, "block too large");
+
+	if (length == 0)
+		return 0;
+
+	memory_copyblock(address, (u8 *)data, (int)length, true);
+
+	CallRegisteredLuaMemHook(address, (int)length, (u8)data[0], LUAMEMHOOK_WRITE);
+	return 0;
+}
+
 static int memory_writebyte(lua_State *L)
 {
 	u32 addr;
@@ -1822,6 +2182,53 @@ static int memory_gbromreadbyterange(lua_State *L)
 	return 1;
 }
 
+#define SNAPSHOT_TYPE "VBA.snapshot"
+
+// snapshot savestate.fork([snapshot])
+//
+// Saves the current state into an uncompressed in-memory snapshot, reusing the given one if any.
+// Restoring the snapshot the emulator was last forked from or restored to only copies back the memory
+// written since, so searches should branch from one snapshot for as long as they can.
+static int savestate_fork(lua_State *L)
+{
+	EmuSnapshot **snapshot;
+	if (lua_isnoneornil(L, 1))
+	{
+		snapshot  = (EmuSnapshot **)lua_newuserdata(L, sizeof(EmuSnapshot *));
+		*snapshot = snapshotCreate();
+		luaL_getmetatable(L, SNAPSHOT_TYPE);
+		lua_setmetatable(L, -2);
+	}
+	else
+	{
+		snapshot = (EmuSnapshot **)luaL_checkudata(L, 1, SNAPSHOT_TYPE);
+		lua_settop(L, 1);
+	}
+
+	if (*snapshot == NULL || !snapshotSave(*snapshot))
+		return luaL_error(L, "savestate.fork failed");
+
+	return 1;
+}
+
+// boolean savestate.restore(snapshot)
+static int savestate_restore(lua_State *L)
+{
+	EmuSnapshot **snapshot = (EmuSnapshot **)luaL_checkudata(L, 1, SNAPSHOT_TYPE);
+
+	lua_pushboolean(L, *snapshot != NULL && snapshotLoad(*snapshot));
+	return 1;
+}
+
+static int snapshot_gc(lua_State *L)
+{
+	EmuSnapshot **snapshot = (EmuSnapshot **)luaL_checkudata(L, 1, SNAPSHOT_TYPE);
+
+	snapshotDelete(*snapshot);
+	*snapshot = NULL;
+	return 0;
+}
+
 // vba.setthrottle(percent)
 static int vba_setthrottle(lua_State* L) {
   int pct = (int)luaL_checkinteger(L, 1);
@@ -1871,9 +2278,13 @@ static const struct luaL_reg memorylib[] = {
 	{ "readdword",				memory_readdword			},
 	{ "readdwordsigned",		memory_readdwordsigned		},
 	{ "readbyterange",			memory_readbyterange		},
+	{ "readwordrange",			memory_readwordrange		},
+	{ "readdwordrange",			memory_readdwordrange		},
+	{ "readblock",				memory_readblock			},
 	{ "writebyte",				memory_writebyte			},
 	{ "writeword",				memory_writeword			},
 	{ "writedword",				memory_writedword			},
+	{ "writeblock",				memory_writeblock			},
 	{ "getregister",			memory_getregister			},
 	{ "setregister",			memory_setregister			},
 	{ "gbromreadbyte",			memory_gbromreadbyte		},
@@ -1894,6 +2305,8 @@ static const struct luaL_reg memorylib[] = {
 	{ "readlong",				memory_readdword			},
 	{ "readlongunsigned",		memory_readdword			},
 	{ "readlongsigned",			memory_readdwordsigned		},
+	{ "readshortrange",			memory_readwordrange		},
+	{ "readlongrange",			memory_readdwordrange		},
 	{ "writeshort",				memory_writeword			},
 	{ "writelong",				memory_writedword			},
 	{ "gbromreadbyteunsigned",	memory_gbromreadbyte		},
@@ -1910,6 +2323,9 @@ static const struct luaL_reg memorylib[] = {
 	{ "registerwrite",	   memory_registerwrite			 },
 	{ "registerread",	   memory_registerread			 },
 	{ "registerexec",	   memory_registerexec			 },
+	{ "registerwrite_batched", memory_registerwrite_batched },
+	{ "registerread_batched",  memory_registerread_batched	},
+	{ "registerexec_batched",  memory_registerexec_batched	},
 	// alternate names
 	{ "register",		   memory_registerwrite			 },
 	{ "registerrun",	   memory_registerexec			 },
@@ -1936,6 +2352,8 @@ static const struct luaL_reg savestatelib[] = {
 	{ "create", savestate_create },
 	{ "save",	savestate_save	 },
 	{ "load",	savestate_load	 },
+	{ "fork",	savestate_fork	 },
+	{ "restore", savestate_restore },
 
 	{ NULL,		NULL			 }
 };
@@ -2049,6 +2467,11 @@ void VBALuaFrameBoundary(void)
 	if (!LUA || !luaRunning)
 		return;
 
+	// Hand over the memory accesses logged during the frame
+	DeliverBatchedMemHooks(LUA);
+	if (!LUA)
+		return;
+
 	// Our function needs calling
 	lua_settop(LUA, 0);
 	lua_getfield(LUA, LUA_REGISTRYINDEX, frameAdvanceThread);
@@ -2161,6 +2584,9 @@ int VBALoadLuaCode(const char *filename)
 		luaL_register(LUA, "sound", soundlib);
 		luaL_register(LUA, "bit", bit_funcs); // LuaBitOp library
 		luaL_register(LUA, "avi", avilib); // workaround for enhanced video encoding
+		luaL_newmetatable(LUA, SNAPSHOT_TYPE);
+		lua_pushcfunction(LUA, snapshot_gc);
+		lua_setfield(LUA, -2, "__gc");
 		lua_settop(LUA, 0); // clean the stack, because each call to luaL_register leaves a table on top
 
 		// register a few utility functions outside of libraries (in the global namespace)
@@ -2185,13 +2611,6 @@ int VBALoadLuaCode(const char *filename)
 		lua_pushcfunction(LUA, sfmt_randomseed);
 		lua_setfield(LUA, -2, "randomseed");
 		lua_settop(LUA, 0);
-
-		// push arrays for storing hook functions in
-		for (int i = 0; i < LUAMEMHOOK_COUNT; i++)
-		{
-			lua_newtable(LUA);
-			lua_setfield(LUA, LUA_REGISTRYINDEX, luaMemHookTypeStrings[i]);
-		}
 	}
 
 	// We make our thread NOW because we want it at the bottom of the stack.
@@ -2225,7 +2644,7 @@ int VBALoadLuaCode(const char *filename)
 	// Initialize settings
 	luaRunning = true;
 	skipRerecords = false;
-	numMemHooks = 0;
+	ClearMemHooks(NULL);
 	transparencyModifier = 255; // opaque
 	lua_joypads_used = 0; // not used
 	for (int i = 0; i < 4; ++i)
@@ -2300,9 +2719,7 @@ void VBALuaStop(void)
 	//execute the user's shutdown callbacks
 	CallExitFunction();
 
-	/*info.*/ numMemHooks = 0;
-	for (int i = 0; i < LUAMEMHOOK_COUNT; i++)
-		CalculateMemHookRegions((LuaMemHookType)i);
+	ClearMemHooks(LUA);
 
 	//sometimes iup uninitializes com
 	//MBG TODO - test whether this is really necessary. i dont think it is
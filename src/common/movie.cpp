@@ -40,6 +40,8 @@
 #include "inputGlobal.h"
 #include "Util.h"
 #include <algorithm>
+#include <vector>
+#include <map>
 
 #include "vbalua.h"
 
@@ -60,18 +62,43 @@
 
 using namespace std;
 
-SMovie Movie;
-bool   loadingMovie = false;
+EMU_STATE SMovie Movie;
+EMU_STATE bool   loadingMovie = false;
 
 // probably bad idea to have so many global variables, but I hate to recompile almost everything after editing VBA.h
 bool autoConvertMovieWhenPlaying = false;
 
-static u16 initialInputs[4] = { 0 };
+static EMU_STATE u16 initialInputs[4] = { 0 };
 
-static bool resetSignaled	  = false;
-static bool resetSignaledLast = false;
+static EMU_STATE bool resetSignaled	  = false;
+static EMU_STATE bool resetSignaledLast = false;
 
-static int prevEmulatorType, prevBorder, prevWinBorder, prevBorderAuto;
+static EMU_STATE int prevEmulatorType, prevBorder, prevWinBorder, prevBorderAuto;
+
+// chained hashes of every complete MOVIE_CHUNK_FRAMES block of the input buffer,
+// so savestates only have to compare the input they don't share with the movie
+struct MovieChunkHash
+{
+	uint32 crc;
+	uint32 adler;
+};
+
+static EMU_STATE_DYNAMIC vector<MovieChunkHash> movieChunks;
+
+// content-addressed copies of every chunk a savestate has referred to, keyed by their chained hashes
+// and kept in a file next to the movie, so the savestates don't have to carry them
+static EMU_STATE_DYNAMIC map<uint64, vector<uint8> > movieChunkStore;
+static EMU_STATE FILE *movieChunkFile = NULL;
+
+// the input of a savestate's movie block, with its complete chunks possibly left in the chunk store
+struct MovieSnapshotInput
+{
+	const uint8 *input;     // the whole input, if the block carries it
+	const uint8 *tail;      // otherwise the input after the complete chunks
+	uint32		 tailFrame;
+	vector<MovieChunkHash> chunks;
+	vector<const uint8 *>  chunkData;
+};
 
 // little-endian integer pop/push functions:
 static inline uint32 Pop32(const uint8 * &ptr)
@@ -170,6 +197,235 @@ static void reserve_movie_buffer_space(uint32 space_needed)
 	}
 }
 
+// forget the hashes of every chunk at or after the one holding the given frame
+static void invalidate_movie_chunks(uint32 frame)
+{
+	uint32 chunk = frame / MOVIE_CHUNK_FRAMES;
+	if (chunk < movieChunks.size())
+		movieChunks.resize(chunk);
+}
+
+// hash the complete chunks the cache doesn't cover yet
+static void update_movie_chunks()
+{
+	const uint32 chunkBytes = Movie.bytesPerFrame * MOVIE_CHUNK_FRAMES;
+	const uint32 numChunks	= Movie.header.length_frames / MOVIE_CHUNK_FRAMES;
+
+	while (movieChunks.size() < numChunks)
+	{
+		const uint32 k	   = (uint32)movieChunks.size();
+		const uint8 *data  = Movie.inputBuffer + k * chunkBytes;
+		MovieChunkHash hash;
+		hash.crc   = k ? movieChunks[k - 1].crc : (uint32)crc32(0L, Z_NULL, 0);
+		hash.adler = k ? movieChunks[k - 1].adler : (uint32)adler32(0L, Z_NULL, 0);
+		hash.crc   = (uint32)crc32(hash.crc, data, chunkBytes);
+		hash.adler = (uint32)adler32(hash.adler, data, chunkBytes);
+		movieChunks.push_back(hash);
+	}
+}
+
+static inline uint64 movie_chunk_key(const MovieChunkHash &hash)
+{
+	return ((uint64)hash.crc << 32) | hash.adler;
+}
+
+static void get_movie_chunk_file_name(char *buffer)
+{
+	sprintf(buffer, "%s.vbc", Movie.filename);
+}
+
+// open the movie's chunk store and load the chunks it holds, creating it only if asked to
+static bool open_movie_chunk_store(bool create)
+{
+	if (movieChunkFile)
+		return true;
+
+	if (Movie.filename[0] == '\0')
+		return false;
+
+	char name[SMovie::MAX_FILENAME_LENGTH + 4];
+	get_movie_chunk_file_name(name);
+
+	const uint32 chunkBytes = Movie.bytesPerFrame * MOVIE_CHUNK_FRAMES;
+	uint8		 header[3 * sizeof(uint32)];
+	const uint8 *ptr  = header;
+	FILE		*file = fopen(name, "rb+");
+	if (file)
+	{
+		if (fread(header, 1, sizeof(header), file) == sizeof(header)
+		    && Pop32(ptr) == MOVIE_CHUNK_MAGIC && Pop32(ptr) == MOVIE_CHUNK_FRAMES && Pop32(ptr) == Movie.bytesPerFrame)
+		{
+			// a record cut short by a failed write is dropped and overwritten by the next one
+			long		 end = ftell(file);
+			vector<uint8> data(chunkBytes);
+			uint8		 key[2 * sizeof(uint32)];
+			while (fread(key, 1, sizeof(key), file) == sizeof(key) && fread(&data[0], 1, chunkBytes, file) == chunkBytes)
+			{
+				MovieChunkHash hash;
+				ptr		   = key;
+				hash.crc   = Pop32(ptr);
+				hash.adler = Pop32(ptr);
+				movieChunkStore[movie_chunk_key(hash)] = data;
+				end = ftell(file);
+			}
+			fseek(file, end, SEEK_SET);
+		}
+		else
+		{
+			fclose(file);
+			file = NULL;
+		}
+	}
+
+	if (!file)
+	{
+		if (!create || !(file = fopen(name, "wb+")))
+			return false;
+
+		uint8 *out = header;
+		Push32(MOVIE_CHUNK_MAGIC, out);
+		Push32(MOVIE_CHUNK_FRAMES, out);
+		Push32(Movie.bytesPerFrame, out);
+		if (fwrite(header, 1, sizeof(header), file) != sizeof(header))
+		{
+			fclose(file);
+			return false;
+		}
+	}
+
+	movieChunkFile = file;
+	return true;
+}
+
+static void close_movie_chunk_store()
+{
+	if (movieChunkFile)
+	{
+		fclose(movieChunkFile);
+		movieChunkFile = NULL;
+	}
+	movieChunkStore.clear();
+}
+
+// put the leading complete chunks of the input into the chunk store, unless they are there already
+static bool store_movie_chunks(uint32 numChunks)
+{
+	if (!open_movie_chunk_store(true))
+		return false;
+
+	const uint32 chunkBytes = Movie.bytesPerFrame * MOVIE_CHUNK_FRAMES;
+	for (uint32 k = 0; k < numChunks; ++k)
+	{
+		const uint64 key = movie_chunk_key(movieChunks[k]);
+		if (movieChunkStore.find(key) != movieChunkStore.end())
+			continue;
+
+		const uint8 *data = Movie.inputBuffer + k * chunkBytes;
+		uint8		 record[2 * sizeof(uint32)];
+		uint8		*ptr = record;
+		Push32(movieChunks[k].crc, ptr);
+		Push32(movieChunks[k].adler, ptr);
+
+		fseek(movieChunkFile, 0, SEEK_END);
+		long end = ftell(movieChunkFile);
+		if (fwrite(record, 1, sizeof(record), movieChunkFile) != sizeof(record)
+		    || fwrite(data, 1, chunkBytes, movieChunkFile) != chunkBytes)
+		{
+			ftruncate(fileno(movieChunkFile), end);
+			return false;
+		}
+
+		movieChunkStore[key].assign(data, data + chunkBytes);
+	}
+
+	fflush(movieChunkFile);
+	return true;
+}
+
+static void push_movie_chunks(uint8 * &ptr, uint32 layout, uint32 numChunks)
+{
+	Push32(MOVIE_CHUNK_MAGIC, ptr);
+	Push32(layout, ptr);
+	Push32(MOVIE_CHUNK_FRAMES, ptr);
+	Push32(numChunks, ptr);
+	for (uint32 k = 0; k < numChunks; ++k)
+	{
+		Push32(movieChunks[k].crc, ptr);
+		Push32(movieChunks[k].adler, ptr);
+	}
+}
+
+// read a chunk hash table of the given layout, returns false if there is none
+static bool pop_movie_chunks(const uint8 * &ptr, uint32 size, uint32 layout, vector<MovieChunkHash> &chunks)
+{
+	if (size < 4 * sizeof(uint32))
+		return false;
+
+	const uint8 *table = ptr;
+	if (Pop32(table) != MOVIE_CHUNK_MAGIC || Pop32(table) != layout || Pop32(table) != MOVIE_CHUNK_FRAMES)
+		return false;
+
+	uint32 numChunks = Pop32(table);
+	if (numChunks > (size - 4 * sizeof(uint32)) / (2 * sizeof(uint32)))
+		return false;
+
+	chunks.resize(numChunks);
+	for (uint32 k = 0; k < numChunks; ++k)
+	{
+		chunks[k].crc	= Pop32(table);
+		chunks[k].adler = Pop32(table);
+	}
+
+	ptr = table;
+	return true;
+}
+
+// returns the number of leading frames a savestate's chunk hashes prove identical to the movie
+static uint32 match_movie_chunks(const vector<MovieChunkHash> &chunks)
+{
+	update_movie_chunks();
+
+	const uint32 numChunks = (uint32)min(chunks.size(), movieChunks.size());
+	uint32		 k		   = 0;
+	while (k < numChunks && chunks[k].crc == movieChunks[k].crc && chunks[k].adler == movieChunks[k].adler)
+		++k;
+
+	return k * MOVIE_CHUNK_FRAMES;
+}
+
+// returns the savestate's input at the given frame, or NULL if it lies in a chunk the store doesn't have
+static const uint8 *get_snapshot_frame(MovieSnapshotInput &snapshot, uint32 frame)
+{
+	if (snapshot.input)
+		return snapshot.input + Movie.bytesPerFrame * frame;
+
+	if (frame >= snapshot.tailFrame)
+		return snapshot.tail + Movie.bytesPerFrame * (frame - snapshot.tailFrame);
+
+	const uint32 k = frame / MOVIE_CHUNK_FRAMES;
+	if (!snapshot.chunkData[k])
+	{
+		open_movie_chunk_store(false);
+
+		const uint32 chunkBytes = Movie.bytesPerFrame * MOVIE_CHUNK_FRAMES;
+		map<uint64, vector<uint8> >::const_iterator it = movieChunkStore.find(movie_chunk_key(snapshot.chunks[k]));
+		if (it == movieChunkStore.end() || it->second.size() != chunkBytes)
+			return NULL;
+
+		// the stored data has to continue the savestate's own hash chain
+		const uint8 *data  = &it->second[0];
+		uint32		 crc   = k ? snapshot.chunks[k - 1].crc : (uint32)crc32(0L, Z_NULL, 0);
+		uint32		 adler = k ? snapshot.chunks[k - 1].adler : (uint32)adler32(0L, Z_NULL, 0);
+		if ((uint32)crc32(crc, data, chunkBytes) != snapshot.chunks[k].crc
+		    || (uint32)adler32(adler, data, chunkBytes) != snapshot.chunks[k].adler)
+			return NULL;
+
+		snapshot.chunkData[k] = data;
+	}
+
+	return snapshot.chunkData[k] + Movie.bytesPerFrame * (frame % MOVIE_CHUNK_FRAMES);
+}
+
 static int read_movie_header(FILE *file, SMovie &movie)
 {
 	assert(file != NULL);
@@ -276,17 +532,21 @@ static void flush_movie_header()
 	fseek(Movie.file, originalPos, SEEK_SET);
 }
 
-static void flush_movie_frames()
+static void flush_movie_frames(uint32 from_frame = 0)
 {
 	assert(Movie.file && "logical error!");
 	if (!Movie.file)
 		return;
 
+	if (from_frame > Movie.header.length_frames)
+		from_frame = Movie.header.length_frames;
+
 	long originalPos = ftell(Movie.file);
 
 	// overwrite the controller data
-	fseek(Movie.file, Movie.header.offset_to_controller_data, SEEK_SET);
-	fwrite(Movie.inputBuffer, 1, Movie.bytesPerFrame * Movie.header.length_frames, Movie.file);
+	fseek(Movie.file, Movie.header.offset_to_controller_data + Movie.bytesPerFrame * from_frame, SEEK_SET);
+	fwrite(Movie.inputBuffer + Movie.bytesPerFrame * from_frame, 1,
+	       Movie.bytesPerFrame * (Movie.header.length_frames - from_frame), Movie.file);
 
 	fflush(Movie.file);
 
@@ -326,7 +586,7 @@ static void preserve_movie_init_input()
 		}
 		else
 		{
-			extern int32 gbJoymask[4];
+			extern EMU_STATE int32 gbJoymask[4];
 			for (int i = 0; i < 4; ++i)
 				initialInputs[i] = u16(gbJoymask[i] & 0xFFFF);
 		}
@@ -354,6 +614,8 @@ static void fix_movie_old_reset(bool8 reset_last_frame)
 	// a compatibility burden
 	if (Movie.currentFrame < Movie.header.length_frames)
 	{
+		invalidate_movie_chunks(Movie.currentFrame);
+
 		const u8 OLD_RESET = u8(BUTTON_MASK_OLD_RESET >> 8);
 		for (int i = 0; i < MOVIE_NUM_OF_POSSIBLE_CONTROLLERS; ++i)
 		{
@@ -381,6 +643,7 @@ static void change_movie_state(MovieState new_state)
 		truncate_movie(Movie.header.length_frames);
 		fclose(Movie.file);
 		Movie.file = NULL;
+		close_movie_chunk_store();
 		Movie.currentFrame		  = 0;
 		Movie.unused			  = false;
 		Movie.RecordedNewRerecord = false;
@@ -569,6 +832,8 @@ void VBAMovieInit()
 
 	memset(&Movie, 0, sizeof(Movie));
 	Movie.state		 = MOVIE_STATE_NONE;
+	movieChunks.clear();
+	movieChunkStore.clear();
 	Movie.pauseFrame = -1;
 
 	resetSignaled	  = false;
@@ -585,7 +850,7 @@ void VBAMovieGetRomInfo(const SMovie &movieInfo, char romTitle [12], uint32 &rom
 {
 	if (systemCartridgeType == IMAGE_GBA) // GBA
 	{
-		extern u8 *rom;
+		extern EMU_STATE u8 *rom;
 		memcpy(romTitle, &rom[0xa0], 12); // GBA TITLE
 		memcpy(&romGameCode, &rom[0xac], 4); // GBA ROM GAME CODE
 		if ((movieInfo.header.optionFlags & MOVIE_SETTING_USEBIOSFILE) != 0)
@@ -596,7 +861,7 @@ void VBAMovieGetRomInfo(const SMovie &movieInfo, char romTitle [12], uint32 &rom
 	}
 	else // non-GBA
 	{
-		extern u8 *gbRom;
+		extern EMU_STATE u8 *gbRom;
 		memcpy(romTitle, &gbRom[0x134], 12); // GB TITLE (note this can be 15 but is truncated to 12)
 		romGameCode = (uint32)gbRom[0x146]; // GB ROM UNIT CODE
 
@@ -608,7 +873,7 @@ void VBAMovieGetRomInfo(const SMovie &movieInfo, char romTitle [12], uint32 &rom
 #ifdef SDL
 static void GetBatterySaveName(char *buffer)
 {
-	extern char batteryDir[2048], filename[2048];     // from SDL.cpp
+	extern EMU_STATE char batteryDir[2048], filename[2048];     // from SDL.cpp
 	extern char *sdlGetFilename(char *name);     // from SDL.cpp
 	if (batteryDir[0])
 		sprintf(buffer, "%s/%s.sav", batteryDir, sdlGetFilename(filename));
@@ -628,8 +893,10 @@ static void SetPlayEmuSettings()
 	theApp.skipBiosIntro = (Movie.header.optionFlags & MOVIE_SETTING_SKIPBIOSINTRO) != 0;
 	theApp.useBiosFile	= (Movie.header.optionFlags & MOVIE_SETTING_USEBIOSFILE) != 0;
 #else
-	extern int	 saveType, sdlRtcEnable, sdlFlashSize;   // from SDL.cpp
-	extern bool8 useBios, skipBios, removeIntros;     // from SDL.cpp
+	extern EMU_STATE int32 saveType;
+	extern EMU_STATE int sdlRtcEnable, sdlFlashSize;   // from SDL.cpp
+	extern EMU_STATE bool8 useBios, skipBios;
+	extern EMU_STATE bool8 removeIntros;     // from SDL.cpp
 	useBios		 = (Movie.header.optionFlags & MOVIE_SETTING_USEBIOSFILE) != 0;
 	skipBios	 = (Movie.header.optionFlags & MOVIE_SETTING_SKIPBIOSINTRO) != 0;
 	removeIntros = false /*(Movie.header.optionFlags & MOVIE_SETTING_REMOVEINTROS) != 0*/;
@@ -854,6 +1121,7 @@ int VBAMovieOpen(const char *filename, bool8 read_only)
 	uint32 to_read = Movie.bytesPerFrame * Movie.header.length_frames;
 	reserve_movie_buffer_space(to_read);
 	fread(Movie.inputBuffer, 1, to_read, file);
+	invalidate_movie_chunks(0);
 
 	change_movie_state(MOVIE_STATE_PLAY);
 
@@ -900,8 +1168,9 @@ static void SetRecordEmuSettings()
 	Movie.header.saveType  = theApp.winSaveType;
 	Movie.header.flashSize = theApp.winFlashSize;
 #else
-	extern int	 saveType, sdlRtcEnable, sdlFlashSize;   // from SDL.cpp
-	extern bool8 useBios, skipBios;     // from SDL.cpp
+	extern EMU_STATE int32 saveType;
+	extern EMU_STATE int sdlRtcEnable, sdlFlashSize;   // from SDL.cpp
+	extern EMU_STATE bool8 useBios, skipBios;
 	if (useBios)
 		Movie.header.optionFlags |= MOVIE_SETTING_USEBIOSFILE;
 	if (skipBios)
@@ -1115,6 +1384,14 @@ int VBAMovieCreate(const char *filename, const char *authorInfo, uint8 startFlag
 	Movie.inputBufferPtr = Movie.inputBuffer;
 	Movie.currentFrame	 = 0;
 	Movie.readOnly		 = false;
+	invalidate_movie_chunks(0);
+
+	// a new movie starts with an empty chunk store
+	{
+		char chunkFileName[SMovie::MAX_FILENAME_LENGTH + 4];
+		get_movie_chunk_file_name(chunkFileName);
+		remove(chunkFileName);
+	}
 
 	change_movie_state(MOVIE_STATE_RECORD);
 
@@ -1402,6 +1679,7 @@ void VBAMovieWrite(int i, bool /*sensor*/)
 		return;      // not a controller we're recognizing
 
 	reserve_movie_buffer_space((uint32)((Movie.inputBufferPtr - Movie.inputBuffer) + Movie.bytesPerFrame * 2));
+	invalidate_movie_chunks(Movie.currentFrame);
 
 	if (Movie.header.controllerFlags & MOVIE_CONTROLLER(i))
 	{
@@ -1680,10 +1958,19 @@ int VBAMovieFreeze(uint8 * *buf, uint32 *size)
 	*buf  = NULL;
 	*size = 0;
 
+	// once the complete chunks are in the movie's chunk store, only their hashes and the input after them are saved;
+	// otherwise the whole input is, followed by the hashes, which older versions skip over
+	update_movie_chunks();
+	const uint32 numChunks	= (uint32)movieChunks.size();
+	const bool	 shared		= numChunks > 0 && store_movie_chunks(numChunks);
+	const uint32 inputFrame = shared ? numChunks * MOVIE_CHUNK_FRAMES : 0;
+
 	// compute size needed for the buffer
 	// room for header.uid, currentFrame, and header.length_frames
 	uint32 size_needed = sizeof(Movie.header.uid) + sizeof(Movie.currentFrame) + sizeof(Movie.header.length_frames);
-	size_needed += (uint32)(Movie.bytesPerFrame * Movie.header.length_frames);
+	size_needed += (uint32)(Movie.bytesPerFrame * (Movie.header.length_frames - inputFrame));
+	if (numChunks > 0)
+		size_needed += 4 * sizeof(uint32) + numChunks * sizeof(MovieChunkHash);
 	*buf		 = new uint8[size_needed];
 	*size		 = size_needed;
 
@@ -1697,7 +1984,14 @@ int VBAMovieFreeze(uint8 * *buf, uint32 *size)
 	Push32(Movie.currentFrame, ptr);
 	Push32(Movie.header.length_frames - 1, ptr);   // HACK: shorten the length by 1 for backward compatibility
 
-	memcpy(ptr, Movie.inputBuffer, Movie.bytesPerFrame * Movie.header.length_frames);
+	if (shared)
+		push_movie_chunks(ptr, MOVIE_CHUNK_SHARED, numChunks);
+
+	memcpy(ptr, Movie.inputBuffer + Movie.bytesPerFrame * inputFrame, Movie.bytesPerFrame * (Movie.header.length_frames - inputFrame));
+	ptr += Movie.bytesPerFrame * (Movie.header.length_frames - inputFrame);
+
+	if (!shared && numChunks > 0)
+		push_movie_chunks(ptr, MOVIE_CHUNK_TRAILER, numChunks);
 
 	return MOVIE_SUCCESS;
 }
@@ -1725,8 +2019,33 @@ int VBAMovieUnfreeze(const uint8 *buf, uint32 size)
 	if (movie_id != Movie.header.uid)
 		return MOVIE_NOT_FROM_THIS_MOVIE;
 
-	if (space_needed > size - headerSize)
-		return MOVIE_WRONG_FORMAT;
+	MovieSnapshotInput snapshot;
+	snapshot.input	   = NULL;
+	snapshot.tail	   = NULL;
+	snapshot.tailFrame = 0;
+	if (space_needed <= size - headerSize)
+	{
+		// the whole input, possibly followed by the hashes of its complete chunks
+		const uint8 *trailer = ptr + space_needed;
+		pop_movie_chunks(trailer, size - headerSize - space_needed, MOVIE_CHUNK_TRAILER, snapshot.chunks);
+		snapshot.input = ptr;
+	}
+	else
+	{
+		// the hashes of the complete chunks, followed by the input after them
+		if (!pop_movie_chunks(ptr, size - headerSize, MOVIE_CHUNK_SHARED, snapshot.chunks))
+			return MOVIE_WRONG_FORMAT;
+
+		snapshot.tail	   = ptr;
+		snapshot.tailFrame = (uint32)snapshot.chunks.size() * MOVIE_CHUNK_FRAMES;
+		if (snapshot.tailFrame > input_frames
+		    || Movie.bytesPerFrame * (input_frames - snapshot.tailFrame) > size - (uint32)(ptr - buf))
+			return MOVIE_WRONG_FORMAT;
+	}
+	snapshot.chunkData.assign(snapshot.chunks.size(), (const uint8 *)NULL);
+
+	// whole chunks with matching hashes need neither a frame by frame comparison nor a copy
+	const uint32 unchanged = min(match_movie_chunks(snapshot.chunks), input_frames - input_frames % MOVIE_CHUNK_FRAMES);
 
 	if (Movie.readOnly)
 	{
@@ -1744,9 +2063,15 @@ int VBAMovieUnfreeze(const uint8 *buf, uint32 size)
 			return MOVIE_UNVERIFIABLE_POST_END;
 		}
 
-		for (uint32 i = 0; i < length_history; ++i)
+		for (uint32 i = unchanged; i < length_history; ++i)
 		{
-			if (memcmp(Movie.inputBuffer + i * Movie.bytesPerFrame, ptr + i * Movie.bytesPerFrame, Movie.bytesPerFrame))
+			const uint8 *frame = get_snapshot_frame(snapshot, i);
+			if (!frame)
+			{
+				Movie.errorInfo = i;
+				return MOVIE_INPUT_MISSING_AT;
+			}
+			if (memcmp(Movie.inputBuffer + i * Movie.bytesPerFrame, frame, Movie.bytesPerFrame))
 			{
 				Movie.errorInfo = i;
 				return MOVIE_TIMELINE_INCONSISTENT_AT;
@@ -1763,17 +2088,34 @@ int VBAMovieUnfreeze(const uint8 *buf, uint32 size)
 		// here, we are going to take the input data from the savestate
 		// and make it the input data for the current movie, then continue
 		// writing new input data at the currentFrame pointer
+		// the chunks it doesn't share with the movie have to be found before anything is changed
+		for (uint32 i = unchanged; i < snapshot.tailFrame; i += MOVIE_CHUNK_FRAMES)
+		{
+			if (!get_snapshot_frame(snapshot, i))
+			{
+				Movie.errorInfo = i;
+				return MOVIE_INPUT_MISSING_AT;
+			}
+		}
+
 		Movie.currentFrame		   = current_frame;
 		Movie.header.length_frames = input_frames;
 
 		// do this before calling reserve_movie_buffer_space()
 		Movie.inputBufferPtr = Movie.inputBuffer + Movie.bytesPerFrame * min(current_frame, Movie.header.length_frames);
 		reserve_movie_buffer_space(space_needed);
-		memcpy(Movie.inputBuffer, ptr, space_needed);
+		// the input both already agree on is neither copied nor rewritten to the file
+		for (uint32 i = unchanged; i < input_frames; )
+		{
+			uint32 frames = i < snapshot.tailFrame ? MOVIE_CHUNK_FRAMES - i % MOVIE_CHUNK_FRAMES : input_frames - i;
+			memcpy(Movie.inputBuffer + Movie.bytesPerFrame * i, get_snapshot_frame(snapshot, i), Movie.bytesPerFrame * frames);
+			i += frames;
+		}
+		invalidate_movie_chunks(unchanged);
 
 		// for consistency, no auto movie conversion here since we don't auto convert the corresponding savestate
 		flush_movie_header();
-		flush_movie_frames();
+		flush_movie_frames(unchanged);
 
 		change_movie_state(MOVIE_STATE_RECORD);
 	}
@@ -1954,6 +2296,7 @@ int VBAMovieConvertCurrent(bool force)
 	}
 
 	Movie.header.minorVersion = VBM_REVISION;
+	invalidate_movie_chunks(0);
 
 	if (Movie.header.length_frames == 0) // this could happen
 	{
@@ -2022,6 +2365,7 @@ int VBAMovieInsertFrames(uint32 num)
 	uint32 numRemaining = Movie.header.length_frames - Movie.currentFrame;
 	Movie.header.length_frames = newLength;
 
+	invalidate_movie_chunks(Movie.currentFrame);
 	fix_movie_old_reset(false);
 	memmove(Movie.inputBufferPtr + num * Movie.bytesPerFrame, Movie.inputBufferPtr, numRemaining * Movie.bytesPerFrame);
 	memset(Movie.inputBufferPtr, 0, num * Movie.bytesPerFrame);
@@ -2052,6 +2396,7 @@ int VBAMovieDeleteFrames(uint32 num)
 		num = numRemaining;
 	}
 	Movie.header.length_frames -= num;
+	invalidate_movie_chunks(Movie.currentFrame);
 	memmove(Movie.inputBufferPtr, Movie.inputBufferPtr + num * Movie.bytesPerFrame, (numRemaining - num) * Movie.bytesPerFrame);
 	fix_movie_old_reset(resetSignaledLast);
 
@@ -28,6 +28,7 @@
 #  define MOVIE_UNRECORDED_INPUT (-7)
 #  define MOVIE_SAME_VERSION (-8)
 #  define MOVIE_TIMELINE_INCONSISTENT_AT (-9)
+#  define MOVIE_INPUT_MISSING_AT (-10)
 #  define MOVIE_FATAL_ERROR (-32768)
 #  define MOVIE_UNKNOWN_ERROR (-2147483647 - 1)
 #endif
@@ -38,6 +39,10 @@
 #define CONTROLLER_DATA_SIZE (2)
 #define BUFFER_GROWTH_SIZE (4096)
 #define MOVIE_METADATA_SIZE (192)
+#define MOVIE_CHUNK_MAGIC (0x434D4256) // VBMC, input chunk hashes in the movie block of a savestate
+#define MOVIE_CHUNK_TRAILER (1)         // the hashes follow the whole input
+#define MOVIE_CHUNK_SHARED (2)          // the hashes stand in for the complete chunks, kept in the movie's chunk store
+#define MOVIE_CHUNK_FRAMES (4096)
 #define MOVIE_METADATA_AUTHOR_SIZE (64)
 
 // revision 1 uses (?) insted of (!) as reset
@@ -33,6 +33,7 @@ enum LuaMemHookType
 	LUAMEMHOOK_COUNT
 };
 void CallRegisteredLuaMemHook(unsigned int address, int size, unsigned int value, LuaMemHookType hookType);
+bool VBALuaHasMemHook(LuaMemHookType hookType);
 
 enum LuaJoypadType
 {
@@ -2812,6 +2812,8 @@ bool gbReadSaveStateFromStream(gzFile gzFile)
 					sprintf(errStr, "%s;\nSnapshot unverifiable with movie after End Frame %u", errStr, VBAMovieGetLastErrorInfo()); break;
 				case MOVIE_TIMELINE_INCONSISTENT_AT:
 					sprintf(errStr, "%s;\nSnapshot inconsistent with movie at Frame %u", errStr, VBAMovieGetLastErrorInfo()); break;
+				case MOVIE_INPUT_MISSING_AT:
+					sprintf(errStr, "%s;\nSnapshot input from Frame %u missing from the movie's chunk store", errStr, VBAMovieGetLastErrorInfo()); break;
 				case MOVIE_WRONG_FORMAT:
 					strcat(errStr, ";\nWrong format"); break;
 				}
@@ -3775,6 +3777,10 @@ struct EmulatedSystem GBSystem =
 	gbReadMemSaveState,
 	// emuWriteMemState
 	gbWriteMemSaveState,
+	// emuWriteSnapshot
+	NULL,
+	// emuReadSnapshot
+	NULL,
 	// emuWritePNG
 	gbWritePNGFile,
 	// emuWriteBMP
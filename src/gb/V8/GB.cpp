@@ -27,177 +27,185 @@ enum
 };
 
 bool gbUpdateSizes();
-bool inBios = false;
+EMU_STATE bool inBios = false;
 
 // debugging
-bool memorydebug = false;
-char gbBuffer[2048];
+EMU_STATE bool memorydebug = false;
+EMU_STATE char gbBuffer[2048];
 
-extern u16 gbLineMix[160];
+extern EMU_STATE u16 gbLineMix[160];
 
 // mappers
-void (*mapper)(u16, u8)		= NULL;
-void (*mapperRAM)(u16, u8)	= NULL;
-u8	 (*mapperReadRAM)(u16)	= NULL;
-void (*mapperUpdateClock)() = NULL;
+EMU_STATE void (*mapper)(u16, u8)		= NULL;
+EMU_STATE void (*mapperRAM)(u16, u8)	= NULL;
+EMU_STATE u8	 (*mapperReadRAM)(u16)	= NULL;
+EMU_STATE void (*mapperUpdateClock)() = NULL;
 
 // registers
-gbRegister PC;
-gbRegister SP;
-gbRegister AF;
-gbRegister BC;
-gbRegister DE;
-gbRegister HL;
-u16		   IFF = 0;
+EMU_STATE gbRegister PC;
+EMU_STATE gbRegister SP;
+EMU_STATE gbRegister AF;
+EMU_STATE gbRegister BC;
+EMU_STATE gbRegister DE;
+EMU_STATE gbRegister HL;
+EMU_STATE u16		   IFF = 0;
 // 0xff04
-u8 register_DIV = 0;
+EMU_STATE u8 register_DIV = 0;
 // 0xff05
-u8 register_TIMA = 0;
+EMU_STATE u8 register_TIMA = 0;
 // 0xff06
-u8 register_TMA = 0;
+EMU_STATE u8 register_TMA = 0;
 // 0xff07
-u8 register_TAC = 0;
+EMU_STATE u8 register_TAC = 0;
 // 0xff0f
-u8 register_IF = 0;
+EMU_STATE u8 register_IF = 0;
 // 0xff40
-u8 register_LCDC = 0;
+EMU_STATE u8 register_LCDC = 0;
 // 0xff41
-u8 register_STAT = 0;
+EMU_STATE u8 register_STAT = 0;
 // 0xff42
-u8 register_SCY = 0;
+EMU_STATE u8 register_SCY = 0;
 // 0xff43
-u8 register_SCX = 0;
+EMU_STATE u8 register_SCX = 0;
 // 0xff44
-u8 register_LY = 0;
+EMU_STATE u8 register_LY = 0;
 // 0xff45
-u8 register_LYC = 0;
+EMU_STATE u8 register_LYC = 0;
 // 0xff46
-u8 register_DMA = 0;
+EMU_STATE u8 register_DMA = 0;
 // 0xff4a
-u8 register_WY = 0;
+EMU_STATE u8 register_WY = 0;
 // 0xff4b
-u8 register_WX = 0;
+EMU_STATE u8 register_WX = 0;
 // 0xff4f
-u8 register_VBK = 0;
+EMU_STATE u8 register_VBK = 0;
 // 0xff51
-u8 register_HDMA1 = 0;
+EMU_STATE u8 register_HDMA1 = 0;
 // 0xff52
-u8 register_HDMA2 = 0;
+EMU_STATE u8 register_HDMA2 = 0;
 // 0xff53
-u8 register_HDMA3 = 0;
+EMU_STATE u8 register_HDMA3 = 0;
 // 0xff54
-u8 register_HDMA4 = 0;
+EMU_STATE u8 register_HDMA4 = 0;
 // 0xff55
-u8 register_HDMA5 = 0;
+EMU_STATE u8 register_HDMA5 = 0;
 // 0xff70
-u8 register_SVBK = 0;
+EMU_STATE u8 register_SVBK = 0;
 // 0xffff
-u8 register_IE = 0;
+EMU_STATE u8 register_IE = 0;
 
 // ticks definition
-int32 GBDIV_CLOCK_TICKS = 64;
-int32 GBLCD_MODE_0_CLOCK_TICKS	 = 51;
-int32 GBLCD_MODE_1_CLOCK_TICKS	 = 1140;
-int32 GBLCD_MODE_2_CLOCK_TICKS	 = 20;
-int32 GBLCD_MODE_3_CLOCK_TICKS	 = 43;
-int32 GBLY_INCREMENT_CLOCK_TICKS = 114;
-int32 GBTIMER_MODE_0_CLOCK_TICKS = 256;
-int32 GBTIMER_MODE_1_CLOCK_TICKS = 4;
-int32 GBTIMER_MODE_2_CLOCK_TICKS = 16;
-int32 GBTIMER_MODE_3_CLOCK_TICKS = 64;
-int32 GBSERIAL_CLOCK_TICKS		 = 128;
+EMU_STATE int32 GBDIV_CLOCK_TICKS = 64;
+EMU_STATE int32 GBLCD_MODE_0_CLOCK_TICKS	 = 51;
+EMU_STATE int32 GBLCD_MODE_1_CLOCK_TICKS	 = 1140;
+EMU_STATE int32 GBLCD_MODE_2_CLOCK_TICKS	 = 20;
+EMU_STATE int32 GBLCD_MODE_3_CLOCK_TICKS	 = 43;
+EMU_STATE int32 GBLY_INCREMENT_CLOCK_TICKS = 114;
+EMU_STATE int32 GBTIMER_MODE_0_CLOCK_TICKS = 256;
+EMU_STATE int32 GBTIMER_MODE_1_CLOCK_TICKS = 4;
+EMU_STATE int32 GBTIMER_MODE_2_CLOCK_TICKS = 16;
+EMU_STATE int32 GBTIMER_MODE_3_CLOCK_TICKS = 64;
+EMU_STATE int32 GBSERIAL_CLOCK_TICKS		 = 128;
 int32 GBSYNCHRONIZE_CLOCK_TICKS	 = 52920;
 
 // state variables
 // general
-int32 gbClockTicks = 0;
-bool8 gbSystemMessage		= false;
-int32 gbGBCColorType		= 0;
-int32 gbRomType				= 0;
-int32 gbRemainingClockTicks = 0;
-int32 gbOldClockTicks		= 0;
-int32 gbIntBreak			= 0;
-int32 gbInterruptLaunched	= 0;
-u8	 gbCheatingDevice		= 0; // 1 = GS, 2 = GG
+EMU_STATE int32 gbClockTicks = 0;
+EMU_STATE bool8 gbSystemMessage		= false;
+EMU_STATE int32 gbGBCColorType		= 0;
+EMU_STATE int32 gbRomType				= 0;
+EMU_STATE int32 gbRemainingClockTicks = 0;
+EMU_STATE int32 gbOldClockTicks		= 0;
+EMU_STATE int32 gbIntBreak			= 0;
+EMU_STATE int32 gbInterruptLaunched	= 0;
+EMU_STATE u8	 gbCheatingDevice		= 0; // 1 = GS, 2 = GG
 // breakpoint
-bool8 breakpoint = false;
+EMU_STATE bool8 breakpoint = false;
 // interrupt
-int32 gbInt48Signal	= 0;
-int32 gbInterruptWait = 0;
+EMU_STATE int32 gbInt48Signal	= 0;
+EMU_STATE int32 gbInterruptWait = 0;
 // serial
-int32 gbSerialOn	= 0;
-int32 gbSerialTicks = 0;
-int32 gbSerialBits	= 0;
+EMU_STATE int32 gbSerialOn	= 0;
+EMU_STATE int32 gbSerialTicks = 0;
+EMU_STATE int32 gbSerialBits	= 0;
 // timer
-int32 gbTimerOn			= false;
-int32 gbTimerTicks		= GBTIMER_MODE_0_CLOCK_TICKS;
-int32 gbTimerClockTicks = GBTIMER_MODE_0_CLOCK_TICKS;
-int32 gbTimerMode		= 0;
-bool8 gbIncreased		= false;
+EMU_STATE int32 gbTimerOn			= false;
+EMU_STATE int32 gbTimerTicks		= 256;
+EMU_STATE int32 gbTimerClockTicks = 256;
+EMU_STATE int32 gbTimerMode		= 0;
+EMU_STATE bool8 gbIncreased		= false;
 // The internal timer is always active, and it is
 // not reset by writing to register_TIMA/TMA, but by
 // writing to register_DIV...
-int32 gbInternalTimer	= 0x55;
+EMU_STATE int32 gbInternalTimer	= 0x55;
 const u8 gbTimerMask[4] = { 0xff, 0x3, 0xf, 0x3f };
 const u8 gbTimerBug[8]	= { 0x80, 0x80, 0x02, 0x02, 0x0, 0xff, 0x0, 0xff };
-int32 gbTimerModeChange = false;
-int32 gbTimerOnChange	= false;
+EMU_STATE int32 gbTimerModeChange = false;
+EMU_STATE int32 gbTimerOnChange	= false;
 // lcd
-bool  gbScreenOn		= true;
-
-int32 gbLcdMode			= 2;
-int32 gbLcdModeDelayed	= 2;
-int32 gbLcdTicks		= GBLCD_MODE_2_CLOCK_TICKS - 1;
-int32 gbLcdTicksDelayed = GBLCD_MODE_2_CLOCK_TICKS;
-int32 gbLcdLYIncrementTicks		   = 114;
-int32 gbLcdLYIncrementTicksDelayed = 115;
-int32 gbScreenTicks				   = 0;
-u8	  gbSCYLine[300];
-u8	  gbSCXLine[300];
-u8	  gbBgpLine[300];
-u8	  gbObp0Line[300];
-u8	  gbObp1Line[300];
-u8	  gbSpritesTicks[300];
-int32 gbLYChangeHappened	= false;
-int32 gbLCDChangeHappened	= false;
-int32 gbLine99Ticks			= 1;
-int32 gbRegisterLYLCDCOffOn = 0;
-int32 inUseRegister_WX		= 0;
-int32 inUseRegister_WY		= 0;
+EMU_STATE bool  gbScreenOn		= true;
+
+EMU_STATE int32 gbLcdMode			= 2;
+EMU_STATE int32 gbLcdModeDelayed	= 2;
+EMU_STATE int32 gbLcdTicks		= 19;
+EMU_STATE int32 gbLcdTicksDelayed = 20;
+EMU_STATE int32 gbLcdLYIncrementTicks		   = 114;
+EMU_STATE int32 gbLcdLYIncrementTicksDelayed = 115;
+EMU_STATE int32 gbScreenTicks				   = 0;
+EMU_STATE u8	  gbSCYLine[300];
+EMU_STATE u8	  gbSCXLine[300];
+EMU_STATE u8	  gbBgpLine[300];
+EMU_STATE u8	  gbObp0Line[300];
+EMU_STATE u8	  gbObp1Line[300];
+EMU_STATE u8	  gbSpritesTicks[300];
+EMU_STATE int32 gbLYChangeHappened	= false;
+EMU_STATE int32 gbLCDChangeHappened	= false;
+EMU_STATE int32 gbLine99Ticks			= 1;
+EMU_STATE int32 gbRegisterLYLCDCOffOn = 0;
+EMU_STATE int32 inUseRegister_WX		= 0;
+EMU_STATE int32 inUseRegister_WY		= 0;
 
 // Used to keep track of the line that ellapse
 // when screen is off
-int32 gbWhiteScreen		= 0;
-bool8 gbBlackScreen		= false;
-int32 register_LCDCBusy = 0;
+EMU_STATE int32 gbWhiteScreen		= 0;
+EMU_STATE bool8 gbBlackScreen		= false;
+EMU_STATE int32 register_LCDCBusy = 0;
 
 // div
-int32 gbDivTicks = GBDIV_CLOCK_TICKS;
+EMU_STATE int32 gbDivTicks = 64;
 // cgb
-int32 gbVramBank		= 0;
-int32 gbWramBank		= 1;
+EMU_STATE int32 gbVramBank		= 0;
+EMU_STATE int32 gbWramBank		= 1;
 //sgb
-bool8 gbSgbResetFlag = false;
+EMU_STATE bool8 gbSgbResetFlag = false;
 // gbHdmaDestination is 0x99d0 on startup (tested on HW)
 // but I'm not sure what gbHdmaSource is...
-int32 gbHdmaSource		= 0x99d0;
-int32 gbHdmaDestination = 0x99d0;
-int32 gbHdmaBytes		= 0x0000;
-int32 gbHdmaOn			= 0;
-int32 gbSpeed			= 0;
+EMU_STATE int32 gbHdmaSource		= 0x99d0;
+EMU_STATE int32 gbHdmaDestination = 0x99d0;
+EMU_STATE int32 gbHdmaBytes		= 0x0000;
+EMU_STATE int32 gbHdmaOn			= 0;
+EMU_STATE int32 gbSpeed			= 0;
 // timing
-u32	  gbElapsedTime		 = 0;
-u32	  gbTimeNow			 = 0;
-int32 gbSynchronizeTicks = GBSYNCHRONIZE_CLOCK_TICKS;
+EMU_STATE u32	  gbElapsedTime		 = 0;
+EMU_STATE u32	  gbTimeNow			 = 0;
+EMU_STATE int32 gbSynchronizeTicks = 52920;
 // emulator features
-int32 gbBattery		 = 0;
-bool8 gbBatteryError = false;
-int32 gbJoymask[4]	 = { 0, 0, 0, 0 };
+EMU_STATE int32 gbBattery		 = 0;
+EMU_STATE bool8 gbBatteryError = false;
+EMU_STATE int32 gbJoymask[4]	 = { 0, 0, 0, 0 };
 
 // HACK
-static int32 stopCounter = 0; // this has to be saved
+static EMU_STATE int32 stopCounter = 0; // this has to be saved
 
-u8 gbRamFill = 0xff;
+// idle loop detection: the last backward jump of a short loop and the CPU state right after it
+#define GB_IDLE_LOOP_SIZE 0x40
+static EMU_STATE bool8 gbIdleLoopClean  = false;
+static EMU_STATE int32 gbIdleLoopBranch = -1;
+static EMU_STATE int32 gbIdleLoopTicks  = 0;
+static EMU_STATE int32 gbIdleLoopNext	  = 0;
+static EMU_STATE u16   gbIdleLoopReg[8];
+
+EMU_STATE u8 gbRamFill = 0xff;
 
 int32 gbRomSizes[] = { 0x00008000, // 32K
 	                 0x00010000, // 64K
@@ -1666,6 +1674,8 @@ void gbWriteMemoryWrapped(register u16 address, register u8 value)
 
 void gbWriteMemory(register u16 address, register u8 value)
 {
+	if (skipIdleLoopsTemp)
+		gbIdleLoopClean = false;
 	gbWriteMemoryWrapped(address, value);
 	CallRegisteredLuaMemHook(address, 1, value, LUAMEMHOOK_WRITE);
 }
@@ -2134,8 +2144,24 @@ u8 gbReadMemoryWrapped(register u16 address)
 	return gbMemoryMap[address >> 12][address & 0x0fff];
 }
 
+// VRAM, OAM, cartridge RAM and some registers depend on the exact tick or on the clock
+static inline void gbIdleLoopRead(u16 address)
+{
+	if (!skipIdleLoopsTemp)
+		return;
+	if ((address >= 0x8000 && address < 0xc000) || (address >= 0xfe00 && address < 0xfea0))
+		gbIdleLoopClean = false;
+	else if (address >= 0xff00 && address < 0xff80)
+	{
+		if ((address == 0xff00 && gbSgbMode) || address == 0xff04 || (address >= 0xff10 && address < 0xff40) ||
+		    (address == 0xff44 && gbLcdMode == 1) || address == 0xff69 || address == 0xff6b)
+			gbIdleLoopClean = false;
+	}
+}
+
 u8 gbReadMemory(register u16 address)
 {
+	gbIdleLoopRead(address);
 	u8 value = gbReadMemoryWrapped(address);
 	CallRegisteredLuaMemHook(address, 1, value, LUAMEMHOOK_READ);
 	return value;
@@ -3747,7 +3773,7 @@ static bool gbReadBatteryFromStream(gzFile gzfile)
 	return retVal;
 }
 
-variable_desc gbSaveGameStruct[] = {
+EMU_STATE_DYNAMIC variable_desc gbSaveGameStruct[] = {
 	{ &PC.W,					   sizeof(u16)	 },
 	{ &SP.W,					   sizeof(u16)	 },
 	{ &AF.W,					   sizeof(u16)	 },
@@ -4477,6 +4503,8 @@ static bool gbReadSaveStateFromStream(gzFile gzFile)
 					sprintf(errStr, "%s;\nSnapshot unverifiable with movie after End Frame %u", errStr, VBAMovieGetLastErrorInfo()); break;
 				case MOVIE_TIMELINE_INCONSISTENT_AT:
 					sprintf(errStr, "%s;\nSnapshot inconsistent with movie at Frame %u", errStr, VBAMovieGetLastErrorInfo()); break;
+				case MOVIE_INPUT_MISSING_AT:
+					sprintf(errStr, "%s;\nSnapshot input from Frame %u missing from the movie's chunk store", errStr, VBAMovieGetLastErrorInfo()); break;
 				case MOVIE_WRONG_FORMAT:
 					strcat(errStr, ";\nWrong format"); break;
 				}
@@ -4901,6 +4929,50 @@ int gbGetNextEvent(int _gbClockTicks)
 	return _gbClockTicks;
 }
 
+// code that is always read back the same
+static inline bool gbIdleLoopCode(u16 address)
+{
+	return address < 0x8000 || (address >= 0xc000 && address < 0xfe00) || address >= 0xff80;
+}
+
+// Called after a short backward jump.  If the CPU is back in the state it was in
+// after the previous pass, no event came in between, and that pass neither wrote
+// memory nor read anything that changes between events, every further pass would do
+// exactly the same until the next event.  Returns the ticks of the passes that end
+// before it, to be run at once.
+static int gbIdleLoopCheck(u16 branch, int ticksToStop)
+{
+	u16 state[8] = { AF.W, BC.W, DE.W, HL.W, SP.W, PC.W, IFF, (u16)gbSpeed };
+
+	// the next event, or anything else that is only counted down by the loop
+	int next = gbGetNextEvent(useOldFrameTiming ? ticksToStop : 0x7fffffff);
+	if (!(register_LCDC & 0x80) && !gbWhiteScreen && gbScreenTicks < next)
+		next = gbScreenTicks;
+	if (gbSgbPacketTimeout && gbSgbPacketTimeout < next)
+		next = gbSgbPacketTimeout;
+
+	int skip = 0;
+	if (branch == gbIdleLoopBranch && gbIdleLoopClean && !memcmp(state, gbIdleLoopReg, sizeof(state)) &&
+	    !(IFF & 0x38) && !gbInterruptWait && !gbInterruptLaunched && !gbIntBreak &&
+	    gbIdleLoopCode(branch) && gbIdleLoopCode(PC.W) &&
+	    !VBALuaHasMemHook(LUAMEMHOOK_READ) && !VBALuaHasMemHook(LUAMEMHOOK_WRITE))
+	{
+		int period = gbIdleLoopTicks - ticksToStop;
+		if (period > 0 && period < gbIdleLoopNext)
+			skip = (next - 1) / period * period;
+	}
+	else
+	{
+		gbIdleLoopBranch = branch;
+		memcpy(gbIdleLoopReg, state, sizeof(state));
+	}
+
+	gbIdleLoopTicks = ticksToStop - skip;
+	gbIdleLoopNext	= next - skip;
+	gbIdleLoopClean = true;
+	return skip;
+}
+
 static void gbDrawPixLine()
 {
 	switch (systemColorDepth)
@@ -4910,28 +4982,8 @@ static void gbDrawPixLine()
 		u16 *dest = (u16 *)pix +
 		            (gbBorderLineSkip + 2) * (register_LY + gbBorderRowSkip + 1)
 		            + gbBorderColumnSkip;
-		for (int x = 0; x < 160; )
-		{
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-			*dest++ = systemColorMap16[gbLineMix[x++]];
-		}
+		utilColorMapLine(dest, gbLineMix, 160);
+		dest += 160;
 		if (gbBorderOn)
 			dest += gbBorderColumnSkip;
 		*dest++ = 0; // for filters that read one pixel more
@@ -4987,28 +5039,7 @@ static void gbDrawPixLine()
 		u32 *dest = (u32 *)pix +
 		            (gbBorderLineSkip + 1) * (register_LY + gbBorderRowSkip + 1)
 		            + gbBorderColumnSkip;
-		for (int x = 0; x < 160; )
-		{
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-			*dest++ = systemColorMap32[gbLineMix[x++]];
-		}
+		utilColorMapLine(dest, gbLineMix, 160);
 		break;
 	}
 	}
@@ -5089,12 +5120,16 @@ void gbEmulate(int ticksToStop)
 
 	gbClockTicks = 0;
 	gbDmaTicks = 0;
+	gbIdleLoopBranch = -1;
 
 	int	 opcode1 = 0;
 	int	 opcode2 = 0;
 	bool execute = false;
 	bool newVideoFrame = false;
 
+	// exec hooks are looked up again on every LY increment
+	bool execHooks = VBALuaHasMemHook(LUAMEMHOOK_EXEC);
+
 	for (;;)
 	{
 #ifndef FINAL_VERSION
@@ -5156,7 +5191,8 @@ void gbEmulate(int ticksToStop)
 
 			register int opcode;
 			opcode2 = opcode1 = opcode = gbReadOpcode(PC.W);
-			CallRegisteredLuaMemHook(PC.W, 1, opcode, LUAMEMHOOK_EXEC);
+			if (execHooks)
+				CallRegisteredLuaMemHook(PC.W, 1, opcode, LUAMEMHOOK_EXEC);
 			PC.W++;
 
 			// If HALT state was launched while IME = 0 and (register_IF & register_IE & 0x1F),
@@ -5174,7 +5210,8 @@ void gbEmulate(int ticksToStop)
 			case 0xCB:
 				// extended opcode
 				opcode2 = opcode = gbReadOpcode(PC.W);
-				CallRegisteredLuaMemHook(PC.W, 1, opcode, LUAMEMHOOK_EXEC);	// is this desired?
+				if (execHooks)
+					CallRegisteredLuaMemHook(PC.W, 1, opcode, LUAMEMHOOK_EXEC);	// is this desired?
 				PC.W++;
 				gbClockTicks = gbCyclesCB[opcode];
 				break;
@@ -5272,6 +5309,7 @@ gbRedoLoop:
 				{
 					gbLYChangeHappened = true;
 					gbMemory[0xff44]   = register_LY = (register_LY + 1) % 154;
+					execHooks		   = VBALuaHasMemHook(LUAMEMHOOK_EXEC);
 
 					if (register_LY == 0x91)
 					{
@@ -5551,15 +5589,21 @@ gbRedoLoop:
 						{
 							if (!gbSgbMask)
 							{
-								if (!gbBlackScreen)
+								u64 renderStart = systemProfileBegin();
+
+								if (!systemFrameDrawingRequired())
 								{
-									gbRenderLine();
-									gbDrawSprites(true);
+									if (!gbBlackScreen)
+										gbSkipLine();
 								}
-
-								if (systemFrameDrawingRequired())
+								else
 								{
-									if (gbBlackScreen)
+									if (!gbBlackScreen)
+									{
+										gbRenderLine();
+										gbDrawSprites(true);
+									}
+									else
 									{
 										u16 color = gbColorOption ? gbColorFilter[0] : 0;
 										if (!gbCgbMode)
@@ -5572,6 +5616,8 @@ gbRedoLoop:
 									}
 									gbDrawPixLine();
 								}
+
+								systemProfileEnd(PROFILE_RENDER, renderStart);
 							}
 						}
 						gbLcdTicksDelayed += GBLCD_MODE_0_CLOCK_TICKS - gbSpritesTicks[299];
@@ -5760,7 +5806,9 @@ gbRedoLoop:
 
 		while (soundTicks < 0)
 		{
+			u64 soundStart = systemProfileBegin();
 			gbSoundTick();
+			systemProfileEnd(PROFILE_SOUND, soundStart);
 			soundTicks += soundTickStep;
 		}
 
@@ -5898,6 +5946,14 @@ gbRedoLoop:
 			goto gbRedoLoop;
 		}
 
+		// a short loop that only waits for the next event is run up to it at once
+		if (skipIdleLoopsTemp && !execHooks && !(IFF & 0x80) && (u16)(oldPCW - PC.W) <= GB_IDLE_LOOP_SIZE)
+		{
+			gbClockTicks = gbIdleLoopCheck(oldPCW, ticksToStop);
+			if (gbClockTicks)
+				goto gbRedoLoop;
+		}
+
 		gbBlackScreen = false;
 
 		if (useOldFrameTiming)
@@ -5956,6 +6012,10 @@ struct EmulatedSystem GBSystem =
 	gbReadMemSaveState,
 	// emuWriteMemState
 	gbWriteMemSaveState,
+	// emuWriteSnapshot
+	NULL,
+	// emuReadSnapshot
+	NULL,
 	// emuWritePNG
 	gbWritePNGFile,
 	// emuWriteBMP
@@ -6,9 +6,9 @@
 
 using namespace std;
 
-extern int32 layerSettings;
-extern int32 inUseRegister_WY;
-extern int32 inUseRegister_WX;
+extern EMU_STATE int32 layerSettings;
+extern EMU_STATE int32 inUseRegister_WY;
+extern EMU_STATE int32 inUseRegister_WX;
 
 u8 gbInvertTab[256] = {
 	0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
@@ -45,8 +45,8 @@ u8 gbInvertTab[256] = {
 	0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
 };
 
-u16 gbLineMix[160];
-u16 gbWindowColor[160];
+EMU_STATE u16 gbLineMix[160];
+EMU_STATE u16 gbWindowColor[160];
 
 void gbRenderLine()
 {
@@ -404,6 +404,23 @@ void gbRenderLine()
 	}
 }
 
+// keeps the state gbRenderLine() would for a line that isn't drawn
+void gbSkipLine()
+{
+	int y = register_LY;
+
+	if (y >= 144 || !(register_LCDC & 0x80))
+		return;
+
+	if ((register_LCDC & 0x01 || gbCgbMode) && (register_LCDC & 0x20) && y >= inUseRegister_WY)
+	{
+		if (gbWindowLine == -2)
+			gbWindowLine = 0;
+		else if (inUseRegister_WX - 7 <= 159 && gbWindowLine <= 143 && gbWindowLine >= 0)
+			gbWindowLine++;
+	}
+}
+
 void gbDrawSpriteTile(int tile, int x, int y, int t, int flags,
                       int size, int spriteNumber)
 {
@@ -5,12 +5,12 @@
 #include "../../common/System.h"
 #include "../../common/movie.h"
 
-u8				  gbDaysinMonth [12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+EMU_STATE u8				  gbDaysinMonth [12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
 const u8		  gbDisabledRam [8] = { 0x80, 0xff, 0xf0, 0x00, 0x30, 0xbf, 0xbf, 0xbf };
-extern int		  gbGBCColorType;
-extern gbRegister PC;
+extern EMU_STATE int		  gbGBCColorType;
+extern EMU_STATE gbRegister PC;
 
-mapperMBC1 gbDataMBC1 = {
+EMU_STATE mapperMBC1 gbDataMBC1 = {
 	0, // RAM enable
 	1, // ROM bank
 	0, // RAM bank
@@ -264,7 +264,7 @@ void memoryUpdateMapMBC1()
 	}
 }
 
-mapperMBC2 gbDataMBC2 = {
+EMU_STATE mapperMBC2 gbDataMBC2 = {
 	0, // RAM enable
 	1 // ROM bank
 };
@@ -330,7 +330,7 @@ void memoryUpdateMapMBC2()
 	gbMemoryMap[0x07] = &gbRom[tmpAddress + 0x3000];
 }
 
-mapperMBC3 gbDataMBC3 = {
+EMU_STATE mapperMBC3 gbDataMBC3 = {
 	0, // RAM enable
 	1, // ROM bank
 	0, // RAM bank
@@ -589,7 +589,7 @@ void memoryUpdateMapMBC3()
 	}
 }
 
-mapperMBC5 gbDataMBC5 = {
+EMU_STATE mapperMBC5 gbDataMBC5 = {
 	0, // RAM enable
 	1, // ROM bank
 	0, // RAM bank
@@ -725,7 +725,7 @@ void memoryUpdateMapMBC5()
 	}
 }
 
-mapperMBC7 gbDataMBC7 = {
+EMU_STATE mapperMBC7 gbDataMBC7 = {
 	0, // RAM enable
 	1, // ROM bank
 	0, // RAM bank
@@ -1030,7 +1030,7 @@ void memoryUpdateMapMBC7()
 	gbMemoryMap[0x07] = &gbRom[tmpAddress + 0x3000];
 }
 
-mapperHuC1 gbDataHuC1 = {
+EMU_STATE mapperHuC1 gbDataHuC1 = {
 	0, // RAM enable
 	1, // ROM bank
 	0, // RAM bank
@@ -1131,7 +1131,7 @@ void memoryUpdateMapHuC1()
 	}
 }
 
-mapperHuC3 gbDataHuC3 = {
+EMU_STATE mapperHuC3 gbDataHuC3 = {
 	0, // RAM enable
 	1, // ROM bank
 	0, // RAM bank
@@ -1291,7 +1291,7 @@ void memoryUpdateMapHuC3()
 
 // TAMA5 (for Tamagotchi 3 (gb)).
 // Very basic (and ugly :p) support, only rom bank switching is actually working...
-mapperTAMA5 gbDataTAMA5 = {
+EMU_STATE mapperTAMA5 gbDataTAMA5 = {
 	1, // RAM enable
 	1, // ROM bank
 	0, // RAM bank
@@ -1655,7 +1655,7 @@ void memoryUpdateMapTAMA5()
 }
 
 // MMM01 Used in Momotarou collection (however the rom is corrupted)
-mapperMMM01 gbDataMMM01 = {
+EMU_STATE mapperMMM01 gbDataMMM01 = {
 	0, // RAM enable
 	1, // ROM bank
 	0, // RAM bank
@@ -1804,7 +1804,7 @@ void mapperGGROM(u16 address, u8 value)
 }
 
 // GS3 Used to emulate the GS V3.0 rom bank switching
-mapperGS3 gbDataGS3 = { 1 }; // ROM bank
+EMU_STATE mapperGS3 gbDataGS3 = { 1 }; // ROM bank
 
 void mapperGS3ROM(u16 address, u8 value)
 {
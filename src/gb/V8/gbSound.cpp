@@ -3,7 +3,6 @@
 #include "../../common/System.h"
 #include "../../common/SystemGlobals.h"
 #include "../../common/Util.h"
-//#include "../../Blip_Buffer.h"
 #include "../gbGlobals.h"
 #include "../gbSound.h"
 
@@ -13,79 +12,85 @@
 
 extern u8 soundWavePattern[4][32];
 
-extern int32 soundLevel1;
-extern int32 soundLevel2;
-extern int32 soundBalance;
-extern int32 soundMasterOn;
-int32		 soundVIN = 0;
-extern int32 soundDebug;
-
-extern int32 sound1On;
-extern int32 sound1ATL;
-int32		 sound1ATLreload;
-int32		 freq1low;
-int32		 freq1high;
-extern int32 sound1Skip;
-extern int32 sound1Index;
-extern int32 sound1Continue;
-extern int32 sound1EnvelopeVolume;
-extern int32 sound1EnvelopeATL;
-extern int32 sound1EnvelopeUpDown;
-extern int32 sound1EnvelopeATLReload;
-extern int32 sound1SweepATL;
-extern int32 sound1SweepATLReload;
-extern int32 sound1SweepSteps;
-extern int32 sound1SweepUpDown;
-extern int32 sound1SweepStep;
-extern u8 *	 sound1Wave;
-
-extern int32 sound2On;
-extern int32 sound2ATL;
-int32		 sound2ATLreload;
-int32		 freq2low;
-int32		 freq2high;
-extern int32 sound2Skip;
-extern int32 sound2Index;
-extern int32 sound2Continue;
-extern int32 sound2EnvelopeVolume;
-extern int32 sound2EnvelopeATL;
-extern int32 sound2EnvelopeUpDown;
-extern int32 sound2EnvelopeATLReload;
-extern u8 *	 sound2Wave;
-
-extern int32 sound3On;
-extern int32 sound3ATL;
-int32		 sound3ATLreload;
-int32		 freq3low;
-int32		 freq3high;
-extern int32 sound3Skip;
-extern int32 sound3Index;
-extern int32 sound3Continue;
-extern int32 sound3OutputLevel;
-extern int32 sound3Last;
-
-extern int32 sound4On;
-extern int32 sound4Clock;
-extern int32 sound4ATL;
-int32		 sound4ATLreload;
-int32		 freq4;
-extern int32 sound4Skip;
-extern int32 sound4Index;
-extern int32 sound4ShiftRight;
-extern int32 sound4ShiftSkip;
-extern int32 sound4ShiftIndex;
-extern int32 sound4NSteps;
-extern int32 sound4CountDown;
-extern int32 sound4Continue;
-extern int32 sound4EnvelopeVolume;
-extern int32 sound4EnvelopeATL;
-extern int32 sound4EnvelopeUpDown;
-extern int32 sound4EnvelopeATLReload;
+extern EMU_STATE int32 soundLevel1;
+extern EMU_STATE int32 soundLevel2;
+extern EMU_STATE int32 soundBalance;
+extern EMU_STATE int32 soundMasterOn;
+EMU_STATE int32		 soundVIN = 0;
+extern EMU_STATE int32 soundDebug;
+
+extern EMU_STATE int32 sound1On;
+extern EMU_STATE int32 sound1ATL;
+EMU_STATE int32		 sound1ATLreload;
+EMU_STATE int32		 freq1low;
+EMU_STATE int32		 freq1high;
+extern EMU_STATE int32 sound1Skip;
+extern EMU_STATE int32 sound1Index;
+extern EMU_STATE int32 sound1Continue;
+extern EMU_STATE int32 sound1EnvelopeVolume;
+extern EMU_STATE int32 sound1EnvelopeATL;
+extern EMU_STATE int32 sound1EnvelopeUpDown;
+extern EMU_STATE int32 sound1EnvelopeATLReload;
+extern EMU_STATE int32 sound1SweepATL;
+extern EMU_STATE int32 sound1SweepATLReload;
+extern EMU_STATE int32 sound1SweepSteps;
+extern EMU_STATE int32 sound1SweepUpDown;
+extern EMU_STATE int32 sound1SweepStep;
+extern EMU_STATE u8 *	 sound1Wave;
+
+extern EMU_STATE int32 sound2On;
+extern EMU_STATE int32 sound2ATL;
+EMU_STATE int32		 sound2ATLreload;
+EMU_STATE int32		 freq2low;
+EMU_STATE int32		 freq2high;
+extern EMU_STATE int32 sound2Skip;
+extern EMU_STATE int32 sound2Index;
+extern EMU_STATE int32 sound2Continue;
+extern EMU_STATE int32 sound2EnvelopeVolume;
+extern EMU_STATE int32 sound2EnvelopeATL;
+extern EMU_STATE int32 sound2EnvelopeUpDown;
+extern EMU_STATE int32 sound2EnvelopeATLReload;
+extern EMU_STATE u8 *	 sound2Wave;
+
+extern EMU_STATE int32 sound3On;
+extern EMU_STATE int32 sound3ATL;
+EMU_STATE int32		 sound3ATLreload;
+EMU_STATE int32		 freq3low;
+EMU_STATE int32		 freq3high;
+extern EMU_STATE int32 sound3Skip;
+extern EMU_STATE int32 sound3Index;
+extern EMU_STATE int32 sound3Continue;
+extern EMU_STATE int32 sound3OutputLevel;
+extern EMU_STATE int32 sound3Last;
+
+extern EMU_STATE int32 sound4On;
+extern EMU_STATE int32 sound4Clock;
+extern EMU_STATE int32 sound4ATL;
+EMU_STATE int32		 sound4ATLreload;
+EMU_STATE int32		 freq4;
+extern EMU_STATE int32 sound4Skip;
+extern EMU_STATE int32 sound4Index;
+extern EMU_STATE int32 sound4ShiftRight;
+extern EMU_STATE int32 sound4ShiftSkip;
+extern EMU_STATE int32 sound4ShiftIndex;
+extern EMU_STATE int32 sound4NSteps;
+extern EMU_STATE int32 sound4CountDown;
+extern EMU_STATE int32 sound4Continue;
+extern EMU_STATE int32 sound4EnvelopeVolume;
+extern EMU_STATE int32 sound4EnvelopeATL;
+extern EMU_STATE int32 sound4EnvelopeUpDown;
+extern EMU_STATE int32 sound4EnvelopeATLReload;
 
 extern int32 soundFreqRatio[8];
 extern int32 soundShiftClock[16];
 
-bool8 gbDigitalSound = false;
+EMU_STATE bool8 gbDigitalSound = false;
+
+// set while a tick's level changes are reported to the band-limited synthesizer
+static EMU_STATE bool8 gbSoundSynthOn = false;
+
+// above one waveform step per output cycle, only the level at the end of the tick is reported
+#define GB_SOUND_SYNTH_MAX_ADVANCE 0x20000000
 
 void gbSoundEvent(register u16 address, register int data)
 {
@@ -334,6 +339,30 @@ void gbSoundEvent(register u16 address, register int data)
 		gbDigitalSound = false;
 }
 
+// cpu cycle of the tick at which a channel advancing by advance has covered distance
+static inline int gbSoundSynthTime(u32 distance, u32 advance)
+{
+	return (int)((u64)distance * soundTickStep / advance);
+}
+
+static void gbSoundSynth(int channel, int time, int value)
+{
+	int left  = (soundBalance & (16 << channel)) ? value * soundLevel1 * 60 : 0;
+	int right = (soundBalance & (1 << channel)) ? value * soundLevel2 * 60 : 0;
+
+	systemSoundSynth(channel, time, left, right);
+}
+
+// reports every duty step a square channel crosses during the tick
+static void gbSoundSynthSquare(int channel, const u8 *wave, u32 index, u32 advance, int vol)
+{
+	if (advance >= GB_SOUND_SYNTH_MAX_ADVANCE)
+		return;
+
+	for (u32 step = 0x1000000 - (index & 0xffffff); step < advance; step += 0x1000000)
+		gbSoundSynth(channel, gbSoundSynthTime(step, advance), ((s8)wave[((index + step) & 0x1fffffff) >> 24]) * vol);
+}
+
 void gbSoundChannel1()
 {
 	int vol = sound1EnvelopeVolume;
@@ -344,13 +373,19 @@ void gbSoundChannel1()
 
 	if (sound1On && (sound1ATL || !sound1Continue))
 	{
-		sound1Index += soundQuality * sound1Skip;
+		u32 advance = (u32)soundQuality * (u32)sound1Skip;
+		if (gbSoundSynthOn)
+			gbSoundSynthSquare(0, sound1Wave, sound1Index, advance, vol);
+
+		sound1Index += advance;
 		sound1Index &= 0x1fffffff;
 
 		value = ((s8)sound1Wave[sound1Index >> 24]) * vol;
 	}
 
 	soundBuffer[0][soundIndex] = value;
+	if (gbSoundSynthOn)
+		gbSoundSynth(0, soundTickStep, value);
 
 	if (sound1On)
 	{
@@ -441,13 +476,19 @@ void gbSoundChannel2()
 
 	if (sound2On && (sound2ATL || !sound2Continue))
 	{
-		sound2Index += soundQuality * sound2Skip;
+		u32 advance = (u32)soundQuality * (u32)sound2Skip;
+		if (gbSoundSynthOn)
+			gbSoundSynthSquare(1, sound2Wave, sound2Index, advance, vol);
+
+		sound2Index += advance;
 		sound2Index &= 0x1fffffff;
 
 		value = ((s8)sound2Wave[sound2Index >> 24]) * vol;
 	}
 
 	soundBuffer[1][soundIndex] = value;
+	if (gbSoundSynthOn)
+		gbSoundSynth(1, soundTickStep, value);
 
 	if (sound2On)
 	{
@@ -484,50 +525,63 @@ void gbSoundChannel2()
 	}
 }
 
-void gbSoundChannel3()
+static int gbSoundChannel3Value(u32 index)
 {
-	int value = 0;
+	int value = gbMemory[0xff30 + ((index & 0x1fffffff) >> 25)];
 
-	if (sound3On && (sound3ATL || !sound3Continue))
+	if ((index & 0x01000000))
 	{
-		value = sound3Last;
+		value &= 0x0f;
+	}
+	else
+	{
+		value >>= 4;
+	}
 
-		sound3Index += soundQuality * sound3Skip;
-		sound3Index &= 0x1fffffff;
+	value -= 8;
+	value *= 2;
+
+	switch (sound3OutputLevel)
+	{
+	case 0:
+		value = 0;
+		break;
+	case 1:
+		break;
+	case 2:
+		value = (value >> 1);
+		break;
+	case 3:
+		value = (value >> 2);
+		break;
+	}
+	//value += 1;
+	return value;
+}
 
-		value = gbMemory[0xff30 + (sound3Index >> 25)];
+void gbSoundChannel3()
+{
+	int value = 0;
 
-		if ((sound3Index & 0x01000000))
-		{
-			value &= 0x0f;
-		}
-		else
+	if (sound3On && (sound3ATL || !sound3Continue))
+	{
+		u32 advance = (u32)soundQuality * (u32)sound3Skip;
+		if (gbSoundSynthOn && advance < GB_SOUND_SYNTH_MAX_ADVANCE)
 		{
-			value >>= 4;
+			for (u32 step = 0x1000000 - (sound3Index & 0xffffff); step < advance; step += 0x1000000)
+				gbSoundSynth(2, gbSoundSynthTime(step, advance), gbSoundChannel3Value(sound3Index + step));
 		}
 
-		value -= 8;
-		value *= 2;
+		sound3Index += advance;
+		sound3Index &= 0x1fffffff;
 
-		switch (sound3OutputLevel)
-		{
-		case 0:
-			value = 0;
-			break;
-		case 1:
-			break;
-		case 2:
-			value = (value >> 1);
-			break;
-		case 3:
-			value = (value >> 2);
-			break;
-		}
-		//value += 1;
+		value	   = gbSoundChannel3Value(sound3Index);
 		sound3Last = value;
 	}
 
 	soundBuffer[2][soundIndex] = value;
+	if (gbSoundSynthOn)
+		gbSoundSynth(2, soundTickStep, value);
 
 	if (sound3On)
 	{
@@ -555,8 +609,12 @@ void gbSoundChannel4()
 		if (sound4On && (sound4ATL || !sound4Continue))
 		{
 #define NOISE_ONE_SAMP_SCALE  0x200000
+			int advance = soundQuality * sound4ShiftSkip;
+			// report each shift of the noise register while there are few per tick
+			bool synth = gbSoundSynthOn && advance > 0 && advance < 16 * NOISE_ONE_SAMP_SCALE;
+
 			sound4Index		 += soundQuality * sound4Skip;
-			sound4ShiftIndex += soundQuality * sound4ShiftSkip;
+			sound4ShiftIndex += advance;
 
 			if (sound4NSteps)
 			{
@@ -566,6 +624,8 @@ void gbSoundChannel4()
 					                     (sound4ShiftRight << 5)) & 0x40) |
 					                   (sound4ShiftRight >> 1);
 					sound4ShiftIndex -= NOISE_ONE_SAMP_SCALE;
+					if (synth)
+						gbSoundSynth(3, gbSoundSynthTime(advance - sound4ShiftIndex, advance), ((sound4ShiftRight & 1) * 2 - 1) * vol);
 				}
 			}
 			else
@@ -577,6 +637,8 @@ void gbSoundChannel4()
 					                   (sound4ShiftRight >> 1);
 
 					sound4ShiftIndex -= NOISE_ONE_SAMP_SCALE;
+					if (synth)
+						gbSoundSynth(3, gbSoundSynthTime(advance - sound4ShiftIndex, advance), ((sound4ShiftRight & 1) * 2 - 1) * vol);
 				}
 			}
 
@@ -592,6 +654,8 @@ void gbSoundChannel4()
 	}
 
 	soundBuffer[3][soundIndex] = value;
+	if (gbSoundSynthOn)
+		gbSoundSynth(3, soundTickStep, value);
 
 	if (sound4On)
 	{
@@ -628,73 +692,39 @@ void gbSoundChannel4()
 	}
 }
 
+// the digital sound hack outputs the master levels directly, bypassing the channels
 void gbSoundMix()
 {
-	if (gbMemory)
-		soundBalance = (gbMemory[NR51] & soundEnableFlag);
-
-	int cgbResL = 0;
-	if (soundBalance & 16)
-	{
-		cgbResL += ((s8)soundBuffer[0][soundIndex]);
-	}
-	if (soundBalance & 32)
-	{
-		cgbResL += ((s8)soundBuffer[1][soundIndex]);
-	}
-	if (soundBalance & 64)
-	{
-		cgbResL += ((s8)soundBuffer[2][soundIndex]);
-	}
-	if (soundBalance & 128)
-	{
-		cgbResL += ((s8)soundBuffer[3][soundIndex]);
-	}
-
-	int cgbResR = 0;
-	if (soundBalance & 1)
-	{
-		cgbResR += ((s8)soundBuffer[0][soundIndex]);
-	}
-	if (soundBalance & 2)
-	{
-		cgbResR += ((s8)soundBuffer[1][soundIndex]);
-	}
-	if (soundBalance & 4)
-	{
-		cgbResR += ((s8)soundBuffer[2][soundIndex]);
-	}
-	if (soundBalance & 8)
-	{
-		cgbResR += ((s8)soundBuffer[3][soundIndex]);
-	}
-
 	if (gbDigitalSound)
-	{
-		cgbResL = soundLevel1 * 256;
-		cgbResR = soundLevel2 * 256;
-	}
+		systemSoundMix(soundLevel1 * 256, soundLevel2 * 256);
 	else
-	{
-		cgbResL *= soundLevel1 * 60;
-		cgbResR *= soundLevel2 * 60;
-	}
-
-	systemSoundMix(cgbResL, cgbResR);
+		systemSoundSynthMix();
 }
 
 void gbSoundTick()
 {
+	gbSoundSynthOn = false;
+
 	if (systemSoundOn)
 	{
 		if (soundMasterOn)
 		{
+			if (systemSoundMixingRequired() && !gbDigitalSound)
+			{
+				gbSoundSynthOn = true;
+				if (gbMemory)
+					soundBalance = (gbMemory[NR51] & soundEnableFlag);
+			}
+
 			gbSoundChannel1();
 			gbSoundChannel2();
 			gbSoundChannel3();
 			gbSoundChannel4();
 
-			gbSoundMix();
+			if (systemSoundMixingRequired())
+				gbSoundMix();
+			else
+				systemSoundMixSilence();
 		}
 		else
 		{
@@ -828,9 +858,9 @@ void gbSoundReset()
 }
 
 // dummy
-static int32 soundTicks_int32;
-static int32 soundTickStep_int32;
-variable_desc gbSoundSaveStruct[] = {
+static EMU_STATE int32 soundTicks_int32;
+static EMU_STATE int32 soundTickStep_int32;
+EMU_STATE_DYNAMIC variable_desc gbSoundSaveStruct[] = {
 	{ &soundPaused,				sizeof(int32) },
 	{ &soundPlay,				sizeof(int32) },
 	{ &soundTicks_int32,		sizeof(int32) },
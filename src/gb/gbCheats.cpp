@@ -11,12 +11,12 @@
 #include "gbCheats.h"
 #include "gbGlobals.h"
 
-gbCheat gbCheatList[100];
-int		gbCheatNumber = 0;
-int		gbNextCheat	  = 0;
-bool	gbCheatMap[0x10000];
+EMU_STATE gbCheat gbCheatList[100];
+EMU_STATE int		gbCheatNumber = 0;
+EMU_STATE int		gbNextCheat	  = 0;
+EMU_STATE bool	gbCheatMap[0x10000];
 
-extern bool8 cheatsEnabled;
+extern EMU_STATE bool8 cheatsEnabled;
 
 #define GBCHEAT_IS_HEX(a) (((a) >= 'A' && (a) <= 'F') || ((a) >= '0' && (a) <= '9'))
 #define GBCHEAT_HEX_VALUE(a) ((a) >= 'A' ? (a) - 'A' + 10 : (a) - '0')
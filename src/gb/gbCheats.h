@@ -44,8 +44,8 @@ bool gbVerifyGgCode(const char *code);
 #define MAX_CHEATS 100
 #endif
 
-extern int	   gbCheatNumber;
-extern gbCheat gbCheatList[MAX_CHEATS];
-extern bool	   gbCheatMap[0x10000];
+extern EMU_STATE int	   gbCheatNumber;
+extern EMU_STATE gbCheat gbCheatList[MAX_CHEATS];
+extern EMU_STATE bool	   gbCheatMap[0x10000];
 
 #endif // VBA_GB_CHEATS_H
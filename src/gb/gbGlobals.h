@@ -7,21 +7,21 @@
 
 #include "../Port.h"
 
-extern int32 gbRomSizeMask;
-extern int32 gbRomSize;
-extern int32 gbRamSize;
-extern int32 gbRamSizeMask;
-extern int32 gbTAMA5ramSize;
-
-extern u8 * gbRom;
-extern u8 * gbRam;
-extern u8 * gbVram;
-extern u8 * gbWram;
-extern u8 * gbMemory;
-extern u16 *gbLineBuffer;
-extern u8 * gbTAMA5ram;
-
-extern u8 *gbMemoryMap[16];
+extern EMU_STATE int32 gbRomSizeMask;
+extern EMU_STATE int32 gbRomSize;
+extern EMU_STATE int32 gbRamSize;
+extern EMU_STATE int32 gbRamSizeMask;
+extern EMU_STATE int32 gbTAMA5ramSize;
+
+extern EMU_STATE u8 * gbRom;
+extern EMU_STATE u8 * gbRam;
+extern EMU_STATE u8 * gbVram;
+extern EMU_STATE u8 * gbWram;
+extern EMU_STATE u8 * gbMemory;
+extern EMU_STATE u16 *gbLineBuffer;
+extern EMU_STATE u8 * gbTAMA5ram;
+
+extern EMU_STATE u8 *gbMemoryMap[16];
 
 extern const u32 gbFrameRateDividend;
 extern const u32 gbFrameRateDivisor;
@@ -30,11 +30,12 @@ extern const double gbFrameRate;
 extern const u32 gbPixBufferSize;
 
 #ifdef USE_GB_CORE_V7
-extern bool gbEchoRAMFixOn;
-extern bool gbDMASpeedVersion;
+extern EMU_STATE bool gbEchoRAMFixOn;
+extern EMU_STATE bool gbDMASpeedVersion;
 #endif
 
-static inline u8 gbReadMemoryQuick(u16 address)
+// the address the quick accessors below use after echo RAM
+static inline u16 gbMemoryQuickAddress(u16 address)
 {
 #ifdef USE_GB_CORE_V7
 	if (gbEchoRAMFixOn)
@@ -45,20 +46,18 @@ static inline u8 gbReadMemoryQuick(u16 address)
 			address -= 0x2000;
 		}
 	}
+	return address;
+}
+
+static inline u8 gbReadMemoryQuick(u16 address)
+{
+	address = gbMemoryQuickAddress(address);
 	return gbMemoryMap[address >> 12][address & 0xfff];
 }
 
 static inline void gbWriteMemoryQuick(u16 address, u8 value)
 {
-#ifdef USE_GB_CORE_V7
-	if (gbEchoRAMFixOn)
-#endif
-	{
-		if (address >= 0xe000 && address < 0xfe00)
-		{
-			address -= 0x2000;
-		}
-	}
+	address = gbMemoryQuickAddress(address);
 	gbMemoryMap[address >> 12][address & 0xfff] = value;
 }
 
@@ -122,57 +121,58 @@ static inline u8 gbReadROMQuick32(u32 addr)
 		gbReadROMQuick(addr & gbRomSizeMask);
 }
 
-extern u16	 gbColorFilter[32768];
-extern int32 gbColorOption;
-extern int32 gbPaletteOption;
-extern int32 gbEmulatorType;
-extern int32 gbHardware;
-extern int32 gbBorderOn;
-extern int32 gbBorderAutomatic;
-extern int32 gbCgbMode;
-extern int32 gbSgbMode;
-extern int32 gbWindowLine;
-extern int32 gbSpeed;
-extern u8	 gbBgp[4];
-extern u8	 gbObp0[4];
-extern u8	 gbObp1[4];
-extern u16	 gbPalette[128];
+extern EMU_STATE u16	 gbColorFilter[32768];
+extern EMU_STATE int32 gbColorOption;
+extern EMU_STATE int32 gbPaletteOption;
+extern EMU_STATE int32 gbEmulatorType;
+extern EMU_STATE int32 gbHardware;
+extern EMU_STATE int32 gbBorderOn;
+extern EMU_STATE int32 gbBorderAutomatic;
+extern EMU_STATE int32 gbCgbMode;
+extern EMU_STATE int32 gbSgbMode;
+extern EMU_STATE int32 gbWindowLine;
+extern EMU_STATE int32 gbSpeed;
+extern EMU_STATE u8	 gbBgp[4];
+extern EMU_STATE u8	 gbObp0[4];
+extern EMU_STATE u8	 gbObp1[4];
+extern EMU_STATE u16	 gbPalette[128];
 
 #ifdef USE_GB_CORE_V7
 #else
-extern bool	 genericflashcardEnable;
-extern bool	 gbScreenOn;
+extern EMU_STATE bool	 genericflashcardEnable;
+extern EMU_STATE bool	 gbScreenOn;
 extern u8	 oldRegister_WY;
 
 // gbSCXLine is used for the emulation (bug) of the SX change
 // found in the Artic Zone game.
-extern u8 gbSCXLine[300];
-extern u8 gbSCYLine[300];
+extern EMU_STATE u8 gbSCXLine[300];
+extern EMU_STATE u8 gbSCYLine[300];
 
 // gbBgpLine is used for the emulation of the
 // Prehistorik Man's title screen scroller.
-extern u8 gbBgpLine[300];
-extern u8 gbObp0Line [300];
-extern u8 gbObp1Line [300];
+extern EMU_STATE u8 gbBgpLine[300];
+extern EMU_STATE u8 gbObp0Line [300];
+extern EMU_STATE u8 gbObp1Line [300];
 
 // gbSpritesTicks is used for the emulation of Parodius' Laser Beam.
-extern u8 gbSpritesTicks[300];
+extern EMU_STATE u8 gbSpritesTicks[300];
 #endif
 
-extern u8 register_LCDC;
-extern u8 register_LY;
-extern u8 register_SCY;
-extern u8 register_SCX;
-extern u8 register_WY;
-extern u8 register_WX;
-extern u8 register_VBK;
+extern EMU_STATE u8 register_LCDC;
+extern EMU_STATE u8 register_LY;
+extern EMU_STATE u8 register_SCY;
+extern EMU_STATE u8 register_SCX;
+extern EMU_STATE u8 register_WY;
+extern EMU_STATE u8 register_WX;
+extern EMU_STATE u8 register_VBK;
 
-extern int32 gbBorderLineSkip;
-extern int32 gbBorderRowSkip;
-extern int32 gbBorderColumnSkip;
-extern int32 gbDmaTicks;
+extern EMU_STATE int32 gbBorderLineSkip;
+extern EMU_STATE int32 gbBorderRowSkip;
+extern EMU_STATE int32 gbBorderColumnSkip;
+extern EMU_STATE int32 gbDmaTicks;
 
 extern void gbRenderLine();
+extern void gbSkipLine();
 
 #ifdef USE_GB_CORE_V7
 extern void gbDrawSprites();
@@ -180,6 +180,6 @@ extern void gbDrawSprites();
 extern void gbDrawSprites(bool);
 #endif
 
-extern u8 (*gbSerialFunction)(u8);
+extern EMU_STATE u8 (*gbSerialFunction)(u8);
 
 #endif // VBA_GB_GLOBALS_H
@@ -150,15 +150,15 @@ struct mapperGS3
 	int32 mapperROMBank;
 };
 
-extern mapperMBC1  gbDataMBC1;
-extern mapperMBC2  gbDataMBC2;
-extern mapperMBC3  gbDataMBC3;
-extern mapperMBC5  gbDataMBC5;
-extern mapperHuC1  gbDataHuC1;
-extern mapperHuC3  gbDataHuC3;
-extern mapperTAMA5 gbDataTAMA5;
-extern mapperMMM01 gbDataMMM01;
-extern mapperGS3   gbDataGS3;
+extern EMU_STATE mapperMBC1  gbDataMBC1;
+extern EMU_STATE mapperMBC2  gbDataMBC2;
+extern EMU_STATE mapperMBC3  gbDataMBC3;
+extern EMU_STATE mapperMBC5  gbDataMBC5;
+extern EMU_STATE mapperHuC1  gbDataHuC1;
+extern EMU_STATE mapperHuC3  gbDataHuC3;
+extern EMU_STATE mapperTAMA5 gbDataTAMA5;
+extern EMU_STATE mapperMMM01 gbDataMMM01;
+extern EMU_STATE mapperGS3   gbDataGS3;
 
 void mapperMBC1ROM(u16, u8);
 void mapperMBC1RAM(u16, u8);
@@ -3,14 +3,14 @@
 
 #include "../common/System.h"
 
-u8	gbPrinterStatus = 0;
-int gbPrinterState	= 0;
-u8	gbPrinterData[0x280 * 9];
-u8	gbPrinterPacket[0x400];
-int gbPrinterCount	   = 0;
-int gbPrinterDataCount = 0;
-int gbPrinterDataSize  = 0;
-int gbPrinterResult	   = 0;
+EMU_STATE u8	gbPrinterStatus = 0;
+EMU_STATE int gbPrinterState	= 0;
+EMU_STATE u8	gbPrinterData[0x280 * 9];
+EMU_STATE u8	gbPrinterPacket[0x400];
+EMU_STATE int gbPrinterCount	   = 0;
+EMU_STATE int gbPrinterDataCount = 0;
+EMU_STATE int gbPrinterDataSize  = 0;
+EMU_STATE int gbPrinterResult	   = 0;
 
 bool gbPrinterCheckCRC()
 {
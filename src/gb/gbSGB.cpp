@@ -7,35 +7,35 @@
 #include "gb.h"
 #include "gbGlobals.h"
 
-extern u8 * pix;
-extern bool gbSgbResetFlag;
+extern EMU_STATE u8 * pix;
+extern EMU_STATE bool gbSgbResetFlag;
 
 #define GBSGB_NONE            0
 #define GBSGB_RESET           1
 #define GBSGB_PACKET_TRANSMIT 2
 
-u8 *gbSgbBorderChar = NULL;
-u8 *gbSgbBorder		= NULL;
-
-int32 gbSgbCGBSupport	   = 0;
-int32 gbSgbMask			   = 0;
-int32 gbSgbMode			   = 0;
-int32 gbSgbPacketState	   = GBSGB_NONE;
-int32 gbSgbBit			   = 0;
-int32 gbSgbPacketTimeout   = 0;
-int32 GBSGB_PACKET_TIMEOUT = 66666;
-u8	  gbSgbPacket[16 * 7];
-int32 gbSgbPacketNBits		 = 0;
-int32 gbSgbPacketByte		 = 0;
-int32 gbSgbPacketNumber		 = 0;
-int32 gbSgbMultiplayer		 = 0;
-int32 gbSgbFourPlayers		 = 0;
-u8	  gbSgbNextController	 = 0x0f;
-u8	  gbSgbReadingController = 0;
-u16	  gbSgbSCPPalette[4 * 512];
-u8	  gbSgbATF[20 * 18];
-u8	  gbSgbATFList[45 * 20 * 18];
-u8	  gbSgbScreenBuffer[4160];
+EMU_STATE u8 *gbSgbBorderChar = NULL;
+EMU_STATE u8 *gbSgbBorder		= NULL;
+
+EMU_STATE int32 gbSgbCGBSupport	   = 0;
+EMU_STATE int32 gbSgbMask			   = 0;
+EMU_STATE int32 gbSgbMode			   = 0;
+EMU_STATE int32 gbSgbPacketState	   = GBSGB_NONE;
+EMU_STATE int32 gbSgbBit			   = 0;
+EMU_STATE int32 gbSgbPacketTimeout   = 0;
+EMU_STATE int32 GBSGB_PACKET_TIMEOUT = 66666;
+EMU_STATE u8	  gbSgbPacket[16 * 7];
+EMU_STATE int32 gbSgbPacketNBits		 = 0;
+EMU_STATE int32 gbSgbPacketByte		 = 0;
+EMU_STATE int32 gbSgbPacketNumber		 = 0;
+EMU_STATE int32 gbSgbMultiplayer		 = 0;
+EMU_STATE int32 gbSgbFourPlayers		 = 0;
+EMU_STATE u8	  gbSgbNextController	 = 0x0f;
+EMU_STATE u8	  gbSgbReadingController = 0;
+EMU_STATE u16	  gbSgbSCPPalette[4 * 512];
+EMU_STATE u8	  gbSgbATF[20 * 18];
+EMU_STATE u8	  gbSgbATFList[45 * 20 * 18];
+EMU_STATE u8	  gbSgbScreenBuffer[4160];
 
 inline void gbSgbDraw24Bit(u8 *p, u16 v)
 {
@@ -947,7 +947,7 @@ void gbSgbDoBitTransfer(u8 value)
 	}
 }
 
-variable_desc gbSgbSaveStruct[] = {
+EMU_STATE_DYNAMIC variable_desc gbSgbSaveStruct[] = {
 	{ &gbSgbMask,			   sizeof(int32) },
 	{ &gbSgbPacketState,	   sizeof(int32) },
 	{ &gbSgbBit,			   sizeof(int32) },
@@ -960,7 +960,7 @@ variable_desc gbSgbSaveStruct[] = {
 	{ NULL,					   0			 }
 };
 
-variable_desc gbSgbSaveStructV3[] = {
+EMU_STATE_DYNAMIC variable_desc gbSgbSaveStructV3[] = {
 	{ &gbSgbMask,			   sizeof(int32) },
 	{ &gbSgbPacketState,	   sizeof(int32) },
 	{ &gbSgbBit,			   sizeof(int32) },
@@ -18,13 +18,13 @@ void gbSgbSaveGame(gzFile);
 void gbSgbReadGame(gzFile, int version);
 void gbSgbRenderBorder();
 
-extern u8	 gbSgbATF[20*18];
-extern int32 gbSgbMode;
-extern int32 gbSgbMask;
-extern int32 gbSgbMultiplayer;
-extern u8	 gbSgbNextController;
-extern int32 gbSgbPacketTimeout;
-extern u8	 gbSgbReadingController;
-extern int32 gbSgbFourPlayers;
+extern EMU_STATE u8	 gbSgbATF[20*18];
+extern EMU_STATE int32 gbSgbMode;
+extern EMU_STATE int32 gbSgbMask;
+extern EMU_STATE int32 gbSgbMultiplayer;
+extern EMU_STATE u8	 gbSgbNextController;
+extern EMU_STATE int32 gbSgbPacketTimeout;
+extern EMU_STATE u8	 gbSgbReadingController;
+extern EMU_STATE int32 gbSgbFourPlayers;
 
 #endif // VBA_GB_SGB_H
@@ -5,18 +5,18 @@
 #include "../common/System.h"
 #include "../common/Util.h"
 
-extern int32 cpuDmaCount;
+extern EMU_STATE int32 cpuDmaCount;
 
-int32 eepromMode	= EEPROM_IDLE;
-int32 eepromByte	= 0;
-int32 eepromBits	= 0;
-int32 eepromAddress = 0;
-u8	  eepromData[0x2000];
-u8	  eepromBuffer[16];
-bool8 eepromInUse = false;
-int32 eepromSize  = 512;
+EMU_STATE int32 eepromMode	= EEPROM_IDLE;
+EMU_STATE int32 eepromByte	= 0;
+EMU_STATE int32 eepromBits	= 0;
+EMU_STATE int32 eepromAddress = 0;
+EMU_STATE u8	  eepromData[0x2000];
+EMU_STATE u8	  eepromBuffer[16];
+EMU_STATE bool8 eepromInUse = false;
+EMU_STATE int32 eepromSize  = 512;
 
-variable_desc eepromSaveData[] = {
+EMU_STATE_DYNAMIC variable_desc eepromSaveData[] = {
 	{ &eepromMode,		sizeof(int32) },
 	{ &eepromByte,		sizeof(int32) },
 	{ &eepromBits,		sizeof(int32) },
@@ -30,7 +30,7 @@ variable_desc eepromSaveData[] = {
 void eepromInit()
 {
 #ifdef USE_GBA_CORE_V7
-	extern bool sramInitFix;
+	extern EMU_STATE bool sramInitFix;
 	if (sramInitFix)
 	{
 		memset(eepromData, 0xff, 0x2000);
@@ -16,9 +16,9 @@ extern void eepromWrite(u32 address, u8 value);
 extern void eepromInit();
 extern void eepromReset();
 extern void eepromErase();
-extern u8    eepromData[0x2000];
-extern bool8 eepromInUse;
-extern int32 eepromSize;
+extern EMU_STATE u8    eepromData[0x2000];
+extern EMU_STATE bool8 eepromInUse;
+extern EMU_STATE int32 eepromSize;
 
 #define EEPROM_IDLE           0
 #define EEPROM_READADDRESS    1
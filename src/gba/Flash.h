@@ -20,7 +20,7 @@ extern void flashReset();
 extern void flashErase();
 extern void flashSetSize(int32 size);
 
-extern int32 flashSize;
-extern u8	 flashSaveMemory[0x20000];
+extern EMU_STATE int32 flashSize;
+extern EMU_STATE u8	 flashSaveMemory[0x20000];
 
 #endif // VBA_FLASH_H
@@ -28,14 +28,14 @@
 #else
 #define SAVE_GAME_VERSION  SAVE_GAME_VERSION_14
 #endif
-extern void (*cpuSaveGameFunc)(u32, u8);
+extern EMU_STATE void (*cpuSaveGameFunc)(u32, u8);
 
 #ifdef BKPT_SUPPORT
-extern u8 freezeWorkRAM[0x40000];
-extern u8 freezeInternalRAM[0x8000];
-extern u8 freezeVRAM[0x18000];
-extern u8 freezePRAM[0x400];
-extern u8 freezeOAM[0x400];
+extern EMU_STATE u8 freezeWorkRAM[0x40000];
+extern EMU_STATE u8 freezeInternalRAM[0x8000];
+extern EMU_STATE u8 freezeVRAM[0x18000];
+extern EMU_STATE u8 freezePRAM[0x400];
+extern EMU_STATE u8 freezeOAM[0x400];
 #endif
 
 extern bool CPUReadGSASnapshot(const char *);
@@ -57,6 +57,8 @@ extern bool CPUWriteMemState(char *, int);
 extern bool CPUWriteState(const char *);
 extern bool CPUReadStateFromStream(gzFile);
 extern bool CPUWriteStateToStream(gzFile);
+extern bool CPUReadSnapshot(gzFile, bool);
+extern bool CPUWriteSnapshot(gzFile);
 extern int  CPULoadRom(const char *);
 extern void CPUMasterCodeCheck();
 extern void CPUDoMirroring(bool);
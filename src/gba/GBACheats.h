@@ -59,8 +59,8 @@ int	 cheatsCheckKeys(u32 keys, u32 extended);
 #define MAX_CHEATS 100
 #endif
 
-extern int        cheatsNumber;
-extern CheatsData cheatsList[MAX_CHEATS];
+extern EMU_STATE int        cheatsNumber;
+extern EMU_STATE CheatsData cheatsList[MAX_CHEATS];
 
 #define CHEAT_IS_HEX(a) (((a) >= 'A' && (a) <= 'F') || ((a) >= '0' && (a) <= '9'))
 
@@ -5,24 +5,24 @@ int coeff[32] = {
 	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16
 };
 
-int32 layerEnable = 0xff00;
+EMU_STATE int32 layerEnable = 0xff00;
 
-u32  line0[240];
-u32  line1[240];
-u32  line2[240];
-u32  line3[240];
-u32  lineOBJ[240];
-u32  lineOBJWin[240];
-u32  lineMix[240];
-bool gfxInWin0[240];
-bool gfxInWin1[240];
-int lineOBJpixleft[128];
+EMU_STATE u32  line0[240];
+EMU_STATE u32  line1[240];
+EMU_STATE u32  line2[240];
+EMU_STATE u32  line3[240];
+EMU_STATE u32  lineOBJ[240];
+EMU_STATE u32  lineOBJWin[240];
+EMU_STATE u32  lineMix[240];
+EMU_STATE bool gfxInWin0[240];
+EMU_STATE bool gfxInWin1[240];
+EMU_STATE int lineOBJpixleft[128];
 
-int gfxBG2Changed = 0;
-int gfxBG3Changed = 0;
+EMU_STATE int gfxBG2Changed = 0;
+EMU_STATE int gfxBG3Changed = 0;
 
-int gfxBG2X       = 0;
-int gfxBG2Y       = 0;
-int gfxBG3X       = 0;
-int gfxBG3Y       = 0;
-int gfxLastVCOUNT = 0;
+EMU_STATE int gfxBG2X       = 0;
+EMU_STATE int gfxBG2Y       = 0;
+EMU_STATE int gfxBG3X       = 0;
+EMU_STATE int gfxBG3Y       = 0;
+EMU_STATE int gfxLastVCOUNT = 0;
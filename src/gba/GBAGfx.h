@@ -9,6 +9,11 @@
 #include "GBA.h"
 #include "GBAGlobals.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GFX_COMPOSITE_SIMD
+#include <emmintrin.h>
+#endif
+
 //#define SPRITE_DEBUG
 
 static void gfxDrawTextScreen(u16, u16, u16, u32 *);
@@ -73,28 +78,28 @@ void mode5RenderLine();
 void mode5RenderLineNoWindow();
 void mode5RenderLineAll();
 
-extern int32 layerEnable;
+extern EMU_STATE int32 layerEnable;
 
 extern int	coeff[32];
-extern u32	line0[240];
-extern u32	line1[240];
-extern u32	line2[240];
-extern u32	line3[240];
-extern u32	lineOBJ[240];
-extern u32	lineOBJWin[240];
-extern u32	lineMix[240];
-extern bool gfxInWin0[240];
-extern bool gfxInWin1[240];
-extern int	lineOBJpixleft[128];
-
-extern int gfxBG2Changed;
-extern int gfxBG3Changed;
-
-extern int gfxBG2X;
-extern int gfxBG2Y;
-extern int gfxBG3X;
-extern int gfxBG3Y;
-extern int gfxLastVCOUNT;
+extern EMU_STATE u32	line0[240];
+extern EMU_STATE u32	line1[240];
+extern EMU_STATE u32	line2[240];
+extern EMU_STATE u32	line3[240];
+extern EMU_STATE u32	lineOBJ[240];
+extern EMU_STATE u32	lineOBJWin[240];
+extern EMU_STATE u32	lineMix[240];
+extern EMU_STATE bool gfxInWin0[240];
+extern EMU_STATE bool gfxInWin1[240];
+extern EMU_STATE int	lineOBJpixleft[128];
+
+extern EMU_STATE int gfxBG2Changed;
+extern EMU_STATE int gfxBG3Changed;
+
+extern EMU_STATE int gfxBG2X;
+extern EMU_STATE int gfxBG2Y;
+extern EMU_STATE int gfxBG3X;
+extern EMU_STATE int gfxBG3Y;
+extern EMU_STATE int gfxLastVCOUNT;
 
 static inline void gfxClearArray(u32 *array)
 {
@@ -1789,4 +1794,397 @@ static inline void gfxAlphaBlend(u32 *ta, u32 *tb, int ca, int cb)
 	}
 }
 
+// Layer compositing shared by the modeN render functions.
+// Layer pixels carry their priority in the top byte (0x80 when transparent) and the backdrop
+// uses 0x30, so layers are ordered by comparing top bytes only.
+enum
+{
+	GFX_COMPOSITE_PLAIN,  // semi-transparent OBJ only
+	GFX_COMPOSITE_FX,	  // special effects, no windows
+	GFX_COMPOSITE_WINDOW  // special effects and windows
+};
+
+static inline u8 gfxWindowMask(int x, bool inWindow0, bool inWindow1)
+{
+	u8 mask = WINOUT & 0xFF;
+
+	if (!(lineOBJWin[x] & 0x80000000))
+		mask = WINOUT >> 8;
+
+	if (inWindow1 && gfxInWin1[x])
+		mask = WININ >> 8;
+
+	if (inWindow0 && gfxInWin0[x])
+		mask = WININ & 0xFF;
+
+	return mask;
+}
+
+#ifdef GFX_COMPOSITE_SIMD
+// Four pixels per vector. Every lane goes through the same steps as the scalar loop
+// in gfxCompositeLine(), with the per-pixel branches turned into lane masks.
+
+static inline __m128i gfxSelect(__m128i cond, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(cond, a), _mm_andnot_si128(cond, b));
+}
+
+static inline __m128i gfxHasBits(__m128i v, __m128i bits)
+{
+	return _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(v, bits), _mm_setzero_si128()), _mm_set1_epi32(-1));
+}
+
+static inline __m128i gfxAbove(__m128i a, __m128i b)
+{
+	return _mm_cmplt_epi32(_mm_srli_epi32(a, 24), _mm_srli_epi32(b, 24));
+}
+
+// picks layer pixels over the current one; exclude holds lanes where the layer may not be taken
+static inline void gfxSelectLayer(const u32 *line, int flag, __m128i mask, __m128i exclude,
+                                  __m128i &color, __m128i &top)
+{
+	__m128i layer = _mm_loadu_si128((const __m128i *)line);
+	__m128i bit	  = _mm_set1_epi32(flag);
+	__m128i take  = _mm_andnot_si128(exclude, _mm_and_si128(gfxHasBits(mask, bit), gfxAbove(layer, color)));
+	color = gfxSelect(take, layer, color);
+	top	  = gfxSelect(take, bit, top);
+}
+
+// same result layout as the scalar blending functions: r | g << 5 | b << 10 | g << 21
+static inline __m128i gfxPackChannels(__m128i r, __m128i g, __m128i b)
+{
+	return _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 5)),
+	                    _mm_or_si128(_mm_slli_epi32(b, 10), _mm_slli_epi32(g, 21)));
+}
+
+static inline __m128i gfxAlphaBlend(__m128i color, __m128i color2, int ca, int cb)
+{
+	const __m128i channel = _mm_set1_epi32(0x1F);
+	// the products fit in the low halves, so 16-bit multiplies are exact
+	__m128i		  a	= _mm_set1_epi32(ca);
+	__m128i		  b	= _mm_set1_epi32(cb);
+	__m128i		  c[3];
+	for (int i = 0; i < 3; i++)
+	{
+		__m128i x = _mm_and_si128(_mm_srli_epi32(color, 5 * i), channel);
+		__m128i y = _mm_and_si128(_mm_srli_epi32(color2, 5 * i), channel);
+		x	 = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi16(x, a), _mm_mullo_epi16(y, b)), 4);
+		c[i] = _mm_min_epi16(x, channel);
+	}
+
+	// transparent pixels are left alone
+	return gfxSelect(_mm_cmplt_epi32(color, _mm_setzero_si128()), color, gfxPackChannels(c[0], c[1], c[2]));
+}
+
+static inline __m128i gfxIncreaseBrightness(__m128i color, int coeff)
+{
+	const __m128i channel = _mm_set1_epi32(0x1F);
+	__m128i		  y		  = _mm_set1_epi32(coeff);
+	__m128i		  c[3];
+	for (int i = 0; i < 3; i++)
+	{
+		__m128i x = _mm_and_si128(_mm_srli_epi32(color, 5 * i), channel);
+		c[i] = _mm_add_epi32(x, _mm_srli_epi32(_mm_mullo_epi16(_mm_sub_epi32(channel, x), y), 4));
+	}
+	return gfxPackChannels(c[0], c[1], c[2]);
+}
+
+static inline __m128i gfxDecreaseBrightness(__m128i color, int coeff)
+{
+	const __m128i channel = _mm_set1_epi32(0x1F);
+	__m128i		  y		  = _mm_set1_epi32(coeff);
+	__m128i		  c[3];
+	for (int i = 0; i < 3; i++)
+	{
+		__m128i x = _mm_and_si128(_mm_srli_epi32(color, 5 * i), channel);
+		c[i] = _mm_sub_epi32(x, _mm_srli_epi32(_mm_mullo_epi16(x, y), 4));
+	}
+	return gfxPackChannels(c[0], c[1], c[2]);
+}
+
+template <int layers, int variant>
+static inline __m128i gfxCompositePixels(int x, __m128i backdrop, __m128i mask)
+{
+	const __m128i none = _mm_setzero_si128();
+	__m128i		  color = backdrop;
+	__m128i		  top	= _mm_set1_epi32(0x20);
+
+	if (layers & 0x01)
+		gfxSelectLayer(&line0[x], 0x01, mask, none, color, top);
+	if (layers & 0x02)
+		gfxSelectLayer(&line1[x], 0x02, mask, none, color, top);
+	if (layers & 0x04)
+		gfxSelectLayer(&line2[x], 0x04, mask, none, color, top);
+	if (layers & 0x08)
+		gfxSelectLayer(&line3[x], 0x08, mask, none, color, top);
+	gfxSelectLayer(&lineOBJ[x], 0x10, mask, none, color, top);
+
+	__m128i semi = gfxHasBits(color, _mm_set1_epi32(0x00010000));
+	if (variant == GFX_COMPOSITE_PLAIN)
+		semi = _mm_and_si128(semi, _mm_cmpeq_epi32(top, _mm_set1_epi32(0x10)));
+
+	int		effect	 = (BLDMOD >> 6) & 3;
+	__m128i topFx	 = gfxHasBits(top, _mm_set1_epi32(BLDMOD));
+	__m128i fx		 = none;
+	if (variant != GFX_COMPOSITE_PLAIN && effect != 0)
+		fx = _mm_andnot_si128(semi, _mm_and_si128(topFx, gfxHasBits(mask, _mm_set1_epi32(32))));
+
+	if (_mm_movemask_epi8(_mm_or_si128(semi, fx)) == 0)
+		return color;
+
+	// second layer for semi-transparent OBJ: backgrounds only
+	__m128i back = backdrop;
+	__m128i top2 = _mm_set1_epi32(0x20);
+	if (layers & 0x01)
+		gfxSelectLayer(&line0[x], 0x01, mask, none, back, top2);
+	if (layers & 0x02)
+		gfxSelectLayer(&line1[x], 0x02, mask, none, back, top2);
+	if (layers & 0x04)
+		gfxSelectLayer(&line2[x], 0x04, mask, none, back, top2);
+	if (layers & 0x08)
+		gfxSelectLayer(&line3[x], 0x08, mask, none, back, top2);
+
+	if (effect == 1 && _mm_movemask_epi8(fx))
+	{
+		// second layer for alpha blending: anything but the top layer
+		__m128i fxBack = backdrop;
+		__m128i fxTop2 = _mm_set1_epi32(0x20);
+		if (layers & 0x01)
+			gfxSelectLayer(&line0[x], 0x01, mask, _mm_cmpeq_epi32(top, _mm_set1_epi32(0x01)), fxBack, fxTop2);
+		if (layers & 0x02)
+			gfxSelectLayer(&line1[x], 0x02, mask, _mm_cmpeq_epi32(top, _mm_set1_epi32(0x02)), fxBack, fxTop2);
+		if (layers & 0x04)
+			gfxSelectLayer(&line2[x], 0x04, mask, _mm_cmpeq_epi32(top, _mm_set1_epi32(0x04)), fxBack, fxTop2);
+		if (layers & 0x08)
+			gfxSelectLayer(&line3[x], 0x08, mask, _mm_cmpeq_epi32(top, _mm_set1_epi32(0x08)), fxBack, fxTop2);
+		gfxSelectLayer(&lineOBJ[x], 0x10, mask, _mm_cmpeq_epi32(top, _mm_set1_epi32(0x10)), fxBack, fxTop2);
+
+		back = gfxSelect(semi, back, fxBack);
+		top2 = gfxSelect(semi, top2, fxTop2);
+	}
+
+	__m128i target = gfxHasBits(top2, _mm_set1_epi32(BLDMOD >> 8));
+	__m128i alpha  = _mm_and_si128(target, _mm_or_si128(semi, effect == 1 ? fx : none));
+	__m128i bright = none;
+	if (effect >= 2)
+		bright = _mm_or_si128(_mm_andnot_si128(target, _mm_and_si128(semi, topFx)), fx);
+
+	if (_mm_movemask_epi8(alpha))
+		color = gfxSelect(alpha, gfxAlphaBlend(color, back, coeff[COLEV & 0x1F], coeff[(COLEV >> 8) & 0x1F]), color);
+
+	if (_mm_movemask_epi8(bright))
+	{
+		if (effect == 2)
+			color = gfxSelect(bright, gfxIncreaseBrightness(color, coeff[COLY & 0x1F]), color);
+		else
+			color = gfxSelect(bright, gfxDecreaseBrightness(color, coeff[COLY & 0x1F]), color);
+	}
+
+	return color;
+}
+
+static inline __m128i gfxWindowMasks(int x, bool inWindow0, bool inWindow1)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	__m128i objWin = _mm_cmplt_epi32(_mm_loadu_si128((const __m128i *)&lineOBJWin[x]), zero);
+	__m128i mask   = gfxSelect(objWin, _mm_set1_epi32(WINOUT & 0xFF), _mm_set1_epi32(WINOUT >> 8));
+
+	if (inWindow1)
+	{
+		__m128i in = _mm_cvtsi32_si128(*(const int *)&gfxInWin1[x]);
+		in	 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(in, zero), zero);
+		mask = gfxSelect(_mm_cmpeq_epi32(in, zero), mask, _mm_set1_epi32(WININ >> 8));
+	}
+
+	if (inWindow0)
+	{
+		__m128i in = _mm_cvtsi32_si128(*(const int *)&gfxInWin0[x]);
+		in	 = _mm_unpacklo_epi16(_mm_unpacklo_epi8(in, zero), zero);
+		mask = gfxSelect(_mm_cmpeq_epi32(in, zero), mask, _mm_set1_epi32(WININ & 0xFF));
+	}
+
+	return mask;
+}
+#endif
+
+// layers has a bit set for each of line0..line3 drawn by the current mode
+template <int layers, int variant>
+static inline void gfxCompositeLine(u32 backdrop, bool inWindow0 = false, bool inWindow1 = false)
+{
+#ifdef GFX_COMPOSITE_SIMD
+	__m128i back = _mm_set1_epi32(backdrop);
+	__m128i all	 = _mm_set1_epi32(0x3F);
+	for (int x = 0; x < 240; x += 8)
+	{
+		__m128i mask0 = all;
+		__m128i mask1 = all;
+		if (variant == GFX_COMPOSITE_WINDOW)
+		{
+			mask0 = gfxWindowMasks(x, inWindow0, inWindow1);
+			mask1 = gfxWindowMasks(x + 4, inWindow0, inWindow1);
+		}
+		_mm_storeu_si128((__m128i *)&lineMix[x], gfxCompositePixels<layers, variant>(x, back, mask0));
+		_mm_storeu_si128((__m128i *)&lineMix[x + 4], gfxCompositePixels<layers, variant>(x + 4, back, mask1));
+	}
+#else
+	for (int x = 0; x < 240; x++)
+	{
+		u32 mask = 0x3F;
+		if (variant == GFX_COMPOSITE_WINDOW)
+			mask = gfxWindowMask(x, inWindow0, inWindow1);
+
+		u32 color = backdrop;
+		u8	top	  = 0x20;
+
+		if ((layers & 0x01) && (mask & 0x01) && (u8)(line0[x] >> 24) < (u8)(color >> 24))
+		{
+			color = line0[x];
+			top	  = 0x01;
+		}
+
+		if ((layers & 0x02) && (mask & 0x02) && (u8)(line1[x] >> 24) < (u8)(color >> 24))
+		{
+			color = line1[x];
+			top	  = 0x02;
+		}
+
+		if ((layers & 0x04) && (mask & 0x04) && (u8)(line2[x] >> 24) < (u8)(color >> 24))
+		{
+			color = line2[x];
+			top	  = 0x04;
+		}
+
+		if ((layers & 0x08) && (mask & 0x08) && (u8)(line3[x] >> 24) < (u8)(color >> 24))
+		{
+			color = line3[x];
+			top	  = 0x08;
+		}
+
+		if ((mask & 0x10) && (u8)(lineOBJ[x] >> 24) < (u8)(color >> 24))
+		{
+			color = lineOBJ[x];
+			top	  = 0x10;
+		}
+
+		bool semi = (color & 0x00010000) != 0;
+		if (variant == GFX_COMPOSITE_PLAIN)
+			semi = semi && (top & 0x10);
+
+		if (semi)
+		{
+			// semi-transparent OBJ
+			u32 back = backdrop;
+			u8	top2 = 0x20;
+
+			if ((layers & 0x01) && (mask & 0x01) && (u8)(line0[x] >> 24) < (u8)(back >> 24))
+			{
+				back = line0[x];
+				top2 = 0x01;
+			}
+
+			if ((layers & 0x02) && (mask & 0x02) && (u8)(line1[x] >> 24) < (u8)(back >> 24))
+			{
+				back = line1[x];
+				top2 = 0x02;
+			}
+
+			if ((layers & 0x04) && (mask & 0x04) && (u8)(line2[x] >> 24) < (u8)(back >> 24))
+			{
+				back = line2[x];
+				top2 = 0x04;
+			}
+
+			if ((layers & 0x08) && (mask & 0x08) && (u8)(line3[x] >> 24) < (u8)(back >> 24))
+			{
+				back = line3[x];
+				top2 = 0x08;
+			}
+
+			if (top2 & (BLDMOD >> 8))
+				color = gfxAlphaBlend(color, back,
+				                      coeff[COLEV & 0x1F],
+				                      coeff[(COLEV >> 8) & 0x1F]);
+			else
+			{
+				switch ((BLDMOD >> 6) & 3)
+				{
+				case 2:
+					if (BLDMOD & top)
+						color = gfxIncreaseBrightness(color, coeff[COLY & 0x1F]);
+					break;
+				case 3:
+					if (BLDMOD & top)
+						color = gfxDecreaseBrightness(color, coeff[COLY & 0x1F]);
+					break;
+				}
+			}
+		}
+		else if (variant != GFX_COMPOSITE_PLAIN && (mask & 32))
+		{
+			// special FX
+			switch ((BLDMOD >> 6) & 3)
+			{
+			case 0:
+				break;
+			case 1:
+			{
+				if (top & BLDMOD)
+				{
+					u32 back = backdrop;
+					u8	top2 = 0x20;
+
+					if ((layers & 0x01) && (mask & 0x01) && top != 0x01 && (u8)(line0[x] >> 24) < (u8)(back >> 24))
+					{
+						back = line0[x];
+						top2 = 0x01;
+					}
+
+					if ((layers & 0x02) && (mask & 0x02) && top != 0x02 && (u8)(line1[x] >> 24) < (u8)(back >> 24))
+					{
+						back = line1[x];
+						top2 = 0x02;
+					}
+
+					if ((layers & 0x04) && (mask & 0x04) && top != 0x04 && (u8)(line2[x] >> 24) < (u8)(back >> 24))
+					{
+						back = line2[x];
+						top2 = 0x04;
+					}
+
+					if ((layers & 0x08) && (mask & 0x08) && top != 0x08 && (u8)(line3[x] >> 24) < (u8)(back >> 24))
+					{
+						back = line3[x];
+						top2 = 0x08;
+					}
+
+					if ((mask & 0x10) && top != 0x10 && (u8)(lineOBJ[x] >> 24) < (u8)(back >> 24))
+					{
+						back = lineOBJ[x];
+						top2 = 0x10;
+					}
+
+					if (top2 & (BLDMOD >> 8))
+						color = gfxAlphaBlend(color, back,
+						                      coeff[COLEV & 0x1F],
+						                      coeff[(COLEV >> 8) & 0x1F]);
+				}
+				break;
+			}
+			case 2:
+				if (BLDMOD & top)
+					color = gfxIncreaseBrightness(color, coeff[COLY & 0x1F]);
+				break;
+			case 3:
+				if (BLDMOD & top)
+					color = gfxDecreaseBrightness(color, coeff[COLY & 0x1F]);
+				break;
+			}
+		}
+
+		lineMix[x] = color;
+	}
+#endif
+}
+
 #endif // GFX_H
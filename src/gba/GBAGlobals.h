@@ -62,113 +62,113 @@ typedef union
 } reg_pair;
 
 // internal...
-extern reg_pair reg[45];
-extern u8		biosProtected[4];
-extern bool8	ioReadable[0x400];
-extern bool8	N_FLAG;
-extern bool8	C_FLAG;
-extern bool8	Z_FLAG;
-extern bool8	V_FLAG;
-extern bool8	armState;
-extern bool8	armIrqEnable;
-extern u32		armNextPC;
-extern int32	armMode;
-extern int32	saveType;
-extern bool8	speedHack;
+extern EMU_STATE reg_pair reg[45];
+extern EMU_STATE u8		biosProtected[4];
+extern EMU_STATE bool8	ioReadable[0x400];
+extern EMU_STATE bool8	N_FLAG;
+extern EMU_STATE bool8	C_FLAG;
+extern EMU_STATE bool8	Z_FLAG;
+extern EMU_STATE bool8	V_FLAG;
+extern EMU_STATE bool8	armState;
+extern EMU_STATE bool8	armIrqEnable;
+extern EMU_STATE u32		armNextPC;
+extern EMU_STATE int32	armMode;
+extern EMU_STATE int32	saveType;
+extern EMU_STATE bool8	speedHack;
 
 #ifdef USE_GBA_CORE_V7
-extern bool		sramInitFix;
+extern EMU_STATE bool		sramInitFix;
 #endif
 
 #ifndef FINAL_VERSION
-extern u32		armStopAddr;
+extern EMU_STATE u32		armStopAddr;
 #endif
 
-extern u8 *rom;
-extern u8 *internalRAM;
-extern u8 *workRAM;
-extern u8 *paletteRAM;
-extern u8 *vram;
-extern u8 *oam;
-extern u8 *ioMem;
+extern EMU_STATE u8 *rom;
+extern EMU_STATE u8 *internalRAM;
+extern EMU_STATE u8 *workRAM;
+extern EMU_STATE u8 *paletteRAM;
+extern EMU_STATE u8 *vram;
+extern EMU_STATE u8 *oam;
+extern EMU_STATE u8 *ioMem;
 
-extern u16 DISPCNT;
-extern u16 DISPSTAT;
-extern u16 VCOUNT;
-extern u16 BG0CNT;
-extern u16 BG1CNT;
-extern u16 BG2CNT;
-extern u16 BG3CNT;
-extern u16 BG0HOFS;
-extern u16 BG0VOFS;
-extern u16 BG1HOFS;
-extern u16 BG1VOFS;
-extern u16 BG2HOFS;
-extern u16 BG2VOFS;
-extern u16 BG3HOFS;
-extern u16 BG3VOFS;
-extern u16 BG2PA;
-extern u16 BG2PB;
-extern u16 BG2PC;
-extern u16 BG2PD;
-extern u16 BG2X_L;
-extern u16 BG2X_H;
-extern u16 BG2Y_L;
-extern u16 BG2Y_H;
-extern u16 BG3PA;
-extern u16 BG3PB;
-extern u16 BG3PC;
-extern u16 BG3PD;
-extern u16 BG3X_L;
-extern u16 BG3X_H;
-extern u16 BG3Y_L;
-extern u16 BG3Y_H;
-extern u16 WIN0H;
-extern u16 WIN1H;
-extern u16 WIN0V;
-extern u16 WIN1V;
-extern u16 WININ;
-extern u16 WINOUT;
-extern u16 MOSAIC;
-extern u16 BLDMOD;
-extern u16 COLEV;
-extern u16 COLY;
-extern u16 DM0SAD_L;
-extern u16 DM0SAD_H;
-extern u16 DM0DAD_L;
-extern u16 DM0DAD_H;
-extern u16 DM0CNT_L;
-extern u16 DM0CNT_H;
-extern u16 DM1SAD_L;
-extern u16 DM1SAD_H;
-extern u16 DM1DAD_L;
-extern u16 DM1DAD_H;
-extern u16 DM1CNT_L;
-extern u16 DM1CNT_H;
-extern u16 DM2SAD_L;
-extern u16 DM2SAD_H;
-extern u16 DM2DAD_L;
-extern u16 DM2DAD_H;
-extern u16 DM2CNT_L;
-extern u16 DM2CNT_H;
-extern u16 DM3SAD_L;
-extern u16 DM3SAD_H;
-extern u16 DM3DAD_L;
-extern u16 DM3DAD_H;
-extern u16 DM3CNT_L;
-extern u16 DM3CNT_H;
-extern u16 TM0D;
-extern u16 TM0CNT;
-extern u16 TM1D;
-extern u16 TM1CNT;
-extern u16 TM2D;
-extern u16 TM2CNT;
-extern u16 TM3D;
-extern u16 TM3CNT;
-extern u16 P1;
-extern u16 IE;
-extern u16 IF;
-extern u16 IME;
+extern EMU_STATE u16 DISPCNT;
+extern EMU_STATE u16 DISPSTAT;
+extern EMU_STATE u16 VCOUNT;
+extern EMU_STATE u16 BG0CNT;
+extern EMU_STATE u16 BG1CNT;
+extern EMU_STATE u16 BG2CNT;
+extern EMU_STATE u16 BG3CNT;
+extern EMU_STATE u16 BG0HOFS;
+extern EMU_STATE u16 BG0VOFS;
+extern EMU_STATE u16 BG1HOFS;
+extern EMU_STATE u16 BG1VOFS;
+extern EMU_STATE u16 BG2HOFS;
+extern EMU_STATE u16 BG2VOFS;
+extern EMU_STATE u16 BG3HOFS;
+extern EMU_STATE u16 BG3VOFS;
+extern EMU_STATE u16 BG2PA;
+extern EMU_STATE u16 BG2PB;
+extern EMU_STATE u16 BG2PC;
+extern EMU_STATE u16 BG2PD;
+extern EMU_STATE u16 BG2X_L;
+extern EMU_STATE u16 BG2X_H;
+extern EMU_STATE u16 BG2Y_L;
+extern EMU_STATE u16 BG2Y_H;
+extern EMU_STATE u16 BG3PA;
+extern EMU_STATE u16 BG3PB;
+extern EMU_STATE u16 BG3PC;
+extern EMU_STATE u16 BG3PD;
+extern EMU_STATE u16 BG3X_L;
+extern EMU_STATE u16 BG3X_H;
+extern EMU_STATE u16 BG3Y_L;
+extern EMU_STATE u16 BG3Y_H;
+extern EMU_STATE u16 WIN0H;
+extern EMU_STATE u16 WIN1H;
+extern EMU_STATE u16 WIN0V;
+extern EMU_STATE u16 WIN1V;
+extern EMU_STATE u16 WININ;
+extern EMU_STATE u16 WINOUT;
+extern EMU_STATE u16 MOSAIC;
+extern EMU_STATE u16 BLDMOD;
+extern EMU_STATE u16 COLEV;
+extern EMU_STATE u16 COLY;
+extern EMU_STATE u16 DM0SAD_L;
+extern EMU_STATE u16 DM0SAD_H;
+extern EMU_STATE u16 DM0DAD_L;
+extern EMU_STATE u16 DM0DAD_H;
+extern EMU_STATE u16 DM0CNT_L;
+extern EMU_STATE u16 DM0CNT_H;
+extern EMU_STATE u16 DM1SAD_L;
+extern EMU_STATE u16 DM1SAD_H;
+extern EMU_STATE u16 DM1DAD_L;
+extern EMU_STATE u16 DM1DAD_H;
+extern EMU_STATE u16 DM1CNT_L;
+extern EMU_STATE u16 DM1CNT_H;
+extern EMU_STATE u16 DM2SAD_L;
+extern EMU_STATE u16 DM2SAD_H;
+extern EMU_STATE u16 DM2DAD_L;
+extern EMU_STATE u16 DM2DAD_H;
+extern EMU_STATE u16 DM2CNT_L;
+extern EMU_STATE u16 DM2CNT_H;
+extern EMU_STATE u16 DM3SAD_L;
+extern EMU_STATE u16 DM3SAD_H;
+extern EMU_STATE u16 DM3DAD_L;
+extern EMU_STATE u16 DM3DAD_H;
+extern EMU_STATE u16 DM3CNT_L;
+extern EMU_STATE u16 DM3CNT_H;
+extern EMU_STATE u16 TM0D;
+extern EMU_STATE u16 TM0CNT;
+extern EMU_STATE u16 TM1D;
+extern EMU_STATE u16 TM1CNT;
+extern EMU_STATE u16 TM2D;
+extern EMU_STATE u16 TM2CNT;
+extern EMU_STATE u16 TM3D;
+extern EMU_STATE u16 TM3CNT;
+extern EMU_STATE u16 P1;
+extern EMU_STATE u16 IE;
+extern EMU_STATE u16 IF;
+extern EMU_STATE u16 IME;
 
 extern const u32 frameRateDividend;
 extern const u32 frameRateDivisor;
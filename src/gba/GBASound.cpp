@@ -11,7 +11,7 @@
 #define SOUND_MAGIC_2 0x30000000
 #define NOISE_MAGIC (2097152.0 / 44100.0)
 
-extern bool8 stopState;
+extern EMU_STATE bool8 stopState;
 
 u8 soundWavePattern[4][32] = {
 	{ 0x01, 0x01, 0x01, 0x01,
@@ -78,92 +78,100 @@ int32 soundShiftClock[16] = {
 	1    // 15
 };
 
-int32 soundLevel1 = 0;
-int32 soundLevel2 = 0;
-int32 soundBalance = 0;
-int32 soundMasterOn = 0;
-int32 soundDebug = 0;
-
-int32 sound1On = 0;
-int32 sound1ATL = 0;
-int32 sound1Skip = 0;
-int32 sound1Index = 0;
-int32 sound1Continue = 0;
-int32 sound1EnvelopeVolume	  = 0;
-int32 sound1EnvelopeATL		  = 0;
-int32 sound1EnvelopeUpDown	  = 0;
-int32 sound1EnvelopeATLReload = 0;
-int32 sound1SweepATL		  = 0;
-int32 sound1SweepATLReload	  = 0;
-int32 sound1SweepSteps		  = 0;
-int32 sound1SweepUpDown		  = 0;
-int32 sound1SweepStep		  = 0;
-u8 *  sound1Wave			  = soundWavePattern[2];
-
-int32 sound2On = 0;
-int32 sound2ATL = 0;
-int32 sound2Skip = 0;
-int32 sound2Index = 0;
-int32 sound2Continue = 0;
-int32 sound2EnvelopeVolume	  = 0;
-int32 sound2EnvelopeATL		  = 0;
-int32 sound2EnvelopeUpDown	  = 0;
-int32 sound2EnvelopeATLReload = 0;
-u8 *  sound2Wave			  = soundWavePattern[2];
-
-int32 sound3On = 0;
-int32 sound3ATL			= 0;
-int32 sound3Skip		= 0;
-int32 sound3Index		= 0;
-int32 sound3Continue	= 0;
-int32 sound3OutputLevel = 0;
-int32 sound3Last		= 0;
-u8	  sound3WaveRam[0x20];
-int32 sound3Bank		 = 0;
-int32 sound3DataSize	 = 0;
-int32 sound3ForcedOutput = 0;
-
-int32 sound4On = 0;
-int32 sound4Clock = 0;
-int32 sound4ATL = 0;
-int32 sound4Skip = 0;
-int32 sound4Index = 0;
-int32 sound4ShiftRight		  = 0x7f;
-int32 sound4ShiftSkip		  = 0;
-int32 sound4ShiftIndex		  = 0;
-int32 sound4NSteps			  = 0;
-int32 sound4CountDown		  = 0;
-int32 sound4Continue		  = 0;
-int32 sound4EnvelopeVolume	  = 0;
-int32 sound4EnvelopeATL		  = 0;
-int32 sound4EnvelopeUpDown	  = 0;
-int32 sound4EnvelopeATLReload = 0;
-
-int32 soundDSFifoAIndex		 = 0;
-int32 soundDSFifoACount		 = 0;
-int32 soundDSFifoAWriteIndex = 0;
-bool8 soundDSAEnabled		 = false;
-int32 soundDSATimer = 0;
-u8	  soundDSFifoA[32];
-u8	  soundDSAValue = 0;
-
-int32 soundDSFifoBIndex		 = 0;
-int32 soundDSFifoBCount		 = 0;
-int32 soundDSFifoBWriteIndex = 0;
-bool8 soundDSBEnabled		 = false; // but bool8 is not big enough for int32
-int32 soundDSBTimer = 0;
-u8	  soundDSFifoB[32];
-u8	  soundDSBValue = 0;
-
-int32 soundControl = 0;
+EMU_STATE int32 soundLevel1 = 0;
+EMU_STATE int32 soundLevel2 = 0;
+EMU_STATE int32 soundBalance = 0;
+EMU_STATE int32 soundMasterOn = 0;
+EMU_STATE int32 soundDebug = 0;
+
+EMU_STATE int32 sound1On = 0;
+EMU_STATE int32 sound1ATL = 0;
+EMU_STATE int32 sound1Skip = 0;
+EMU_STATE int32 sound1Index = 0;
+EMU_STATE int32 sound1Continue = 0;
+EMU_STATE int32 sound1EnvelopeVolume	  = 0;
+EMU_STATE int32 sound1EnvelopeATL		  = 0;
+EMU_STATE int32 sound1EnvelopeUpDown	  = 0;
+EMU_STATE int32 sound1EnvelopeATLReload = 0;
+EMU_STATE int32 sound1SweepATL		  = 0;
+EMU_STATE int32 sound1SweepATLReload	  = 0;
+EMU_STATE int32 sound1SweepSteps		  = 0;
+EMU_STATE int32 sound1SweepUpDown		  = 0;
+EMU_STATE int32 sound1SweepStep		  = 0;
+EMU_STATE u8 *  sound1Wave			  = soundWavePattern[2];
+
+EMU_STATE int32 sound2On = 0;
+EMU_STATE int32 sound2ATL = 0;
+EMU_STATE int32 sound2Skip = 0;
+EMU_STATE int32 sound2Index = 0;
+EMU_STATE int32 sound2Continue = 0;
+EMU_STATE int32 sound2EnvelopeVolume	  = 0;
+EMU_STATE int32 sound2EnvelopeATL		  = 0;
+EMU_STATE int32 sound2EnvelopeUpDown	  = 0;
+EMU_STATE int32 sound2EnvelopeATLReload = 0;
+EMU_STATE u8 *  sound2Wave			  = soundWavePattern[2];
+
+EMU_STATE int32 sound3On = 0;
+EMU_STATE int32 sound3ATL			= 0;
+EMU_STATE int32 sound3Skip		= 0;
+EMU_STATE int32 sound3Index		= 0;
+EMU_STATE int32 sound3Continue	= 0;
+EMU_STATE int32 sound3OutputLevel = 0;
+EMU_STATE int32 sound3Last		= 0;
+EMU_STATE u8	  sound3WaveRam[0x20];
+EMU_STATE int32 sound3Bank		 = 0;
+EMU_STATE int32 sound3DataSize	 = 0;
+EMU_STATE int32 sound3ForcedOutput = 0;
+
+EMU_STATE int32 sound4On = 0;
+EMU_STATE int32 sound4Clock = 0;
+EMU_STATE int32 sound4ATL = 0;
+EMU_STATE int32 sound4Skip = 0;
+EMU_STATE int32 sound4Index = 0;
+EMU_STATE int32 sound4ShiftRight		  = 0x7f;
+EMU_STATE int32 sound4ShiftSkip		  = 0;
+EMU_STATE int32 sound4ShiftIndex		  = 0;
+EMU_STATE int32 sound4NSteps			  = 0;
+EMU_STATE int32 sound4CountDown		  = 0;
+EMU_STATE int32 sound4Continue		  = 0;
+EMU_STATE int32 sound4EnvelopeVolume	  = 0;
+EMU_STATE int32 sound4EnvelopeATL		  = 0;
+EMU_STATE int32 sound4EnvelopeUpDown	  = 0;
+EMU_STATE int32 sound4EnvelopeATLReload = 0;
+
+EMU_STATE int32 soundDSFifoAIndex		 = 0;
+EMU_STATE int32 soundDSFifoACount		 = 0;
+EMU_STATE int32 soundDSFifoAWriteIndex = 0;
+EMU_STATE bool8 soundDSAEnabled		 = false;
+EMU_STATE int32 soundDSATimer = 0;
+EMU_STATE u8	  soundDSFifoA[32];
+EMU_STATE u8	  soundDSAValue = 0;
+
+EMU_STATE int32 soundDSFifoBIndex		 = 0;
+EMU_STATE int32 soundDSFifoBCount		 = 0;
+EMU_STATE int32 soundDSFifoBWriteIndex = 0;
+EMU_STATE bool8 soundDSBEnabled		 = false; // but bool8 is not big enough for int32
+EMU_STATE int32 soundDSBTimer = 0;
+EMU_STATE u8	  soundDSFifoB[32];
+EMU_STATE u8	  soundDSBValue = 0;
+
+EMU_STATE int32 soundControl = 0;
+
+// set while a run's level changes are reported to the band-limited synthesizer
+static EMU_STATE bool8 soundSynthOn = false;
+
+// above one waveform step per output cycle, only the levels at the ends of the first and the last tick of a span are reported
+#define SOUND_SYNTH_MAX_ADVANCE 0x20000000
+
+static const int soundSynthPSGShift[4] = { 2, 1, 0, 2 };
 
 // dummy variables
-static int32  soundTicks_int32;
-static int32  soundTickStep_int32;
-static int32  soundDSBValue_int32;
-static int32  soundDSBEnabled_int32;
+static EMU_STATE int32  soundTicks_int32;
+static EMU_STATE int32  soundTickStep_int32;
+static EMU_STATE int32  soundDSBValue_int32;
+static EMU_STATE int32  soundDSBEnabled_int32;
 
-variable_desc soundSaveStruct[] = {
+EMU_STATE_DYNAMIC variable_desc soundSaveStruct[] = {
 	{ &soundPaused,				sizeof(int32) },
 	{ &soundPlay,				sizeof(int32) },
 	{ &soundTicks_int32,		sizeof(int32) },
@@ -233,12 +241,12 @@ variable_desc soundSaveStruct[] = {
 	{ &soundDSBTimer,			sizeof(int32) },
 	{ &soundDSFifoB[0],			32			  },
 	{ &soundDSBValue_int32,		sizeof(int32) }, // save as int32 because of a mistake of the past.
-	{ &soundBuffer[0][0],		6 * 735		  },
+	{ &soundBuffer[0][0],		6 * 735		  }, // no longer filled, kept for the state layout
 	{ &soundFinalWave[0],		2 * 735		  },
 	{ NULL,						0			  }
 };
 
-variable_desc soundSaveStructV2[] = {
+EMU_STATE_DYNAMIC variable_desc soundSaveStructV2[] = {
 	{ &sound3WaveRam[0],   0x20			 },
 	{ &sound3Bank,		   sizeof(int32) },
 	{ &sound3DataSize,	   sizeof(int32) },
@@ -257,6 +265,9 @@ void soundEvent(u32 address, u8 data)
 {
 	int freq = 0;
 
+	// the ticks before the write still see the old register values
+	soundSync();
+
 	switch (address)
 	{
 	case NR10:
@@ -527,6 +538,8 @@ void soundEvent(u32 address, u8 data)
 
 void soundEvent(u32 address, u16 data)
 {
+	soundSync();
+
 	switch (address)
 	{
 	case SGCNT0_H:
@@ -588,315 +601,484 @@ void soundEvent(u32 address, u16 data)
 	}
 }
 
-void soundChannel1()
+// cpu cycle of the run at which a channel advancing by advance per tick has covered distance
+static inline int soundSynthTime(int tick, u64 distance, u32 advance)
 {
-	int vol = sound1EnvelopeVolume;
+	return tick * soundTickStep + (int)(distance * soundTickStep / advance);
+}
 
-	int freq  = 0;
-	int value = 0;
+static void soundSynth(int channel, int time, int value)
+{
+	int left  = 0;
+	int right = 0;
 
-	if (sound1On && (sound1ATL || !sound1Continue))
+	if (channel < 4)
 	{
-		sound1Index += soundQuality * sound1Skip;
-		sound1Index &= 0x1fffffff;
-
-		value = ((s8)sound1Wave[sound1Index >> 24]) * vol;
+		// PSG channels share the master level and the GBA's PSG ratio
+		int level = (value * 52 * soundLevel1) >> soundSynthPSGShift[ioMem[0x82] & 3];
+		if (soundBalance & (16 << channel))
+			left = level;
+		if (soundBalance & (1 << channel))
+			right = level;
 	}
-
-	soundBuffer[0][soundIndex] = value;
-
-	if (sound1On)
+	else
 	{
-		if (sound1ATL)
+		int ds = channel - 4;
+		if (soundEnableFlag & (0x100 << ds))
 		{
-			sound1ATL -= soundQuality;
-
-			if (sound1ATL <= 0 && sound1Continue)
-			{
-				ioMem[NR52] &= 0xfe;
-				sound1On	 = 0;
-			}
+			int level = ((ioMem[0x82] & (4 << ds)) ? value : (value >> 1)) * 170;
+			if (soundControl & (0x200 << (4 * ds)))
+				left = level;
+			if (soundControl & (0x100 << (4 * ds)))
+				right = level;
 		}
+	}
 
-		if (sound1EnvelopeATL)
-		{
-			sound1EnvelopeATL -= soundQuality;
-
-			if (sound1EnvelopeATL <= 0)
-			{
-				if (sound1EnvelopeUpDown)
-				{
-					if (sound1EnvelopeVolume < 15)
-						sound1EnvelopeVolume++;
-				}
-				else
-				{
-					if (sound1EnvelopeVolume)
-						sound1EnvelopeVolume--;
-				}
+	systemSoundSynth(channel, time, left, right);
+}
 
-				sound1EnvelopeATL += sound1EnvelopeATLReload;
-			}
-		}
+// ticks, at most count, until a length, envelope or sweep counter runs out; a channel's
+// state only changes then, so it is advanced through that many ticks at once
+static inline int soundCounterTicks(int counter, int count)
+{
+	int ticks = counter > 0 ? (counter + soundQuality - 1) / soundQuality : 1;
+	return ticks < count ? ticks : count;
+}
 
-		if (sound1SweepATL)
-		{
-			sound1SweepATL -= soundQuality;
+// counts a counter down over ticks in which it doesn't run out; like the per-tick
+// countdown, a length counter without the continue flag stops once it hits 0
+static inline int soundCounterSkip(int counter, int ticks)
+{
+	if (counter > 0 && counter % soundQuality == 0 && counter / soundQuality <= ticks)
+		return 0;
 
-			if (sound1SweepATL <= 0)
-			{
-				freq = (((int)(ioMem[NR14] & 7) << 8) | ioMem[NR13]);
+	return counter ? counter - soundQuality * ticks : 0;
+}
 
-				int updown = 1;
+static int soundChannel3Value(u32 index)
+{
+	int value;
 
-				if (sound1SweepUpDown)
-					updown = -1;
+	if (sound3DataSize)
+	{
+		value = sound3WaveRam[(index & 0x3fffffff) >> 25];
+	}
+	else
+	{
+		value = sound3WaveRam[sound3Bank * 0x10 + ((index & 0x1fffffff) >> 25)];
+	}
 
-				int newfreq = 0;
-				if (sound1SweepSteps)
-				{
-					newfreq = freq + updown * freq / (1 << sound1SweepSteps);
-					if (newfreq == freq)
-						newfreq = 0;
-				}
-				else
-					newfreq = freq;
+	if ((index & 0x01000000))
+	{
+		value &= 0x0f;
+	}
+	else
+	{
+		value >>= 4;
+	}
 
-				if (newfreq < 0)
-				{
-					sound1SweepATL += sound1SweepATLReload;
-				}
-				else if (newfreq > 2047)
-				{
-					sound1SweepATL = 0;
-					sound1On	   = 0;
-					ioMem[NR52]	  &= 0xfe;
-				}
-				else
-				{
-					sound1SweepATL += sound1SweepATLReload;
-					sound1Skip		= SOUND_MAGIC / (2048 - newfreq);
+	value -= 8;
+	value *= 2;
 
-					ioMem[NR13] = newfreq & 0xff;
-					ioMem[NR14] = (ioMem[NR14] & 0xf8) | ((newfreq >> 8) & 7);
-				}
-			}
+	if (sound3ForcedOutput)
+	{
+		value = ((value >> 1) + value) >> 1;
+	}
+	else
+	{
+		switch (sound3OutputLevel)
+		{
+		case 0:
+			value = 0;
+			break;
+		case 1:
+			break;
+		case 2:
+			value = (value >> 1);
+			break;
+		case 3:
+			value = (value >> 2);
+			break;
 		}
 	}
+	//value += 1;
+	return value;
+}
+
+static int soundSynthLevel(int channel, u32 index)
+{
+	switch (channel)
+	{
+	case 0:
+		return ((s8)sound1Wave[(index & 0x1fffffff) >> 24]) * sound1EnvelopeVolume;
+	case 1:
+		return ((s8)sound2Wave[(index & 0x1fffffff) >> 24]) * sound2EnvelopeVolume;
+	default:
+		return soundChannel3Value(index);
+	}
 }
 
-void soundChannel2()
+// reports every waveform step a channel crosses in count ticks from index, and its level at
+// the end of the first and the last of them; a level set by a new volume shows up after
+// the first tick, as it did when the channel was run tick by tick
+static void soundSynthSteps(int channel, int tick, int count, u32 index, u32 advance)
 {
-	//  int freq = 0;
-	int vol = sound2EnvelopeVolume;
+	bool steps = advance < SOUND_SYNTH_MAX_ADVANCE;
+	u64	 end   = (u64)advance * count;
+	u64	 step  = 0x1000000 - (index & 0xffffff);
 
-	int value = 0;
+	for (; steps && step < advance; step += 0x1000000)
+		soundSynth(channel, soundSynthTime(tick, step, advance), soundSynthLevel(channel, index + (u32)step));
+	soundSynth(channel, (tick + 1) * soundTickStep, soundSynthLevel(channel, index + advance));
 
-	if (sound2On && (sound2ATL || !sound2Continue))
+	if (count > 1)
 	{
-		sound2Index += soundQuality * sound2Skip;
-		sound2Index &= 0x1fffffff;
-
-		value = ((s8)sound2Wave[sound2Index >> 24]) * vol;
+		for (; steps && step < end; step += 0x1000000)
+			soundSynth(channel, soundSynthTime(tick, step, advance), soundSynthLevel(channel, index + (u32)step));
+		soundSynth(channel, (tick + count) * soundTickStep, soundSynthLevel(channel, index + (u32)end));
 	}
+}
 
-	soundBuffer[1][soundIndex] = value;
+// the length, envelope and sweep counters of the last tick of a span, where one runs out
+static void soundChannel1Counters()
+{
+	int freq = 0;
 
-	if (sound2On)
+	if (sound1ATL)
 	{
-		if (sound2ATL)
+		sound1ATL -= soundQuality;
+
+		if (sound1ATL <= 0 && sound1Continue)
 		{
-			sound2ATL -= soundQuality;
+			ioMem[NR52] &= 0xfe;
+			sound1On	 = 0;
+		}
+	}
 
-			if (sound2ATL <= 0 && sound2Continue)
+	if (sound1EnvelopeATL)
+	{
+		sound1EnvelopeATL -= soundQuality;
+
+		if (sound1EnvelopeATL <= 0)
+		{
+			if (sound1EnvelopeUpDown)
 			{
-				ioMem[NR52] &= 0xfd;
-				sound2On	 = 0;
+				if (sound1EnvelopeVolume < 15)
+					sound1EnvelopeVolume++;
 			}
+			else
+			{
+				if (sound1EnvelopeVolume)
+					sound1EnvelopeVolume--;
+			}
+
+			sound1EnvelopeATL += sound1EnvelopeATLReload;
 		}
+	}
+
+	if (sound1SweepATL)
+	{
+		sound1SweepATL -= soundQuality;
 
-		if (sound2EnvelopeATL)
+		if (sound1SweepATL <= 0)
 		{
-			sound2EnvelopeATL -= soundQuality;
+			freq = (((int)(ioMem[NR14] & 7) << 8) | ioMem[NR13]);
+
+			int updown = 1;
 
-			if (sound2EnvelopeATL <= 0)
+			if (sound1SweepUpDown)
+				updown = -1;
+
+			int newfreq = 0;
+			if (sound1SweepSteps)
 			{
-				if (sound2EnvelopeUpDown)
-				{
-					if (sound2EnvelopeVolume < 15)
-						sound2EnvelopeVolume++;
-				}
-				else
-				{
-					if (sound2EnvelopeVolume)
-						sound2EnvelopeVolume--;
-				}
-				sound2EnvelopeATL += sound2EnvelopeATLReload;
+				newfreq = freq + updown * freq / (1 << sound1SweepSteps);
+				if (newfreq == freq)
+					newfreq = 0;
+			}
+			else
+				newfreq = freq;
+
+			if (newfreq < 0)
+			{
+				sound1SweepATL += sound1SweepATLReload;
+			}
+			else if (newfreq > 2047)
+			{
+				sound1SweepATL = 0;
+				sound1On	   = 0;
+				ioMem[NR52]	  &= 0xfe;
+			}
+			else
+			{
+				sound1SweepATL += sound1SweepATLReload;
+				sound1Skip		= SOUND_MAGIC / (2048 - newfreq);
+
+				ioMem[NR13] = newfreq & 0xff;
+				ioMem[NR14] = (ioMem[NR14] & 0xf8) | ((newfreq >> 8) & 7);
 			}
 		}
 	}
 }
 
-void soundChannel3()
+static void soundChannel1(int count)
 {
-	int value = sound3Last;
-
-	if (sound3On && (sound3ATL || !sound3Continue))
+	for (int tick = 0, ticks; tick < count; tick += ticks)
 	{
-		sound3Index += soundQuality * sound3Skip;
-		if (sound3DataSize)
+		ticks = count - tick;
+		if (sound1On)
 		{
-			sound3Index &= 0x3fffffff;
-			value		 = sound3WaveRam[sound3Index >> 25];
+			if (sound1ATL && sound1Continue)
+				ticks = soundCounterTicks(sound1ATL, ticks);
+			if (sound1EnvelopeATL)
+				ticks = soundCounterTicks(sound1EnvelopeATL, ticks);
+			if (sound1SweepATL)
+				ticks = soundCounterTicks(sound1SweepATL, ticks);
 		}
-		else
+
+		if (sound1On && (sound1ATL || !sound1Continue))
 		{
-			sound3Index &= 0x1fffffff;
-			value		 = sound3WaveRam[sound3Bank * 0x10 + (sound3Index >> 25)];
-		}
+			u32 advance = (u32)soundQuality * (u32)sound1Skip;
+			if (soundSynthOn)
+				soundSynthSteps(0, tick, ticks, sound1Index, advance);
 
-		if ((sound3Index & 0x01000000))
+			sound1Index += (u32)((u64)advance * ticks);
+			sound1Index &= 0x1fffffff;
+		}
+		else if (soundSynthOn)
 		{
-			value &= 0x0f;
+			soundSynth(0, (tick + 1) * soundTickStep, 0);
 		}
-		else
+
+		if (sound1On)
 		{
-			value >>= 4;
+			sound1ATL		  = soundCounterSkip(sound1ATL, ticks - 1);
+			sound1EnvelopeATL = soundCounterSkip(sound1EnvelopeATL, ticks - 1);
+			sound1SweepATL	  = soundCounterSkip(sound1SweepATL, ticks - 1);
+			soundChannel1Counters();
 		}
+	}
+}
 
-		value -= 8;
-		value *= 2;
+static void soundChannel2Counters()
+{
+	if (sound2ATL)
+	{
+		sound2ATL -= soundQuality;
 
-		if (sound3ForcedOutput)
+		if (sound2ATL <= 0 && sound2Continue)
 		{
-			value = ((value >> 1) + value) >> 1;
+			ioMem[NR52] &= 0xfd;
+			sound2On	 = 0;
 		}
-		else
+	}
+
+	if (sound2EnvelopeATL)
+	{
+		sound2EnvelopeATL -= soundQuality;
+
+		if (sound2EnvelopeATL <= 0)
 		{
-			switch (sound3OutputLevel)
+			if (sound2EnvelopeUpDown)
+			{
+				if (sound2EnvelopeVolume < 15)
+					sound2EnvelopeVolume++;
+			}
+			else
 			{
-			case 0:
-				value = 0;
-				break;
-			case 1:
-				break;
-			case 2:
-				value = (value >> 1);
-				break;
-			case 3:
-				value = (value >> 2);
-				break;
+				if (sound2EnvelopeVolume)
+					sound2EnvelopeVolume--;
 			}
+			sound2EnvelopeATL += sound2EnvelopeATLReload;
 		}
-		//value += 1;
-		sound3Last = value;
 	}
+}
 
-	soundBuffer[2][soundIndex] = value;
-
-	if (sound3On)
+static void soundChannel2(int count)
+{
+	for (int tick = 0, ticks; tick < count; tick += ticks)
 	{
-		if (sound3ATL)
+		ticks = count - tick;
+		if (sound2On)
 		{
-			sound3ATL -= soundQuality;
+			if (sound2ATL && sound2Continue)
+				ticks = soundCounterTicks(sound2ATL, ticks);
+			if (sound2EnvelopeATL)
+				ticks = soundCounterTicks(sound2EnvelopeATL, ticks);
+		}
 
-			if (sound3ATL <= 0 && sound3Continue)
-			{
-				ioMem[NR52] &= 0xfb;
-				sound3On	 = 0;
-			}
+		if (sound2On && (sound2ATL || !sound2Continue))
+		{
+			u32 advance = (u32)soundQuality * (u32)sound2Skip;
+			if (soundSynthOn)
+				soundSynthSteps(1, tick, ticks, sound2Index, advance);
+
+			sound2Index += (u32)((u64)advance * ticks);
+			sound2Index &= 0x1fffffff;
+		}
+		else if (soundSynthOn)
+		{
+			soundSynth(1, (tick + 1) * soundTickStep, 0);
+		}
+
+		if (sound2On)
+		{
+			sound2ATL		  = soundCounterSkip(sound2ATL, ticks - 1);
+			sound2EnvelopeATL = soundCounterSkip(sound2EnvelopeATL, ticks - 1);
+			soundChannel2Counters();
 		}
 	}
 }
 
-void soundChannel4()
+static void soundChannel3(int count)
 {
-	int vol = sound4EnvelopeVolume;
-
-	int value = 0;
-
-	if (sound4Clock <= 0x0c)
+	for (int tick = 0, ticks; tick < count; tick += ticks)
 	{
-		if (sound4On && (sound4ATL || !sound4Continue))
+		ticks = count - tick;
+		if (sound3On && sound3ATL && sound3Continue)
+			ticks = soundCounterTicks(sound3ATL, ticks);
+
+		if (sound3On && (sound3ATL || !sound3Continue))
 		{
-	  #define NOISE_ONE_SAMP_SCALE  0x200000
+			u32 advance = (u32)soundQuality * (u32)sound3Skip;
+			if (soundSynthOn)
+				soundSynthSteps(2, tick, ticks, sound3Index, advance);
 
-			sound4Index		 += soundQuality * sound4Skip;
-			sound4ShiftIndex += soundQuality * sound4ShiftSkip;
+			sound3Index += (u32)((u64)advance * ticks);
+			sound3Index &= sound3DataSize ? 0x3fffffff : 0x1fffffff;
 
-			if (sound4NSteps)
-			{
-				while (sound4ShiftIndex >= NOISE_ONE_SAMP_SCALE)
-				{
-					sound4ShiftRight = (((sound4ShiftRight << 6) ^
-					                     (sound4ShiftRight << 5)) & 0x40) |
-					                   (sound4ShiftRight >> 1);
-					sound4ShiftIndex -= NOISE_ONE_SAMP_SCALE;
-				}
-			}
-			else
+			sound3Last = soundChannel3Value(sound3Index);
+		}
+		else if (soundSynthOn)
+		{
+			soundSynth(2, (tick + 1) * soundTickStep, sound3Last);
+		}
+
+		if (sound3On)
+		{
+			sound3ATL = soundCounterSkip(sound3ATL, ticks - 1);
+			if (sound3ATL)
 			{
-				while (sound4ShiftIndex >= NOISE_ONE_SAMP_SCALE)
-				{
-					sound4ShiftRight = (((sound4ShiftRight << 14) ^
-					                     (sound4ShiftRight << 13)) & 0x4000) |
-					                   (sound4ShiftRight >> 1);
+				sound3ATL -= soundQuality;
 
-					sound4ShiftIndex -= NOISE_ONE_SAMP_SCALE;
+				if (sound3ATL <= 0 && sound3Continue)
+				{
+					ioMem[NR52] &= 0xfb;
+					sound3On	 = 0;
 				}
 			}
+		}
+	}
+}
 
-			sound4Index		 %= NOISE_ONE_SAMP_SCALE;
-			sound4ShiftIndex %= NOISE_ONE_SAMP_SCALE;
+static void soundChannel4Counters()
+{
+	if (sound4ATL)
+	{
+		sound4ATL -= soundQuality;
 
-			value = ((sound4ShiftRight & 1) * 2 - 1) * vol;
-		}
-		else
+		if (sound4ATL <= 0 && sound4Continue)
 		{
-			value = 0;
+			ioMem[NR52] &= 0xfd;
+			sound4On	 = 0;
 		}
 	}
 
-	soundBuffer[3][soundIndex] = value;
-
-	if (sound4On)
+	if (sound4EnvelopeATL)
 	{
-		if (sound4ATL)
-		{
-			sound4ATL -= soundQuality;
+		sound4EnvelopeATL -= soundQuality;
 
-			if (sound4ATL <= 0 && sound4Continue)
+		if (sound4EnvelopeATL <= 0)
+		{
+			if (sound4EnvelopeUpDown)
+			{
+				if (sound4EnvelopeVolume < 15)
+					sound4EnvelopeVolume++;
+			}
+			else
 			{
-				ioMem[NR52] &= 0xfd;
-				sound4On	 = 0;
+				if (sound4EnvelopeVolume)
+					sound4EnvelopeVolume--;
 			}
+			sound4EnvelopeATL += sound4EnvelopeATLReload;
+		}
+	}
+}
+
+#define NOISE_ONE_SAMP_SCALE  0x200000
+
+static inline int soundChannel4Shift(int shiftRight)
+{
+	if (sound4NSteps)
+		return (((shiftRight << 6) ^ (shiftRight << 5)) & 0x40) | (shiftRight >> 1);
+
+	return (((shiftRight << 14) ^ (shiftRight << 13)) & 0x4000) | (shiftRight >> 1);
+}
+
+static void soundChannel4(int count)
+{
+	for (int tick = 0, ticks; tick < count; tick += ticks)
+	{
+		ticks = count - tick;
+		if (sound4On)
+		{
+			if (sound4ATL && sound4Continue)
+				ticks = soundCounterTicks(sound4ATL, ticks);
+			if (sound4EnvelopeATL)
+				ticks = soundCounterTicks(sound4EnvelopeATL, ticks);
 		}
 
-		if (sound4EnvelopeATL)
+		if (sound4Clock <= 0x0c && sound4On && (sound4ATL || !sound4Continue))
 		{
-			sound4EnvelopeATL -= soundQuality;
+			int vol		= sound4EnvelopeVolume;
+			int advance = soundQuality * sound4ShiftSkip;
+			// report each shift of the noise register while there are few per tick
+			bool synth = soundSynthOn && advance > 0 && advance < 16 * NOISE_ONE_SAMP_SCALE;
+			u64	 end   = (u64)advance * ticks;
+			u64	 shift = NOISE_ONE_SAMP_SCALE - sound4ShiftIndex;
+
+			for (; shift <= (u64)advance; shift += NOISE_ONE_SAMP_SCALE)
+			{
+				sound4ShiftRight = soundChannel4Shift(sound4ShiftRight);
+				if (synth)
+					soundSynth(3, soundSynthTime(tick, shift, advance), ((sound4ShiftRight & 1) * 2 - 1) * vol);
+			}
+			if (soundSynthOn)
+				soundSynth(3, (tick + 1) * soundTickStep, ((sound4ShiftRight & 1) * 2 - 1) * vol);
 
-			if (sound4EnvelopeATL <= 0)
+			if (ticks > 1)
 			{
-				if (sound4EnvelopeUpDown)
-				{
-					if (sound4EnvelopeVolume < 15)
-						sound4EnvelopeVolume++;
-				}
-				else
+				for (; shift <= end; shift += NOISE_ONE_SAMP_SCALE)
 				{
-					if (sound4EnvelopeVolume)
-						sound4EnvelopeVolume--;
+					sound4ShiftRight = soundChannel4Shift(sound4ShiftRight);
+					if (synth)
+						soundSynth(3, soundSynthTime(tick, shift, advance), ((sound4ShiftRight & 1) * 2 - 1) * vol);
 				}
-				sound4EnvelopeATL += sound4EnvelopeATLReload;
+				if (soundSynthOn)
+					soundSynth(3, (tick + ticks) * soundTickStep, ((sound4ShiftRight & 1) * 2 - 1) * vol);
 			}
+
+			sound4Index		 = (int)(((u64)sound4Index + (u64)(soundQuality * sound4Skip) * ticks) % NOISE_ONE_SAMP_SCALE);
+			sound4ShiftIndex = (int)(((u64)sound4ShiftIndex + end) % NOISE_ONE_SAMP_SCALE);
+		}
+		else if (soundSynthOn)
+		{
+			soundSynth(3, (tick + 1) * soundTickStep, 0);
+		}
+
+		if (sound4On)
+		{
+			sound4ATL		  = soundCounterSkip(sound4ATL, ticks - 1);
+			sound4EnvelopeATL = soundCounterSkip(sound4EnvelopeATL, ticks - 1);
+			soundChannel4Counters();
 		}
 	}
 }
 
-void soundDirectSoundA()
+// the direct sound levels only change on timer overflows, which end the run
+static void soundDirectSoundA()
 {
-	soundBuffer[4][soundIndex] = soundDSAValue;
+	soundSynth(4, soundTickStep, (s8)soundDSAValue);
 }
 
 void soundDirectSoundATimer()
@@ -927,9 +1109,9 @@ void soundDirectSoundATimer()
 		soundDSAValue = 0;
 }
 
-void soundDirectSoundB()
+static void soundDirectSoundB()
 {
-	soundBuffer[5][soundIndex] = soundDSBValue;
+	soundSynth(5, soundTickStep, (s8)soundDSBValue);
 }
 
 void soundDirectSoundBTimer()
@@ -964,136 +1146,89 @@ void soundDirectSoundBTimer()
 
 void soundTimerOverflow(int timer)
 {
+	soundSync();
+
+	// the next tick is soundTicks away, so the overflow lies that far before its end
 	if (soundDSAEnabled && (soundDSATimer == timer))
 	{
 		soundDirectSoundATimer();
+		if (soundSynthOn)
+			soundSynth(4, soundTickStep - soundTicks, (s8)soundDSAValue);
 	}
 	if (soundDSBEnabled && (soundDSBTimer == timer))
 	{
 		soundDirectSoundBTimer();
+		if (soundSynthOn)
+			soundSynth(5, soundTickStep - soundTicks, (s8)soundDSBValue);
 	}
 }
 
-void soundMix()
+// runs count ticks, split where the mixed samples are handed over; the channels don't
+// affect each other, so each one is advanced through a whole run between its own
+// length, envelope and sweep events, and the run is mixed at once
+static void soundRun(int count)
 {
-	soundBalance = (ioMem[NR51] & soundEnableFlag);
+	soundSynthOn = false;
 
-	int cgbRatio = ioMem[0x82] & 3;
-	int dsaRatio = ioMem[0x82] & 4;
-	int dsbRatio = ioMem[0x82] & 8;
+	if (!systemSoundOn)
+		return;
 
-	int cgbResL = 0;
-	if (soundBalance & 16)
+	while (count > 0)
 	{
-		cgbResL += ((s8)soundBuffer[0][soundIndex]);
-	}
-	if (soundBalance & 32)
-	{
-		cgbResL += ((s8)soundBuffer[1][soundIndex]);
-	}
-	if (soundBalance & 64)
-	{
-		cgbResL += ((s8)soundBuffer[2][soundIndex]);
-	}
-	if (soundBalance & 128)
-	{
-		cgbResL += ((s8)soundBuffer[3][soundIndex]);
-	}
-
-	int cgbResR = 0;
-	if (soundBalance & 1)
-	{
-		cgbResR += ((s8)soundBuffer[0][soundIndex]);
-	}
-	if (soundBalance & 2)
-	{
-		cgbResR += ((s8)soundBuffer[1][soundIndex]);
-	}
-	if (soundBalance & 4)
-	{
-		cgbResR += ((s8)soundBuffer[2][soundIndex]);
-	}
-	if (soundBalance & 8)
-	{
-		cgbResR += ((s8)soundBuffer[3][soundIndex]);
-	}
+		int run = systemSoundRunLength(count);
 
-	int dsResL = 0;
-	if ((soundControl & 0x0200) && (soundEnableFlag & 0x100))
-	{
-		if (!dsaRatio)
-			dsResL = ((s8)soundBuffer[4][soundIndex]) >> 1;
-		else
-			dsResL = ((s8)soundBuffer[4][soundIndex]);
-	}
-	if ((soundControl & 0x2000) && (soundEnableFlag & 0x200))
-	{
-		if (!dsbRatio)
-			dsResL += ((s8)soundBuffer[5][soundIndex]) >> 1;
-		else
-			dsResL += ((s8)soundBuffer[5][soundIndex]);
-	}
+		if (soundMasterOn && !stopState)
+		{
+			if (systemSoundMixingRequired())
+			{
+				soundSynthOn = true;
+				soundBalance = (ioMem[NR51] & soundEnableFlag);
+			}
 
-	int dsResR = 0;
-	if ((soundControl & 0x0100) && (soundEnableFlag & 0x100))
-	{
-		if (!dsaRatio)
-			dsResR = ((s8)soundBuffer[4][soundIndex]) >> 1;
-		else
-			dsResR = ((s8)soundBuffer[4][soundIndex]);
-	}
+			soundChannel1(run);
+			soundChannel2(run);
+			soundChannel3(run);
+			soundChannel4(run);
 
-	if ((soundControl & 0x1000) && (soundEnableFlag & 0x200))
-	{
-		if (!dsbRatio)
-			dsResR += ((s8)soundBuffer[5][soundIndex]) >> 1;
+			if (soundSynthOn)
+			{
+				soundDirectSoundA();
+				soundDirectSoundB();
+				systemSoundSynthMix(run);
+			}
+			else
+			{
+				systemSoundMixSilence(run);
+			}
+		}
 		else
-			dsResR += ((s8)soundBuffer[5][soundIndex]);
-	}
-
-	dsResL  *= 170;
-	dsResR	*= 170;
-	cgbResL *= 52 * soundLevel1;
-	cgbResR *= 52 * soundLevel1;
+		{
+			systemSoundMixSilence(run);
+		}
 
-	switch (cgbRatio)
-	{
-	case 0:
-	case 3: // prohibited, but 25%
-		cgbResL >>= 2;
-		cgbResR >>= 2;
-		break;
-	case 1:
-		cgbResL >>= 1;
-		cgbResR >>= 1;
-		break;
-	case 2:
-		break;
+		systemSoundNext(run);
+		count -= run;
 	}
-
-	systemSoundMix(cgbResL + dsResL, cgbResR + dsResR);
 }
 
 void soundTick()
 {
-	if (systemSoundOn)
-	{
-		if (soundMasterOn && !stopState)
-		{
-			soundChannel1();
-			soundChannel2();
-			soundChannel3();
-			soundChannel4();
-			soundDirectSoundA();
-			soundDirectSoundB();
-			soundMix();
-		}
-		else
-		{
-			systemSoundMixSilence();
-		}
-		systemSoundNext();
-	}
+	soundRun(1);
+}
+
+// the CPU loop only counts soundTicks down; the ticks that have passed are run here,
+// whenever the sound state is about to be observed
+void soundSync()
+{
+	if (soundTicksPending <= 0)
+		return;
+
+	int count = soundTicksPending;
+	soundTicksPending = 0;
+
+	u64 soundStart = systemProfileBegin();
+	soundRun(count);
+	systemProfileEnd(PROFILE_SOUND, soundStart);
 }
 
 void soundReset()
@@ -1107,6 +1242,7 @@ void soundReset()
 	soundTickStep	  = soundQuality * USE_TICKS_AS;
 	soundTicks		  = soundTickStep;
 	//soundTicks		  = 0;
+	soundTicksPending = 0;
 	soundNextPosition = 0;
 	soundMasterOn	  = 1;
 	soundLevel1		  = 7;
@@ -1239,6 +1375,7 @@ void soundReadGame(gzFile gzFile, int version)
 	soundTicks		 = (soundtick_t) soundTicks_int32;
 	soundTickStep	 = (soundtick_t) soundTickStep_int32;
 	//}
+	soundTicksPending = 0;
 	soundDSBEnabled	 = (u8) (soundDSBEnabled_int32 & 0xFF);
 	soundDSBValue	 = (u8) (soundDSBValue_int32 & 0xFF);
 }
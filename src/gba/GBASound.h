@@ -39,6 +39,7 @@
 							 // FIXME: (16777216.0/280896.0)(fps) vs 60.0fps?
 
 extern void soundTick();
+extern void soundSync();
 extern void soundReset();
 extern void soundSaveGame(gzFile);
 extern void soundReadGame(gzFile, int);
@@ -5,6 +5,8 @@
 #pragma once
 #endif // _MSC_VER > 1000
 
+#include <cstring>
+
 #include "../Port.h"
 
 // moved from GBA.h
@@ -14,7 +16,78 @@ typedef struct
 	u32 mask;
 } MemoryMap;
 
-extern MemoryMap memoryMap[256];
+extern EMU_STATE MemoryMap memoryMap[256];
+
+// Pages of EWRAM, IWRAM and VRAM written since the last snapshot was saved or loaded,
+// so that restoring that snapshot again only has to copy these pages back (see CPUReadSnapshot)
+#define CPU_DIRTY_PAGE_SHIFT	9
+#define CPU_DIRTY_PAGE_SIZE		(1 << CPU_DIRTY_PAGE_SHIFT)
+#define CPU_DIRTY_IWRAM			0x40000
+#define CPU_DIRTY_VRAM			0x48000
+#define CPU_DIRTY_PAGE_COUNT	((CPU_DIRTY_VRAM + 0x20000) >> CPU_DIRTY_PAGE_SHIFT)
+
+extern EMU_STATE bool8 cpuDirtyPage[CPU_DIRTY_PAGE_COUNT];
+
+// The block cache (see GBA-arm.cpp) decodes code from the same pages, plus one that stands for the
+// BIOS and the cartridge ROM.  Writing to a page that blocks were built from moves its generation on,
+// which drops those blocks, and counts in cpuCodeWrites, which stops the block running at the time
+// and the links between blocks.
+#define CPU_CODE_PAGE_ROM		CPU_DIRTY_PAGE_COUNT
+#define CPU_CODE_PAGE_COUNT		(CPU_DIRTY_PAGE_COUNT + 1)
+
+extern EMU_STATE bool8 cpuCodePage[CPU_CODE_PAGE_COUNT];
+extern EMU_STATE u32   cpuCodePageGen[CPU_CODE_PAGE_COUNT];
+extern EMU_STATE u32   cpuCodeWrites;
+
+static inline void CPUCodePageWritten(u32 page)
+{
+	cpuCodePage[page] = false;
+	cpuCodePageGen[page]++;
+	cpuCodeWrites++;
+}
+
+static inline void CPUMarkDirtyPage(u32 page)
+{
+	cpuDirtyPage[page] = true;
+	if (cpuCodePage[page])
+		CPUCodePageWritten(page);
+}
+
+static inline void CPUMarkDirty(u32 addr)
+{
+	switch (addr >> 24)
+	{
+	case 2:
+		CPUMarkDirtyPage((addr & 0x3FFFF) >> CPU_DIRTY_PAGE_SHIFT);
+		break;
+	case 3:
+		CPUMarkDirtyPage((CPU_DIRTY_IWRAM + (addr & 0x7FFF)) >> CPU_DIRTY_PAGE_SHIFT);
+		break;
+	case 6:
+		CPUMarkDirtyPage((CPU_DIRTY_VRAM + (addr & memoryMap[6].mask)) >> CPU_DIRTY_PAGE_SHIFT);
+		break;
+	}
+}
+
+// offset and size are in the EWRAM, IWRAM, VRAM space above
+static inline void CPUMarkDirtyRange(u32 offset, u32 size)
+{
+	u32 first = offset >> CPU_DIRTY_PAGE_SHIFT;
+	u32 last  = (offset + size - 1) >> CPU_DIRTY_PAGE_SHIFT;
+	memset(&cpuDirtyPage[first], true, last - first + 1);
+	for (u32 page = first; page <= last; page++)
+	{
+		if (cpuCodePage[page])
+			CPUCodePageWritten(page);
+	}
+}
+
+// size bytes written from addr on, within one mirror of the region
+static inline void CPUMarkDirtyRun(u32 addr, u32 size)
+{
+	for (u32 page = addr & ~(CPU_DIRTY_PAGE_SIZE - 1); page < addr + size; page += CPU_DIRTY_PAGE_SIZE)
+		CPUMarkDirty(page);
+}
 
 #if 0
 
@@ -55,16 +128,21 @@ static inline u32 CPUReadMemoryQuick(u32 addr)
 static inline void CPUWriteByteQuick(u32 addr, u8 b)
 {
 	memoryMap[addr >> 24].address[addr & memoryMap[addr >> 24].mask] = b;
+	CPUMarkDirty(addr);
 }
 
 static inline void CPUWriteHalfWordQuick(u32 addr, u16 b)
 {
 	WRITE16LE(&memoryMap[addr >> 24].address[addr & memoryMap[addr >> 24].mask], b);
+	CPUMarkDirty(addr);
+	CPUMarkDirty(addr + 1);
 }
 
 static inline void CPUWriteMemoryQuick(u32 addr, u32 b)
 {
 	WRITE32LE(&memoryMap[addr >> 24].address[addr & memoryMap[addr >> 24].mask], b);
+	CPUMarkDirty(addr);
+	CPUMarkDirty(addr + 3);
 }
 
 #endif
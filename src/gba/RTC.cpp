@@ -25,8 +25,8 @@ typedef struct
 	u32	 reserved3;
 } RTCCLOCKDATA;
 
-static RTCCLOCKDATA rtcClockData;
-static bool			rtcEnabled = false;
+static EMU_STATE RTCCLOCKDATA rtcClockData;
+static EMU_STATE bool			rtcEnabled = false;
 
 void rtcEnable(bool enable)
 {
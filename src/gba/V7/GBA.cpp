@@ -965,6 +965,8 @@ bool CPUReadStateFromStream(gzFile gzFile)
 					sprintf(errStr, "%s;\nSnapshot unverifiable with movie after End Frame %u", errStr, VBAMovieGetLastErrorInfo()); break;
 				case MOVIE_TIMELINE_INCONSISTENT_AT:
 					sprintf(errStr, "%s;\nSnapshot inconsistent with movie at Frame %u", errStr, VBAMovieGetLastErrorInfo()); break;
+				case MOVIE_INPUT_MISSING_AT:
+					sprintf(errStr, "%s;\nSnapshot input from Frame %u missing from the movie's chunk store", errStr, VBAMovieGetLastErrorInfo()); break;
 				case MOVIE_WRONG_FORMAT:
 					strcat(errStr, ";\nWrong format"); break;
 				}
@@ -4249,6 +4251,10 @@ struct EmulatedSystem GBASystem =
 	CPUReadMemState,
 	// emuWriteMemState
 	CPUWriteMemState,
+	// emuWriteSnapshot
+	NULL,
+	// emuReadSnapshot
+	NULL,
 	// emuWritePNG
 	CPUWritePNGFile,
 	// emuWriteBMP
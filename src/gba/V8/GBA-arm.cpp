@@ -1,4 +1,6 @@
+#include <cstdlib>
 #include "../common/System.h"
+#include "../common/SystemGlobals.h"
 #include "GBA.h"
 #include "GBAGlobals.h"
 #include "GBAinline.h"
@@ -19,7 +21,7 @@
 
 ///////////////////////////////////////////////////////////////////////////
 
-static int clockTicks;
+static EMU_STATE int clockTicks;
 
 static INSN_REGPARM void armUnknownInsn(u32 opcode)
 {
@@ -2879,110 +2881,315 @@ static void tester(void)
 
 #endif
 
-int armExecute()
+static inline bool armConditionPassed(u32 cond)
 {
-	do
+	switch (cond)
 	{
-		CPUMasterCodeCheck();
+	case 0x00:   // EQ
+		return Z_FLAG;
+	case 0x01:   // NE
+		return !Z_FLAG;
+	case 0x02:   // CS
+		return C_FLAG;
+	case 0x03:   // CC
+		return !C_FLAG;
+	case 0x04:   // MI
+		return N_FLAG;
+	case 0x05:   // PL
+		return !N_FLAG;
+	case 0x06:   // VS
+		return V_FLAG;
+	case 0x07:   // VC
+		return !V_FLAG;
+	case 0x08:   // HI
+		return C_FLAG && !Z_FLAG;
+	case 0x09:   // LS
+		return !C_FLAG || Z_FLAG;
+	case 0x0A:   // GE
+		return N_FLAG == V_FLAG;
+	case 0x0B:   // LT
+		return N_FLAG != V_FLAG;
+	case 0x0C:   // GT
+		return !Z_FLAG && (N_FLAG == V_FLAG);
+	case 0x0D:   // LE
+		return Z_FLAG || (N_FLAG != V_FLAG);
+	case 0x0E:   // AL
+		return true;
+	case 0x0F:
+	default:
+		// ???
+		return false;
+	}
+}
 
-		if ((armNextPC & 0x0803FFFF) == 0x08020000)
-			busPrefetchCount = 0x100;
+// Executes the instruction at armNextPC.  Returns false if the execution
+// loop must exit.  execHooks selects whether Lua exec hooks are checked at all.
+template <bool execHooks>
+static inline bool armStep()
+{
+	CPUMasterCodeCheck();
 
-		u32 opcode = cpuPrefetch[0];
-		cpuPrefetch[0] = cpuPrefetch[1];
+	if ((armNextPC & 0x0803FFFF) == 0x08020000)
+		busPrefetchCount = 0x100;
 
-		busPrefetch = false;
-		if (busPrefetchCount & 0xFFFFFE00)
-			busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+	u32 opcode = cpuPrefetch[0];
+	cpuPrefetch[0] = cpuPrefetch[1];
 
-		clockTicks = 0;
-		u32 oldArmNextPC = armNextPC;
+	busPrefetch = false;
+	if (busPrefetchCount & 0xFFFFFE00)
+		busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+
+	clockTicks = 0;
+	u32 oldArmNextPC = armNextPC;
 
 #ifndef FINAL_VERSION
-		if (armNextPC == armStopAddr)
-		{
-			armNextPC++;
-		}
+	if (armNextPC == armStopAddr)
+	{
+		armNextPC++;
+	}
 #endif
 
+	if (execHooks)
 		CallRegisteredLuaMemHook(armNextPC, 4, CPUReadMemoryQuick(armNextPC), LUAMEMHOOK_EXEC);
 
+	armNextPC  = reg[15].I;
+	reg[15].I += 4;
+	ARM_PREFETCH_NEXT;
+
+	u32	 cond	  = opcode >> 28;
+	bool cond_res = true;
+	if (UNLIKELY(cond != 0x0E))    // most opcodes are AL (always)
+		cond_res = armConditionPassed(cond);
+
+	if (cond_res)
+		(*armInsnTable[((opcode >> 16) & 0xFF0) | ((opcode >> 4) & 0x0F)])(opcode);
+#ifdef INSN_COUNTER
+	count(opcode, cond_res);
+#endif
+	if (clockTicks < 0)
+		return false;
+	if (clockTicks == 0)
+		clockTicks = 1 + codeTicksAccessSeq32(oldArmNextPC);
+	cpuTotalTicks += clockTicks;
+	if (!execHooks && skipIdleLoopsTemp && oldArmNextPC - armNextPC <= CPU_IDLE_LOOP_SIZE)
+		CPUIdleLoopCheck(oldArmNextPC);
+	return true;
+}
+
+template <bool execHooks>
+static int armExecuteLoop()
+{
+	do
+	{
+		if (!armStep<execHooks>())
+			return 0;
+	}
+	while (cpuTotalTicks < cpuNextEvent && armState && !holdState && !SWITicks);
+
+	return 1;
+}
+
+// Block cache ////////////////////////////////////////////////////////////
+
+// Runs of code from the BIOS, ROM, EWRAM and IWRAM are decoded once into
+// blocks of pre-resolved handlers, each with the opcode it is given and
+// the word the interpreter would prefetch behind it.  A block ends at an
+// unconditional write to pc, at ARM_BLOCK_MAX_INSNS or at the end of its
+// code page, so a write to the page (GBAinline.h) is all it takes to drop
+// it.  Blocks also remember the blocks that ran after them, which saves
+// looking those up again until code is written anywhere.
+#define ARM_BLOCK_CACHE_SIZE 2048
+#define ARM_BLOCK_MAX_INSNS	 16
+
+struct armBlockInsn
+{
+	insnfunc_t func;
+	u32		   opcode;
+	u32		   prefetch;
+};
+
+struct armBlock
+{
+	u32			 address;
+	u32			 gen;
+	u16			 page;
+	u8			 count;
+	u8			 prefetched; // insns[] whose prefetch is up to the page end
+	u8			 seqTicks;   // sequential fetch ticks, 0 for ROM
+	armBlock	*exits[2];   // blocks last run after running off the end, and after a branch
+	u32			 exitWrites[2]; // cpuCodeWrites when they were linked
+	armBlockInsn insns[ARM_BLOCK_MAX_INSNS];
+};
+
+static EMU_STATE armBlock *armBlockCache = NULL;
+
+void armBlockCacheFree()
+{
+	free(armBlockCache);
+	armBlockCache = NULL;
+}
+
+// Returns the block at address, or NULL if the code there is not cached or
+// the pipeline holds something else than what a new block was built from.
+// A block found built already needs no such check: its page has not been
+// written since, so any prefetch from it agrees with it.
+static armBlock *armBlockLookup(u32 address)
+{
+	int page = cpuCodePageOf(address);
+	if (page < 0)
+		return NULL;
+
+	if (armBlockCache == NULL)
+	{
+		armBlockCache = (armBlock *)calloc(ARM_BLOCK_CACHE_SIZE, sizeof(armBlock));
+		if (armBlockCache == NULL)
+			return NULL;
+	}
+
+	armBlock *block = &armBlockCache[((address >> 2) ^ (address >> 12)) & (ARM_BLOCK_CACHE_SIZE - 1)];
+	if (block->count && block->address == address && block->gen == cpuCodePageGen[page])
+		return block;
+
+	u32 end = cpuCodePageEnd(address, page);
+	u32 pc	= address;
+	int count = 0;
+	while (pc < end && count < ARM_BLOCK_MAX_INSNS)
+	{
+		u32 opcode = CPUReadMemoryQuick(pc);
+		block->insns[count].func   = armInsnTable[((opcode >> 16) & 0xFF0) | ((opcode >> 4) & 0x0F)];
+		block->insns[count].opcode = opcode;
+		count++;
+		pc += 4;
+
+		// B, BL, BX, SWI, LDM with pc and data processing or LDR into pc
+		if ((opcode >> 28) == 0x0E &&
+		    ((opcode & 0x0E000000) == 0x0A000000 || (opcode & 0x0FFFFFF0) == 0x012FFF10 ||
+		     (opcode & 0x0F000000) == 0x0F000000 || (opcode & 0x0E108000) == 0x08108000 ||
+		     (opcode & 0x0C00F000) == 0x0000F000 || (opcode & 0x0C10F000) == 0x0410F000))
+			break;
+	}
+
+	int prefetched = 0;
+	for (int i = 0; i < count && address + (i + 2) * 4 < end; i++, prefetched++)
+		block->insns[i].prefetch = i + 2 < count ? block->insns[i + 2].opcode :
+		                           CPUReadMemoryQuick(address + (i + 2) * 4);
+
+	int region = address >> 24;
+	block->address	  = address;
+	block->gen		  = cpuCodePageGen[page];
+	block->page		  = page;
+	block->count	  = count;
+	block->prefetched = prefetched;
+	block->seqTicks	  = region < 0x08 ? memoryWaitSeq32[region] + 1 : 0;
+	block->exits[0]	  = NULL;
+	block->exits[1]	  = NULL;
+	cpuCodePage[page] = true;
+
+	if (cpuPrefetch[0] != block->insns[0].opcode || (count > 1 && cpuPrefetch[1] != block->insns[1].opcode))
+		return NULL;
+	return block;
+}
+
+// Runs block from its first instruction as armStep() would, and returns
+// false if the execution loop must exit.  exit is set to the exits[] slot
+// for the block that comes next.
+static inline bool armBlockRun(armBlock *block, int &exit)
+{
+	const armBlockInsn *insn = block->insns;
+	const armBlockInsn *last = insn + block->count;
+	const armBlockInsn *prefetchEnd = insn + block->prefetched;
+	u32 pc = block->address;
+	u32 writes = cpuCodeWrites;
+	// blocks do not cross a page, so this can only be their first instruction
+	if ((pc & 0x0803FFFF) == 0x08020000)
+		busPrefetchCount = 0x100;
+	do
+	{
+		cpuPrefetch[0] = cpuPrefetch[1];
+
+		busPrefetch = false;
+		if (busPrefetchCount & 0xFFFFFE00)
+			busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+
+		clockTicks = 0;
 		armNextPC  = reg[15].I;
 		reg[15].I += 4;
-		ARM_PREFETCH_NEXT;
+		cpuPrefetch[1] = insn < prefetchEnd ? insn->prefetch : CPUReadMemoryQuick(armNextPC + 4);
 
-		u32	 cond	  = opcode >> 28;
+		u32	 cond	  = insn->opcode >> 28;
 		bool cond_res = true;
-		if (UNLIKELY(cond != 0x0E))    // most opcodes are AL (always)
-		{
-			switch (cond)
-			{
-			case 0x00:   // EQ
-				cond_res = Z_FLAG;
-				break;
-			case 0x01:   // NE
-				cond_res = !Z_FLAG;
-				break;
-			case 0x02:   // CS
-				cond_res = C_FLAG;
-				break;
-			case 0x03:   // CC
-				cond_res = !C_FLAG;
-				break;
-			case 0x04:   // MI
-				cond_res = N_FLAG;
-				break;
-			case 0x05:   // PL
-				cond_res = !N_FLAG;
-				break;
-			case 0x06:   // VS
-				cond_res = V_FLAG;
-				break;
-			case 0x07:   // VC
-				cond_res = !V_FLAG;
-				break;
-			case 0x08:   // HI
-				cond_res = C_FLAG && !Z_FLAG;
-				break;
-			case 0x09:   // LS
-				cond_res = !C_FLAG || Z_FLAG;
-				break;
-			case 0x0A:   // GE
-				cond_res = N_FLAG == V_FLAG;
-				break;
-			case 0x0B:   // LT
-				cond_res = N_FLAG != V_FLAG;
-				break;
-			case 0x0C:   // GT
-				cond_res = !Z_FLAG && (N_FLAG == V_FLAG);
-				break;
-			case 0x0D:   // LE
-				cond_res = Z_FLAG || (N_FLAG != V_FLAG);
-				break;
-			case 0x0E:   // AL (impossible, checked above)
-				cond_res = true;
-				break;
-			case 0x0F:
-			default:
-				// ???
-				cond_res = false;
-				break;
-			}
-		}
+		if (UNLIKELY(cond != 0x0E))
+			cond_res = armConditionPassed(cond);
 
 		if (cond_res)
-			(*armInsnTable[((opcode >> 16) & 0xFF0) | ((opcode >> 4) & 0x0F)])(opcode);
+			(*insn->func)(insn->opcode);
 #ifdef INSN_COUNTER
-		count(opcode, cond_res);
+		count(insn->opcode, cond_res);
 #endif
 		if (clockTicks < 0)
-			return 0;
+			return false;
 		if (clockTicks == 0)
-			clockTicks = 1 + codeTicksAccessSeq32(oldArmNextPC);
+			clockTicks = block->seqTicks ? block->seqTicks : 1 + codeTicksAccessSeq32(pc);
 		cpuTotalTicks += clockTicks;
+		pc += 4;
+	}
+	while (++insn != last && armNextPC == pc && cpuCodeWrites == writes &&
+	       cpuTotalTicks < cpuNextEvent && armState && !holdState && !SWITicks);
+
+	// a backward branch leaves the block, so only its last instruction can close an idle loop
+	if (skipIdleLoopsTemp && pc - 4 - armNextPC <= CPU_IDLE_LOOP_SIZE)
+		CPUIdleLoopCheck(pc - 4);
+
+	exit = armNextPC != pc;
+	return true;
+}
+
+// Runs blocks, or single instructions through the table where there is
+// none, following the exits of each block to the next one.
+static int armExecuteBlocks()
+{
+	armBlock *last = NULL;
+	int		  exit = 0;
+	do
+	{
+		armBlock *block = last ? last->exits[exit] : NULL;
+		// a link made before any code was written since still points at a valid block
+		if (block == NULL || block->address != armNextPC || last->exitWrites[exit] != cpuCodeWrites)
+		{
+			block = armBlockLookup(armNextPC);
+			if (last)
+			{
+				last->exits[exit]	   = block;
+				last->exitWrites[exit] = cpuCodeWrites;
+			}
+		}
+
+		if (block == NULL)
+		{
+			last = NULL;
+			if (!armStep<false>())
+				return 0;
+		}
+		else
+		{
+			last = block;
+			if (!armBlockRun(block, exit))
+				return 0;
+		}
 	}
 	while (cpuTotalTicks < cpuNextEvent && armState && !holdState && !SWITicks);
 
 	return 1;
 }
 
+// The hook-free loop is picked when no exec hooks exist; hooks registered
+// while it runs take effect from the next CPU event.
+int armExecute()
+{
+	if (VBALuaHasMemHook(LUAMEMHOOK_EXEC))
+		return armExecuteLoop<true>();
+	// the master code is checked before every instruction, which blocks leave out
+	if (cpuBlockCacheEnabled && !(cheatsEnabled && mastercode))
+		return armExecuteBlocks();
+	return armExecuteLoop<false>();
+}
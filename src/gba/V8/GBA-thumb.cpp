@@ -1,6 +1,8 @@
 #include <cstdio>
+#include <cstdlib>
 
 #include "../common/System.h"
+#include "../common/SystemGlobals.h"
 #include "GBA.h"
 #include "GBAGlobals.h"
 #include "GBAinline.h"
@@ -17,7 +19,7 @@
 
 ///////////////////////////////////////////////////////////////////////////
 
-static int clockTicks;
+static EMU_STATE int clockTicks;
 
 static INSN_REGPARM void thumbUnknownInsn(u32 opcode)
 {
@@ -2325,16 +2327,171 @@ static insnfunc_t thumbInsnTable[1024] = {
 
 // Wrapper routine (execution loop) ///////////////////////////////////////
 
-int thumbExecute()
+// Executes the instruction at armNextPC.  Returns false if the execution
+// loop must exit.  execHooks selects whether Lua exec hooks are checked at all.
+template <bool execHooks>
+static inline bool thumbStep()
+{
+	CPUMasterCodeCheck();
+
+	//if ((armNextPC & 0x0803FFFF) == 0x08020000)
+	//    busPrefetchCount=0x100;
+
+	u32 opcode = cpuPrefetch[0];
+	cpuPrefetch[0] = cpuPrefetch[1];
+
+	busPrefetch = false;
+	if (busPrefetchCount & 0xFFFFFF00)
+		busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
+
+	clockTicks = 0;
+	u32 oldArmNextPC = armNextPC;
+
+#ifndef FINAL_VERSION
+	if (armNextPC == armStopAddr)
+	{
+		armNextPC++;
+	}
+#endif
+
+	if (execHooks)
+		CallRegisteredLuaMemHook(armNextPC, 2, CPUReadHalfWordQuick(armNextPC), LUAMEMHOOK_EXEC);
+
+	armNextPC  = reg[15].I;
+	reg[15].I += 2;
+	THUMB_PREFETCH_NEXT;
+
+	(*thumbInsnTable[opcode >> 6])(opcode);
+
+	if (clockTicks < 0)
+		return false;
+	if (clockTicks == 0)
+		clockTicks = codeTicksAccessSeq16(oldArmNextPC) + 1;
+	cpuTotalTicks += clockTicks;
+	if (!execHooks && skipIdleLoopsTemp && oldArmNextPC - armNextPC <= CPU_IDLE_LOOP_SIZE)
+		CPUIdleLoopCheck(oldArmNextPC);
+	return true;
+}
+
+template <bool execHooks>
+static int thumbExecuteLoop()
 {
 	do
 	{
-		CPUMasterCodeCheck();
+		if (!thumbStep<execHooks>())
+			return 0;
+	}
+	while (cpuTotalTicks < cpuNextEvent && !armState && !holdState && !SWITicks);
+
+	return 1;
+}
+
+// Block cache ////////////////////////////////////////////////////////////
+
+// THUMB blocks work like the ARM ones in GBA-arm.cpp, with halfword
+// opcodes and the second half of BL, POP {pc} and the branches ending them.
+#define THUMB_BLOCK_CACHE_SIZE 2048
+#define THUMB_BLOCK_MAX_INSNS  32
+
+struct thumbBlockInsn
+{
+	insnfunc_t func;
+	u32		   opcode;
+	u32		   prefetch;
+};
+
+struct thumbBlock
+{
+	u32			   address;
+	u32			   gen;
+	u16			   page;
+	u8			   count;
+	u8			   prefetched; // insns[] whose prefetch is up to the page end
+	u8			   seqTicks;   // sequential fetch ticks, 0 for ROM
+	thumbBlock	  *exits[2];   // blocks last run after running off the end, and after a branch
+	u32			   exitWrites[2]; // cpuCodeWrites when they were linked
+	thumbBlockInsn insns[THUMB_BLOCK_MAX_INSNS];
+};
+
+static EMU_STATE thumbBlock *thumbBlockCache = NULL;
+
+void thumbBlockCacheFree()
+{
+	free(thumbBlockCache);
+	thumbBlockCache = NULL;
+}
+
+// Returns the block at address, or NULL if the code there is not cached or
+// the pipeline holds something else than what a new block was built from.
+// A block found built already needs no such check: its page has not been
+// written since, so any prefetch from it agrees with it.
+static thumbBlock *thumbBlockLookup(u32 address)
+{
+	int page = cpuCodePageOf(address);
+	if (page < 0)
+		return NULL;
+
+	if (thumbBlockCache == NULL)
+	{
+		thumbBlockCache = (thumbBlock *)calloc(THUMB_BLOCK_CACHE_SIZE, sizeof(thumbBlock));
+		if (thumbBlockCache == NULL)
+			return NULL;
+	}
 
-		//if ((armNextPC & 0x0803FFFF) == 0x08020000)
-		//    busPrefetchCount=0x100;
+	thumbBlock *block = &thumbBlockCache[((address >> 1) ^ (address >> 12)) & (THUMB_BLOCK_CACHE_SIZE - 1)];
+	if (block->count && block->address == address && block->gen == cpuCodePageGen[page])
+		return block;
 
-		u32 opcode = cpuPrefetch[0];
+	u32 end = cpuCodePageEnd(address, page);
+	u32 pc	= address;
+	int count = 0;
+	while (pc < end && count < THUMB_BLOCK_MAX_INSNS)
+	{
+		u32 opcode = CPUReadHalfWordQuick(pc);
+		block->insns[count].func   = thumbInsnTable[opcode >> 6];
+		block->insns[count].opcode = opcode;
+		count++;
+		pc += 2;
+
+		// B, BX, SWI, the second half of BL and POP {..., pc}
+		if ((opcode & 0xF800) == 0xE000 || (opcode & 0xFF80) == 0x4700 || (opcode & 0xFF00) == 0xDF00 ||
+		    (opcode & 0xF800) == 0xF800 || (opcode & 0xFF00) == 0xBD00)
+			break;
+	}
+
+	int prefetched = 0;
+	for (int i = 0; i < count && address + (i + 2) * 2 < end; i++, prefetched++)
+		block->insns[i].prefetch = i + 2 < count ? block->insns[i + 2].opcode :
+		                           CPUReadHalfWordQuick(address + (i + 2) * 2);
+
+	int region = address >> 24;
+	block->address	  = address;
+	block->gen		  = cpuCodePageGen[page];
+	block->page		  = page;
+	block->count	  = count;
+	block->prefetched = prefetched;
+	block->seqTicks	  = region < 0x08 ? memoryWaitSeq[region] + 1 : 0;
+	block->exits[0]	  = NULL;
+	block->exits[1]	  = NULL;
+	cpuCodePage[page] = true;
+
+	if (cpuPrefetch[0] != block->insns[0].opcode || (count > 1 && cpuPrefetch[1] != block->insns[1].opcode))
+		return NULL;
+	return block;
+}
+
+// Runs block from its first instruction as thumbStep() would, and returns
+// false if the execution loop must exit.  exit is set to the exits[] slot
+// for the block that comes next.
+static inline bool thumbBlockRun(thumbBlock *block, int &exit)
+{
+	const thumbBlockInsn *insn = block->insns;
+	const thumbBlockInsn *last = insn + block->count;
+	const thumbBlockInsn *prefetchEnd = insn + block->prefetched;
+	u32 pc = block->address;
+	u32 writes = cpuCodeWrites;
+	do
+	{
 		cpuPrefetch[0] = cpuPrefetch[1];
 
 		busPrefetch = false;
@@ -2342,31 +2499,84 @@ int thumbExecute()
 			busPrefetchCount = 0x100 | (busPrefetchCount & 0xFF);
 
 		clockTicks = 0;
-		u32 oldArmNextPC = armNextPC;
-
-#ifndef FINAL_VERSION
-		if (armNextPC == armStopAddr)
-		{
-			armNextPC++;
-		}
-#endif
-
-		CallRegisteredLuaMemHook(armNextPC, 2, CPUReadHalfWordQuick(armNextPC), LUAMEMHOOK_EXEC);
-
 		armNextPC  = reg[15].I;
 		reg[15].I += 2;
-		THUMB_PREFETCH_NEXT;
+		cpuPrefetch[1] = insn < prefetchEnd ? insn->prefetch : CPUReadHalfWordQuick(armNextPC + 2);
 
-		(*thumbInsnTable[opcode >> 6])(opcode);
+		(*insn->func)(insn->opcode);
 
 		if (clockTicks < 0)
-			return 0;
+			return false;
 		if (clockTicks == 0)
-			clockTicks = codeTicksAccessSeq16(oldArmNextPC) + 1;
+		{
+			if (block->seqTicks)
+			{
+				busPrefetchCount = 0;
+				clockTicks		 = block->seqTicks;
+			}
+			else
+				clockTicks = codeTicksAccessSeq16(pc) + 1;
+		}
 		cpuTotalTicks += clockTicks;
+		pc += 2;
+	}
+	// only the instructions ending a block switch to ARM or start a SWI, which thumbExecuteBlocks() checks for
+	while (++insn != last && armNextPC == pc && cpuCodeWrites == writes && !holdState && cpuTotalTicks < cpuNextEvent);
+
+	// a backward branch leaves the block, so only its last instruction can close an idle loop
+	if (skipIdleLoopsTemp && pc - 2 - armNextPC <= CPU_IDLE_LOOP_SIZE)
+		CPUIdleLoopCheck(pc - 2);
+
+	exit = armNextPC != pc;
+	return true;
+}
+
+// Runs blocks, or single instructions through the table where there is
+// none, following the exits of each block to the next one.
+static int thumbExecuteBlocks()
+{
+	thumbBlock *last = NULL;
+	int			exit = 0;
+	do
+	{
+		thumbBlock *block = last ? last->exits[exit] : NULL;
+		// a link made before any code was written since still points at a valid block
+		if (block == NULL || block->address != armNextPC || last->exitWrites[exit] != cpuCodeWrites)
+		{
+			block = thumbBlockLookup(armNextPC);
+			if (last)
+			{
+				last->exits[exit]	   = block;
+				last->exitWrites[exit] = cpuCodeWrites;
+			}
+		}
+
+		if (block == NULL)
+		{
+			last = NULL;
+			if (!thumbStep<false>())
+				return 0;
+		}
+		else
+		{
+			last = block;
+			if (!thumbBlockRun(block, exit))
+				return 0;
+		}
 	}
 	while (cpuTotalTicks < cpuNextEvent && !armState && !holdState && !SWITicks);
 
 	return 1;
 }
 
+// The hook-free loop is picked when no exec hooks exist; hooks registered
+// while it runs take effect from the next CPU event.
+int thumbExecute()
+{
+	if (VBALuaHasMemHook(LUAMEMHOOK_EXEC))
+		return thumbExecuteLoop<true>();
+	// the master code is checked before every instruction, which blocks leave out
+	if (cpuBlockCacheEnabled && !(cheatsEnabled && mastercode))
+		return thumbExecuteBlocks();
+	return thumbExecuteLoop<false>();
+}
@@ -22,6 +22,7 @@
 #include "../../common/System.h"
 #include "../../common/SystemGlobals.h"
 #include "../../common/Util.h"
+#include "../../common/MappedImage.h"
 #include "../../common/movie.h"
 #include "../../common/vbalua.h"
 
@@ -36,40 +37,50 @@
 static inline void interp_rate()
 { /* empty for now */ }
 
-int32 SWITicks = 0;
-int32 IRQTicks = 0;
-
-u32	  mastercode = 0;
-int32 layerEnableDelay	= 0;
-
-bool8 busPrefetch		= false;
-bool8 busPrefetchEnable	= false;
-u32	  busPrefetchCount	= 0;
-u32	  cpuPrefetch[2];
-
-int32 cpuDmaTicksToUpdate = 0;
-int32 cpuDmaCount		  = 0;
-bool8 cpuDmaHack		  = 0;
-u32	  cpuDmaLast		  = 0;
-int32 dummyAddress		  = 0;
-
-int32 gbaSaveType = 0;      // used to remember the save type on reset
-bool8 intState	  = false;
-bool8 stopState	  = false;
-bool8 holdState	  = false;
-int32 holdType	  = 0;
-bool8 cpuSramEnabled		 = true;
-bool8 cpuFlashEnabled		 = true;
-bool8 cpuEEPROMEnabled		 = true;
-bool8 cpuEEPROMSensorEnabled = false;
+EMU_STATE int32 SWITicks = 0;
+EMU_STATE int32 IRQTicks = 0;
+
+EMU_STATE u32	  mastercode = 0;
+EMU_STATE int32 layerEnableDelay	= 0;
+
+EMU_STATE bool8 busPrefetch		= false;
+EMU_STATE bool8 busPrefetchEnable	= false;
+EMU_STATE u32	  busPrefetchCount	= 0;
+EMU_STATE u32	  cpuPrefetch[2];
+
+static EMU_STATE bool8 cpuSnapshotDirtyOnly = false;
+
+EMU_STATE int32 cpuDmaTicksToUpdate = 0;
+EMU_STATE int32 cpuDmaCount		  = 0;
+EMU_STATE bool8 cpuDmaHack		  = 0;
+EMU_STATE u32	  cpuDmaLast		  = 0;
+EMU_STATE int32 dummyAddress		  = 0;
+
+EMU_STATE int32 gbaSaveType = 0;      // used to remember the save type on reset
+EMU_STATE bool8 intState	  = false;
+EMU_STATE bool8 stopState	  = false;
+EMU_STATE bool8 holdState	  = false;
+EMU_STATE int32 holdType	  = 0;
+EMU_STATE bool8 cpuSramEnabled		 = true;
+EMU_STATE bool8 cpuFlashEnabled		 = true;
+EMU_STATE bool8 cpuEEPROMEnabled		 = true;
+EMU_STATE bool8 cpuEEPROMSensorEnabled = false;
 
 #ifdef SDL
-bool8 cpuBreakLoop = false;
+EMU_STATE bool8 cpuBreakLoop = false;
 #endif
 
 // These don't seem to affect determinism
-int32 cpuNextEvent = 0;
-int32 cpuTotalTicks = 0;
+EMU_STATE int32 cpuNextEvent = 0;
+EMU_STATE int32 cpuTotalTicks = 0;
+
+// the last backward branch of a short loop and the CPU state right after it
+EMU_STATE bool8 cpuIdleLoopClean = false;
+static EMU_STATE u32	  cpuIdleLoopBranch = 0;
+static EMU_STATE int32 cpuIdleLoopTicks	 = 0;
+static EMU_STATE u32	  cpuIdleLoopFlags	 = 0;
+static EMU_STATE u32	  cpuIdleLoopPrefetch[3];
+static EMU_STATE reg_pair cpuIdleLoopReg[45];
 
 #ifdef PROFILING
 int profilingTicks		 = 0;
@@ -78,55 +89,55 @@ static profile_segment *profilSegment = NULL;
 #endif
 
 #ifdef BKPT_SUPPORT
-u8	 freezeWorkRAM[0x40000];
-u8	 freezeInternalRAM[0x8000];
-u8	 freezeVRAM[0x18000];
-u8	 freezePRAM[0x400];
-u8	 freezeOAM[0x400];
+EMU_STATE u8	 freezeWorkRAM[0x40000];
+EMU_STATE u8	 freezeInternalRAM[0x8000];
+EMU_STATE u8	 freezeVRAM[0x18000];
+EMU_STATE u8	 freezePRAM[0x400];
+EMU_STATE u8	 freezeOAM[0x400];
 bool debugger_last;
 #endif
 
-int32 lcdTicks = (useBios && !skipBios) ? 1008 : 208;
-u8	  timerOnOffDelay	= 0;
-u16	  timer0Value		= 0;
-bool8 timer0On			= false;
-int32 timer0Ticks		= 0;
-int32 timer0Reload		= 0;
-int32 timer0ClockReload = 0;
-u16	  timer1Value		= 0;
-bool8 timer1On			= false;
-int32 timer1Ticks		= 0;
-int32 timer1Reload		= 0;
-int32 timer1ClockReload = 0;
-u16	  timer2Value		= 0;
-bool8 timer2On			= false;
-int32 timer2Ticks		= 0;
-int32 timer2Reload		= 0;
-int32 timer2ClockReload = 0;
-u16	  timer3Value		= 0;
-bool8 timer3On			= false;
-int32 timer3Ticks		= 0;
-int32 timer3Reload		= 0;
-int32 timer3ClockReload = 0;
-u32	  dma0Source		= 0;
-u32	  dma0Dest			= 0;
-u32	  dma1Source		= 0;
-u32	  dma1Dest			= 0;
-u32	  dma2Source		= 0;
-u32	  dma2Dest			= 0;
-u32	  dma3Source		= 0;
-u32	  dma3Dest			= 0;
-void  (*cpuSaveGameFunc)(u32, u8) = flashSaveDecide;
-void  (*renderLine)() = mode0RenderLine;
-bool8 fxOn			 = false;
-bool8 windowOn		 = false;
-
-char  buffer[1024];
-FILE *out = NULL;
+EMU_STATE int32 lcdTicks = 208;
+EMU_STATE u8	  timerOnOffDelay	= 0;
+EMU_STATE u16	  timer0Value		= 0;
+EMU_STATE bool8 timer0On			= false;
+EMU_STATE int32 timer0Ticks		= 0;
+EMU_STATE int32 timer0Reload		= 0;
+EMU_STATE int32 timer0ClockReload = 0;
+EMU_STATE u16	  timer1Value		= 0;
+EMU_STATE bool8 timer1On			= false;
+EMU_STATE int32 timer1Ticks		= 0;
+EMU_STATE int32 timer1Reload		= 0;
+EMU_STATE int32 timer1ClockReload = 0;
+EMU_STATE u16	  timer2Value		= 0;
+EMU_STATE bool8 timer2On			= false;
+EMU_STATE int32 timer2Ticks		= 0;
+EMU_STATE int32 timer2Reload		= 0;
+EMU_STATE int32 timer2ClockReload = 0;
+EMU_STATE u16	  timer3Value		= 0;
+EMU_STATE bool8 timer3On			= false;
+EMU_STATE int32 timer3Ticks		= 0;
+EMU_STATE int32 timer3Reload		= 0;
+EMU_STATE int32 timer3ClockReload = 0;
+EMU_STATE u32	  dma0Source		= 0;
+EMU_STATE u32	  dma0Dest			= 0;
+EMU_STATE u32	  dma1Source		= 0;
+EMU_STATE u32	  dma1Dest			= 0;
+EMU_STATE u32	  dma2Source		= 0;
+EMU_STATE u32	  dma2Dest			= 0;
+EMU_STATE u32	  dma3Source		= 0;
+EMU_STATE u32	  dma3Dest			= 0;
+EMU_STATE void  (*cpuSaveGameFunc)(u32, u8) = flashSaveDecide;
+EMU_STATE void  (*renderLine)() = mode0RenderLine;
+EMU_STATE bool8 fxOn			 = false;
+EMU_STATE bool8 windowOn		 = false;
+
+EMU_STATE char  buffer[1024];
+EMU_STATE FILE *out = NULL;
 
 const int32 TIMER_TICKS[4] = { 0, 6, 8, 10 };
 
-extern bool8 cpuIsMultiBoot;
+extern EMU_STATE bool8 cpuIsMultiBoot;
 extern const u32 objTilesAddress[3] = { 0x010000, 0x014000, 0x014000 };
 
 const u8	gamepakRamWaitState[4] = { 4, 3, 2, 8 };
@@ -138,13 +149,13 @@ const bool8 isInRom[16] =
 { false, false,	 false, false, false, false, false,	 false,
   true,	 true,	 true,	true,  true,  true,	 false,	 false };
 
-u8 memoryWait[16] =
+EMU_STATE u8 memoryWait[16] =
 { 0, 0, 2, 0, 0, 0, 0, 0, 4, 4, 4, 4, 4, 4, 4, 0 };
-u8 memoryWait32[16] =
+EMU_STATE u8 memoryWait32[16] =
 { 0, 0, 5, 0, 0, 1, 1, 0, 7, 7, 9, 9, 13, 13, 4, 0 };
-u8 memoryWaitSeq[16] =
+EMU_STATE u8 memoryWaitSeq[16] =
 { 0, 0, 2, 0, 0, 0, 0, 0, 2, 2, 4, 4, 8, 8, 4, 0 };
-u8 memoryWaitSeq32[16] =
+EMU_STATE u8 memoryWaitSeq32[16] =
 { 0, 0, 5, 0, 0, 1, 1, 0, 5, 5, 9, 9, 17, 17, 4, 0 };
 
 // The videoMemoryWait constants are used to add some waitstates
@@ -154,15 +165,15 @@ u8 memoryWaitSeq32[16] =
 //const u8 videoMemoryWait[16] =
 //  {0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
-static int32 romSize = 0x2000000;
+static EMU_STATE int32 romSize = 0x2000000;
 
-u8 biosProtected[4];
+EMU_STATE u8 biosProtected[4];
 
-u8 cpuBitsSet[256];
-u8 cpuLowestBitSet[256];
+EMU_STATE u8 cpuBitsSet[256];
+EMU_STATE u8 cpuLowestBitSet[256];
 
 #ifdef WORDS_BIGENDIAN
-bool8 cpuBiosSwapped = false;
+EMU_STATE bool8 cpuBiosSwapped = false;
 #endif
 
 u32 myROM[] = {
@@ -341,7 +352,7 @@ u32 myROM[] = {
 	0x03007FE0
 };
 
-variable_desc saveGameStruct[] = {
+EMU_STATE_DYNAMIC variable_desc saveGameStruct[] = {
 	{ &DISPCNT,			  sizeof(u16) },
 	{ &DISPSTAT,		  sizeof(u16) },
 	{ &VCOUNT,			  sizeof(u16) },
@@ -478,52 +489,138 @@ void cpuEnableProfiling(int hz)
 
 #endif
 
-inline int CPUUpdateTicks()
+// CPULoop stops at the earliest deadline any of these event sources has registered.  The
+// deadlines are kept in a binary heap on cpuEventClock, which only moves at the stops, so the
+// counters the rest of the core reads (lcdTicks, soundTicks, timerNTicks, ...) stay relative to
+// the last stop as before, and a source only registers again when its counter is reloaded.
+enum
 {
-	int cpuLoopTicks = lcdTicks;
+	CPU_EVENT_LCD,
+	CPU_EVENT_SOUND,
+	CPU_EVENT_TIMER0,
+	CPU_EVENT_TIMER1,
+	CPU_EVENT_TIMER2,
+	CPU_EVENT_TIMER3,
+	CPU_EVENT_SWI,
+	CPU_EVENT_IRQ,
+#ifdef PROFILING
+	CPU_EVENT_PROFILING,
+#endif
+	CPU_EVENT_COUNT
+};
 
-	if (soundTicks < cpuLoopTicks)
-		cpuLoopTicks = soundTicks;
+static EMU_STATE u32 cpuEventClock = 0;
+static EMU_STATE u32 cpuEventDeadline[CPU_EVENT_COUNT];
+static EMU_STATE u8	 cpuEventHeap[CPU_EVENT_COUNT + 1]; // from 1, earliest deadline first
+static EMU_STATE u8	 cpuEventPos[CPU_EVENT_COUNT];		// index in cpuEventHeap, 0 when not registered
+static EMU_STATE int cpuEventCount = 0;
 
-	if (timer0On && (timer0Ticks < cpuLoopTicks))
-	{
-		cpuLoopTicks = timer0Ticks;
-	}
-	if (timer1On && !(TM1CNT & 4) && (timer1Ticks < cpuLoopTicks))
+static inline int32 CPUEventTicks(int event)
+{
+	return (int32)(cpuEventDeadline[event] - cpuEventClock);
+}
+
+static inline void CPUEventPlace(int event, int pos)
+{
+	cpuEventHeap[pos] = event;
+	cpuEventPos[event] = pos;
+}
+
+static void CPUEventSift(int pos)
+{
+	int	  event = cpuEventHeap[pos];
+	int32 due	= CPUEventTicks(event);
+
+	while (pos > 1 && CPUEventTicks(cpuEventHeap[pos >> 1]) > due)
 	{
-		cpuLoopTicks = timer1Ticks;
+		CPUEventPlace(cpuEventHeap[pos >> 1], pos);
+		pos >>= 1;
 	}
-	if (timer2On && !(TM2CNT & 4) && (timer2Ticks < cpuLoopTicks))
+
+	for (;;)
 	{
-		cpuLoopTicks = timer2Ticks;
+		int child = pos << 1;
+		if (child > cpuEventCount)
+			break;
+		if (child < cpuEventCount && CPUEventTicks(cpuEventHeap[child + 1]) < CPUEventTicks(cpuEventHeap[child]))
+			child++;
+		if (CPUEventTicks(cpuEventHeap[child]) >= due)
+			break;
+		CPUEventPlace(cpuEventHeap[child], pos);
+		pos = child;
 	}
-	if (timer3On && !(TM3CNT & 4) && (timer3Ticks < cpuLoopTicks))
+
+	CPUEventPlace(event, pos);
+}
+
+// ticks are counted from the last stop, like the counters
+static void CPUScheduleEvent(int event, int32 ticks)
+{
+	cpuEventDeadline[event] = cpuEventClock + ticks;
+	if (!cpuEventPos[event])
+		CPUEventPlace(event, ++cpuEventCount);
+	CPUEventSift(cpuEventPos[event]);
+}
+
+static void CPUCancelEvent(int event)
+{
+	int pos = cpuEventPos[event];
+	if (!pos)
+		return;
+
+	int last = cpuEventHeap[cpuEventCount--];
+	cpuEventPos[event] = 0;
+	if (last != event)
 	{
-		cpuLoopTicks = timer3Ticks;
+		CPUEventPlace(last, pos);
+		CPUEventSift(pos);
 	}
+}
+
+// a cascading timer only counts the overflows of the one before it
+static void CPUScheduleTimers()
+{
+	if (timer0On)
+		CPUScheduleEvent(CPU_EVENT_TIMER0, timer0Ticks);
+	else
+		CPUCancelEvent(CPU_EVENT_TIMER0);
+	if (timer1On && !(TM1CNT & 4))
+		CPUScheduleEvent(CPU_EVENT_TIMER1, timer1Ticks);
+	else
+		CPUCancelEvent(CPU_EVENT_TIMER1);
+	if (timer2On && !(TM2CNT & 4))
+		CPUScheduleEvent(CPU_EVENT_TIMER2, timer2Ticks);
+	else
+		CPUCancelEvent(CPU_EVENT_TIMER2);
+	if (timer3On && !(TM3CNT & 4))
+		CPUScheduleEvent(CPU_EVENT_TIMER3, timer3Ticks);
+	else
+		CPUCancelEvent(CPU_EVENT_TIMER3);
+}
+
+// Registers every source again from its counter, for when they were set from outside the loop
+// (reset, savestates, sound settings).
+static void CPUScheduleEvents()
+{
+	memset(cpuEventPos, 0, sizeof(cpuEventPos));
+	cpuEventCount = 0;
+
+	CPUScheduleEvent(CPU_EVENT_LCD, lcdTicks);
+	CPUScheduleEvent(CPU_EVENT_SOUND, soundTicks);
+	CPUScheduleTimers();
 #ifdef PROFILING
 	if (profilingTicksReload != 0)
-	{
-		if (profilingTicks < cpuLoopTicks)
-		{
-			cpuLoopTicks = profilingTicks;
-		}
-	}
+		CPUScheduleEvent(CPU_EVENT_PROFILING, profilingTicks);
 #endif
-
 	if (SWITicks)
-	{
-		if (SWITicks < cpuLoopTicks)
-			cpuLoopTicks = SWITicks;
-	}
-
+		CPUScheduleEvent(CPU_EVENT_SWI, SWITicks);
 	if (IRQTicks)
-	{
-		if (IRQTicks < cpuLoopTicks)
-			cpuLoopTicks = IRQTicks;
-	}
+		CPUScheduleEvent(CPU_EVENT_IRQ, IRQTicks);
+}
 
-	return cpuLoopTicks;
+inline int CPUUpdateTicks()
+{
+	return CPUEventTicks(cpuEventHeap[1]);
 }
 
 void CPUUpdateWindow0()
@@ -716,6 +813,36 @@ bool CPUWriteMemState(char *memory, int available)
 	return res;
 }
 
+// the uncompressed snapshot is the savestate itself, it only differs in that the memory is in sync with it afterwards
+bool CPUWriteSnapshot(gzFile gzFile)
+{
+	if (!CPUWriteStateToStream(gzFile))
+		return false;
+
+	memset(cpuDirtyPage, false, sizeof(cpuDirtyPage));
+	return true;
+}
+
+// reads EWRAM, IWRAM or VRAM from the state; when restoring the snapshot the memory is in sync with,
+// only the pages written since are copied back out of the raw stream
+static void CPUReadStateMemory(gzFile gzFile, u8 *memory, u32 size, u32 dirtyOffset)
+{
+	RawMemStream *stream = (RawMemStream *)gzFile;
+	if (!cpuSnapshotDirtyOnly || stream->size - stream->pos < size)
+	{
+		utilGzRead(gzFile, memory, size);
+		return;
+	}
+
+	const u8 *data = stream->data + stream->pos;
+	for (u32 offset = 0; offset < size; offset += CPU_DIRTY_PAGE_SIZE)
+	{
+		if (cpuDirtyPage[(dirtyOffset + offset) >> CPU_DIRTY_PAGE_SHIFT])
+			memcpy(memory + offset, data + offset, CPU_DIRTY_PAGE_SIZE);
+	}
+	utilGzSeek(gzFile, size, SEEK_CUR);
+}
+
 bool CPUReadStateFromStream(gzFile gzFile)
 {
 	char tempBackupName[128];
@@ -772,10 +899,10 @@ bool CPUReadStateFromStream(gzFile gzFile)
 	else
 		intState = utilReadInt(gzFile) ? true : false;
 
-	utilGzRead(gzFile, internalRAM, 0x8000);
+	CPUReadStateMemory(gzFile, internalRAM, 0x8000, CPU_DIRTY_IWRAM);
 	utilGzRead(gzFile, paletteRAM, 0x400);
-	utilGzRead(gzFile, workRAM, 0x40000);
-	utilGzRead(gzFile, vram, 0x20000);
+	CPUReadStateMemory(gzFile, workRAM, 0x40000, 0);
+	CPUReadStateMemory(gzFile, vram, 0x20000, CPU_DIRTY_VRAM);
 	utilGzRead(gzFile, oam, 0x400);
 	if (version < SAVE_GAME_VERSION_6)
 		utilGzRead(gzFile, pix, 4 * 240 * 160);
@@ -783,6 +910,9 @@ bool CPUReadStateFromStream(gzFile gzFile)
 		utilGzRead(gzFile, pix, 4 * 241 * 162);
 	utilGzRead(gzFile, ioMem, 0x400);
 
+	// from here on the memory is out of sync with the last snapshot, CPUReadSnapshot syncs it again on success
+	CPUMarkDirtyRange(0, CPU_DIRTY_PAGE_COUNT << CPU_DIRTY_PAGE_SHIFT);
+
 	if (skipSaveGameBattery)
 	{
 		// skip eeprom data
@@ -848,6 +978,8 @@ bool CPUReadStateFromStream(gzFile gzFile)
 		interp_rate();
 	}
 
+	CPUScheduleEvents();
+
 	// set pointers!
 	layerEnable = layerSettings & DISPCNT;
 
@@ -928,6 +1060,8 @@ bool CPUReadStateFromStream(gzFile gzFile)
 					sprintf(errStr, "%s;\nSnapshot unverifiable with movie after End Frame %u", errStr, VBAMovieGetLastErrorInfo()); break;
 				case MOVIE_TIMELINE_INCONSISTENT_AT:
 					sprintf(errStr, "%s;\nSnapshot inconsistent with movie at Frame %u", errStr, VBAMovieGetLastErrorInfo()); break;
+				case MOVIE_INPUT_MISSING_AT:
+					sprintf(errStr, "%s;\nSnapshot input from Frame %u missing from the movie's chunk store", errStr, VBAMovieGetLastErrorInfo()); break;
 				case MOVIE_WRONG_FORMAT:
 					strcat(errStr, ";\nWrong format"); break;
 				}
@@ -1020,6 +1154,20 @@ bool CPUReadMemState(char *memory, int available)
 	return res;
 }
 
+bool CPUReadSnapshot(gzFile gzFile, bool dirtyOnly)
+{
+	cpuSnapshotDirtyOnly = dirtyOnly;
+	tempSaveSafe = false;
+	bool res = CPUReadStateFromStream(gzFile);
+	tempSaveSafe = true;
+	cpuSnapshotDirtyOnly = false;
+
+	if (res)
+		memset(cpuDirtyPage, false, sizeof(cpuDirtyPage));
+
+	return res;
+}
+
 bool CPUReadState(const char *file)
 {
 	gzFile gzFile = utilGzOpen(file, "rb");
@@ -1409,7 +1557,8 @@ void CPUCleanUp()
 	free(bios);
 	bios = NULL;
 
-	free(rom);
+	if (!mappedImageFree(rom))
+		free(rom);
 	rom = NULL;
 
 	free(internalRAM);
@@ -1430,6 +1579,9 @@ void CPUCleanUp()
 	free(ioMem);
 	ioMem = NULL;
 
+	armBlockCacheFree();
+	thumbBlockCacheFree();
+
 #if 0
 	eepromErase();
 	flashErase();
@@ -1443,6 +1595,26 @@ void CPUCleanUp()
 	systemRefreshScreen();
 }
 
+// Past the end of the image the ROM reads back the lower address bits, which repeat every 128 KB.
+// A plain image is mapped with that pattern behind it, so the ROM space is shared and paged in lazily.
+static u8 *CPUMapRom(const char *szFile, int &size)
+{
+	u8 *pattern = (u8 *)malloc(0x20000);
+	if (pattern == NULL)
+		return NULL;
+
+	u16 *temp = (u16 *)pattern;
+	for (int i = 0; i < 0x20000; i += 2)
+	{
+		WRITE16LE(temp, (i >> 1) & 0xFFFF);
+		temp++;
+	}
+
+	u8 *image = mappedImageLoad(szFile, 0x2000000, size, pattern, 0x20000);
+	free(pattern);
+	return image;
+}
+
 int CPULoadRom(const char *szFile)
 {
 	int size = 0x2000000;
@@ -1454,7 +1626,15 @@ int CPULoadRom(const char *szFile)
 
 	systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
 
-	rom = (u8 *)malloc(0x2000000);
+	bool romMapped = false;
+	if (szFile != NULL && !cpuIsMultiBoot && !utilIsELF(szFile))
+	{
+		rom		  = CPUMapRom(szFile, size);
+		romMapped = rom != NULL;
+	}
+
+	if (rom == NULL)
+		rom = (u8 *)malloc(0x2000000);
 	if (rom == NULL)
 	{
 		systemMessage(MSG_OUT_OF_MEMORY, N_("Failed to allocate memory for %s"),
@@ -1494,7 +1674,7 @@ int CPULoadRom(const char *szFile)
 	}
 	else
 #endif //NO_DEBUGGER
-	if (szFile != NULL)
+	if (szFile != NULL && !romMapped)
 	{
 		if (!utilLoad(szFile,
 		              utilIsGBAImage,
@@ -1506,11 +1686,14 @@ int CPULoadRom(const char *szFile)
 		}
 	}
 
-	u16 *temp = (u16 *)(rom + ((size + 1) & ~1));
-	for (int i = (size + 1) & ~1; i < 0x2000000; i += 2)
+	if (!romMapped)
 	{
-		WRITE16LE(temp, (i >> 1) & 0xFFFF);
-		temp++;
+		u16 *temp = (u16 *)(rom + ((size + 1) & ~1));
+		for (int i = (size + 1) & ~1; i < 0x2000000; i += 2)
+		{
+			WRITE16LE(temp, (i >> 1) & 0xFFFF);
+			temp++;
+		}
 	}
 
 	pix = (u8 *)PIX_CALLOC(4 * 241 * 162);
@@ -1613,6 +1796,45 @@ void CPUMasterCodeCheck()
 	}
 }
 
+static inline u32 CPUIdleLoopGetFlags()
+{
+	return N_FLAG | (Z_FLAG << 1) | (C_FLAG << 2) | (V_FLAG << 3) | (armState << 4) |
+	       (armIrqEnable << 5) | (busPrefetch << 6) | (armMode << 8);
+}
+
+// Called after a short backward branch.  If the CPU is back in the state it was
+// in after the previous pass, and that pass neither wrote memory nor read anything
+// that changes between events, every further pass would do exactly the same until
+// the next event, so the ones that end before it are skipped at once.
+void CPUIdleLoopCheck(u32 branch)
+{
+	u32 flags = CPUIdleLoopGetFlags();
+
+	if (branch == cpuIdleLoopBranch && cpuIdleLoopClean && flags == cpuIdleLoopFlags &&
+	    busPrefetchCount == cpuIdleLoopPrefetch[0] && cpuPrefetch[0] == cpuIdleLoopPrefetch[1] &&
+	    cpuPrefetch[1] == cpuIdleLoopPrefetch[2] && !memcmp(reg, cpuIdleLoopReg, sizeof(reg)) &&
+	    !(cheatsEnabled && mastercode) && !VBALuaHasMemHook(LUAMEMHOOK_READ) &&
+	    !VBALuaHasMemHook(LUAMEMHOOK_WRITE))
+	{
+		int32 period = cpuTotalTicks - cpuIdleLoopTicks;
+		int32 count	 = (cpuNextEvent - 1 - cpuTotalTicks) / period;
+		if (count > 0)
+			cpuTotalTicks += count * period;
+	}
+	else
+	{
+		cpuIdleLoopBranch	   = branch;
+		cpuIdleLoopFlags	   = flags;
+		cpuIdleLoopPrefetch[0] = busPrefetchCount;
+		cpuIdleLoopPrefetch[1] = cpuPrefetch[0];
+		cpuIdleLoopPrefetch[2] = cpuPrefetch[1];
+		memcpy(cpuIdleLoopReg, reg, sizeof(reg));
+	}
+
+	cpuIdleLoopTicks = cpuTotalTicks;
+	cpuIdleLoopClean = true;
+}
+
 void CPUUpdateRender()
 {
 	switch (DISPCNT & 7)
@@ -1885,7 +2107,9 @@ void CPUSoftwareInterrupt()
 
 void CPUSoftwareInterrupt(int comment)
 {
-	static bool disableMessage = false;
+	static EMU_STATE bool disableMessage = false;
+	// the emulated BIOS calls take their time outside of the loop being timed
+	cpuIdleLoopClean = false;
 	if (armState)
 		comment >>= 16;
 #ifdef BKPT_SUPPORT
@@ -1981,6 +2205,7 @@ void CPUSoftwareInterrupt(int comment)
 			    VCOUNT);
 		}
 #endif
+		soundSync();
 		holdState	 = true;
 		holdType	 = -1;
 		stopState	 = true;
@@ -2205,6 +2430,9 @@ void CPUSoftwareInterrupt(int comment)
 		}
 		break;
 	}
+
+	if (SWITicks)
+		CPUScheduleEvent(CPU_EVENT_SWI, SWITicks);
 }
 
 void CPUCompareVCOUNT()
@@ -2233,6 +2461,149 @@ void CPUCompareVCOUNT()
 	}
 }
 
+// The host memory at address when it is plain memory the memory functions would only copy to or
+// from, with available set to the bytes up to the end of its mirror.  NULL for anything they have
+// to handle themselves, and while hooks or watchpoints need to see every access.
+u8 *CPUMemoryBlock(u32 address, u32 &available, bool write)
+{
+#if defined(BKPT_SUPPORT) && defined(SDL)
+	return NULL;
+#else
+	if (VBALuaHasMemHook(LUAMEMHOOK_READ) || VBALuaHasMemHook(LUAMEMHOOK_WRITE))
+		return NULL;
+
+	u8 *base;
+	u32 mask;
+	switch (address >> 24)
+	{
+	case 2:
+		base = workRAM;
+		mask = 0x3FFFF;
+		break;
+	case 3:
+		base = internalRAM;
+		mask = 0x7FFF;
+		break;
+	case 5:
+		base = paletteRAM;
+		mask = 0x3FF;
+		break;
+	case 6:
+		// the mirror of the OBJ tiles and the bitmap mode hole are left to the memory functions
+		if ((address & 0x1FFFF) >= 0x18000)
+			return NULL;
+		available = 0x18000 - (address & 0x1FFFF);
+		return &vram[address & 0x1FFFF];
+	case 7:
+		base = oam;
+		mask = 0x3FF;
+		break;
+	case 8:
+	case 9:
+	case 10:
+	case 11:
+	case 12:
+		if (write || (address >= 0x80000c4 && address < 0x80000ca))
+			return NULL;    // RTC
+		base = rom;
+		mask = 0x1FFFFFF;
+		break;
+	default:
+		return NULL;
+	}
+
+	available = mask + 1 - (address & mask);
+	if ((address >> 24) == 8 && address < 0x80000c4 && available > 0x80000c4 - address)
+		available = 0x80000c4 - address;
+	// the ROM mirror at 0x0C is followed by the EEPROM window, which stays on the memory functions
+	if ((address >> 24) == 12)
+		available = 0x1000000 - (address & 0xFFFFFF);
+	return &base[address & mask];
+#endif
+}
+
+// does what the memory functions do after a write besides storing the data
+void CPUMemoryBlockWritten(u32 address, u32 size)
+{
+	switch (address >> 24)
+	{
+	case 2:
+	case 3:
+	case 6:
+		CPUMarkDirtyRun(address, size);
+		break;
+	case 8:
+	case 9:
+	case 10:
+	case 11:
+	case 12:
+	case 13:
+		if (cpuCodePage[CPU_CODE_PAGE_ROM])
+			CPUCodePageWritten(CPU_CODE_PAGE_ROM);
+		break;
+	}
+	cpuIdleLoopClean = false;
+}
+
+// Runs a DMA between plain memory regions straight on the host buffers, doing what the
+// unit by unit loop through CPUReadMemory and CPUWriteMemory would.  Returns false if the
+// transfer touches anything else or the increments are not plain ones.
+static bool CPUDmaBlock(u32 &s, u32 &d, u32 si, u32 di, u32 c, int unit)
+{
+	int sstep = (int)si;
+	int dstep = (int)di;
+	if (c == 0 || (sstep != unit && sstep != -unit && sstep != 0) || (dstep != unit && dstep != -unit))
+		return false;
+
+	u32 sa	  = s;
+	u32 da	  = d & ~(unit - 1);
+	u32 size  = c * unit;
+	u32 sLow  = sstep < 0 ? sa - (size - unit) : sa;
+	u32 sSize = sstep ? size : unit;
+	u32 dLow  = dstep < 0 ? da - (size - unit) : da;
+
+	u32 sAvailable, dAvailable;
+	u8 *src = CPUMemoryBlock(sLow, sAvailable, false);
+	u8 *dst = CPUMemoryBlock(dLow, dAvailable, true);
+	if (src == NULL || dst == NULL || sAvailable < sSize || dAvailable < size)
+		return false;
+	if (src < dst + size && dst < src + sSize)
+		return false;
+
+	if (sstep == unit && dstep == unit)
+		memcpy(dst, src, size);
+	else
+	{
+		u8 *sp = sstep < 0 ? src + sSize - unit : src;
+		u8 *dp = dstep < 0 ? dst + size - unit : dst;
+		for (u32 i = 0; i < c; i++)
+		{
+			if (unit == 4)
+				WRITE32LE((u32 *)dp, READ32LE((u32 *)sp));
+			else
+				WRITE16LE((u16 *)dp, READ16LE((u16 *)sp));
+			sp += sstep;
+			dp += dstep;
+		}
+	}
+
+	// the open bus keeps the last unit read
+	u32 sLast = sa + (c - 1) * si;
+	if (unit == 4)
+		cpuDmaLast = READ32LE((u32 *)&src[sLast - sLow]);
+	else
+	{
+		cpuDmaLast	= READ16LE((u16 *)&src[sLast - sLow]);
+		cpuDmaLast |= (cpuDmaLast << 16);
+	}
+
+	CPUMemoryBlockWritten(dLow, size);
+
+	s += c * si;
+	d += c * di;
+	return true;
+}
+
 static void doDMA(u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
 {
 	int sm = s >> 24;
@@ -2263,7 +2634,7 @@ static void doDMA(u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
 				c--;
 			}
 		}
-		else
+		else if (!CPUDmaBlock(s, d, si, di, c, 4))
 		{
 			while (c != 0)
 			{
@@ -2289,7 +2660,7 @@ static void doDMA(u32 &s, u32 &d, u32 si, u32 di, u32 c, int transfer32)
 				c--;
 			}
 		}
-		else
+		else if (!CPUDmaBlock(s, d, si, di, c, 2))
 		{
 			while (c != 0)
 			{
@@ -2654,6 +3025,7 @@ void CPUUpdateRegister(u32 address, u16 value)
 			if (!(DISPSTAT & 1))
 			{
 				lcdTicks = 1008;
+				CPUScheduleEvent(CPU_EVENT_LCD, lcdTicks);
 				//      VCOUNT = 0;
 				//      UPDATE_REG(0x06, VCOUNT);
 				DISPSTAT &= 0xFFFC;
@@ -3213,6 +3585,7 @@ void applyTimer()
 		TM3CNT	 = timer3Value & 0xC7;
 		UPDATE_REG(0x10E, TM3CNT);
 	}
+	CPUScheduleTimers();
 	cpuNextEvent	= CPUUpdateTicks();
 	timerOnOffDelay = 0;
 }
@@ -3335,6 +3708,10 @@ void CPUReset()
 	memset(vram, 0, 0x20000);
 	// clean io memory
 	memset(ioMem, 0, 0x400);
+	// out of sync with any snapshot
+	CPUMarkDirtyRange(0, CPU_DIRTY_PAGE_COUNT << CPU_DIRTY_PAGE_SHIFT);
+	// the BIOS or the ROM may be new
+	CPUCodePageWritten(CPU_CODE_PAGE_ROM);
 
 	DISPCNT	 = 0x0080;
 	DISPSTAT = 0x0000;
@@ -3616,6 +3993,7 @@ void CPUReset()
 	IRQTicks = 0;
 
 	soundReset();
+	CPUScheduleEvents();
 	systemRefreshScreen();
 }
 
@@ -3649,28 +4027,8 @@ static inline void CPUDrawPixLine()
 	case 16:
 	{
 		u16 *dest = (u16 *)pix + 241 * (VCOUNT + 1);
-		for (int x = 0; x < 240; )
-		{
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap16[lineMix[x++] & 0xFFFF];
-		}
+		utilColorMapLine(dest, lineMix, 240);
+		dest += 240;
 		// for filters that read past the screen
 		*dest++ = 0;
 		break;
@@ -3721,28 +4079,7 @@ static inline void CPUDrawPixLine()
 	case 32:
 	{
 		u32 *dest = (u32 *)pix + 241 * (VCOUNT + 1);
-		for (int x = 0; x < 240; )
-		{
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-			*dest++ = systemColorMap32[lineMix[x++] & 0xFFFF];
-		}
+		utilColorMapLine(dest, lineMix, 240);
 		break;
 	}
 	}
@@ -3809,6 +4146,9 @@ static inline void CPUBeforeEmulation()
 
 static inline void CPUFrameBoundaryWork()
 {
+	// the frame's sound must be complete before the frontend takes it
+	soundSync();
+
 	// HACK: some special "buttons"
 	if (cheatsEnabled)
 		cheatsCheckKeys(P1 ^ 0x3FF, extButtons);
@@ -3826,8 +4166,10 @@ void CPULoop(int _ticks)
 	bool newVideoFrame = false;
 
 	// variable used by the CPU core
-	cpuTotalTicks = 0;
+	cpuTotalTicks	  = 0;
+	cpuIdleLoopBranch = 0;
 
+	CPUScheduleEvents();
 	cpuNextEvent = CPUUpdateTicks();
 	if (cpuNextEvent > ticks)
 		cpuNextEvent = ticks;
@@ -3927,22 +4269,35 @@ void CPULoop(int _ticks)
 			if (SWITicks)
 			{
 				SWITicks -= clockTicks;
-				if (SWITicks < 0)
+				if (SWITicks <= 0)
+				{
 					SWITicks = 0;
+					CPUCancelEvent(CPU_EVENT_SWI);
+				}
 			}
 
-			clockTicks	  = cpuNextEvent;
-			cpuTotalTicks = 0;
-			cpuDmaHack	  = false;
+			clockTicks		  = cpuNextEvent;
+			cpuTotalTicks	  = 0;
+			cpuDmaHack		  = false;
+			cpuIdleLoopBranch = 0;
 
 updateLoop:
+			cpuEventClock += clockTicks;
+
 			if (IRQTicks)
 			{
 				IRQTicks -= clockTicks;
-				if (IRQTicks < 0)
+				if (IRQTicks <= 0)
+				{
 					IRQTicks = 0;
+					CPUCancelEvent(CPU_EVENT_IRQ);
+				}
 			}
 
+			// the SWI delay is only counted down once per stop, above
+			if (SWITicks)
+				CPUScheduleEvent(CPU_EVENT_SWI, SWITicks);
+
 			lcdTicks -= clockTicks;
 
 			if (lcdTicks <= 0)
@@ -4011,9 +4366,13 @@ updateLoop:
 					{
 						if (systemFrameDrawingRequired())
 						{
+							u64 renderStart = systemProfileBegin();
+
 							(*renderLine)();
 
 							CPUDrawPixLine();
+
+							systemProfileEnd(PROFILE_RENDER, renderStart);
 						}
 						// entering H-Blank
 						DISPSTAT |= 2;
@@ -4027,16 +4386,23 @@ updateLoop:
 						}
 					}
 				}
+				CPUScheduleEvent(CPU_EVENT_LCD, lcdTicks);
 			}
 
 			// we shouldn't be doing sound in stop state, but we lose synchronization
-			// if sound is disabled, so in stop state, soundTick will just produce
-			// mute sound
+			// if sound is disabled, so in stop state, the ticks will just produce
+			// mute sound.
+			// the ticks are only counted here and soundSync runs them in batches when
+			// the sound state is observed; in stop state they are run right away,
+			// because leaving it doesn't go through the sound code
 			soundTicks -= clockTicks;
 			if (soundTicks <= 0)
 			{
-				soundTick();
 				soundTicks += soundTickStep;
+				soundTicksPending++;
+				CPUScheduleEvent(CPU_EVENT_SOUND, soundTicks);
+				if (stopState)
+					soundSync();
 			}
 
 			if (!stopState)
@@ -4048,6 +4414,7 @@ updateLoop:
 					{
 						timer0Ticks	  += (0x10000 - timer0Reload) << timer0ClockReload;
 						timerOverflow |= 1;
+						CPUScheduleEvent(CPU_EVENT_TIMER0, timer0Ticks);
 						soundTimerOverflow(0);
 						if (TM0CNT & 0x40)
 						{
@@ -4087,6 +4454,7 @@ updateLoop:
 						{
 							timer1Ticks	  += (0x10000 - timer1Reload) << timer1ClockReload;
 							timerOverflow |= 2;
+							CPUScheduleEvent(CPU_EVENT_TIMER1, timer1Ticks);
 							soundTimerOverflow(1);
 							if (TM1CNT & 0x40)
 							{
@@ -4126,6 +4494,7 @@ updateLoop:
 						{
 							timer2Ticks	  += (0x10000 - timer2Reload) << timer2ClockReload;
 							timerOverflow |= 4;
+							CPUScheduleEvent(CPU_EVENT_TIMER2, timer2Ticks);
 							if (TM2CNT & 0x40)
 							{
 								IF |= 0x20;
@@ -4162,6 +4531,7 @@ updateLoop:
 						if (timer3Ticks <= 0)
 						{
 							timer3Ticks += (0x10000 - timer3Reload) << timer3ClockReload;
+							CPUScheduleEvent(CPU_EVENT_TIMER3, timer3Ticks);
 							if (TM3CNT & 0x40)
 							{
 								IF |= 0x40;
@@ -4173,6 +4543,11 @@ updateLoop:
 					}
 				}
 			}
+			else
+			{
+				// the timers stand still, so their deadlines move with the clock
+				CPUScheduleTimers();
+			}
 
 			timerOverflow = 0;
 
@@ -4181,6 +4556,7 @@ updateLoop:
 			if (profilingTicks <= 0)
 			{
 				profilingTicks += profilingTicksReload;
+				CPUScheduleEvent(CPU_EVENT_PROFILING, profilingTicks);
 				if (profilSegment)
 				{
 					profile_segment *seg = profilSegment;
@@ -4245,6 +4621,7 @@ updateLoop:
 						{
 							intState = true;
 							IRQTicks = 7;
+							CPUScheduleEvent(CPU_EVENT_IRQ, IRQTicks);
 							if (cpuNextEvent > IRQTicks)
 								cpuNextEvent = IRQTicks;
 						}
@@ -4260,7 +4637,10 @@ updateLoop:
 					// Stops the SWI Ticks emulation if an IRQ is executed
 					//(to avoid problems with nested IRQ/SWI)
 					if (SWITicks)
+					{
 						SWITicks = 0;
+						CPUCancelEvent(CPU_EVENT_SWI);
+					}
 				}
 			}
 
@@ -4286,6 +4666,7 @@ updateLoop:
 			if (newFrame || useOldFrameTiming && ticks <= 0)
 #endif
 			{
+				soundSync();
 				break;
 			}
 		}
@@ -4320,6 +4701,10 @@ struct EmulatedSystem GBASystem =
 	CPUReadMemState,
 	// emuWriteMemState
 	CPUWriteMemState,
+	// emuWriteSnapshot
+	CPUWriteSnapshot,
+	// emuReadSnapshot
+	CPUReadSnapshot,
 	// emuWritePNG
 	CPUWritePNGFile,
 	// emuWriteBMP
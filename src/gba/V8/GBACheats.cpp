@@ -9,6 +9,8 @@
 #include "../GBA.h"
 #include "../GBAinline.h"
 #include "../GBAGlobals.h"
+#include "GBACpu.h"
+#include "../../common/vbalua.h"
 
 /**
  * Gameshark code types: (based on AR v1.0)
@@ -183,28 +185,48 @@
 #define countof(a)  (sizeof(a) / sizeof(a[0]))
 #endif
 
-CheatsData cheatsList[100];
-int		   cheatsNumber = 0;
-u32		   rompatch2addr [4];
-u16		   rompatch2val [4];
-u16		   rompatch2oldval [4];
-
-u8		   cheatsCBASeedBuffer[0x30];
-u32		   cheatsCBASeed[4];
-u32		   cheatsCBATemporaryValue = 0;
-u16		   cheatsCBATable[256];
-bool	   cheatsCBATableGenerated = false;
-u16		   super = 0;
-extern u32 mastercode;
-
-u8 cheatsCBACurrentSeed[12] = {
+// ROM patches go through these so that code blocks built from the old ROM (GBA-arm.cpp) are dropped.
+// Patches reapplied every frame leave the ROM as it was and drop nothing.
+static void cheatsPatchRom16(u32 address, u16 value)
+{
+	if (READ16LE(((u16 *)&rom[address & 0x1ffffff])) != value)
+	{
+		CHEAT_PATCH_ROM_16BIT(address, value);
+		CPUMemoryBlockWritten(address, 2);
+	}
+}
+
+static void cheatsPatchRom32(u32 address, u32 value)
+{
+	if (READ32LE(((u32 *)&rom[address & 0x1ffffff])) != value)
+	{
+		CHEAT_PATCH_ROM_32BIT(address, value);
+		CPUMemoryBlockWritten(address, 4);
+	}
+}
+
+EMU_STATE CheatsData cheatsList[100];
+EMU_STATE int		   cheatsNumber = 0;
+EMU_STATE u32		   rompatch2addr [4];
+EMU_STATE u16		   rompatch2val [4];
+EMU_STATE u16		   rompatch2oldval [4];
+
+EMU_STATE u8		   cheatsCBASeedBuffer[0x30];
+EMU_STATE u32		   cheatsCBASeed[4];
+EMU_STATE u32		   cheatsCBATemporaryValue = 0;
+EMU_STATE u16		   cheatsCBATable[256];
+EMU_STATE bool	   cheatsCBATableGenerated = false;
+EMU_STATE u16		   super = 0;
+extern EMU_STATE u32 mastercode;
+
+EMU_STATE u8 cheatsCBACurrentSeed[12] = {
 	0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00
 };
 
-u32 seeds_v1[4];
-u32 seeds_v3[4];
+EMU_STATE u32 seeds_v1[4];
+EMU_STATE u32 seeds_v3[4];
 
 u32 seed_gen(u8 upper, u8 seed, u8 *deadtable1, u8 *deadtable2);
 
@@ -544,6 +566,420 @@ static int getCodeLength(int num)
 	return 1;
 }
 
+// The list is compiled to one op per line whenever it changes.  Writes and comparisons on
+// WRAM and IWRAM run straight on the host memory, disabled codes jump over their lines, and
+// ROM patches the list always reaches are kept in an index and applied once instead of
+// every frame.  Everything else goes through the interpreter in cheatsCheckKeys().
+#define CHEATS_OP_CODE  0
+#define CHEATS_OP_SKIP  1
+#define CHEATS_OP_WRITE 2
+#define CHEATS_OP_IF    3
+
+#define CHEATS_IF_EQ  0
+#define CHEATS_IF_NE  1
+#define CHEATS_IF_LTU 2
+#define CHEATS_IF_GTU 3
+#define CHEATS_IF_LEU 4
+#define CHEATS_IF_GEU 5
+#define CHEATS_IF_LTS 6
+#define CHEATS_IF_GTS 7
+#define CHEATS_IF_AND 8
+
+#define CHEATS_SKIP_CODES_OFF -1
+#define CHEATS_SKIP_FROM_CODE -2
+
+struct CheatsOp
+{
+	u8 *data;     // host memory of address
+	u32 address;
+	u32 value;
+	s16 next;     // line after a skipped code, or lines an IF skips when it fails
+	u8	op;
+	u8	width;
+	u8	cond;
+	bool button;  // only while the GS button is held
+};
+
+struct CheatsIfCode
+{
+	int	 size;
+	u8	 width;
+	u8	 cond;
+	s8	 skip;
+	bool mask;    // the value is compared as a width-sized one
+};
+
+static const CheatsIfCode cheatsIfCodes[] = {
+	{ CBA_IF_TRUE, 2, CHEATS_IF_EQ, 1, false },
+	{ CBA_IF_FALSE, 2, CHEATS_IF_NE, 1, false },
+	{ CBA_GT, 2, CHEATS_IF_GTU, 1, false },
+	{ CBA_LT, 2, CHEATS_IF_LTU, 1, false },
+	{ GSA_8_BIT_IF_TRUE, 1, CHEATS_IF_EQ, 1, false },
+	{ GSA_32_BIT_IF_TRUE, 4, CHEATS_IF_EQ, 1, false },
+	{ GSA_8_BIT_IF_FALSE, 1, CHEATS_IF_NE, 1, false },
+	{ GSA_32_BIT_IF_FALSE, 4, CHEATS_IF_NE, 1, false },
+	{ GSA_8_BIT_IF_TRUE2, 1, CHEATS_IF_EQ, 2, false },
+	{ GSA_16_BIT_IF_TRUE2, 2, CHEATS_IF_EQ, 2, false },
+	{ GSA_32_BIT_IF_TRUE2, 4, CHEATS_IF_EQ, 2, false },
+	{ GSA_8_BIT_IF_FALSE2, 1, CHEATS_IF_NE, 2, false },
+	{ GSA_16_BIT_IF_FALSE2, 2, CHEATS_IF_NE, 2, false },
+	{ GSA_32_BIT_IF_FALSE2, 4, CHEATS_IF_NE, 2, false },
+	{ GSA_8_BIT_IF_TRUE3, 1, CHEATS_IF_EQ, CHEATS_SKIP_CODES_OFF, false },
+	{ GSA_16_BIT_IF_TRUE3, 2, CHEATS_IF_EQ, CHEATS_SKIP_CODES_OFF, false },
+	{ GSA_32_BIT_IF_TRUE3, 4, CHEATS_IF_EQ, CHEATS_SKIP_CODES_OFF, false },
+	{ GSA_8_BIT_IF_FALSE3, 1, CHEATS_IF_NE, CHEATS_SKIP_CODES_OFF, false },
+	{ GSA_16_BIT_IF_FALSE3, 2, CHEATS_IF_NE, CHEATS_SKIP_CODES_OFF, false },
+	{ GSA_32_BIT_IF_FALSE3, 4, CHEATS_IF_NE, CHEATS_SKIP_CODES_OFF, false },
+	{ GSA_8_BIT_IF_LOWER_U, 1, CHEATS_IF_LTU, 1, true },
+	{ GSA_16_BIT_IF_LOWER_U, 2, CHEATS_IF_LTU, 1, true },
+	{ GSA_32_BIT_IF_LOWER_U, 4, CHEATS_IF_LTU, 1, true },
+	{ GSA_8_BIT_IF_HIGHER_U, 1, CHEATS_IF_GTU, 1, true },
+	{ GSA_16_BIT_IF_HIGHER_U, 2, CHEATS_IF_GTU, 1, true },
+	{ GSA_32_BIT_IF_HIGHER_U, 4, CHEATS_IF_GTU, 1, true },
+	{ GSA_8_BIT_IF_AND, 1, CHEATS_IF_AND, 1, true },
+	{ GSA_16_BIT_IF_AND, 2, CHEATS_IF_AND, 1, true },
+	{ GSA_32_BIT_IF_AND, 4, CHEATS_IF_AND, 1, true },
+	{ GSA_8_BIT_IF_LOWER_U2, 1, CHEATS_IF_LTU, 2, true },
+	{ GSA_16_BIT_IF_LOWER_U2, 2, CHEATS_IF_LTU, 2, true },
+	{ GSA_32_BIT_IF_LOWER_U2, 4, CHEATS_IF_LTU, 2, true },
+	{ GSA_8_BIT_IF_HIGHER_U2, 1, CHEATS_IF_GTU, 2, true },
+	{ GSA_16_BIT_IF_HIGHER_U2, 2, CHEATS_IF_GTU, 2, true },
+	{ GSA_32_BIT_IF_HIGHER_U2, 4, CHEATS_IF_GTU, 2, true },
+	{ GSA_8_BIT_IF_AND2, 1, CHEATS_IF_AND, 2, true },
+	{ GSA_16_BIT_IF_AND2, 2, CHEATS_IF_AND, 2, true },
+	{ GSA_32_BIT_IF_AND2, 4, CHEATS_IF_AND, 2, true },
+	{ GSA_8_BIT_IF_LOWER_U3, 1, CHEATS_IF_LTU, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_16_BIT_IF_LOWER_U3, 2, CHEATS_IF_LTU, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_32_BIT_IF_LOWER_U3, 4, CHEATS_IF_LTU, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_8_BIT_IF_HIGHER_U3, 1, CHEATS_IF_GTU, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_16_BIT_IF_HIGHER_U3, 2, CHEATS_IF_GTU, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_32_BIT_IF_HIGHER_U3, 4, CHEATS_IF_GTU, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_8_BIT_IF_AND3, 1, CHEATS_IF_AND, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_16_BIT_IF_AND3, 2, CHEATS_IF_AND, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_32_BIT_IF_AND3, 4, CHEATS_IF_AND, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_ALWAYS3, 4, CHEATS_IF_AND, CHEATS_SKIP_CODES_OFF, true },
+	// the signed ones compare against the value masked to the width, not sign extended
+	{ GSA_8_BIT_IF_LOWER_S, 1, CHEATS_IF_LTS, 1, true },
+	{ GSA_16_BIT_IF_LOWER_S, 2, CHEATS_IF_LTS, 1, true },
+	{ GSA_32_BIT_IF_LOWER_S, 4, CHEATS_IF_LTS, 1, true },
+	{ GSA_8_BIT_IF_HIGHER_S, 1, CHEATS_IF_GTS, 1, true },
+	{ GSA_16_BIT_IF_HIGHER_S, 2, CHEATS_IF_GTS, 1, true },
+	{ GSA_32_BIT_IF_HIGHER_S, 4, CHEATS_IF_GTS, 1, true },
+	{ GSA_8_BIT_IF_LOWER_S2, 1, CHEATS_IF_LTS, 2, true },
+	{ GSA_16_BIT_IF_LOWER_S2, 2, CHEATS_IF_LTS, 2, true },
+	{ GSA_32_BIT_IF_LOWER_S2, 4, CHEATS_IF_LTS, 2, true },
+	{ GSA_8_BIT_IF_HIGHER_S2, 1, CHEATS_IF_GTS, 2, true },
+	{ GSA_16_BIT_IF_HIGHER_S2, 2, CHEATS_IF_GTS, 2, true },
+	{ GSA_32_BIT_IF_HIGHER_S2, 4, CHEATS_IF_GTS, 2, true },
+	{ GSA_8_BIT_IF_LOWER_S3, 1, CHEATS_IF_LTS, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_16_BIT_IF_LOWER_S3, 2, CHEATS_IF_LTS, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_32_BIT_IF_LOWER_S3, 4, CHEATS_IF_LTS, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_8_BIT_IF_HIGHER_S3, 1, CHEATS_IF_GTS, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_16_BIT_IF_HIGHER_S3, 2, CHEATS_IF_GTS, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_32_BIT_IF_HIGHER_S3, 4, CHEATS_IF_GTS, CHEATS_SKIP_CODES_OFF, true },
+	{ GSA_16_BIT_IF_LOWER_OR_EQ_U, 2, CHEATS_IF_LEU, 1, false },
+	{ GSA_16_BIT_IF_HIGHER_OR_EQ_U, 2, CHEATS_IF_GEU, 1, false },
+	{ GSA_16_BIT_MIF_TRUE, 2, CHEATS_IF_EQ, CHEATS_SKIP_FROM_CODE, false },
+	{ GSA_16_BIT_MIF_FALSE, 2, CHEATS_IF_NE, CHEATS_SKIP_FROM_CODE, false },
+	{ GSA_16_BIT_MIF_LOWER_OR_EQ_U, 2, CHEATS_IF_LEU, CHEATS_SKIP_FROM_CODE, false },
+	{ GSA_16_BIT_MIF_HIGHER_OR_EQ_U, 2, CHEATS_IF_GEU, CHEATS_SKIP_FROM_CODE, false }
+};
+
+static EMU_STATE CheatsOp cheatsProgram[MAX_CHEATS];
+static EMU_STATE bool	  cheatsProgramValid = false;
+static EMU_STATE u8		 *cheatsProgramMemory[3];  // the buffers it was compiled for
+
+// ROM patch slots applied by the last compile, undone by the next one
+static EMU_STATE u8 *cheatsPatchedRom = NULL;
+static EMU_STATE u32 cheatsPatchedAddress[4];
+static EMU_STATE u16 cheatsPatchedValue[4];
+static EMU_STATE u16 cheatsPatchedOldValue[4];
+static EMU_STATE int cheatsPatchedCount = 0;
+
+static void cheatsInvalidate()
+{
+	cheatsProgramValid = false;
+}
+
+static void cheatsUnpatchRom()
+{
+	// a ROM loaded since keeps what it has
+	for (int i = cheatsPatchedCount - 1; i >= 0; i--)
+		if (cheatsPatchedRom == rom && READ16LE(&rom[cheatsPatchedAddress[i] & 0x1ffffff]) == cheatsPatchedValue[i])
+			cheatsPatchRom16(cheatsPatchedAddress[i], cheatsPatchedOldValue[i]);
+	cheatsPatchedCount = 0;
+	cheatsPatchedRom   = NULL;
+}
+
+static u8 *cheatsResolve(u32 address, int width)
+{
+	if ((address >> 24) != 2 && (address >> 24) != 3)
+		return NULL;
+
+	u32 available;
+	u8 *data = CPUMemoryBlock(address, available, true);
+	return data != NULL && available >= (u32)width ? data : NULL;
+}
+
+static bool cheatsIsRomSlot(int size)
+{
+	return size == GSA_16_BIT_ROM_PATCH2C || size == GSA_16_BIT_ROM_PATCH2D ||
+	       size == GSA_16_BIT_ROM_PATCH2E || size == GSA_16_BIT_ROM_PATCH2F;
+}
+
+static int cheatsRomSlot(int size)
+{
+	switch (size)
+	{
+	case GSA_16_BIT_ROM_PATCH2C:
+		return 0;
+	case GSA_16_BIT_ROM_PATCH2D:
+		return 1;
+	case GSA_16_BIT_ROM_PATCH2E:
+		return 2;
+	}
+	return 3;
+}
+
+static u32 cheatsRomSlotAddress(int line)
+{
+	return ((cheatsList[line].value & 0x00FFFFFF) << 1) + 0x8000000;
+}
+
+// Advances past the code at line if every frame runs it the same way and returns false at the
+// first one that can skip lines or turn the codes off.  A patch slot code only counts with an
+// empty data line, as the data line still goes through the codes that check onoff.
+static bool cheatsIsStraight(int &line)
+{
+	int size = cheatsList[line].size;
+	if (!cheatsList[line].enabled)
+		line += getCodeLength(line);
+	else if (cheatsIsRomSlot(size))
+	{
+		if (line + 1 >= cheatsNumber || cheatsList[line + 1].size != UNKNOWN_CODE)
+			return false;
+		line += 2;
+	}
+	else if (size == INT_8_BIT_WRITE || size == INT_16_BIT_WRITE || size == INT_32_BIT_WRITE ||
+	         size == GSA_8_BIT_GS_WRITE || size == GSA_16_BIT_GS_WRITE || size == GSA_32_BIT_GS_WRITE ||
+	         size == CHEATS_16_BIT_WRITE || size == CHEATS_32_BIT_WRITE ||
+	         size == MASTER_CODE || size == GSA_CODES_ON || size == UNKNOWN_CODE)
+		line++;
+	else
+		return false;
+	return true;
+}
+
+// Patches in the ROM patches every frame applies the same way and marks the lines they take in
+// indexed.  Those are the ones before the first code that isn't straight, with the patch slots
+// only when no code after that can claim one of them.  A ROM write under a slot that is still
+// claimed every frame stays there too, as the slot restores what was under it every frame.
+static void cheatsIndexRomPatches(bool *indexed)
+{
+	u32	 slotAddress[4] = { 0, 0, 0, 0 };
+	u16	 slotValue[4];
+	u16	 slotOldValue[4];
+	bool slots = true;
+	int	 end   = 0;
+	int	 line;
+	int	 i;
+
+	while (end < cheatsNumber && cheatsIsStraight(end))
+		;
+	for (i = end; i < cheatsNumber; i++)
+		if (cheatsIsRomSlot(cheatsList[i].size))
+			slots = false;
+
+	for (line = 0; line < end; )
+	{
+		int size = cheatsList[line].size;
+		if (cheatsList[line].enabled && slots && cheatsIsRomSlot(size))
+		{
+			// with the ROM as the codes before it left it, none of the slots patched in yet
+			int slot = cheatsRomSlot(size);
+			slotAddress[slot]  = cheatsRomSlotAddress(line);
+			slotValue[slot]	   = cheatsList[line + 1].rawaddress & 0xFFFF;
+			slotOldValue[slot] = CPUReadHalfWord(slotAddress[slot]);
+			indexed[line]	   = indexed[line + 1] = true;
+		}
+		else if (cheatsList[line].enabled && (size == CHEATS_16_BIT_WRITE || size == CHEATS_32_BIT_WRITE) &&
+		         (cheatsList[line].address >> 24) >= 0x08)
+		{
+			u32 address = cheatsList[line].address & 0x1ffffff;
+			u32 width	= size == CHEATS_16_BIT_WRITE ? 2 : 4;
+			bool claimed = false;
+			for (i = 0; i < cheatsNumber && !slots; i++)
+				if (cheatsIsRomSlot(cheatsList[i].size))
+				{
+					u32 slot = cheatsRomSlotAddress(i) & 0x1ffffff;
+					if (slot < address + width && address < slot + 2)
+						claimed = true;
+				}
+			if (!claimed)
+			{
+				if (size == CHEATS_16_BIT_WRITE)
+				{
+					cheatsPatchRom16(cheatsList[line].address, cheatsList[line].value);
+				}
+				else
+				{
+					cheatsPatchRom32(cheatsList[line].address, cheatsList[line].value);
+				}
+				indexed[line] = true;
+			}
+		}
+		cheatsIsStraight(line);
+	}
+
+	for (i = 0; i < 4; i++)
+		if (slotAddress[i] != 0)
+		{
+			cheatsPatchedAddress[cheatsPatchedCount]  = slotAddress[i];
+			cheatsPatchedValue[cheatsPatchedCount]	  = slotValue[i];
+			cheatsPatchedOldValue[cheatsPatchedCount] = slotOldValue[i];
+			cheatsPatchedCount++;
+		}
+	for (i = 0; i < cheatsPatchedCount; i++)
+		cheatsPatchRom16(cheatsPatchedAddress[i], cheatsPatchedValue[i]);
+	cheatsPatchedRom = rom;
+}
+
+static void cheatsCompile()
+{
+	bool indexed[MAX_CHEATS];
+	int	 i;
+
+	memset(indexed, 0, sizeof(indexed));
+	cheatsUnpatchRom();
+	cheatsIndexRomPatches(indexed);
+
+	for (i = 0; i < cheatsNumber; i++)
+	{
+		CheatsOp &op = cheatsProgram[i];
+		memset(&op, 0, sizeof(op));
+		op.op	   = CHEATS_OP_CODE;
+		op.address = cheatsList[i].address;
+		op.value   = cheatsList[i].value;
+
+		if (!cheatsList[i].enabled)
+		{
+			op.op	= CHEATS_OP_SKIP;
+			op.next = i + getCodeLength(i);
+			continue;
+		}
+		if (indexed[i])
+		{
+			op.op	= CHEATS_OP_SKIP;
+			op.next = i + (cheatsIsRomSlot(cheatsList[i].size) ? 2 : 1);
+			continue;
+		}
+
+		switch (cheatsList[i].size)
+		{
+		case GSA_8_BIT_GS_WRITE:
+		case GSA_16_BIT_GS_WRITE:
+		case GSA_32_BIT_GS_WRITE:
+			op.button = true;
+		// fall through
+		case INT_8_BIT_WRITE:
+		case INT_16_BIT_WRITE:
+		case INT_32_BIT_WRITE:
+		case CHEATS_16_BIT_WRITE:
+		case CHEATS_32_BIT_WRITE:
+			switch (cheatsList[i].size)
+			{
+			case INT_8_BIT_WRITE:
+			case GSA_8_BIT_GS_WRITE:
+				op.width = 1;
+				break;
+			case INT_32_BIT_WRITE:
+			case GSA_32_BIT_GS_WRITE:
+			case CHEATS_32_BIT_WRITE:
+				op.width = 4;
+				break;
+			default:
+				op.width = 2;
+				break;
+			}
+			op.address &= ~(op.width - 1);
+			op.data		= cheatsResolve(op.address, op.width);
+			if (op.data != NULL)
+				op.op = CHEATS_OP_WRITE;
+			break;
+		default:
+			for (int j = 0; j < (int)countof(cheatsIfCodes); j++)
+			{
+				const CheatsIfCode &code = cheatsIfCodes[j];
+				if (code.size != cheatsList[i].size)
+					continue;
+				// unaligned reads rotate
+				if (op.address & (code.width - 1))
+					break;
+				op.data = cheatsResolve(op.address, code.width);
+				if (op.data == NULL)
+					break;
+				op.op	 = CHEATS_OP_IF;
+				op.width = code.width;
+				op.cond	 = code.cond;
+				op.next	 = code.skip;
+				if (code.skip == CHEATS_SKIP_FROM_CODE)
+					op.next = (cheatsList[i].rawaddress >> 0x10) & 0xFF;
+				if (code.mask && code.width < 4)
+					op.value &= (1 << (code.width * 8)) - 1;
+				break;
+			}
+			break;
+		}
+	}
+
+	cheatsProgramMemory[0] = workRAM;
+	cheatsProgramMemory[1] = internalRAM;
+	cheatsProgramMemory[2] = rom;
+	cheatsProgramValid	   = true;
+}
+
+static bool cheatsTest(const CheatsOp &op)
+{
+	u32 data;
+	s32 sdata;
+	switch (op.width)
+	{
+	case 1:
+		data  = *op.data;
+		sdata = (s8)data;
+		break;
+	case 2:
+		data  = READ16LE(op.data);
+		sdata = (s16)data;
+		break;
+	default:
+		data  = READ32LE(op.data);
+		sdata = (s32)data;
+		break;
+	}
+
+	switch (op.cond)
+	{
+	case CHEATS_IF_EQ:
+		return data == op.value;
+	case CHEATS_IF_NE:
+		return data != op.value;
+	case CHEATS_IF_LTU:
+		return data < op.value;
+	case CHEATS_IF_GTU:
+		return data > op.value;
+	case CHEATS_IF_LEU:
+		return data <= op.value;
+	case CHEATS_IF_GEU:
+		return data >= op.value;
+	case CHEATS_IF_LTS:
+		return sdata < (s32)op.value;
+	case CHEATS_IF_GTS:
+		return sdata > (s32)op.value;
+	}
+	return (data & op.value) != 0;
+}
+
 int cheatsCheckKeys(u32 keys, u32 extended)
 {
 	bool onoff = true;
@@ -554,12 +990,56 @@ int cheatsCheckKeys(u32 keys, u32 extended)
 	for (i = 0; i < 4; i++)
 		if (rompatch2addr [i] != 0)
 		{
-			CHEAT_PATCH_ROM_16BIT(rompatch2addr [i], rompatch2oldval [i]);
+			cheatsPatchRom16(rompatch2addr [i], rompatch2oldval [i]);
 			rompatch2addr [i] = 0;
 		}
 
+	if (!cheatsProgramValid || cheatsProgramMemory[0] != workRAM || cheatsProgramMemory[1] != internalRAM ||
+	    cheatsProgramMemory[2] != rom)
+		cheatsCompile();
+	// hooks have to see every access
+	bool direct = !VBALuaHasMemHook(LUAMEMHOOK_READ) && !VBALuaHasMemHook(LUAMEMHOOK_WRITE);
+
 	for (i = 0; i < cheatsNumber; i++)
 	{
+		const CheatsOp &op = cheatsProgram[i];
+		if (op.op == CHEATS_OP_SKIP)
+		{
+			i = op.next - 1;
+			continue;
+		}
+		if (op.op != CHEATS_OP_CODE && direct)
+		{
+			if (!onoff)
+				continue;
+			if (op.op == CHEATS_OP_WRITE)
+			{
+				if (op.button && !(extended & 4))
+					continue;
+				switch (op.width)
+				{
+				case 1:
+					*op.data = (u8)op.value;
+					break;
+				case 2:
+					WRITE16LE(op.data, (u16)op.value);
+					break;
+				default:
+					WRITE32LE(op.data, op.value);
+					break;
+				}
+				CPUMemoryBlockWritten(op.address, op.width);
+			}
+			else if (!cheatsTest(op))
+			{
+				if (op.next == CHEATS_SKIP_CODES_OFF)
+					onoff = false;
+				else
+					i += op.next;
+			}
+			continue;
+		}
+
 		if (!cheatsList[i].enabled)
 		{
 			// make sure we skip other lines in this code
@@ -674,7 +1154,7 @@ int cheatsCheckKeys(u32 keys, u32 extended)
 				{
 					cheatsList[i].oldValue = CPUReadHalfWord(cheatsList[i].address);
 					cheatsList[i].status  |= 1;
-					CHEAT_PATCH_ROM_16BIT(cheatsList[i].address, cheatsList[i].value);
+					cheatsPatchRom16(cheatsList[i].address, cheatsList[i].value);
 				}
 			}
 			break;
@@ -1385,7 +1865,7 @@ int cheatsCheckKeys(u32 keys, u32 extended)
 			case CHEATS_16_BIT_WRITE:
 				if ((cheatsList[i].address >> 24) >= 0x08)
 				{
-					CHEAT_PATCH_ROM_16BIT(cheatsList[i].address, cheatsList[i].value);
+					cheatsPatchRom16(cheatsList[i].address, cheatsList[i].value);
 				}
 				else
 				{
@@ -1395,7 +1875,7 @@ int cheatsCheckKeys(u32 keys, u32 extended)
 			case CHEATS_32_BIT_WRITE:
 				if ((cheatsList[i].address >> 24) >= 0x08)
 				{
-					CHEAT_PATCH_ROM_32BIT(cheatsList[i].address, cheatsList[i].value);
+					cheatsPatchRom32(cheatsList[i].address, cheatsList[i].value);
 				}
 				else
 				{
@@ -1407,7 +1887,7 @@ int cheatsCheckKeys(u32 keys, u32 extended)
 	}
 	for (i = 0; i < 4; i++)
 		if (rompatch2addr [i] != 0)
-			CHEAT_PATCH_ROM_16BIT(rompatch2addr [i], rompatch2val [i]);
+			cheatsPatchRom16(rompatch2addr [i], rompatch2val [i]);
 	return ticks;
 }
 
@@ -1453,6 +1933,7 @@ void cheatsAdd(const char *codeStr,
 			break;
 		}
 		cheatsNumber++;
+		cheatsInvalidate();
 	}
 }
 
@@ -1478,7 +1959,7 @@ void cheatsDelete(int number, bool restore)
 			case CHEATS_16_BIT_WRITE:
 				if ((cheatsList[x].address >> 24) >= 0x08)
 				{
-					CHEAT_PATCH_ROM_16BIT(cheatsList[x].address, cheatsList[x].oldValue);
+					cheatsPatchRom16(cheatsList[x].address, cheatsList[x].oldValue);
 				}
 				else
 				{
@@ -1488,7 +1969,7 @@ void cheatsDelete(int number, bool restore)
 			case CHEATS_32_BIT_WRITE:
 				if ((cheatsList[x].address >> 24) >= 0x08)
 				{
-					CHEAT_PATCH_ROM_32BIT(cheatsList[x].address, cheatsList[x].oldValue);
+					cheatsPatchRom32(cheatsList[x].address, cheatsList[x].oldValue);
 				}
 				else
 				{
@@ -1498,8 +1979,8 @@ void cheatsDelete(int number, bool restore)
 				if (cheatsList[x].status & 1)
 				{
 					cheatsList[x].status &= ~1;
-					CHEAT_PATCH_ROM_16BIT(cheatsList[x].address,
-					                      cheatsList[x].oldValue);
+					cheatsPatchRom16(cheatsList[x].address,
+					                 cheatsList[x].oldValue);
 				}
 				break;
 			case GSA_16_BIT_ROM_PATCH2C:
@@ -1522,6 +2003,7 @@ void cheatsDelete(int number, bool restore)
 			memcpy(&cheatsList[x], &cheatsList[x + 1], sizeof(CheatsData) *
 			       (cheatsNumber - x));
 		}
+		cheatsInvalidate();
 	}
 }
 
@@ -1539,6 +2021,7 @@ void cheatsEnable(int i)
 	{
 		cheatsList[i].enabled = true;
 		mastercode = 0;
+		cheatsInvalidate();
 	}
 }
 
@@ -1552,8 +2035,8 @@ void cheatsDisable(int i)
 			if (cheatsList[i].status & 1)
 			{
 				cheatsList[i].status &= ~1;
-				CHEAT_PATCH_ROM_16BIT(cheatsList[i].address,
-				                      cheatsList[i].oldValue);
+				cheatsPatchRom16(cheatsList[i].address,
+				                 cheatsList[i].oldValue);
 			}
 			break;
 		case GSA_16_BIT_ROM_PATCH2C:
@@ -1570,6 +2053,7 @@ void cheatsDisable(int i)
 			break;
 		}
 		cheatsList[i].enabled = false;
+		cheatsInvalidate();
 	}
 }
 
@@ -2813,6 +3297,7 @@ void cheatsSaveGame(gzFile file)
 
 void cheatsReadGame(gzFile file, int version)
 {
+	cheatsInvalidate();
 	cheatsNumber = 0;
 
 	cheatsNumber = utilReadInt(file);
@@ -2930,6 +3415,8 @@ bool cheatsLoadCheatList(const char *file)
 {
 	int count = 0;
 
+	cheatsInvalidate();
+
 	FILE *f = fopen(file, "rb");
 
 	if (f == NULL)
@@ -41,25 +41,61 @@ extern int thumbExecute();
 #define THUMB_PREFETCH_NEXT \
 	cpuPrefetch[1] = CPUReadHalfWordQuick(armNextPC + 2);
 
-extern int32 SWITicks;
-extern u32	 mastercode;
-extern bool8 busPrefetch;
-extern bool8 busPrefetchEnable;
-extern u32	 busPrefetchCount;
-extern int32 cpuNextEvent;
-extern bool8 holdState;
-extern u32	 cpuPrefetch[2];
-extern int32 cpuTotalTicks;
-extern u8	 memoryWait[16];
-extern u8	 memoryWait32[16];
-extern u8	 memoryWaitSeq[16];
-extern u8	 memoryWaitSeq32[16];
-extern u8	 cpuBitsSet[256];
-extern u8	 cpuLowestBitSet[256];
+extern EMU_STATE int32 SWITicks;
+extern EMU_STATE u32	 mastercode;
+extern EMU_STATE bool8 busPrefetch;
+extern EMU_STATE bool8 busPrefetchEnable;
+extern EMU_STATE u32	 busPrefetchCount;
+extern EMU_STATE int32 cpuNextEvent;
+extern EMU_STATE bool8 holdState;
+extern EMU_STATE u32	 cpuPrefetch[2];
+extern EMU_STATE int32 cpuTotalTicks;
+extern EMU_STATE bool8 cpuIdleLoopClean;
+extern EMU_STATE u8	 memoryWait[16];
+extern EMU_STATE u8	 memoryWait32[16];
+extern EMU_STATE u8	 memoryWaitSeq[16];
+extern EMU_STATE u8	 memoryWaitSeq32[16];
+extern EMU_STATE u8	 cpuBitsSet[256];
+extern EMU_STATE u8	 cpuLowestBitSet[256];
 
+// Longest backward branch that is checked for an idle loop
+#define CPU_IDLE_LOOP_SIZE 0x40
+
+// Code page (see GBAinline.h) that blocks of the code at address are built from,
+// or -1 if code there is never cached
+inline int cpuCodePageOf(u32 address)
+{
+	switch (address >> 24)
+	{
+	case 0:
+		return address < 0x4000 ? CPU_CODE_PAGE_ROM : -1;
+	case 2:
+		return (address & 0x3FFFF) >> CPU_DIRTY_PAGE_SHIFT;
+	case 3:
+		return (CPU_DIRTY_IWRAM + (address & 0x7FFF)) >> CPU_DIRTY_PAGE_SHIFT;
+	case 8: case 9: case 10: case 11: case 12: case 13:
+		return CPU_CODE_PAGE_ROM;
+	}
+	return -1;
+}
+
+// End of the code a block starting at address may cover: the end of its
+// page, or of the BIOS or ROM mirror, which change as one page
+inline u32 cpuCodePageEnd(u32 address, int page)
+{
+	if (page != CPU_CODE_PAGE_ROM)
+		return (address | (CPU_DIRTY_PAGE_SIZE - 1)) + 1;
+	return address < 0x4000 ? 0x4000 : (address | 0xFFFFFF) + 1;
+}
+
+extern void armBlockCacheFree();
+extern void thumbBlockCacheFree();
 extern void CPUSwitchMode(int mode, bool saveState, bool breakLoop);
 extern void CPUSwitchMode(int mode, bool saveState);
 extern void CPUUpdateCPSR();
+extern u8 *CPUMemoryBlock(u32 address, u32 &available, bool write);
+extern void CPUMemoryBlockWritten(u32 address, u32 size);
+extern void CPUIdleLoopCheck(u32 branch);
 extern void CPUUpdateFlags(bool breakLoop);
 extern void CPUUpdateFlags();
 extern void CPUUndefinedException();
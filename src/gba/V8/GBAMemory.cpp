@@ -10,6 +10,7 @@
 #include "../EEprom.h"
 #include "../Flash.h"
 #include "../RTC.h"
+#include "GBACpu.h"
 
 #ifdef BKPT_SUPPORT
 void cheatsWriteMemory(u32 *address, u32 value, u32 mask);
@@ -19,7 +20,7 @@ void cheatsWriteByte(u8 *address, u8 value);
 
 #ifdef BKPT_SUPPORT
 #ifdef SDL
-extern int cpuNextEvent;
+extern EMU_STATE int cpuNextEvent;
 extern void debuggerBreakOnWrite(u32, u32, u32, int, int);
 
 static u8 cheatsGetType(u32 address)
@@ -90,36 +91,36 @@ void cheatsWriteByte(u32 address, u8 value)
 #endif
 #endif
 
-extern bool8 stopState;
-extern bool8 holdState;
-extern int32 holdType;
-extern bool8 cpuSramEnabled;
-extern bool8 cpuFlashEnabled;
-extern bool8 cpuEEPROMEnabled;
-extern bool8 cpuEEPROMSensorEnabled;
-extern bool8 cpuDmaHack;
-extern u32	 cpuDmaLast;
-extern int32 cpuDmaCount;
-
-extern int32 cpuTotalTicks;
-extern int32 cpuNextEvent;
-
-extern bool8 timer0On;
-extern int32 timer0Ticks;
-extern int32 timer0ClockReload;
-extern bool8 timer1On;
-extern int32 timer1Ticks;
-extern int32 timer1ClockReload;
-extern bool8 timer2On;
-extern int32 timer2Ticks;
-extern int32 timer2ClockReload;
-extern bool8 timer3On;
-extern int32 timer3Ticks;
-extern int32 timer3ClockReload;
+extern EMU_STATE bool8 stopState;
+extern EMU_STATE bool8 holdState;
+extern EMU_STATE int32 holdType;
+extern EMU_STATE bool8 cpuSramEnabled;
+extern EMU_STATE bool8 cpuFlashEnabled;
+extern EMU_STATE bool8 cpuEEPROMEnabled;
+extern EMU_STATE bool8 cpuEEPROMSensorEnabled;
+extern EMU_STATE bool8 cpuDmaHack;
+extern EMU_STATE u32	 cpuDmaLast;
+extern EMU_STATE int32 cpuDmaCount;
+
+extern EMU_STATE int32 cpuTotalTicks;
+extern EMU_STATE int32 cpuNextEvent;
+
+extern EMU_STATE bool8 timer0On;
+extern EMU_STATE int32 timer0Ticks;
+extern EMU_STATE int32 timer0ClockReload;
+extern EMU_STATE bool8 timer1On;
+extern EMU_STATE int32 timer1Ticks;
+extern EMU_STATE int32 timer1ClockReload;
+extern EMU_STATE bool8 timer2On;
+extern EMU_STATE int32 timer2Ticks;
+extern EMU_STATE int32 timer2ClockReload;
+extern EMU_STATE bool8 timer3On;
+extern EMU_STATE int32 timer3Ticks;
+extern EMU_STATE int32 timer3ClockReload;
 
 extern const u32 objTilesAddress[3];
 
-MemoryMap memoryMap[256];
+EMU_STATE MemoryMap memoryMap[256];
 
 u32 CPUReadMemoryWrapped(u32 address)
 {
@@ -167,6 +168,8 @@ u32 CPUReadMemoryWrapped(u32 address)
 	case 4:
 		if ((address < 0x4000400) && ioReadable[address & 0x3fc])
 		{
+			if (address >= 0x4000060 && address < 0x40000a8)
+				soundSync();
 			if (ioReadable[(address & 0x3fc) + 2])
 			{
 				if (address >= 0x400012d && address <= 0x4000131)
@@ -316,6 +319,8 @@ u32 CPUReadHalfWordWrapped(u32 address)
 	case 4:
 		if ((address < 0x4000400) && ioReadable[address & 0x3fe])
 		{
+			if (address >= 0x4000060 && address < 0x40000a8)
+				soundSync();
 			if (address >= 0x400012f && address <= 0x4000131)
 				systemCounters.lagged = false;
 			value =  READ16LE(((u16 *)&ioMem[address & 0x3fe]));
@@ -446,6 +451,8 @@ u8 CPUReadByteWrapped(u32 address)
 	case 4:
 		if ((address < 0x4000400) && ioReadable[address & 0x3ff])
 		{
+			if (address >= 0x4000060 && address < 0x40000a8)
+				soundSync();
 			if (address == 0x4000130 || address == 0x4000131)
 				systemCounters.lagged = false;
 			return ioMem[address & 0x3ff];
@@ -545,6 +552,7 @@ void CPUWriteMemoryWrapped(u32 address, u32 value)
 #endif
 #endif
 		WRITE32LE(((u32 *)&workRAM[address & 0x3FFFC]), value);
+		CPUMarkDirtyPage((address & 0x3FFFF) >> CPU_DIRTY_PAGE_SHIFT);
 		break;
 	case 0x03:
 #ifdef BKPT_SUPPORT
@@ -555,6 +563,7 @@ void CPUWriteMemoryWrapped(u32 address, u32 value)
 #endif
 #endif
 		WRITE32LE(((u32 *)&internalRAM[address & 0x7ffC]), value);
+		CPUMarkDirtyPage((CPU_DIRTY_IWRAM + (address & 0x7fff)) >> CPU_DIRTY_PAGE_SHIFT);
 		break;
 	case 0x04:
 		if (address < 0x4000400)
@@ -591,6 +600,7 @@ void CPUWriteMemoryWrapped(u32 address, u32 value)
 #endif
 
 		WRITE32LE(((u32 *)&vram[address]), value);
+		CPUMarkDirtyPage((CPU_DIRTY_VRAM + address) >> CPU_DIRTY_PAGE_SHIFT);
 		break;
 	case 0x07:
 #ifdef BKPT_SUPPORT
@@ -657,6 +667,7 @@ void CPUWriteHalfWordWrapped(u32 address, u16 value)
 #endif
 #endif
 		WRITE16LE(((u16 *)&workRAM[address & 0x3FFFE]), value);
+		CPUMarkDirtyPage((address & 0x3FFFF) >> CPU_DIRTY_PAGE_SHIFT);
 		break;
 	case 3:
 #ifdef BKPT_SUPPORT
@@ -667,6 +678,7 @@ void CPUWriteHalfWordWrapped(u32 address, u16 value)
 #endif
 #endif
 		WRITE16LE(((u16 *)&internalRAM[address & 0x7ffe]), value);
+		CPUMarkDirtyPage((CPU_DIRTY_IWRAM + (address & 0x7fff)) >> CPU_DIRTY_PAGE_SHIFT);
 		break;
 	case 4:
 		if (address < 0x4000400)
@@ -698,6 +710,7 @@ void CPUWriteHalfWordWrapped(u32 address, u16 value)
 #endif
 #endif
 		WRITE16LE(((u16 *)&vram[address]), value);
+		CPUMarkDirtyPage((CPU_DIRTY_VRAM + address) >> CPU_DIRTY_PAGE_SHIFT);
 		break;
 	case 7:
 #ifdef BKPT_SUPPORT
@@ -761,6 +774,7 @@ void CPUWriteByteWrapped(u32 address, u8 b)
 #endif
 #endif
 		workRAM[address & 0x3FFFF] = b;
+		CPUMarkDirtyPage((address & 0x3FFFF) >> CPU_DIRTY_PAGE_SHIFT);
 		break;
 	case 3:
 #ifdef BKPT_SUPPORT
@@ -771,6 +785,7 @@ void CPUWriteByteWrapped(u32 address, u8 b)
 #endif
 #endif
 		internalRAM[address & 0x7fff] = b;
+		CPUMarkDirtyPage((CPU_DIRTY_IWRAM + (address & 0x7fff)) >> CPU_DIRTY_PAGE_SHIFT);
 		break;
 	case 4:
 		if (address < 0x4000400)
@@ -821,7 +836,10 @@ void CPUWriteByteWrapped(u32 address, u8 b)
 				break;
 			case 0x301: // HALTCNT, undocumented
 				if (b == 0x80)
+				{
+					soundSync();
 					stopState = true;
+				}
 				holdState	 = true;
 				holdType	 = -1;
 				cpuNextEvent = cpuTotalTicks;
@@ -865,6 +883,7 @@ void CPUWriteByteWrapped(u32 address, u8 b)
 #endif
 #endif
 			*((u16 *)&vram[address]) = (b << 8) | b;
+			CPUMarkDirtyPage((CPU_DIRTY_VRAM + address) >> CPU_DIRTY_PAGE_SHIFT);
 		}
 		break;
 	case 7:
@@ -901,26 +920,50 @@ unwritable:
 	}
 }
 
+// The LCD registers, the keys and the interrupt registers only change at the
+// events, everything else outside of memory may change in between.  Nothing is
+// tracked while loops are not skipped; CPULoop() forgets the last loop anyway.
+static inline void CPUIdleLoopRead(u32 address)
+{
+	if (!skipIdleLoopsTemp)
+		return;
+	if ((address >> 24) == 4)
+	{
+		if (address >= 0x4000060 && (address < 0x4000130 || address >= 0x4000134) &&
+		    (address < 0x4000200 || address >= 0x400020c))
+			cpuIdleLoopClean = false;
+	}
+	else if (address >= 0x0d000000 || (address >= 0x080000c4 && address < 0x080000ca))
+		cpuIdleLoopClean = false;
+}
+
 void CPUWriteMemory(u32 address, u32 value)
 {
+	if (skipIdleLoopsTemp)
+		cpuIdleLoopClean = false;
 	CPUWriteMemoryWrapped(address, value);
 	CallRegisteredLuaMemHook(address, 4, value, LUAMEMHOOK_WRITE);
 }
 
 void CPUWriteHalfWord(u32 address, u16 value)
 {
+	if (skipIdleLoopsTemp)
+		cpuIdleLoopClean = false;
 	CPUWriteHalfWordWrapped(address, value);
 	CallRegisteredLuaMemHook(address, 2, value, LUAMEMHOOK_WRITE);
 }
 
 void CPUWriteByte(u32 address, u8 b)
 {
+	if (skipIdleLoopsTemp)
+		cpuIdleLoopClean = false;
 	CPUWriteByteWrapped(address, b);
 	CallRegisteredLuaMemHook(address, 1, b, LUAMEMHOOK_WRITE);
 }
 
 u32 CPUReadMemory(u32 address)
 {
+	CPUIdleLoopRead(address);
 	u32 value = CPUReadMemoryWrapped(address);
 	CallRegisteredLuaMemHook(address, 4, value, LUAMEMHOOK_READ);
 	return value;
@@ -928,6 +971,7 @@ u32 CPUReadMemory(u32 address)
 
 u32 CPUReadHalfWord(u32 address)
 {
+	CPUIdleLoopRead(address);
 	u32 value = CPUReadHalfWordWrapped(address);
 	CallRegisteredLuaMemHook(address, 2, value, LUAMEMHOOK_READ);
 	return value;
@@ -935,6 +979,7 @@ u32 CPUReadHalfWord(u32 address)
 
 u16 CPUReadHalfWordSigned(u32 address)
 {
+	CPUIdleLoopRead(address);
 	u16 value = CPUReadHalfWordSignedWrapped(address);
 	CallRegisteredLuaMemHook(address, 2, value, LUAMEMHOOK_READ);
 	return value;
@@ -942,6 +987,7 @@ u16 CPUReadHalfWordSigned(u32 address)
 
 u8 CPUReadByte(u32 address)
 {
+	CPUIdleLoopRead(address);
 	u8 value = CPUReadByteWrapped(address);
 	CallRegisteredLuaMemHook(address, 1, value, LUAMEMHOOK_READ);
 	return value;
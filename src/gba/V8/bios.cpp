@@ -7,6 +7,105 @@
 #include "../GBA.h"
 #include "../GBAinline.h"
 #include "../GBAGlobals.h"
+#include "../../common/SystemGlobals.h"
+#include "GBACpu.h"
+
+// The decompressors and the copy routines go through the memory functions one element at a
+// time.  When the source or the destination is plain memory they use its host buffer instead,
+// and only accesses running out of it, or that the buffer cannot stand for, take the slow way.
+struct BiosMemory
+{
+	u32 base;
+	u32 size;
+	u8 *data;
+	u32 low;
+	u32 high;
+
+	// byte stores to VRAM, palette and OAM are not plain ones, so bytes only go straight to WRAM
+	BiosMemory(u32 address, bool write, bool bytes = false)
+		: base(address & ~3), size(0), data(NULL), low(0xFFFFFFFF), high(0)
+	{
+		if (!biosDirectAccess || (bytes && (address >> 24) != 2 && (address >> 24) != 3))
+			return;
+		data = CPUMemoryBlock(base, size, write);
+		if (data == NULL)
+			size = 0;
+	}
+
+	~BiosMemory()
+	{
+		if (low < high)
+			CPUMemoryBlockWritten(base + low, high - low);
+	}
+
+	void written(u32 offset, u32 length)
+	{
+		if (offset < low)
+			low = offset;
+		if (offset + length > high)
+			high = offset + length;
+	}
+
+	u8 readByte(u32 address)
+	{
+		u32 offset = address - base;
+		if (offset < size)
+			return data[offset];
+		return CPUReadByte(address);
+	}
+
+	u16 readHalfWord(u32 address)
+	{
+		u32 offset = address - base;
+		if (!(address & 1) && offset < size && offset + 2 <= size)
+			return READ16LE(&data[offset]);
+		return CPUReadHalfWord(address);
+	}
+
+	u32 readMemory(u32 address)
+	{
+		u32 offset = address - base;
+		if (!(address & 3) && offset < size && offset + 4 <= size)
+			return READ32LE(&data[offset]);
+		return CPUReadMemory(address);
+	}
+
+	void writeByte(u32 address, u8 value)
+	{
+		u32 offset = address - base;
+		if (offset < size)
+		{
+			data[offset] = value;
+			written(offset, 1);
+		}
+		else
+			CPUWriteByte(address, value);
+	}
+
+	void writeHalfWord(u32 address, u16 value)
+	{
+		u32 offset = (address & ~1) - base;
+		if (offset < size && offset + 2 <= size)
+		{
+			WRITE16LE(&data[offset], value);
+			written(offset, 2);
+		}
+		else
+			CPUWriteHalfWord(address, value);
+	}
+
+	void writeMemory(u32 address, u32 value)
+	{
+		u32 offset = (address & ~3) - base;
+		if (offset < size && offset + 4 <= size)
+		{
+			WRITE32LE(&data[offset], value);
+			written(offset, 4);
+		}
+		else
+			CPUWriteMemory(address, value);
+	}
+};
 
 s16 sineTable[256] = {
 	(s16)0x0000, (s16)0x0192, (s16)0x0323, (s16)0x04B5, (s16)0x0645, (s16)0x07D5, (s16)0x0964, (s16)0x0AF1,
@@ -283,6 +382,8 @@ void BIOS_CpuSet()
 		return;
 
 	int count = cnt & 0x1FFFFF;
+	BiosMemory src(source, false);
+	BiosMemory dst(dest, true);
 
 	// 32-bit ?
 	if ((cnt >> 26) & 1)
@@ -293,10 +394,10 @@ void BIOS_CpuSet()
 		// fill ?
 		if ((cnt >> 24) & 1)
 		{
-			u32 value = (source > 0x0EFFFFFF ? 0x1CAD1CAD : CPUReadMemory(source));
+			u32 value = (source > 0x0EFFFFFF ? 0x1CAD1CAD : src.readMemory(source));
 			while (count)
 			{
-				CPUWriteMemory(dest, value);
+				dst.writeMemory(dest, value);
 				dest += 4;
 				count--;
 			}
@@ -306,7 +407,7 @@ void BIOS_CpuSet()
 			// copy
 			while (count)
 			{
-				CPUWriteMemory(dest, (source > 0x0EFFFFFF ? 0x1CAD1CAD : CPUReadMemory(source)));
+				dst.writeMemory(dest, (source > 0x0EFFFFFF ? 0x1CAD1CAD : src.readMemory(source)));
 				source += 4;
 				dest   += 4;
 				count--;
@@ -318,10 +419,10 @@ void BIOS_CpuSet()
 		// 16-bit fill?
 		if ((cnt >> 24) & 1)
 		{
-			u16 value = (source > 0x0EFFFFFF ? 0x1CAD : CPUReadHalfWord(source));
+			u16 value = (source > 0x0EFFFFFF ? 0x1CAD : src.readHalfWord(source));
 			while (count)
 			{
-				CPUWriteHalfWord(dest, value);
+				dst.writeHalfWord(dest, value);
 				dest += 2;
 				count--;
 			}
@@ -331,7 +432,7 @@ void BIOS_CpuSet()
 			// copy
 			while (count)
 			{
-				CPUWriteHalfWord(dest, (source > 0x0EFFFFFF ? 0x1CAD : CPUReadHalfWord(source)));
+				dst.writeHalfWord(dest, (source > 0x0EFFFFFF ? 0x1CAD : src.readHalfWord(source)));
 				source += 2;
 				dest   += 2;
 				count--;
@@ -363,6 +464,8 @@ void BIOS_CpuFastSet()
 	dest   &= 0xFFFFFFFC;
 
 	int count = cnt & 0x1FFFFF;
+	BiosMemory src(source, false);
+	BiosMemory dst(dest, true);
 
 	// fill?
 	if ((cnt >> 24) & 1)
@@ -370,10 +473,10 @@ void BIOS_CpuFastSet()
 		while (count > 0)
 		{
 			// BIOS always transfers 32 bytes at a time
-			u32 value = (source > 0x0EFFFFFF ? 0xBAFFFFFB : CPUReadMemory(source));
+			u32 value = (source > 0x0EFFFFFF ? 0xBAFFFFFB : src.readMemory(source));
 			for (int i = 0; i < 8; i++)
 			{
-				CPUWriteMemory(dest, value);
+				dst.writeMemory(dest, value);
 				dest += 4;
 			}
 			count -= 8;
@@ -387,7 +490,7 @@ void BIOS_CpuFastSet()
 			// BIOS always transfers 32 bytes at a time
 			for (int i = 0; i < 8; i++)
 			{
-				CPUWriteMemory(dest, (source > 0x0EFFFFFF ? 0xBAFFFFFB : CPUReadMemory(source)));
+				dst.writeMemory(dest, (source > 0x0EFFFFFF ? 0xBAFFFFFB : src.readMemory(source)));
 				source += 4;
 				dest   += 4;
 			}
@@ -588,7 +691,10 @@ void BIOS_HuffUnComp()
 	    ((source + ((header >> 8) & 0x1fffff)) & 0xe000000) == 0)
 		return;
 
-	u8 treeSize = CPUReadByte(source++);
+	BiosMemory src(source, false);
+	BiosMemory dst(dest, true);
+
+	u8 treeSize = src.readByte(source++);
 
 	u32 treeStart = source;
 
@@ -597,11 +703,11 @@ void BIOS_HuffUnComp()
 	int len = header >> 8;
 
 	u32 mask = 0x80000000;
-	u32 data = CPUReadMemory(source);
+	u32 data = src.readMemory(source);
 	source += 4;
 
 	int	 pos		 = 0;
-	u8	 rootNode	 = CPUReadByte(treeStart);
+	u8	 rootNode	 = src.readByte(treeStart);
 	u8	 currentNode = rootNode;
 	bool writeData	 = false;
 	int	 byteShift	 = 0;
@@ -623,14 +729,14 @@ void BIOS_HuffUnComp()
 				// right
 				if (currentNode & 0x40)
 					writeData = true;
-				currentNode = CPUReadByte(treeStart + pos + 1);
+				currentNode = src.readByte(treeStart + pos + 1);
 			}
 			else
 			{
 				// left
 				if (currentNode & 0x80)
 					writeData = true;
-				currentNode = CPUReadByte(treeStart + pos);
+				currentNode = src.readByte(treeStart + pos);
 			}
 
 			if (writeData)
@@ -647,7 +753,7 @@ void BIOS_HuffUnComp()
 				{
 					byteCount = 0;
 					byteShift = 0;
-					CPUWriteMemory(dest, writeValue);
+					dst.writeMemory(dest, writeValue);
 					writeValue = 0;
 					dest	  += 4;
 					len		  -= 4;
@@ -657,7 +763,7 @@ void BIOS_HuffUnComp()
 			if (mask == 0)
 			{
 				mask	= 0x80000000;
-				data	= CPUReadMemory(source);
+				data	= src.readMemory(source);
 				source += 4;
 			}
 		}
@@ -679,14 +785,14 @@ void BIOS_HuffUnComp()
 				// right
 				if (currentNode & 0x40)
 					writeData = true;
-				currentNode = CPUReadByte(treeStart + pos + 1);
+				currentNode = src.readByte(treeStart + pos + 1);
 			}
 			else
 			{
 				// left
 				if (currentNode & 0x80)
 					writeData = true;
-				currentNode = CPUReadByte(treeStart + pos);
+				currentNode = src.readByte(treeStart + pos);
 			}
 
 			if (writeData)
@@ -710,7 +816,7 @@ void BIOS_HuffUnComp()
 					{
 						byteCount = 0;
 						byteShift = 0;
-						CPUWriteMemory(dest, writeValue);
+						dst.writeMemory(dest, writeValue);
 						dest	  += 4;
 						writeValue = 0;
 						len		  -= 4;
@@ -724,7 +830,7 @@ void BIOS_HuffUnComp()
 			if (mask == 0)
 			{
 				mask	= 0x80000000;
-				data	= CPUReadMemory(source);
+				data	= src.readMemory(source);
 				source += 4;
 			}
 		}
@@ -753,6 +859,9 @@ void BIOS_LZ77UnCompVram()
 	    ((source + ((header >> 8) & 0x1fffff)) & 0xe000000) == 0)
 		return;
 
+	BiosMemory src(source, false);
+	BiosMemory dst(dest, true);
+
 	int byteCount  = 0;
 	int byteShift  = 0;
 	u32 writeValue = 0;
@@ -761,7 +870,7 @@ void BIOS_LZ77UnCompVram()
 
 	while (len > 0)
 	{
-		u8 d = CPUReadByte(source++);
+		u8 d = src.readByte(source++);
 
 		if (d)
 		{
@@ -769,20 +878,20 @@ void BIOS_LZ77UnCompVram()
 			{
 				if (d & 0x80)
 				{
-					u16 data = CPUReadByte(source++) << 8;
-					data |= CPUReadByte(source++);
+					u16 data = src.readByte(source++) << 8;
+					data |= src.readByte(source++);
 					int length		 = (data >> 12) + 3;
 					int offset		 = (data & 0x0FFF);
 					u32 windowOffset = dest + byteCount - offset - 1;
 					for (int j = 0; j < length; j++)
 					{
-						writeValue |= (CPUReadByte(windowOffset++) << byteShift);
+						writeValue |= (dst.readByte(windowOffset++) << byteShift);
 						byteShift  += 8;
 						byteCount++;
 
 						if (byteCount == 2)
 						{
-							CPUWriteHalfWord(dest, writeValue);
+							dst.writeHalfWord(dest, writeValue);
 							dest	  += 2;
 							byteCount  = 0;
 							byteShift  = 0;
@@ -795,12 +904,12 @@ void BIOS_LZ77UnCompVram()
 				}
 				else
 				{
-					writeValue |= (CPUReadByte(source++) << byteShift);
+					writeValue |= (src.readByte(source++) << byteShift);
 					byteShift  += 8;
 					byteCount++;
 					if (byteCount == 2)
 					{
-						CPUWriteHalfWord(dest, writeValue);
+						dst.writeHalfWord(dest, writeValue);
 						dest	  += 2;
 						byteCount  = 0;
 						byteShift  = 0;
@@ -817,12 +926,12 @@ void BIOS_LZ77UnCompVram()
 		{
 			for (int i = 0; i < 8; i++)
 			{
-				writeValue |= (CPUReadByte(source++) << byteShift);
+				writeValue |= (src.readByte(source++) << byteShift);
 				byteShift  += 8;
 				byteCount++;
 				if (byteCount == 2)
 				{
-					CPUWriteHalfWord(dest, writeValue);
+					dst.writeHalfWord(dest, writeValue);
 					dest	  += 2;
 					byteShift  = 0;
 					byteCount  = 0;
@@ -856,11 +965,14 @@ void BIOS_LZ77UnCompWram()
 	    ((source + ((header >> 8) & 0x1fffff)) & 0xe000000) == 0)
 		return;
 
+	BiosMemory src(source, false);
+	BiosMemory dst(dest, true, true);
+
 	int len = header >> 8;
 
 	while (len > 0)
 	{
-		u8 d = CPUReadByte(source++);
+		u8 d = src.readByte(source++);
 
 		if (d)
 		{
@@ -868,14 +980,14 @@ void BIOS_LZ77UnCompWram()
 			{
 				if (d & 0x80)
 				{
-					u16 data = CPUReadByte(source++) << 8;
-					data |= CPUReadByte(source++);
+					u16 data = src.readByte(source++) << 8;
+					data |= src.readByte(source++);
 					int length		 = (data >> 12) + 3;
 					int offset		 = (data & 0x0FFF);
 					u32 windowOffset = dest - offset - 1;
 					for (int j = 0; j < length; j++)
 					{
-						CPUWriteByte(dest++, CPUReadByte(windowOffset++));
+						dst.writeByte(dest++, dst.readByte(windowOffset++));
 						len--;
 						if (len == 0)
 							return;
@@ -883,7 +995,7 @@ void BIOS_LZ77UnCompWram()
 				}
 				else
 				{
-					CPUWriteByte(dest++, CPUReadByte(source++));
+					dst.writeByte(dest++, src.readByte(source++));
 					len--;
 					if (len == 0)
 						return;
@@ -895,7 +1007,7 @@ void BIOS_LZ77UnCompWram()
 		{
 			for (int i = 0; i < 8; i++)
 			{
-				CPUWriteByte(dest++, CPUReadByte(source++));
+				dst.writeByte(dest++, src.readByte(source++));
 				len--;
 				if (len == 0)
 					return;
@@ -964,11 +1076,13 @@ void BIOS_RegisterRamReset(u32 flags)
 		{
 			// clear work RAM
 			memset(workRAM, 0, 0x40000);
+			CPUMarkDirtyRange(0, 0x40000);
 		}
 		if (flags & 0x02)
 		{
 			// clear internal RAM
 			memset(internalRAM, 0, 0x7e00); // don't clear 0x7e00-0x7fff
+			CPUMarkDirtyRange(CPU_DIRTY_IWRAM, 0x7e00);
 		}
 		if (flags & 0x04)
 		{
@@ -979,6 +1093,7 @@ void BIOS_RegisterRamReset(u32 flags)
 		{
 			// clear VRAM
 			memset(vram, 0, 0x18000);
+			CPUMarkDirtyRange(CPU_DIRTY_VRAM, 0x18000);
 		}
 		if (flags & 0x10)
 		{
@@ -1072,6 +1187,9 @@ void BIOS_RLUnCompVram()
 	    ((source + ((header >> 8) & 0x1fffff)) & 0xe000000) == 0)
 		return;
 
+	BiosMemory src(source, false);
+	BiosMemory dst(dest, true);
+
 	int len		   = header >> 8;
 	int byteCount  = 0;
 	int byteShift  = 0;
@@ -1079,11 +1197,11 @@ void BIOS_RLUnCompVram()
 
 	while (len > 0)
 	{
-		u8	d = CPUReadByte(source++);
+		u8	d = src.readByte(source++);
 		int l = d & 0x7F;
 		if (d & 0x80)
 		{
-			u8 data = CPUReadByte(source++);
+			u8 data = src.readByte(source++);
 			l += 3;
 			for (int i = 0; i < l; i++)
 			{
@@ -1093,7 +1211,7 @@ void BIOS_RLUnCompVram()
 
 				if (byteCount == 2)
 				{
-					CPUWriteHalfWord(dest, writeValue);
+					dst.writeHalfWord(dest, writeValue);
 					dest	  += 2;
 					byteCount  = 0;
 					byteShift  = 0;
@@ -1109,12 +1227,12 @@ void BIOS_RLUnCompVram()
 			l++;
 			for (int i = 0; i < l; i++)
 			{
-				writeValue |= (CPUReadByte(source++) << byteShift);
+				writeValue |= (src.readByte(source++) << byteShift);
 				byteShift  += 8;
 				byteCount++;
 				if (byteCount == 2)
 				{
-					CPUWriteHalfWord(dest, writeValue);
+					dst.writeHalfWord(dest, writeValue);
 					dest	  += 2;
 					byteCount  = 0;
 					byteShift  = 0;
@@ -1150,19 +1268,22 @@ void BIOS_RLUnCompWram()
 	    ((source + ((header >> 8) & 0x1fffff)) & 0xe000000) == 0)
 		return;
 
+	BiosMemory src(source, false);
+	BiosMemory dst(dest, true, true);
+
 	int len = header >> 8;
 
 	while (len > 0)
 	{
-		u8	d = CPUReadByte(source++);
+		u8	d = src.readByte(source++);
 		int l = d & 0x7F;
 		if (d & 0x80)
 		{
-			u8 data = CPUReadByte(source++);
+			u8 data = src.readByte(source++);
 			l += 3;
 			for (int i = 0; i < l; i++)
 			{
-				CPUWriteByte(dest++, data);
+				dst.writeByte(dest++, data);
 				len--;
 				if (len == 0)
 					return;
@@ -1173,7 +1294,7 @@ void BIOS_RLUnCompWram()
 			l++;
 			for (int i = 0; i < l; i++)
 			{
-				CPUWriteByte(dest++,  CPUReadByte(source++));
+				dst.writeByte(dest++, src.readByte(source++));
 				len--;
 				if (len == 0)
 					return;
@@ -1207,6 +1328,7 @@ void BIOS_SoftReset()
 	u8 b = internalRAM[0x7ffa];
 
 	memset(&internalRAM[0x7e00], 0, 0x200);
+	CPUMarkDirtyRange(CPU_DIRTY_IWRAM + 0x7e00, 0x200);
 
 	if (b)
 	{
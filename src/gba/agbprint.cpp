@@ -8,8 +8,8 @@ extern void (*dbgSignal)(int, int);
 extern void (*dbgOutput)(const char *, u32);
 extern int systemVerbose;
 
-static bool agbPrintEnabled = false;
-static bool agbPrintProtect = false;
+static EMU_STATE bool agbPrintEnabled = false;
+static EMU_STATE bool agbPrintProtect = false;
 
 bool agbPrintWrite(u32 address, u16 value)
 {
@@ -5,6 +5,7 @@
 #include "../Port.h"
 #include "../NLS.h"
 #include "../common/System.h" // systemMessage
+#include "../common/MappedImage.h"
 #include "GBAGlobals.h"
 #include "GBAinline.h"
 #include "elf.h"
@@ -221,7 +222,7 @@ struct ELFFrameState
 	int returnAddress;
 };
 
-bool8 cpuIsMultiBoot = false;
+EMU_STATE bool8 cpuIsMultiBoot = false;
 bool8 parseDebug	 = true;
 
 Symbol *elfSymbols		 = NULL;
@@ -231,12 +232,21 @@ int		elfSymbolsCount	 = 0;
 ELFSectionHeader * *elfSectionHeaders = NULL;
 char *elfSectionHeadersStringTable	  = NULL;
 int	  elfSectionHeadersCount = 0;
-u8 *  elfFileData = NULL;
+u8 *  elfFileData	  = NULL;
+int	  elfFileSize	  = 0;
+bool  elfFileMapped	  = false;
 
 CompileUnit *elfCompileUnits = NULL;
 DebugInfo *	 elfDebugInfo	 = NULL;
 char *		 elfDebugStrings = NULL;
 
+CompileUnit * *elfUnits			 = NULL; // in .debug_info order
+int			   elfUnitCount		 = 0;
+ELFRange *	   elfUnitRanges	 = NULL;
+int			   elfUnitRangeCount = 0;
+ELFRange *	   elfSymbolRanges	 = NULL; // one per symbol
+int *		   elfSymbolNames	 = NULL; // symbol indices sorted by name
+
 ELFcie *  elfCies	  = NULL;
 ELFfde * *elfFdes	  = NULL;
 int		  elfFdeCount = 0;
@@ -245,36 +255,69 @@ CompileUnit *elfCurrentUnit = NULL;
 
 u32 elfRead4Bytes(u8 *);
 u16 elfRead2Bytes(u8 *);
+CompileUnit *elfLoadCompileUnit(CompileUnit *);
+LineInfo *elfLoadLineInfo(CompileUnit *);
 
-CompileUnit *elfGetCompileUnit(u32 addr)
+int elfCompareRanges(const void *a, const void *b)
+{
+	const ELFRange *x = (const ELFRange *)a;
+	const ELFRange *y = (const ELFRange *)b;
+
+	if (x->lowPC != y->lowPC)
+		return x->lowPC < y->lowPC ? -1 : 1;
+	return x->index - y->index;
+}
+
+void elfSortRanges(ELFRange *ranges, int count)
 {
-	if (elfCompileUnits)
+	qsort(ranges, count, sizeof(ELFRange), elfCompareRanges);
+
+	u32 reach = 0;
+	for (int i = 0; i < count; i++)
 	{
-		CompileUnit *unit = elfCompileUnits;
-		while (unit)
-		{
-			if (unit->lowPC)
-			{
-				if (addr >= unit->lowPC && addr < unit->highPC)
-					return unit;
-			}
-			else
-			{
-				ARanges *r = unit->ranges;
-				if (r)
-				{
-					int count = r->count;
-					for (int j = 0; j < count; j++)
-					{
-						if (addr >= r->ranges[j].lowPC && addr < r->ranges[j].highPC)
-							return unit;
-					}
-				}
-			}
-			unit = unit->next;
-		}
+		if (ranges[i].highPC > reach)
+			reach = ranges[i].highPC;
+		ranges[i].reach = reach;
 	}
-	return NULL;
+}
+
+// returns the index of the first range in list order holding addr, or -1
+int elfFindRange(ELFRange *ranges, int count, u32 addr)
+{
+	int low	 = 0;
+	int high = count;
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		if (ranges[mid].lowPC <= addr)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	ELFRange *found = NULL;
+	for (int i = low - 1; i >= 0 && ranges[i].reach > addr; i--)
+	{
+		if (ranges[i].highPC > addr && (found == NULL || ranges[i].index < found->index))
+			found = &ranges[i];
+	}
+	return found ? found->index : -1;
+}
+
+CompileUnit *elfGetCompileUnit(u32 addr)
+{
+	int i = elfFindRange(elfUnitRanges, elfUnitRangeCount, addr);
+	if (i < 0)
+		return NULL;
+	return elfLoadCompileUnit(elfUnits[i]);
+}
+
+Function *elfGetUnitFunction(CompileUnit *unit, u32 addr)
+{
+	int i = elfFindRange(unit->functionRanges, unit->functionCount, addr);
+	if (i < 0)
+		return NULL;
+	return unit->functionList[i];
 }
 
 const char *elfGetAddressSymbol(u32 addr)
@@ -285,51 +328,34 @@ const char *elfGetAddressSymbol(u32 addr)
 	// found unit, need to find function
 	if (unit)
 	{
-		Function *func = unit->functions;
-		while (func)
+		Function *func = elfGetUnitFunction(unit, addr);
+		if (func)
 		{
-			if (addr >= func->lowPC && addr < func->highPC)
-			{
-				int offset		 = addr - func->lowPC;
-				const char *name = func->name;
-				if (!name)
-					name = "";
-				if (offset)
-					sprintf(buffer, "%s+%d", name, offset);
-				else
-					strcpy(buffer, name);
-				return buffer;
-			}
-			func = func->next;
+			int offset		 = addr - func->lowPC;
+			const char *name = func->name;
+			if (!name)
+				name = "";
+			if (offset)
+				sprintf(buffer, "%s+%d", name, offset);
+			else
+				strcpy(buffer, name);
+			return buffer;
 		}
 	}
 
-	if (elfSymbolsCount)
+	int i = elfFindRange(elfSymbolRanges, elfSymbolsCount, addr);
+	if (i >= 0)
 	{
-		for (int i = 0; i < elfSymbolsCount; i++)
-		{
-			Symbol *s = &elfSymbols[i];
-			if ((addr >= s->value)  && addr < (s->value + s->size))
-			{
-				int offset		 = addr - s->value;
-				const char *name = s->name;
-				if (name == NULL)
-					name = "";
-				if (offset)
-					sprintf(buffer, "%s+%d", name, addr - s->value);
-				else
-					strcpy(buffer, name);
-				return buffer;
-			}
-			else if (addr == s->value)
-			{
-				if (s->name)
-					strcpy(buffer, s->name);
-				else
-					strcpy(buffer, "");
-				return buffer;
-			}
-		}
+		Symbol *s = &elfSymbols[i];
+		int offset		 = addr - s->value;
+		const char *name = s->name;
+		if (name == NULL)
+			name = "";
+		if (offset)
+			sprintf(buffer, "%s+%d", name, offset);
+		else
+			strcpy(buffer, name);
+		return buffer;
 	}
 
 	return "";
@@ -341,7 +367,7 @@ bool elfFindLineInModule(u32 *addr, const char *name, int line)
 
 	while (unit)
 	{
-		if (unit->lineInfoTable)
+		if (elfLoadLineInfo(unit))
 		{
 			int	  i;
 			int	  count = unit->lineInfoTable->fileCount;
@@ -379,15 +405,32 @@ bool elfFindLineInModule(u32 *addr, const char *name, int line)
 int elfFindLine(CompileUnit *unit, Function * /* func */, u32 addr, const char * *f)
 {
 	int currentLine = -1;
-	if (unit->hasLineInfo)
+	if (unit->hasLineInfo && elfLoadLineInfo(unit))
 	{
 		int count = unit->lineInfoTable->number;
 		LineInfoItem *table = unit->lineInfoTable->lines;
 		int i;
-		for (i = 0; i < count; i++)
+		if (unit->lineInfoTable->sorted)
 		{
-			if (addr <= table[i].address)
-				break;
+			// first line at or above addr
+			int high = count;
+			i = 0;
+			while (i < high)
+			{
+				int mid = (i + high) / 2;
+				if (table[mid].address < addr)
+					i = mid + 1;
+				else
+					high = mid;
+			}
+		}
+		else
+		{
+			for (i = 0; i < count; i++)
+			{
+				if (addr <= table[i].address)
+					break;
+			}
 		}
 		if (i == count)
 			i--;
@@ -399,7 +442,7 @@ int elfFindLine(CompileUnit *unit, Function * /* func */, u32 addr, const char *
 
 bool elfFindLineInUnit(u32 *addr, CompileUnit *unit, int line)
 {
-	if (unit->hasLineInfo)
+	if (unit->hasLineInfo && elfLoadLineInfo(unit))
 	{
 		int count = unit->lineInfoTable->number;
 		LineInfoItem *table = unit->lineInfoTable->lines;
@@ -422,16 +465,12 @@ bool elfGetCurrentFunction(u32 addr, Function * *f, CompileUnit * *u)
 	// found unit, need to find function
 	if (unit)
 	{
-		Function *func = unit->functions;
-		while (func)
+		Function *func = elfGetUnitFunction(unit, addr);
+		if (func)
 		{
-			if (addr >= func->lowPC && addr < func->highPC)
-			{
-				*f = func;
-				*u = unit;
-				return true;
-			}
-			func = func->next;
+			*f = func;
+			*u = unit;
+			return true;
 		}
 	}
 	return false;
@@ -480,7 +519,7 @@ bool elfGetObject(const char *name, Function *f, CompileUnit *u, Object * *o)
 	{
 		if (c != u)
 		{
-			Object *v = c->variables;
+			Object *v = elfLoadCompileUnit(c)->variables;
 			while (v)
 			{
 				if (strcmp(name, v->name) == 0)
@@ -514,9 +553,20 @@ bool elfGetSymbolAddress(const char *sym, u32 *addr, u32 *size, int *type)
 {
 	if (elfSymbolsCount)
 	{
-		for (int i = 0; i < elfSymbolsCount; i++)
+		// first symbol named sym, ties are sorted by index
+		int low	 = 0;
+		int high = elfSymbolsCount;
+		while (low < high)
 		{
-			Symbol *s = &elfSymbols[i];
+			int mid = (low + high) / 2;
+			if (strcmp(elfSymbols[elfSymbolNames[mid]].name, sym) < 0)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		if (low < elfSymbolsCount)
+		{
+			Symbol *s = &elfSymbols[elfSymbolNames[low]];
 			if (strcmp(sym, s->name) == 0)
 			{
 				*addr = s->value;
@@ -953,16 +1003,24 @@ CompileUnit *elfGetCompileUnitForData(u8 *data)
 	if (data >= elfCurrentUnit->top && data < end)
 		return elfCurrentUnit;
 
-	CompileUnit *unit = elfCompileUnits;
-
-	while (unit)
+	// units are kept in section order, find the last one starting at or below data
+	int low	 = 0;
+	int high = elfUnitCount;
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		if (elfUnits[mid]->top <= data)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low > 0)
 	{
+		CompileUnit *unit = elfUnits[low - 1];
 		end = unit->top + 4 + unit->length;
 
-		if (data >= unit->top && data < end)
+		if (data < end)
 			return unit;
-
-		unit = unit->next;
 	}
 
 	printf("Error: cannot find reference to compile unit at offset %08x\n",
@@ -1240,10 +1298,9 @@ void elfAddLine(LineInfo *l, u32 a, int file, int line, int *max)
 	l->number++;
 }
 
-void elfParseLineInfo(CompileUnit *unit, u8 *top)
+void elfParseLineInfo(CompileUnit *unit)
 {
-	ELFSectionHeader *h = elfGetSectionByName(".debug_line");
-	if (h == NULL)
+	if (elfDebugInfo->linedata == NULL)
 	{
 		fprintf(stderr, "No line information found\n");
 		return;
@@ -1253,7 +1310,7 @@ void elfParseLineInfo(CompileUnit *unit, u8 *top)
 	int max = 1000;
 	l->lines = (LineInfoItem *)malloc(1000 * sizeof(LineInfoItem));
 
-	u8 *data = elfReadSection(top, h);
+	u8 *data = elfDebugInfo->linedata;
 	data += unit->lineInfo;
 	u32 totalLen = elfRead4Bytes(data);
 	data += 4;
@@ -1395,6 +1452,16 @@ void elfParseLineInfo(CompileUnit *unit, u8 *top)
 	void *tmp = realloc(l->lines, l->number * sizeof(LineInfoItem));
 	if (!tmp) free(l->lines);
 	l->lines = (LineInfoItem *)tmp;
+
+	l->sorted = true;
+	for (i = 1; i < l->number; i++)
+	{
+		if (l->lines[i].address < l->lines[i - 1].address)
+		{
+			l->sorted = false;
+			break;
+		}
+	}
 }
 
 u8 *elfSkipData(u8 *data, ELFAbbrev *abbrev, ELFAbbrev * *abbrevs)
@@ -2707,12 +2774,114 @@ CompileUnit *elfParseCompUnit(u8 *data, u8 *abbrevData)
 		}
 	}
 
+	// the children are parsed by elfLoadCompileUnit() once something looks into the unit
 	if (abbrev->hasChildren)
-		elfParseCompileUnitChildren(data, unit);
+		unit->children = data;
 
 	return unit;
 }
 
+void elfIndexFunctions(CompileUnit *unit)
+{
+	int		  count = 0;
+	Function *func	= unit->functions;
+	while (func)
+	{
+		count++;
+		func = func->next;
+	}
+
+	unit->functionList	 = (Function * *)malloc(sizeof(Function *) * (count + 1));
+	unit->functionRanges = (ELFRange *)malloc(sizeof(ELFRange) * (count + 1));
+	unit->functionCount	 = 0;
+
+	func = unit->functions;
+	for (int i = 0; i < count; i++)
+	{
+		unit->functionList[i] = func;
+		if (func->highPC > func->lowPC)
+		{
+			ELFRange *r = &unit->functionRanges[unit->functionCount++];
+			r->lowPC  = func->lowPC;
+			r->highPC = func->highPC;
+			r->index  = i;
+		}
+		func = func->next;
+	}
+	elfSortRanges(unit->functionRanges, unit->functionCount);
+}
+
+CompileUnit *elfLoadCompileUnit(CompileUnit *unit)
+{
+	if (!unit->parsed)
+	{
+		unit->parsed = true;
+		if (unit->children)
+		{
+			elfCurrentUnit = unit;
+			elfParseCompileUnitChildren(unit->children, unit);
+		}
+		elfIndexFunctions(unit);
+	}
+	return unit;
+}
+
+LineInfo *elfLoadLineInfo(CompileUnit *unit)
+{
+	if (!unit->lineInfoParsed)
+	{
+		unit->lineInfoParsed = true;
+		elfParseLineInfo(unit);
+	}
+	return unit->lineInfoTable;
+}
+
+void elfIndexCompileUnits()
+{
+	int count = 0;
+	for (int i = 0; i < elfUnitCount; i++)
+	{
+		CompileUnit *unit = elfUnits[i];
+		if (unit->lowPC)
+			count++;
+		else if (unit->ranges)
+			count += unit->ranges->count;
+	}
+
+	elfUnitRanges	  = (ELFRange *)malloc(sizeof(ELFRange) * (count + 1));
+	elfUnitRangeCount = 0;
+
+	for (int i = 0; i < elfUnitCount; i++)
+	{
+		CompileUnit *unit = elfUnits[i];
+		if (unit->lowPC)
+		{
+			if (unit->highPC > unit->lowPC)
+			{
+				ELFRange *r = &elfUnitRanges[elfUnitRangeCount++];
+				r->lowPC  = unit->lowPC;
+				r->highPC = unit->highPC;
+				r->index  = i;
+			}
+		}
+		else if (unit->ranges)
+		{
+			ARanges *ar = unit->ranges;
+			for (int j = 0; j < ar->count; j++)
+			{
+				if (ar->ranges[j].highPC > ar->ranges[j].lowPC)
+				{
+					ELFRange *r = &elfUnitRanges[elfUnitRangeCount++];
+					r->lowPC  = ar->ranges[j].lowPC;
+					r->highPC = ar->ranges[j].highPC;
+					r->index  = i;
+				}
+			}
+		}
+	}
+	elfSortRanges(elfUnitRanges, elfUnitRangeCount);
+}
+
 void elfParseAranges(u8 *data)
 {
 	ELFSectionHeader *sh = elfGetSectionByName(".debug_aranges");
@@ -2771,6 +2940,36 @@ void elfParseAranges(u8 *data)
 	elfDebugInfo->ranges	= ranges;
 }
 
+int elfCompareSymbolNames(const void *a, const void *b)
+{
+	int x = *(const int *)a;
+	int y = *(const int *)b;
+	int c = strcmp(elfSymbols[x].name, elfSymbols[y].name);
+
+	return c ? c : x - y;
+}
+
+void elfIndexSymbols()
+{
+	elfSymbolRanges = (ELFRange *)malloc(sizeof(ELFRange) * (elfSymbolsCount + 1));
+	elfSymbolNames	= (int *)malloc(sizeof(int) * (elfSymbolsCount + 1));
+
+	for (int i = 0; i < elfSymbolsCount; i++)
+	{
+		Symbol *  s = &elfSymbols[i];
+		ELFRange *r = &elfSymbolRanges[i];
+		r->lowPC  = s->value;
+		r->highPC = s->value + s->size;
+		// a symbol also matches its own address, whatever its size
+		if (r->highPC <= r->lowPC)
+			r->highPC = s->value + 1;
+		r->index		  = i;
+		elfSymbolNames[i] = i;
+	}
+	elfSortRanges(elfSymbolRanges, elfSymbolsCount);
+	qsort(elfSymbolNames, elfSymbolsCount, sizeof(int), elfCompareSymbolNames);
+}
+
 void elfReadSymtab(u8 *data)
 {
 	ELFSectionHeader *sh = elfGetSectionByName(".symtab");
@@ -2823,6 +3022,8 @@ void elfReadSymtab(u8 *data)
 	}
 	elfSymbolsStrTab = strtable;
 	//  free(symtab);
+
+	elfIndexSymbols();
 }
 
 bool elfReadProgram(ELFHeader *eh, u8 *data, int &size, bool parseDebug)
@@ -2965,6 +3166,9 @@ bool elfReadProgram(ELFHeader *eh, u8 *data, int &size, bool parseDebug)
 		elfDebugInfo->debugdata = data;
 		elfDebugInfo->infodata	= debugdata;
 
+		h = elfGetSectionByName(".debug_line");
+		elfDebugInfo->linedata = h ? elfReadSection(data, h) : NULL;
+
 		u32 total = READ32LE(&dbgHeader->size);
 		u8 *end	  = debugdata + total;
 		u8 *ddata = debugdata;
@@ -2972,17 +3176,25 @@ bool elfReadProgram(ELFHeader *eh, u8 *data, int &size, bool parseDebug)
 		CompileUnit *last = NULL;
 		CompileUnit *unit = NULL;
 
+		// only the unit headers are read here, the rest is parsed on the first query
 		while (ddata < end)
 		{
 			unit		 = elfParseCompUnit(ddata, abbrevdata);
 			unit->offset = (u32)(ddata - debugdata);
-			elfParseLineInfo(unit, data);
 			if (last == NULL)
 				elfCompileUnits = unit;
 			else
 				last->next = unit;
 			last   = unit;
 			ddata += 4 + unit->length;
+
+			if ((elfUnitCount % 64) == 0)
+			{
+				void *tmp = realloc(elfUnits, (elfUnitCount + 64) * sizeof(CompileUnit *));
+				if (!tmp) free(elfUnits);
+				elfUnits = (CompileUnit * *)tmp;
+			}
+			elfUnits[elfUnitCount++] = unit;
 		}
 		elfParseAranges(data);
 		CompileUnit *comp = elfCompileUnits;
@@ -2997,6 +3209,7 @@ bool elfReadProgram(ELFHeader *eh, u8 *data, int &size, bool parseDebug)
 				}
 			comp = comp->next;
 		}
+		elfIndexCompileUnits();
 		elfParseCFA(data);
 		elfReadSymtab(data);
 	}
@@ -3015,20 +3228,43 @@ end:
 
 extern bool8 parseDebug;
 
-bool elfRead(const char *name, int &siz, FILE *f)
+void elfFreeFileData()
 {
-	fseek(f, 0, SEEK_END);
-	long size = ftell(f);
-	elfFileData = (u8 *)malloc(size);
-	fseek(f, 0, SEEK_SET);
-	int res = fread(elfFileData, 1, size, f);
-	fclose(f);
+	if (elfFileMapped)
+		mappedFileFree(elfFileData, elfFileSize);
+	else
+		free(elfFileData);
+	elfFileData	  = NULL;
+	elfFileSize	  = 0;
+	elfFileMapped = false;
+}
 
-	if (res < 0)
+bool elfRead(const char *name, int &siz, FILE *f)
+{
+	// the debug sections are only touched as units are looked at, so map the file rather than read it
+	int mappedSize = 0;
+	elfFileData = mappedFileLoad(name, mappedSize);
+	if (elfFileData != NULL)
 	{
-		free(elfFileData);
-		elfFileData = NULL;
-		return false;
+		elfFileSize	  = mappedSize;
+		elfFileMapped = true;
+		fclose(f);
+	}
+	else
+	{
+		fseek(f, 0, SEEK_END);
+		long size = ftell(f);
+		elfFileData = (u8 *)malloc(size);
+		elfFileSize = size;
+		fseek(f, 0, SEEK_SET);
+		int res = fread(elfFileData, 1, size, f);
+		fclose(f);
+
+		if (res < 0)
+		{
+			elfFreeFileData();
+			return false;
+		}
 	}
 
 	ELFHeader *header = (ELFHeader *)elfFileData;
@@ -3038,15 +3274,13 @@ bool elfRead(const char *name, int &siz, FILE *f)
 	    header->clazz != 1)
 	{
 		systemMessage(0, N_("Not a valid ELF file %s"), name);
-		free(elfFileData);
-		elfFileData = NULL;
+		elfFreeFileData();
 		return false;
 	}
 
 	if (!elfReadProgram(header, elfFileData, siz, parseDebug))
 	{
-		free(elfFileData);
-		elfFileData = NULL;
+		elfFreeFileData();
 		return false;
 	}
 
@@ -3183,6 +3417,8 @@ void elfCleanUp(CompileUnit *comp)
 		free(comp->lineInfoTable->files);
 		free(comp->lineInfoTable);
 	}
+	free(comp->functionList);
+	free(comp->functionRanges);
 }
 
 void elfCleanUp()
@@ -3197,8 +3433,19 @@ void elfCleanUp()
 		comp = next;
 	}
 	elfCompileUnits = NULL;
+	free(elfUnits);
+	elfUnits	 = NULL;
+	elfUnitCount = 0;
+	free(elfUnitRanges);
+	elfUnitRanges	  = NULL;
+	elfUnitRangeCount = 0;
 	free(elfSymbols);
-	elfSymbols = NULL;
+	elfSymbols		= NULL;
+	elfSymbolsCount = 0;
+	free(elfSymbolRanges);
+	elfSymbolRanges = NULL;
+	free(elfSymbolNames);
+	elfSymbolNames = NULL;
 	//  free(elfSymbolsStrTab);
 	elfSymbolsStrTab = NULL;
 
@@ -3239,9 +3486,6 @@ void elfCleanUp()
 	elfCies = NULL;
 
 	if (elfFileData)
-	{
-		free(elfFileData);
-		elfFileData = NULL;
-	}
+		elfFreeFileData();
 }
 
@@ -222,6 +222,7 @@ struct LineInfo
 	char * *	  files;
 	int			  number;
 	LineInfoItem *lines;
+	bool		  sorted;	// addresses never decrease, so lookups can bisect
 };
 
 struct ARange
@@ -237,6 +238,16 @@ struct ARanges
 	ARange *ranges;
 };
 
+// Address index entry, sorted by lowPC. reach is the highest highPC of this and every earlier
+// entry, so a lookup walking back from the address can stop as soon as reach falls below it.
+struct ELFRange
+{
+	u32 lowPC;
+	u32 highPC;
+	u32 reach;
+	int index;	// position in the original list, the first match there wins
+};
+
 struct CompileUnit
 {
 	u32 length;
@@ -255,6 +266,12 @@ struct CompileUnit
 	Function *	 lastFunction;
 	Object *	 variables;
 	Type *		 types;
+	u8 *		 children;	   // first child DIE, parsed on the first query
+	bool		 parsed;
+	bool		 lineInfoParsed;
+	int			 functionCount;
+	Function * * functionList; // functions in DIE order
+	ELFRange *	 functionRanges;
 	CompileUnit *next;
 };
 
@@ -264,6 +281,7 @@ struct DebugInfo
 	u8 *	 abbrevdata;
 	u8 *	 debugdata;
 	u8 *	 infodata;
+	u8 *	 linedata;
 	int		 numRanges;
 	ARanges *ranges;
 };
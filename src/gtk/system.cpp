@@ -40,21 +40,21 @@ int  systemBlueShift;
 int  systemColorDepth;
 int  systemDebug;
 int  systemVerbose;
-int  systemSaveUpdateCounter;
+EMU_STATE int  systemSaveUpdateCounter;
 int  systemFrameSkip;
 u32  systemColorMap32[0x10000];
 u16  systemColorMap16[0x10000];
 u16  systemGbPalette[24];
 bool systemSoundOn;
 
-char filename[2048];
+EMU_STATE char filename[2048];
 char biosFileName[2048];
 //char captureDir[2048];
 char saveDir[2048];
-char batteryDir[2048];
+EMU_STATE char batteryDir[2048];
 
-int sensorX = 2047;
-int sensorY = 2047;
+EMU_STATE int sensorX = 2047;
+EMU_STATE int sensorY = 2047;
 bool sensorOn = false;
 
 int  emulating;
@@ -66,9 +66,9 @@ int sizeOption = 0;
 int captureFormat = 0;
 int throttle = 0;
 bool paused = false;
-bool removeIntros = false;
-int sdlFlashSize = 0;
-int sdlRtcEnable = 0;
+EMU_STATE bool removeIntros = false;
+EMU_STATE int sdlFlashSize = 0;
+EMU_STATE int sdlRtcEnable = 0;
 
 int sdlDefaultJoypad = 0;
 
@@ -0,0 +1,725 @@
+// VisualBoyAdvance - Nintendo Gameboy/GameboyAdvance (TM) emulator.
+// Copyright (C) 1999-2003 Forgotten
+// Copyright (C) 2004 Forgotten and the VBA development team
+
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2, or(at your option)
+// any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+
+// Headless movie replay benchmark: plays a .vbm against a ROM as fast as
+// possible with no video, sound or input devices, then reports the speed,
+// where the time went and a hash of the final emulator state.
+//
+// Given a list of movies it becomes a verification farm instead, replaying
+// them on a pool of workers (each its own emulator in a MULTI_INSTANCE
+// build) and reporting one line per movie.
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#ifdef MULTI_INSTANCE
+#include <pthread.h>
+#endif
+
+#include "AutoBuild.h"
+
+#include "Port.h"
+#include "gba/GBA.h"
+#include "gba/GBAGlobals.h"
+#include "gb/GB.h"
+#include "gb/gbGlobals.h"
+#include "common/System.h"
+#include "common/SystemGlobals.h"
+#include "common/Util.h"
+#include "common/movie.h"
+#include "common/vbalua.h"
+
+EMU_STATE int  systemCartridgeType = IMAGE_GBA;
+int  systemSpeed = 0;
+bool systemSoundOn = false;
+u32  systemColorMap32[0x10000];
+u16  systemColorMap16[0x10000];
+u16  systemGbPalette[24];
+int  systemRedShift = 19;
+int  systemGreenShift = 11;
+int  systemBlueShift = 3;
+int  systemColorDepth = 32;
+int  systemDebug = 0;
+int  systemVerbose = 0;
+int  systemFrameSkip = 0;
+EMU_STATE int  systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
+
+// used by the movie code
+EMU_STATE char filename[2048];
+EMU_STATE char batteryDir[2048];
+EMU_STATE bool removeIntros = false;
+EMU_STATE int sdlFlashSize = 0;
+EMU_STATE int sdlRtcEnable = 0;
+
+static bool paused = false;
+static bool verbose = false;
+
+struct Checkpoint {
+  u32 frame;
+  u32 hash;
+};
+
+struct BenchmarkJob {
+  const char *romFile;
+  const char *movieFile;
+  const char *checkFile;   // state hashes to verify against, or to record with -w
+  bool loaded;
+  u32  frames;
+  u32  length;
+  int  lagCount;
+  u32  hash;
+  u32  stateSize;
+  int  desyncFrame;        // first checkpoint that did not match, -1 if none
+};
+
+// options, fixed before any worker starts
+static const char *biosFile = NULL;
+static u32 maxFrames = 0;
+static u32 recordInterval = 0;
+static bool turbo = false;
+static bool slowBios = false;
+static bool blockCache = false;
+
+static std::vector<BenchmarkJob> jobs;
+static size_t nextJob = 0;
+#ifdef MULTI_INSTANCE
+static pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+char *sdlGetFilename(char *name)
+{
+  static EMU_STATE char filebuffer[2048];
+
+  char *p = strrchr(name, '/');
+  char *q = strrchr(name, '\\');
+  if(q > p)
+    p = q;
+
+  strcpy(filebuffer, p ? p + 1 : name);
+  return filebuffer;
+}
+
+static void usage(char *cmd)
+{
+  printf("%s [options] rom-file movie-file\n", cmd);
+  printf("%s [options] -L list-file\n", cmd);
+  printf("  -b file     GBA BIOS file to use when the movie asks for one\n");
+  printf("  -l file     Lua script to run during the replay\n");
+  printf("  -f frames   stop after the given number of frames\n");
+  printf("  -c file     state hashes to check the replay against\n");
+  printf("  -w frames   record a state hash every given number of frames to the\n");
+  printf("              checkpoint files instead of checking them\n");
+  printf("  -L file     verify every movie in the file, one per line as\n");
+  printf("              rom-file<TAB>movie-file[<TAB>checkpoint-file]\n");
+  printf("  -j workers  number of movies to verify at once with -L\n");
+  printf("  -t          turbo, skip rendering and sound synthesis (always on with -L)\n");
+  printf("  -s          move HLE BIOS data through the memory functions, to check\n");
+  printf("              the direct path against (with -w or -c)\n");
+  printf("  -x          run GBA code from the block cache\n");
+  printf("  -v          show emulator messages\n");
+}
+
+static bool benchmarkLoadRom(const char *szFile)
+{
+  IMAGE_TYPE type = utilFindType(szFile);
+
+  if(type == IMAGE_GB) {
+    if(!gbLoadRom(szFile))
+      return false;
+    systemCartridgeType = IMAGE_GB;
+    theEmulator = GBSystem;
+    gbBorderOn = 0;
+    gbBorderLineSkip = 160;
+    gbBorderColumnSkip = 0;
+    gbBorderRowSkip = 0;
+    return true;
+  }
+
+  if(type == IMAGE_GBA) {
+    if(CPULoadRom(szFile) == 0)
+      return false;
+    systemCartridgeType = IMAGE_GBA;
+    theEmulator = GBASystem;
+    CPUInit();
+    CPUReset();
+    return true;
+  }
+
+  systemMessage(0, "Unknown file type %s", szFile);
+  return false;
+}
+
+// CRC of the uncompressed savestate, so two runs agree exactly when the emulated machine does
+static u32 benchmarkStateHash(u32 &size)
+{
+  RawMemStream stream = { NULL, 0, 0, 0 };
+
+  gzFile gzFile = utilRawMemOpen(&stream, "w");
+  bool   res    = theEmulator.emuWriteStateToStream(gzFile);
+  utilGzClose(gzFile);
+
+  u32 hash = 0;
+  size = 0;
+  if(res) {
+    hash = crc32(crc32(0L, Z_NULL, 0), stream.data, stream.size);
+    size = stream.size;
+  }
+  free(stream.data);
+  return hash;
+}
+
+// checkpoint files are text, one "frame hash" pair per line
+static bool benchmarkReadCheckpoints(const char *file, std::vector<Checkpoint> &checkpoints)
+{
+  FILE *f = fopen(file, "r");
+  if(!f)
+    return false;
+
+  Checkpoint c;
+  while(fscanf(f, "%u %x", &c.frame, &c.hash) == 2)
+    checkpoints.push_back(c);
+
+  fclose(f);
+  return true;
+}
+
+// loads the job's ROM into this thread's emulator and starts its movie
+static bool benchmarkStartMovie(BenchmarkJob &job)
+{
+  job.loaded = false;
+  job.desyncFrame = -1;
+
+  batteryDir[0] = 0;
+  strcpy(filename, job.romFile);
+  char *p = strrchr(filename, '.');
+  if(p)
+    *p = 0;
+
+  // no emulated frame may depend on the host clock
+  synchronize = false;
+  frameSkip = gbFrameSkip = 0;
+  soundOffFlag = true;
+  turboMode = turbo;
+  biosDirectAccess = !slowBios;
+  cpuBlockCacheEnabled = blockCache;
+  systemCleanUp();
+
+  if(!benchmarkLoadRom(job.romFile)) {
+    systemMessage(0, "Failed to load file %s", job.romFile);
+    return false;
+  }
+
+  if(biosFile && systemCartridgeType == IMAGE_GBA)
+    systemLoadBIOS(biosFile, true);
+
+  int res = VBAMovieOpen(job.movieFile, true);
+  if(res != MOVIE_SUCCESS) {
+    systemMessage(0, "Failed to open movie %s (error %d)", job.movieFile, res);
+    theEmulator.emuCleanUp();
+    return false;
+  }
+
+  job.loaded = true;
+  return true;
+}
+
+// plays the movie to its end or to -f, checking or recording state hashes on the way
+static void benchmarkRunMovie(BenchmarkJob &job)
+{
+  std::vector<Checkpoint> checkpoints;
+  FILE *record = NULL;
+
+  if(job.checkFile && recordInterval) {
+    record = fopen(job.checkFile, "w");
+    if(!record)
+      systemMessage(0, "Failed to create checkpoint file %s", job.checkFile);
+  } else if(job.checkFile && !benchmarkReadCheckpoints(job.checkFile, checkpoints))
+    systemMessage(0, "Failed to read checkpoint file %s", job.checkFile);
+
+  job.length = VBAMovieGetLength();
+  u32 length = job.length;
+  if(maxFrames != 0 && maxFrames < length)
+    length = maxFrames;
+
+  size_t next = 0;
+  u32 size;
+  while(VBAMovieGetState() == MOVIE_STATE_PLAY &&
+        VBAMovieGetFrameCounter() < length) {
+    theEmulator.emuMain(theEmulator.emuCount);
+
+    u32 frame = VBAMovieGetFrameCounter();
+    if(record) {
+      if(frame % recordInterval == 0)
+        fprintf(record, "%u %08x\n", frame, benchmarkStateHash(size));
+    } else if(next < checkpoints.size() && frame >= checkpoints[next].frame) {
+      if(benchmarkStateHash(size) != checkpoints[next].hash) {
+        job.desyncFrame = checkpoints[next].frame;
+        break;
+      }
+      next++;
+    }
+  }
+
+  if(record)
+    fclose(record);
+
+  job.frames = VBAMovieGetFrameCounter();
+  job.lagCount = systemCounters.lagCount;
+  job.hash = benchmarkStateHash(job.stateSize);
+}
+
+static void benchmarkStopMovie()
+{
+  VBAMovieStop(true);
+  theEmulator.emuCleanUp();
+}
+
+static BenchmarkJob *benchmarkNextJob()
+{
+  BenchmarkJob *job = NULL;
+
+#ifdef MULTI_INSTANCE
+  pthread_mutex_lock(&jobLock);
+#endif
+  if(nextJob < jobs.size())
+    job = &jobs[nextJob++];
+#ifdef MULTI_INSTANCE
+  pthread_mutex_unlock(&jobLock);
+#endif
+
+  return job;
+}
+
+static void *benchmarkWorker(void *)
+{
+  BenchmarkJob *job;
+  while((job = benchmarkNextJob()) != NULL) {
+    if(benchmarkStartMovie(*job)) {
+      benchmarkRunMovie(*job);
+      benchmarkStopMovie();
+    }
+  }
+  return NULL;
+}
+
+static bool benchmarkReadList(const char *file)
+{
+  FILE *f = fopen(file, "r");
+  if(!f)
+    return false;
+
+  char line[3 * 2048 + 4];
+  while(fgets(line, sizeof(line), f)) {
+    char *rom = strtok(line, "\t\r\n");
+    if(!rom || rom[0] == '#')
+      continue;
+    char *movie = strtok(NULL, "\t\r\n");
+    if(!movie) {
+      systemMessage(0, "No movie given for %s", rom);
+      continue;
+    }
+    char *check = strtok(NULL, "\t\r\n");
+
+    BenchmarkJob job;
+    memset(&job, 0, sizeof(job));
+    job.romFile = strdup(rom);
+    job.movieFile = strdup(movie);
+    job.checkFile = check ? strdup(check) : NULL;
+    job.desyncFrame = -1;
+    jobs.push_back(job);
+  }
+
+  fclose(f);
+  return true;
+}
+
+static int benchmarkFarm(const char *listFile, int workers)
+{
+  if(!benchmarkReadList(listFile)) {
+    systemMessage(0, "Failed to read movie list %s", listFile);
+    return -1;
+  }
+
+#ifndef MULTI_INSTANCE
+  if(workers > 1) {
+    systemMessage(0, "Built without MULTI_INSTANCE, verifying one movie at a time");
+    workers = 1;
+  }
+#endif
+  if(workers > (int)jobs.size())
+    workers = (int)jobs.size();
+
+  u64 start = systemGetPreciseTime();
+
+#ifdef MULTI_INSTANCE
+  std::vector<pthread_t> threads(workers);
+  for(int i = 0; i < workers; i++)
+    pthread_create(&threads[i], NULL, benchmarkWorker, NULL);
+  for(int i = 0; i < workers; i++)
+    pthread_join(threads[i], NULL);
+#else
+  benchmarkWorker(NULL);
+#endif
+
+  double seconds = (systemGetPreciseTime() - start) / 1e9;
+
+  int failed = 0;
+  u64 frames = 0;
+  printf("# movie\tresult\tframes\tlag\tstate\tdesync\n");
+  for(size_t i = 0; i < jobs.size(); i++) {
+    const BenchmarkJob &job = jobs[i];
+    const char *result = "ok";
+    if(!job.loaded)
+      result = "error";
+    else if(job.desyncFrame >= 0)
+      result = "desync";
+    else if(job.frames < job.length && (maxFrames == 0 || job.frames < maxFrames))
+      result = "short";
+
+    if(strcmp(result, "ok"))
+      failed++;
+    frames += job.frames;
+
+    printf("%s\t%s\t%u/%u\t%d\t%08x\t%d\n", job.movieFile, result,
+           job.frames, job.length, job.lagCount, job.hash, job.desyncFrame);
+  }
+
+  fprintf(stderr, "%d of %d movies verified in %.1f s (%.1f fps) on %d workers\n",
+          (int)jobs.size() - failed, (int)jobs.size(), seconds,
+          seconds > 0 ? frames / seconds : 0.0, workers);
+
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  fprintf(stderr, "VisualBoyAdvance-Benchmark version %s\n", VERSION);
+
+  const char *luaFile = NULL;
+  const char *checkFile = NULL;
+  const char *listFile = NULL;
+  int workers = 1;
+
+  int arg = 1;
+  for(; arg < argc && argv[arg][0] == '-'; arg++) {
+    if(!strcmp(argv[arg], "-v"))
+      verbose = true;
+    else if(!strcmp(argv[arg], "-t"))
+      turbo = true;
+    else if(!strcmp(argv[arg], "-s"))
+      slowBios = true;
+    else if(!strcmp(argv[arg], "-x"))
+      blockCache = true;
+    else if(arg + 1 < argc && !strcmp(argv[arg], "-b"))
+      biosFile = argv[++arg];
+    else if(arg + 1 < argc && !strcmp(argv[arg], "-l"))
+      luaFile = argv[++arg];
+    else if(arg + 1 < argc && !strcmp(argv[arg], "-f"))
+      maxFrames = strtoul(argv[++arg], NULL, 10);
+    else if(arg + 1 < argc && !strcmp(argv[arg], "-c"))
+      checkFile = argv[++arg];
+    else if(arg + 1 < argc && !strcmp(argv[arg], "-w"))
+      recordInterval = strtoul(argv[++arg], NULL, 10);
+    else if(arg + 1 < argc && !strcmp(argv[arg], "-L"))
+      listFile = argv[++arg];
+    else if(arg + 1 < argc && !strcmp(argv[arg], "-j"))
+      workers = atoi(argv[++arg]);
+    else {
+      usage(argv[0]);
+      exit(-1);
+    }
+  }
+
+  // Lua runs in one interpreter for the whole process, and the list names
+  // each movie's own checkpoints
+  if(listFile ? (argc != arg || luaFile || checkFile) : argc - arg != 2) {
+    usage(argv[0]);
+    exit(-1);
+  }
+
+  for(int i = 0; i < 24;) {
+    systemGbPalette[i++] = (0x1f) | (0x1f << 5) | (0x1f << 10);
+    systemGbPalette[i++] = (0x15) | (0x15 << 5) | (0x15 << 10);
+    systemGbPalette[i++] = (0x0c) | (0x0c << 5) | (0x0c << 10);
+    systemGbPalette[i++] = 0;
+  }
+  utilUpdateSystemColorMaps();
+
+  emulating = 1;
+
+  if(listFile) {
+    // nothing is shown or heard, so only the emulated machine matters
+    turbo = true;
+    return benchmarkFarm(listFile, workers < 1 ? 1 : workers);
+  }
+
+  BenchmarkJob job;
+  memset(&job, 0, sizeof(job));
+  job.romFile = argv[arg];
+  job.movieFile = argv[arg + 1];
+  job.checkFile = checkFile;
+
+  if(!benchmarkStartMovie(job))
+    exit(-1);
+
+  if(luaFile && !VBALoadLuaCode(luaFile)) {
+    systemMessage(0, "Failed to load Lua script %s", luaFile);
+    exit(-1);
+  }
+
+  systemResetProfile();
+  systemProfiling = true;
+  u64 start = systemGetPreciseTime();
+
+  benchmarkRunMovie(job);
+
+  u64 total = systemGetPreciseTime() - start;
+  systemProfiling = false;
+
+  u32 length = job.length;
+  if(maxFrames != 0 && maxFrames < length)
+    length = maxFrames;
+
+  double seconds = total / 1e9;
+  double render = systemProfileTime[PROFILE_RENDER] / 1e9;
+  double sound = systemProfileTime[PROFILE_SOUND] / 1e9;
+  double lua = systemProfileTime[PROFILE_LUA] / 1e9;
+  double cpu = seconds - render - sound - lua;
+  if(seconds <= 0)
+    seconds = 1e-9;
+
+  printf("rom:        %s\n", job.romFile);
+  printf("movie:      %s\n", job.movieFile);
+  printf("frames:     %u of %u\n", job.frames, job.length);
+  printf("lag frames: %d\n", job.lagCount);
+  printf("time:       %.3f s\n", seconds);
+  printf("speed:      %.1f fps (%.1f%%)\n", job.frames / seconds,
+         job.frames / seconds * 100.0 / systemGetFrameRate());
+  printf("cpu:        %.3f s (%.1f%%)\n", cpu, cpu * 100.0 / seconds);
+  printf("render:     %.3f s (%.1f%%)\n", render, render * 100.0 / seconds);
+  printf("sound:      %.3f s (%.1f%%)\n", sound, sound * 100.0 / seconds);
+  printf("lua:        %.3f s (%.1f%%)\n", lua, lua * 100.0 / seconds);
+  printf("state:      %08x (%u bytes)\n", job.hash, job.stateSize);
+  if(checkFile && !recordInterval) {
+    if(job.desyncFrame >= 0)
+      printf("desync:     frame %d\n", job.desyncFrame);
+    else
+      printf("desync:     none\n");
+  }
+
+  if(luaFile)
+    VBALuaStop();
+  benchmarkStopMovie();
+
+  return job.frames < length || job.desyncFrame >= 0 ? 1 : 0;
+}
+
+void log(const char *msg, ...)
+{
+  if(!verbose)
+    return;
+
+  va_list valist;
+  va_start(valist, msg);
+  vfprintf(stderr, msg, valist);
+  va_end(valist);
+}
+
+void systemMessage(int num, const char *msg, ...)
+{
+  char buffer[2048];
+  va_list valist;
+
+  va_start(valist, msg);
+  vsprintf(buffer, msg, valist);
+
+  fprintf(stderr, "%s\n", buffer);
+  va_end(valist);
+}
+
+void systemScreenMessage(const char *msg, int slot, int duration, const char *colorList)
+{
+  if(verbose)
+    fprintf(stderr, "%s\n", msg);
+}
+
+void systemGbPrint(u8 *data, int pages, int feed, int palette, int contrast)
+{
+}
+
+int systemScreenCapture(int captureNumber)
+{
+  return captureNumber;
+}
+
+void systemRenderLua(u8 *data, int pitch)
+{
+}
+
+void systemRefreshScreen()
+{
+}
+
+void systemRenderFrame()
+{
+}
+
+void systemRedrawScreen()
+{
+}
+
+void systemUpdateListeners()
+{
+}
+
+int systemGetDefaultJoypad()
+{
+  return 0;
+}
+
+void systemSetDefaultJoypad(int which)
+{
+}
+
+bool systemReadJoypads()
+{
+  return true;
+}
+
+// all input comes from the movie
+u32 systemGetOriginalJoypad(int which, bool sensor)
+{
+  return 0;
+}
+
+bool systemSoundInit()
+{
+  return true;
+}
+
+void systemSoundShutdown()
+{
+}
+
+void systemSoundPause()
+{
+}
+
+void systemSoundResume()
+{
+}
+
+bool systemSoundIsPaused()
+{
+  return true;
+}
+
+void systemSoundResetBuffer()
+{
+}
+
+void systemSoundWriteToBuffer()
+{
+}
+
+void systemSoundClearBuffer()
+{
+}
+
+bool systemSoundAppliesDSP()
+{
+  return false;
+}
+
+u32 systemGetClock()
+{
+  return (u32)(systemGetPreciseTime() / 1000000);
+}
+
+void systemSetTitle(const char *title)
+{
+}
+
+void systemShowSpeed(int speed)
+{
+  systemSpeed = speed;
+}
+
+void systemIncreaseThrottle()
+{
+}
+
+void systemDecreaseThrottle()
+{
+}
+
+void systemSetThrottle(int throttle)
+{
+}
+
+int systemGetThrottle()
+{
+  return 0;
+}
+
+void systemFrame()
+{
+}
+
+int systemFramesToSkip()
+{
+  return systemFrameSkip;
+}
+
+bool systemIsEmulating()
+{
+  return emulating != 0;
+}
+
+void systemGbBorderOn()
+{
+}
+
+bool systemIsRunningGBA()
+{
+  return systemCartridgeType == IMAGE_GBA;
+}
+
+bool systemIsSpedUp()
+{
+  return true;
+}
+
+bool systemIsPaused()
+{
+  return paused;
+}
+
+void systemSetPause(bool pause)
+{
+  paused = pause;
+}
+
+bool systemPausesNextFrame()
+{
+  return false;
+}
@@ -41,6 +41,8 @@
 #include "common/Util.h"
 #include "common/movie.h"
 #include "common/System.h"
+#include "common/AsyncSave.h"
+#include "common/Rewind.h"
 #include "common/inputGlobal.h"
 #include "../common/vbalua.h"
 #include "SoundSDL.h"
@@ -69,9 +71,9 @@
 #ifdef MMX
 extern "C" bool cpu_mmx;
 #endif
-extern bool8 soundEcho;
-extern bool8 soundLowPass;
-extern bool8 soundReverse;
+extern EMU_STATE bool8 soundEcho;
+extern EMU_STATE bool8 soundLowPass;
+extern EMU_STATE bool8 soundReverse;
 extern int Init_2xSaI(u32);
 extern void _2xSaI(u8*,u32,u8*,u8*,u32,int,int);
 extern void _2xSaI32(u8*,u32,u8*,u8*,u32,int,int);  
@@ -120,7 +122,7 @@ extern void debuggerOutput(char *, u32);
 
 extern void CPUUpdateRenderBuffers(bool);
 
-struct EmulatedSystem theEmulator = {
+EMU_STATE struct EmulatedSystem theEmulator = {
   NULL,
   NULL,
   NULL,
@@ -149,7 +151,7 @@ int systemColorDepth = 0;
 int systemDebug = 0;
 int systemVerbose = 0;
 int systemFrameSkip = 0;
-int systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
+EMU_STATE int systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
 
 int srcPitch = 0;
 int srcWidth = 0;
@@ -157,8 +159,8 @@ int srcHeight = 0;
 int destWidth = 0;
 int destHeight = 0;
 
-int sensorX = 2047;
-int sensorY = 2047;
+EMU_STATE int sensorX = 2047;
+EMU_STATE int sensorY = 2047;
 bool sensorOn = false;
 
 int filter = 0;
@@ -167,7 +169,7 @@ u8 *delta = NULL;
 int sdlPrintUsage = 0;
 int disableMMX = 0;
 
-int systemCartridgeType = 3;
+EMU_STATE int systemCartridgeType = 3;
 int sizeOption = 0;
 int captureFormat = 0;
 int useMovie = 0;
@@ -182,23 +184,21 @@ u16 systemGbPalette[24];
 void (*filterFunction)(u8*,u32,u8*,u8*,u32,int,int) = NULL;
 void (*ifbFunction)(u8*,u32,int,int) = NULL;
 int ifbType = 0;
-char filename[2048];
+EMU_STATE char filename[2048];
 char ipsname[2048];
 char biosFileName[2048];
 char movieFileName[2048];
 char captureDir[2048];
 char saveDir[2048];
-char batteryDir[2048];
+EMU_STATE char batteryDir[2048];
 
-static char *rewindMemory = NULL;
-static int rewindPos = 0;
-static int rewindTopPos = 0;
+static bool rewindEnabled = false;
 static int rewindCounter = 0;
-static int rewindCount = 0;
 static bool rewindSaveNeeded = false;
 static int rewindTimer = 0;
-
-#define REWIND_SIZE 400000
+static int rewindPoints = 0x400;
+static int rewindKeyframes = 0x20;
+static int rewindBufferSize = 0x20;
 
 #define _stricmp strcasecmp
 
@@ -220,7 +220,7 @@ static int rewindTimer = 0;
 	--Felipe
 */
 
-u16 currentButtons[4] = {0, 0, 0, 0};
+EMU_STATE u16 currentButtons[4] = {0, 0, 0, 0};
 
 bool sdlMotionButtons[4] = { false, false, false, false };
 const int32 INITIAL_SENSOR_VALUE = 2047;
@@ -249,10 +249,10 @@ int fullscreen = 0;
 bool systemSoundOn = false;
 bool yuv = false;
 int yuvType = 0;
-bool removeIntros = false;
-int sdlFlashSize = 0;
+EMU_STATE bool removeIntros = false;
+EMU_STATE int sdlFlashSize = 0;
 int sdlAutoIPS = 1;
-int sdlRtcEnable = 0;
+EMU_STATE int sdlRtcEnable = 0;
 int sdlAgbPrint = 0;
 
 int sdlDefaultJoypad = 0;
@@ -1216,8 +1216,30 @@ void sdlReadPreferences(FILE *f)
       if(rewindTimer < 0 || rewindTimer > 600)
         rewindTimer = 0;
       rewindTimer *= 6;  // convert value to 10 frames multiple
+    } else if(!strcmp(key, "rewindFrames")) {
+      rewindTimer = sdlFromHex(value);
+      if(rewindTimer < 0 || rewindTimer > 36000)
+        rewindTimer = 0;
+    } else if(!strcmp(key, "rewindPoints")) {
+      rewindPoints = sdlFromHex(value);
+      if(rewindPoints < 1 || rewindPoints > 0x10000)
+        rewindPoints = 0x400;
+    } else if(!strcmp(key, "rewindKeyframes")) {
+      rewindKeyframes = sdlFromHex(value);
+      if(rewindKeyframes < 1 || rewindKeyframes > 0x1000)
+        rewindKeyframes = 0x20;
+    } else if(!strcmp(key, "rewindBufferSize")) {
+      rewindBufferSize = sdlFromHex(value);
+      if(rewindBufferSize < 1 || rewindBufferSize > 0x400)
+        rewindBufferSize = 0x20;
     } else if(!strcmp(key, "enhancedDetection")) {
       cpuEnhancedDetection = sdlFromHex(value) ? true : false;
+    } else if(!strcmp(key, "blockCache")) {
+      cpuBlockCacheEnabled = sdlFromHex(value) ? true : false;
+    } else if(!strcmp(key, "asyncSaveStates")) {
+      asyncSaveStates = sdlFromHex(value) ? true : false;
+    } else if(!strcmp(key, "skipIdleLoops")) {
+      skipIdleLoops = sdlFromHex(value) ? true : false;
     } else {
       fprintf(stderr, "Unknown configuration key %s\n", key);
     }
@@ -1318,7 +1340,8 @@ static void sdlApplyPerImagePreferences()
         int save = atoi(value);
         if(save >= 0 && save <= 5)
           cpuSaveType = save;
-      }
+      } else if(!strcmp(token, "idleLoopSkip"))
+        skipIdleLoopsTemp = atoi(value) == 0 ? false : true;
     }
   }
   fclose(f);
@@ -1365,7 +1388,9 @@ void sdlWriteState(int num)
             num+1);
   else
     sprintf(stateName,"%s%d.sgm", filename, num+1);
-  if(theEmulator.emuWriteState)
+  if(asyncSaveStates && theEmulator.emuWriteStateToStream)
+    asyncSaveState(stateName, theEmulator.emuWriteStateToStream);
+  else if(theEmulator.emuWriteState)
     theEmulator.emuWriteState(stateName);
   sprintf(stateName, "Wrote state %d", num+1);
   systemScreenMessage(stateName);
@@ -1381,6 +1406,7 @@ void sdlReadState(int num)
   else
     sprintf(stateName,"%s%d.sgm", filename, num+1);
 
+  asyncSaveFlush();
   if(theEmulator.emuReadState)
     theEmulator.emuReadState(stateName);
 
@@ -1741,12 +1767,7 @@ void sdlPollEvents()
       case SDLK_b:
         if(!(event.key.keysym.mod & MOD_NOCTRL) &&
            (event.key.keysym.mod & KMOD_CTRL)) {
-          if(emulating && theEmulator.emuReadMemState && rewindMemory 
-             && rewindCount) {
-            rewindPos = --rewindPos & 7;
-            theEmulator.emuReadMemState(&rewindMemory[REWIND_SIZE*rewindPos], 
-                                     REWIND_SIZE);
-            rewindCount--;
+          if(emulating && rewindEnabled && rewindLoadPoint()) {
             rewindCounter = 0;
             systemScreenMessage("Rewind");
           }
@@ -1990,6 +2011,7 @@ void file_run()
       if(!failed) {
         systemCartridgeType = 1;
         theEmulator = GBSystem;
+        skipIdleLoopsTemp = skipIdleLoops;
         if(sdlAutoIPS) {
           int size = gbRomSize;
           utilApplyIPS(ipsname, &gbRom, &size);
@@ -2008,6 +2030,7 @@ void file_run()
         //          utilGBAFindSave(rom, size);
         //        }
 
+        skipIdleLoopsTemp = skipIdleLoops;
         sdlApplyPerImagePreferences();
         
         systemCartridgeType = 0;
@@ -2282,7 +2305,8 @@ int main(int argc, char **argv)
 #endif
 
   if(rewindTimer)
-    rewindMemory = (char *)malloc(8*REWIND_SIZE);
+    rewindEnabled = rewindInit(rewindPoints, rewindKeyframes,
+                               rewindBufferSize << 20);
 
   if(sdlFlashSize == 0)
     flashSetSize(0x10000);
@@ -2454,11 +2478,7 @@ int main(int argc, char **argv)
           (((i & 0xf800) >> 11) << systemRedShift);  
       }      
     } else {
-      for(int i = 0; i < 0x10000; i++) {
-        systemColorMap16[i] = ((i & 0x1f) << systemRedShift) |
-          (((i & 0x3e0) >> 5) << systemGreenShift) |
-          (((i & 0x7c00) >> 10) << systemBlueShift);  
-      }
+      utilUpdateSystemColorMaps();
     }
     srcPitch = srcWidth * 2+4;
   } else {
@@ -2468,11 +2488,7 @@ int main(int argc, char **argv)
     if(systemColorDepth == 32) {
       Init_2xSaI(32);
     }
-    for(int i = 0; i < 0x10000; i++) {
-      systemColorMap32[i] = ((i & 0x1f) << systemRedShift) |
-        (((i & 0x3e0) >> 5) << systemGreenShift) |
-        (((i & 0x7c00) >> 10) << systemBlueShift);  
-    }
+    utilUpdateSystemColorMaps();
     if(systemColorDepth == 32)
       srcPitch = srcWidth*4 + 4;
     else
@@ -2651,18 +2667,8 @@ int main(int argc, char **argv)
         dbgMain();
       else {
         theEmulator.emuMain(theEmulator.emuCount);
-        if(rewindSaveNeeded && rewindMemory && theEmulator.emuWriteMemState) {
-          rewindCount++;
-          if(rewindCount > 8)
-            rewindCount = 8;
-          if(theEmulator.emuWriteMemState &&
-             theEmulator.emuWriteMemState(&rewindMemory[rewindPos*REWIND_SIZE], 
-                                       REWIND_SIZE)) {
-            rewindPos = ++rewindPos & 7;
-            if(rewindCount == 8)
-              rewindTopPos = ++rewindTopPos & 7;
-          }
-        }
+        if(rewindSaveNeeded && rewindEnabled)
+          rewindSavePoint();
 
         rewindSaveNeeded = false;
       }
@@ -2686,6 +2692,8 @@ int main(int argc, char **argv)
     sdlWriteBattery();
     theEmulator.emuCleanUp();
   }
+  asyncSaveShutdown();
+  rewindCleanup();
 
   if(delta) {
     free(delta);
@@ -3021,7 +3029,7 @@ void systemFrame(/*int rate*/) //Looking at System.cpp, it looks like rate shoul
     throttleLastTime = systemGetClock();
     */
   }
-  if(rewindMemory) {
+  if(rewindEnabled) {
     if(++rewindCounter >= rewindTimer) {
       rewindSaveNeeded = true;
       rewindCounter = 0;
@@ -3518,11 +3526,7 @@ void systemGbBorderOn()
           (((i & 0xf800) >> 11) << systemRedShift);  
       }      
     } else {
-      for(int i = 0; i < 0x10000; i++) {
-        systemColorMap16[i] = ((i & 0x1f) << systemRedShift) |
-          (((i & 0x3e0) >> 5) << systemGreenShift) |
-          (((i & 0x7c00) >> 10) << systemBlueShift);  
-      }
+      utilUpdateSystemColorMaps();
     }
     srcPitch = srcWidth * 2+4;
   } else {
@@ -3532,11 +3536,7 @@ void systemGbBorderOn()
     if(systemColorDepth == 32) {
       Init_2xSaI(32);
     }
-    for(int i = 0; i < 0x10000; i++) {
-      systemColorMap32[i] = ((i & 0x1f) << systemRedShift) |
-        (((i & 0x3e0) >> 5) << systemGreenShift) |
-        (((i & 0x7c00) >> 10) << systemBlueShift);  
-    }
+    utilUpdateSystemColorMaps();
     if(systemColorDepth == 32)
       srcPitch = srcWidth*4 + 4;
     else
@@ -3595,7 +3595,7 @@ u16 checksumBIOS()
 	return biosCheck;
 }
 
-EmulatedSystemCounters systemCounters = {
+EMU_STATE EmulatedSystemCounters systemCounters = {
 	0,	//framecount
 	0,	//lagcount
 	0,	//extracount
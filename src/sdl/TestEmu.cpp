@@ -47,9 +47,9 @@
 #ifdef MMX
 extern "C" bool cpu_mmx;
 #endif
-extern bool8 soundEcho;
-extern bool8 soundLowPass;
-extern bool8 soundReverse;
+extern EMU_STATE bool8 soundEcho;
+extern EMU_STATE bool8 soundLowPass;
+extern EMU_STATE bool8 soundReverse;
 
 extern void remoteInit();
 extern void remoteCleanUp();
@@ -68,10 +68,10 @@ int systemGreenShift = 8;
 int systemColorDepth = 32;
 int systemDebug = 0;
 int systemVerbose = 0;
-int systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
+EMU_STATE int systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
 
-int sensorX = 2047;
-int sensorY = 2047;
+EMU_STATE int sensorX = 2047;
+EMU_STATE int sensorY = 2047;
 bool sensorOn = false;
 
 int cartridgeType = 3;
@@ -83,11 +83,11 @@ int systemFrameSkip = 0;
 u32 systemColorMap32[0x10000];
 u16 systemColorMap16[0x10000];
 u16 systemGbPalette[24];
-char filename[2048];
+EMU_STATE char filename[2048];
 char biosFileName[2048];
 char captureDir[2048];
 char saveDir[2048];
-char batteryDir[2048];
+EMU_STATE char batteryDir[2048];
 
 int throttle = 0;
 
@@ -95,10 +95,10 @@ bool paused = false;
 bool debugger = true;
 bool debuggerStub = false;
 bool systemSoundOn = false;
-bool removeIntros = false;
-int sdlFlashSize = 0;
+EMU_STATE bool removeIntros = false;
+EMU_STATE int sdlFlashSize = 0;
 int sdlAutoIPS = 1;
-int sdlRtcEnable = 0;
+EMU_STATE int sdlRtcEnable = 0;
 int sdlAgbPrint = 0;
 
 int sdlDefaultJoypad = 0;
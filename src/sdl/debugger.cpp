@@ -35,7 +35,7 @@ extern "C" {
 extern bool debugger;
 extern int emulating;
 
-extern struct EmulatedSystem theEmulator;
+extern EMU_STATE struct EmulatedSystem theEmulator;
 
 #define debuggerReadMemory(addr) \
   READ32LE((&map[(addr)>>24].address[(addr) & map[(addr)>>24].mask]))
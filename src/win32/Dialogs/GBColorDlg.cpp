@@ -6,10 +6,10 @@
 #include "GBColorDlg.h"
 #include "../Reg.h"
 
-extern int32 gbPaletteOption;
+extern EMU_STATE int32 gbPaletteOption;
 extern int   emulating;
-extern int   systemCartridgeType;
-extern u16   gbPalette[128];
+extern EMU_STATE int   systemCartridgeType;
+extern EMU_STATE u16   gbPalette[128];
 extern u16   systemGbPalette[24];
 
 static u16 defaultPalettes[][24] = {
@@ -10,13 +10,13 @@
 #include "../../gb/GB.h"
 #include "../../gb/gbGlobals.h"
 
-extern gbRegister AF;
-extern gbRegister BC;
-extern gbRegister DE;
-extern gbRegister HL;
-extern gbRegister SP;
-extern gbRegister PC;
-extern u16        IFF;
+extern EMU_STATE gbRegister AF;
+extern EMU_STATE gbRegister BC;
+extern EMU_STATE gbRegister DE;
+extern EMU_STATE gbRegister HL;
+extern EMU_STATE gbRegister SP;
+extern EMU_STATE gbRegister PC;
+extern EMU_STATE u16        IFF;
 extern int        gbDis(char *, u16);
 
 /////////////////////////////////////////////////////////////////////////////
@@ -6,7 +6,7 @@
 #include "RomInfo.h"
 #include "../WinResUtil.h"
 
-extern int32 gbRomSize;
+extern EMU_STATE int32 gbRomSize;
 
 struct WinGBACompanyName
 {
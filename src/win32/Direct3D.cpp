@@ -15,6 +15,7 @@
 //#include "../common/System.h"
 #include "../common/SystemGlobals.h"
 #include "../common/Text.h"
+#include "../common/Util.h"
 #include "../version.h"
 
 #ifdef MMX
@@ -244,30 +245,7 @@ bool Direct3DDisplay::initialize()
 
 	restoreDeviceObjects();
 
-	switch (systemColorDepth)
-	{
-	case 16:
-	{
-		for (int i = 0; i < 0x10000; i++)
-		{
-			systemColorMap16[i] = ((i & 0x1f) << systemRedShift) |
-			                      (((i & 0x3e0) >> 5) << systemGreenShift) |
-			                      (((i & 0x7c00) >> 10) << systemBlueShift);
-		}
-		break;
-	}
-	case 24:
-	case 32:
-	{
-		for (int i = 0; i < 0x10000; i++)
-		{
-			systemColorMap32[i] = ((i & 0x1f) << systemRedShift) |
-			                      (((i & 0x3e0) >> 5) << systemGreenShift) |
-			                      (((i & 0x7c00) >> 10) << systemBlueShift);
-		}
-		break;
-	}
-	}
+	utilUpdateSystemColorMaps();
 
 	theApp.updateFilter();
 	theApp.updateIFB();
@@ -1061,7 +1061,7 @@ u32 DirectInput::readDevice(int i, bool sensor)
 {
 	// this old hack is evil
 	extern int systemGetDefaultJoypad();
-	extern int gbSgbMode, gbSgbMultiplayer;
+	extern EMU_STATE int gbSgbMode, gbSgbMultiplayer;
 	if (!(gbSgbMode && gbSgbMultiplayer))
 		i = systemGetDefaultJoypad();
 
@@ -26,6 +26,7 @@
 #include "../common/Util.h"
 #include "../common/movie.h"
 #include "../common/vbalua.h"
+#include "../common/AsyncSave.h"
 #include "../common/System.h"
 #include "../common/SystemGlobals.h"
 #include "../gba/GBAGlobals.h"
@@ -1313,6 +1314,7 @@ void MainWnd::winFileClose(bool reopening)
 			captureNumber	= 0;
 		}
 
+		asyncSaveFlush();
 		theApp.emulator.emuCleanUp();
 
 		extern void remoteCleanUp();
@@ -1371,8 +1373,9 @@ bool MainWnd::winFileRun(bool reopening)
 		if (!gbLoadRom(physicalName))
 			return false;
 
-		gbBorderOn		= theApp.winGbBorderOn;
-		theApp.emulator = GBSystem;
+		gbBorderOn		  = theApp.winGbBorderOn;
+		skipIdleLoopsTemp = skipIdleLoops;
+		theApp.emulator	  = GBSystem;
 		theApp.romSize	= gbRomSize;
 		if (theApp.autoIPS)
 		{
@@ -1404,6 +1407,7 @@ bool MainWnd::winFileRun(bool reopening)
 		flashSetSize(theApp.winFlashSize);
 		rtcEnable(theApp.winRtcEnable);
 		cpuSaveType = theApp.winSaveType;
+		skipIdleLoopsTemp = skipIdleLoops;
 
 		//    if(cpuEnhancedDetection && winSaveType == 0) {
 		//      utilGBAFindSave(rom, size);
@@ -1434,6 +1438,11 @@ bool MainWnd::winFileRun(bool reopening)
 		i = GetPrivateProfileInt(buffer, "mirroringEnabled", -1, vbaOverINI);
 		if (i != (UINT)-1)
 			CPUDoMirroring(i != 0);
+
+		// games whose busy-wait loops must not be skipped, or that are known to be safe
+		i = GetPrivateProfileInt(buffer, "idleLoopSkip", -1, vbaOverINI);
+		if (i != (UINT)-1)
+			skipIdleLoopsTemp = i != 0;
 #endif
 
 		/* disabled due to problems
@@ -538,7 +538,7 @@ void MainWnd::OnUpdateFileExportGamesharksnapshot(CCmdUI *pCmdUI)
 
 void MainWnd::OnFileQuickScreencapture()
 {
-	extern int32 captureNumber;   // GBAGlobals.cpp
+	extern EMU_STATE int32 captureNumber;   // GBAGlobals.cpp
 	captureNumber = winScreenCapture(captureNumber);
 }
 
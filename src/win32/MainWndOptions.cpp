@@ -457,7 +457,7 @@ void MainWnd::OnUpdateOptionsVideoFullscreenstretchtofit(CCmdUI*pCmdUI)
 BOOL MainWnd::OnVideoLayer(UINT nID)
 {
 	layerSettings ^= 0x0100 << ((nID & 0xFFFF) - ID_OPTIONS_VIDEO_LAYERS_BG0);
-	extern int32 layerEnable;
+	extern EMU_STATE int32 layerEnable;
 	layerEnable = DISPCNT & layerSettings;
 	CPUUpdateRenderBuffers(false);
 	return TRUE;
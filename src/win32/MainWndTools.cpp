@@ -32,7 +32,7 @@
 #include "../gb/GB.h"
 #include "../common/SystemGlobals.h"
 
-extern int32 soundQuality;
+extern EMU_STATE int32 soundQuality;
 
 extern bool debugger;
 extern SOCKET	remoteSocket;
@@ -212,7 +212,7 @@ void MainWnd::OnUpdateDebugNextframeAccountForLag(CCmdUI *pCmdUI)
 
 void MainWnd::OnDebugFramesearch()
 {
-	extern SMovie Movie;
+	extern EMU_STATE SMovie Movie;
 	if (!theApp.frameSearching)
 	{
 		// starting a new search
@@ -251,7 +251,7 @@ void MainWnd::OnDebugFramesearch()
 
 void MainWnd::OnUpdateDebugFramesearch(CCmdUI *pCmdUI)
 {
-	extern SMovie Movie;
+	extern EMU_STATE SMovie Movie;
 	pCmdUI->Enable(emulating && Movie.state != MOVIE_STATE_PLAY);
 	pCmdUI->SetCheck(theApp.frameSearching);
 }
@@ -285,7 +285,7 @@ void MainWnd::OnDebugFramesearchPrev()
 
 void MainWnd::OnUpdateDebugFramesearchPrev(CCmdUI *pCmdUI)
 {
-	extern SMovie Movie;
+	extern EMU_STATE SMovie Movie;
 	pCmdUI->Enable(emulating && theApp.frameSearching && Movie.state != MOVIE_STATE_PLAY);
 }
 
@@ -307,7 +307,7 @@ void MainWnd::OnDebugFramesearchLoad()
 
 void MainWnd::OnUpdateDebugFramesearchLoad(CCmdUI *pCmdUI)
 {
-	extern SMovie Movie;
+	extern EMU_STATE SMovie Movie;
 	pCmdUI->Enable(emulating && Movie.state != MOVIE_STATE_PLAY);
 }
 
@@ -493,7 +493,7 @@ void MainWnd::OnToolsSoundStartrecording()
 
 	if (VBAMovieIsActive())
 	{
-		extern SMovie Movie;
+		extern EMU_STATE SMovie Movie;
 		wavName = Movie.filename;
 		int index = wavName.ReverseFind('.');
 		if (index != -1)
@@ -560,7 +560,7 @@ void MainWnd::OnToolsStartAVIRecording()
 
 	if (VBAMovieIsActive())
 	{
-		extern SMovie Movie;
+		extern EMU_STATE SMovie Movie;
 		aviName = Movie.filename;
 		int index = aviName.ReverseFind('.');
 		if (index != -1)
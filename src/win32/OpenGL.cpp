@@ -10,6 +10,7 @@
 #include "../gb/gbGlobals.h"
 #include "../common/SystemGlobals.h"
 #include "../common/Text.h"
+#include "../common/Util.h"
 #include "../version.h"
 
 #ifdef MMX
@@ -202,30 +203,7 @@ bool OpenGLDisplay::initialize()
 		winlog("B shift: %d\n", systemBlueShift);
 	}
 
-	switch (systemColorDepth)
-	{
-	case 16:
-	{
-		for (int i = 0; i < 0x10000; i++)
-		{
-			systemColorMap16[i] = ((i & 0x1f) << systemRedShift) |
-			                      (((i & 0x3e0) >> 5) << systemGreenShift) |
-			                      (((i & 0x7c00) >> 10) << systemBlueShift);
-		}
-		break;
-	}
-	case 24:
-	case 32:
-	{
-		for (int i = 0; i < 0x10000; i++)
-		{
-			systemColorMap32[i] = ((i & 0x1f) << systemRedShift) |
-			                      (((i & 0x3e0) >> 5) << systemGreenShift) |
-			                      (((i & 0x7c00) >> 10) << systemBlueShift);
-		}
-		break;
-	}
-	}
+	utilUpdateSystemColorMaps();
 	theApp.updateFilter();
 	theApp.updateIFB();
 
@@ -31,6 +31,7 @@
 #include "../common/movie.h"
 #include "../common/nesvideos-piece.h"
 #include "../common/vbalua.h"
+#include "../common/AsyncSave.h"
 #include "../filters/filters.h"
 #include "../version.h"
 
@@ -452,6 +453,7 @@ VBA::~VBA()
 	systemSoundShutdown();
 
 	((MainWnd *)(m_pMainWnd))->winFileClose();
+	asyncSaveShutdown();
 
 	if (input)
 		delete input;
@@ -1089,7 +1091,7 @@ void VBA::saveRewindStateIfNecessary()
 	// also update/cache some frame search stuff
 	if (frameSearching)
 	{
-		extern SMovie Movie;
+		extern EMU_STATE SMovie Movie;
 		int curFrame = (Movie.state == MOVIE_STATE_NONE) ? systemCounters.frameCount : Movie.currentFrame;
 		int endFrame = theApp.frameSearchStart + theApp.frameSearchLength;
 		frameSearchSkipping	 = (curFrame < endFrame);
@@ -1131,6 +1133,12 @@ BOOL VBA::OnIdle(LONG lCount)
 	{
 ///    for(int i = 0; i < 2; i++)
 		{
+			// frames a search skips over are neither shown nor heard
+			bool skipFrame = frameSearchSkipping && !frameSearchFirstStep;
+			if (skipFrame && !turboMode)
+				systemSoundClearBuffer();
+			turboMode = skipFrame;
+
 			emulator.emuMain(emulator.emuCount);
 
 			// save the state for rewinding, if necessary
@@ -1934,6 +1942,9 @@ void VBA::loadSettings()
 		winFlashSize = 0x10000;
 
 	cpuDisableSfx = regQueryDwordValue("disableSfx", 0) ? true : false;
+	cpuBlockCacheEnabled = regQueryDwordValue("blockCache", 0) ? true : false;
+	asyncSaveStates = regQueryDwordValue("asyncSaveStates", 0) ? true : false;
+	skipIdleLoops = regQueryDwordValue("skipIdleLoops", 0) ? true : false;
 
 	// GBx
 	winGbPrinterEnabled = regQueryDwordValue("gbPrinter", false) ? true : false;
@@ -2158,6 +2169,9 @@ void VBA::saveSettings()
 	regSetDwordValue("flashSize", winFlashSize);
 
 	regSetDwordValue("disableSfx", cpuDisableSfx);
+	regSetDwordValue("blockCache", cpuBlockCacheEnabled);
+	regSetDwordValue("asyncSaveStates", asyncSaveStates);
+	regSetDwordValue("skipIdleLoops", skipIdleLoops);
 
 	// GBx
 	regSetDwordValue("emulatorType", gbEmulatorType);
@@ -7,6 +7,7 @@
 #include "Reg.h"
 #include "../common/SystemGlobals.h"
 #include "../common/movie.h"
+#include "../common/AsyncSave.h"
 #include <direct.h>
 #include <algorithm>
 
@@ -481,6 +482,7 @@ bool winEraseBatteryFile()
 
 bool winReadSaveGame(const char *name)
 {
+	asyncSaveFlush();
 	if (theApp.emulator.emuReadState)
 		return theApp.emulator.emuReadState(name);
 	return false;
@@ -488,6 +490,8 @@ bool winReadSaveGame(const char *name)
 
 bool winWriteSaveGame(const char *name)
 {
+	if (asyncSaveStates && theApp.emulator.emuWriteStateToStream)
+		return asyncSaveState(name, theApp.emulator.emuWriteStateToStream);
 	if (theApp.emulator.emuWriteState)
 		return theApp.emulator.emuWriteState(name);
 	return false;
@@ -495,5 +499,6 @@ bool winWriteSaveGame(const char *name)
 
 bool winEraseSaveGame(const char *name)
 {
+	asyncSaveFlush();
 	return !remove(name);
 }
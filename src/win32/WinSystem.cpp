@@ -25,7 +25,7 @@
 #include <cassert>
 
 u32	 RGB_LOW_BITS_MASK		 = 0;
-int	 systemCartridgeType	 = IMAGE_GBA;
+EMU_STATE int	 systemCartridgeType	 = IMAGE_GBA;
 int	 systemSpeed			 = 0;
 bool systemSoundOn			 = false;
 u32	 systemColorMap32[0x10000];
@@ -38,7 +38,7 @@ int	 systemColorDepth		 = 16;
 int	 systemDebug			 = 0;
 int	 systemVerbose			 = 0;
 int	 systemFrameSkip		 = 0;
-int	 systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
+EMU_STATE int	 systemSaveUpdateCounter = SYSTEM_SAVE_NOT_UPDATED;
 
 // static_assertion that BUTTON_REGULAR_RECORDING_MASK should be an u16 constant
 namespace { const void * const s_STATIC_ASSERTION_(static_cast<void *>(BUTTON_REGULAR_RECORDING_MASK & 0xFFFF0000)); }